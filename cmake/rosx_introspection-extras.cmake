@@ -0,0 +1,6 @@
+# PkgConfig::LZ4 is not created by find_package(): define it again for the
+# packages that link the exported target (see ament_export_dependencies)
+find_package(PkgConfig QUIET)
+if(PkgConfig_FOUND)
+    pkg_check_modules(LZ4 QUIET IMPORTED_TARGET liblz4)
+endif()
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rosx_introspection/message_writer.hpp"
+#include "rosx_introspection/ros_parser.hpp"
+
+//---------------------------------------------------------
+// Apache Arrow C Data Interface, see https://arrow.apache.org/docs/format/CDataInterface.html
+// The structs are part of a stable ABI: they are declared here, and no Arrow library is needed.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+}  // extern "C"
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+namespace RosMsgParser {
+
+/**
+ * @brief MessageWriter that accumulates the messages of a topic into Arrow arrays,
+ * exported with the Arrow C Data Interface (pyarrow, polars, DuckDB, ...).
+ *
+ * Each message is a row of a struct array, whose children mirror the FieldTree of
+ * the Parser:
+ *
+ * - builtin fields are primitive arrays; TIME and DURATION are timestamp[ns] and duration[ns],
+ *   strings are utf8 and enums are int32.
+ * - structs are struct arrays, and the arrays (fixed size or not) are list arrays.
+ * - arrays of BYTE and UINT8 are binary_view arrays. The blobs reference the buffer of
+ *   the message if the Parser uses STORE_BLOB_AS_REFERENCE: the buffers must then outlive
+ *   the exported ArrowArray. Otherwise they are copied.
+ *
+ * Absent values (optional members, fields excluded by Parser::setFieldFilter()) are null,
+ * absent arrays are empty. Unions are not exported.
+ *
+ *   ArrowBatchWriter writer(parser);
+ *   for (const auto& buffer : messages) {
+ *     writer.append(buffer, &deserializer);
+ *   }
+ *   ArrowSchema schema;
+ *   ArrowArray batch;
+ *   writer.exportSchema(&schema);
+ *   writer.exportBatch(&batch);  // e.g. pyarrow.RecordBatch._import_from_c(batch, schema)
+ *
+ * The Parser must outlive the writer.
+ */
+class ArrowBatchWriter final : public MessageWriter {
+ public:
+  explicit ArrowBatchWriter(const Parser& parser);
+  ~ArrowBatchWriter() override;
+
+  ArrowBatchWriter(const ArrowBatchWriter&) = delete;
+  ArrowBatchWriter& operator=(const ArrowBatchWriter&) = delete;
+
+  /// Append the message in [buffer] as a new row. If the message is rejected by a predicate
+  /// of the Parser (see Parser::setFieldPredicates()), no row is added.
+  /// Returns the result of Parser::walkSchema().
+  template <class DeserializerT>
+  bool append(Span<const uint8_t> buffer, DeserializerT* deserializer);
+
+  /// Number of rows that have not been exported yet.
+  size_t rows() const {
+    return _rows;
+  }
+
+  /// The type of the batches: a struct with a child for each field of the message.
+  void exportSchema(ArrowSchema* schema) const;
+
+  /// Move the rows appended so far into [array] (ownership is given to the consumer,
+  /// that must call array->release). The writer is then empty and can be reused.
+  void exportBatch(ArrowArray* array);
+
+  void writeValue(const FieldLeaf& leaf, const Variant& value) override;
+  void writeBool(const FieldLeaf& leaf, bool value) override;
+  void writeChar(const FieldLeaf& leaf, char value) override;
+  void writeInt8(const FieldLeaf& leaf, int8_t value) override;
+  void writeInt16(const FieldLeaf& leaf, int16_t value) override;
+  void writeInt32(const FieldLeaf& leaf, int32_t value) override;
+  void writeInt64(const FieldLeaf& leaf, int64_t value) override;
+  void writeUInt8(const FieldLeaf& leaf, uint8_t value) override;
+  void writeUInt16(const FieldLeaf& leaf, uint16_t value) override;
+  void writeUInt32(const FieldLeaf& leaf, uint32_t value) override;
+  void writeUInt64(const FieldLeaf& leaf, uint64_t value) override;
+  void writeFloat32(const FieldLeaf& leaf, float value) override;
+  void writeFloat64(const FieldLeaf& leaf, double value) override;
+  void writeString(const FieldLeaf& leaf, const std::string& value) override;
+  void writeString(const FieldLeaf& leaf, std::string_view value) override;
+  void writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& name) override;
+  void writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) override;
+  void writeBlob(const FieldLeaf& leaf, Span<const uint8_t> data) override;
+  void beginStruct(const ROSField& field) override;
+  void endStruct() override;
+  void finish() override;
+
+ private:
+  struct Column;
+
+  // Remove the rows after the first [rows], see append().
+  void truncate(size_t rows);
+  void beginRow();
+  // The column that receives the next value of [node], null if the field is not exported.
+  Column* openColumn(const FieldTreeNode* node);
+  template <typename T>
+  void appendValue(const FieldLeaf& leaf, T value);
+
+  const Parser& _parser;
+  std::unique_ptr<Column> _root;
+  // column of each node of the FieldTree, by FieldTreeNode::nodeId(). Null for the unions
+  // and the members of their cases.
+  std::vector<Column*> _columns;
+  // nodes of the structs opened by beginStruct(), the root first
+  std::vector<const FieldTreeNode*> _struct_nodes;
+  size_t _rows = 0;
+  bool _row_open = false;
+};
+
+template <class DeserializerT>
+inline bool ArrowBatchWriter::append(Span<const uint8_t> buffer, DeserializerT* deserializer) {
+  const size_t rows = _rows;
+  bool filtered_out = false;
+  bool entire_message_parsed = false;
+  try {
+    entire_message_parsed = _parser.walkSchema(buffer, deserializer, this, &filtered_out);
+  } catch (...) {
+    truncate(rows);
+    throw;
+  }
+  if (filtered_out) {
+    truncate(rows);
+  }
+  return entire_message_parsed;
+}
+
+}  // namespace RosMsgParser
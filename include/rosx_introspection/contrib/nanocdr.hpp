@@ -19,6 +19,8 @@
 #include <cstddef>
 #include <cstring>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
@@ -175,12 +177,28 @@ struct TypeDefinition
 //----------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------
 /**
- * @brief Decoder is a class that decodes data from a buffer.
+ * @brief BasicDecoder is a class that decodes data from a buffer.
+ *
+ * With kParameterList, the values of the XCDR1 optional members are aligned relative
+ * to the beginning of their member, as in a parameter list: a scope is tracked for
+ * each of them (see hasMember()). Without it, the alignment is always relative to the
+ * origin of the stream. Use Decoder for the former and PlainDecoder for the latter.
  */
-class Decoder
+template <bool kParameterList>
+class BasicDecoder
 {
 public:
-  Decoder(ConstBuffer buffer, CdrVersion default_cdr = CdrVersion::DDS_CDR);
+  BasicDecoder(ConstBuffer buffer, CdrVersion default_cdr = CdrVersion::DDS_CDR);
+
+  /// Continue decoding from the position of [other].
+  template <bool kOther>
+  explicit BasicDecoder(const BasicDecoder<kOther>& other)
+    : buffer_(other.buffer_)
+    , origin_(other.origin_)
+    , header_(other.header_)
+    , align64_(other.align64_)
+  {
+  }
 
   const CdrHeader& header() const
   {
@@ -209,10 +227,15 @@ public:
 
   /// Check if an optional member is present in the CDR stream.
   /// Consumes the presence indicator from the buffer.
+  /// The XCDR1 members require kParameterList.
   bool hasMember()
   {
     if (header_.version == CdrVersion::XCDRv1 || header_.version == CdrVersion::DDS_CDR)
     {
+      if constexpr (!kParameterList)
+      {
+        throw std::runtime_error("Decode: the XCDR1 optional members require a nanocdr::Decoder");
+      }
       // XCDRv1/DDS_CDR: 2 bytes member ID + 2 bytes size.
       // The 4-byte PL_CDR member header itself must be 4-byte aligned relative
       // to the CDR origin (a uint16 decode would only align to 2).
@@ -233,7 +256,10 @@ public:
       {
         throw std::runtime_error("Decode: optional member size exceeds remaining buffer");
       }
-      member_scopes_.push_back(MemberScope{buffer_.data(), buffer_.data() + size});
+      if constexpr (kParameterList)
+      {
+        member_scopes_.push_back(MemberScope{buffer_.data(), buffer_.data() + size});
+      }
       return true;
     }
     else
@@ -251,6 +277,17 @@ public:
     buffer_.trim_front(offset);
   }
 
+  /// Skip the padding that precedes a value of size data_size
+  void align(size_t data_size)
+  {
+    const size_t pad = alignment(data_size);
+    if (pad > buffer_.size())
+    {
+      throw std::runtime_error("Decode: not enough data to decode");
+    }
+    buffer_.trim_front(pad);
+  }
+
   /// Get a view to the current buffer (bytes left to decode)
   ConstBuffer currentBuffer() const
   {
@@ -258,6 +295,13 @@ public:
   }
 
 private:
+  template <bool kOther>
+  friend class BasicDecoder;
+
+  // Decode [count] contiguous arithmetic values with a single bounds check and copy.
+  template <typename T>
+  void decodeArray(T* out, size_t count);
+
   ConstBuffer buffer_;
   const uint8_t* origin_ = nullptr;
   CdrHeader header_;
@@ -267,23 +311,43 @@ private:
     const uint8_t* origin = nullptr;
     const uint8_t* end = nullptr;
   };
+  struct NoMemberScopes
+  {
+  };
 
-  llvm_vecsmall::SmallVector<MemberScope, 8> member_scopes_;
+  [[no_unique_address]] std::conditional_t<kParameterList,
+                                           llvm_vecsmall::SmallVector<MemberScope, 8>,
+                                           NoMemberScopes>
+      member_scopes_;
 
+  // Padding before a value of [data_size] bytes, a power of 2.
   size_t alignment(size_t data_size)
   {
-    while (!member_scopes_.empty() && buffer_.data() >= member_scopes_.back().end)
+    data_size = (data_size == 8) ? align64_ : data_size;
+    const uint8_t* origin = origin_;
+    if constexpr (kParameterList)
     {
-      member_scopes_.pop_back();
+      while (!member_scopes_.empty() && buffer_.data() >= member_scopes_.back().end)
+      {
+        member_scopes_.pop_back();
+      }
+      if (!member_scopes_.empty())
+      {
+        origin = member_scopes_.back().origin;
+      }
     }
-
-    data_size = (data_size == 8) ? align64_ : data_size;
-    const auto* origin = member_scopes_.empty() ? origin_ : member_scopes_.back().origin;
-    return (data_size - ((buffer_.data() - origin) % data_size)) & (data_size - 1);
+    return static_cast<size_t>(origin - buffer_.data()) & (data_size - 1);
   }
   size_t align64_ = 8;
 };
 
+/// Decoder that supports the XCDR1 optional members.
+using Decoder = BasicDecoder<true>;
+
+/// Decoder of the streams without XCDR1 optional members: it does not track the members
+/// being decoded.
+using PlainDecoder = BasicDecoder<false>;
+
 //----------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------
@@ -319,6 +383,7 @@ public:
 
   // specializations for std::string
   void encode(const std::string& in);
+  void encode(std::string_view in);
 
   // specializations for std::vector
   template <typename T, typename Allocator>
@@ -414,9 +479,14 @@ inline void swapEndianness(T& val)
   }
 }
 
-inline Decoder::Decoder(ConstBuffer buffer, CdrVersion default_cdr)
+template <bool kParameterList>
+inline BasicDecoder<kParameterList>::BasicDecoder(ConstBuffer buffer, CdrVersion default_cdr)
   : buffer_(buffer), origin_(buffer.data() + 4)
 {
+  if (buffer_.size() < 4)
+  {
+    throw std::runtime_error("Invalid CDR header: the buffer is smaller than the header");
+  }
   const auto* ptr = buffer_.data();
   uint8_t dummy = ptr[0];
   if (dummy != 0)
@@ -467,28 +537,80 @@ inline Decoder::Decoder(ConstBuffer buffer, CdrVersion default_cdr)
   buffer_.trim_front(4);  // Remove the header from the buffer
 }
 
+template <bool kParameterList>
 template <typename T, typename Allocator>
-inline void Decoder::decode(std::vector<T, Allocator>& out)
+inline void BasicDecoder<kParameterList>::decode(std::vector<T, Allocator>& out)
 {
   uint32_t len = 0;
   decode(len);
-  out.resize(len);
-  for (uint32_t i = 0; i < len; i++)
+  // std::vector<bool> doesn't store its values contiguously
+  if constexpr (is_arithmetic<T>() && !std::is_same_v<T, bool>)
   {
-    decode(out[i]);
+    if (static_cast<size_t>(len) * sizeof(T) > buffer_.size())
+    {
+      throw std::runtime_error("Decode: not enough data to decode");
+    }
+    out.resize(len);
+    decodeArray(out.data(), len);
+  }
+  else
+  {
+    out.resize(len);
+    for (uint32_t i = 0; i < len; i++)
+    {
+      decode(out[i]);
+    }
   }
 }
 
+template <bool kParameterList>
 template <typename T, size_t N>
-inline void Decoder::decode(std::array<T, N>& out)
+inline void BasicDecoder<kParameterList>::decode(std::array<T, N>& out)
+{
+  if constexpr (is_arithmetic<T>())
+  {
+    decodeArray(out.data(), N);
+  }
+  else
+  {
+    for (uint32_t i = 0; i < out.size(); i++)
+    {
+      decode(out[i]);
+    }
+  }
+}
+
+template <bool kParameterList>
+template <typename T>
+inline void BasicDecoder<kParameterList>::decodeArray(T* out, size_t count)
 {
-  for (uint32_t i = 0; i < out.size(); i++)
+  if (count == 0)
+  {
+    return;
+  }
+  // the first value is aligned, the following ones are contiguous
+  align(sizeof(T));
+  const size_t bytes = count * sizeof(T);
+  if (buffer_.size() < bytes)
   {
-    decode(out[i]);
+    throw std::runtime_error("Decode: not enough data to decode");
   }
+  memcpy(out, buffer_.data(), bytes);
+  if constexpr (sizeof(T) >= 2)
+  {
+    if (header_.endianness != getCurrentEndianness())
+    {
+      for (size_t i = 0; i < count; i++)
+      {
+        swapEndianness(out[i]);
+      }
+    }
+  }
+  buffer_.trim_front(bytes);
 }
 
-inline void Decoder::decode(std::string& out)
+template <bool kParameterList>
+inline void BasicDecoder<kParameterList>::decode(std::string& out)
 {
   uint32_t len = 0;
   decode(len);
@@ -515,8 +637,9 @@ inline void Decoder::decode(std::string& out)
   }
 }
 
+template <bool kParameterList>
 template <typename T>
-inline void Decoder::decode(T& out)
+inline void BasicDecoder<kParameterList>::decode(T& out)
 {
   static_assert(is_arithmetic<T>() || is_type_defined_v<T>(), "decode: T must be an "
                                                               "arithmetic type or a "
@@ -608,6 +731,11 @@ inline void Encoder::encode(const T& in)
 }
 
 inline void Encoder::encode(const std::string& in)
+{
+  encode(std::string_view(in));
+}
+
+inline void Encoder::encode(std::string_view in)
 {
   const uint32_t str_len = in.size();
   encode(str_len);
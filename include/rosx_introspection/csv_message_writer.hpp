@@ -0,0 +1,226 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "rosx_introspection/message_writer.hpp"
+#include "rosx_introspection/ros_parser.hpp"
+
+namespace RosMsgParser {
+
+/**
+ * @brief MessageWriter that appends the messages of a topic to a CSV text, a row per message.
+ *
+ *   std::string csv;
+ *   CsvMessageWriter writer(&csv);
+ *   for (const auto& [timestamp, buffer] : messages) {
+ *     writer.append(parser, buffer, timestamp, &deserializer);
+ *     if (csv.size() > (1 << 20)) {
+ *       file << csv;
+ *       csv.clear();
+ *     }
+ *   }
+ *
+ * The first column is the timestamp, followed by a column for each value of the FieldTree,
+ * in its order: an array has a column per element, up to setArrayColumns() for the
+ * sequences, and the members of the struct cases of a union follow the union. The header
+ * is written before the first row. The values are formatted directly into the output with
+ * std::to_chars (floating point numbers with the shortest representation that round-trips,
+ * TIME and DURATION as "sec.nanosec"); the strings are quoted if needed.
+ *
+ * The columns of the absent values (@optional fields, inactive union cases, elements beyond
+ * the size of an array) are left empty. The elements of a sequence beyond setArrayColumns()
+ * have no column: they are dropped (see droppedValues()). So are the values under a @key
+ * that is not in the first message, because the columns of a struct with a @key, identified
+ * by the value of the key, are those of the first message. Blobs are not written.
+ */
+class CsvMessageWriter final : public MessageWriter {
+ public:
+  explicit CsvMessageWriter(std::string* output, char separator = ',');
+
+  CsvMessageWriter(const CsvMessageWriter&) = delete;
+  CsvMessageWriter& operator=(const CsvMessageWriter&) = delete;
+
+  /// Append the row of the message in [buffer]. If the message is rejected by a predicate
+  /// of the parser (see Parser::setFieldPredicates()), nothing is appended.
+  /// Returns the result of Parser::walkSchema().
+  template <class DeserializerT>
+  bool append(const Parser& parser, Span<const uint8_t> buffer, double timestamp, DeserializerT* deserializer);
+
+  /// Number of columns of each sequence (i.e. array that is not of fixed size), 16 by default.
+  /// To be called before the first row.
+  void setArrayColumns(size_t count) {
+    _array_columns = count;
+  }
+
+  /// Set the timestamp of the next row, when this is used directly with Parser::walkSchema().
+  void setTimestamp(double timestamp) {
+    _timestamp = timestamp;
+  }
+
+  /// Number of columns, including the timestamp. Zero before the first row.
+  size_t columns() const {
+    return _columns.empty() ? 0 : _columns.size() + 1;
+  }
+
+  /// Number of values that were not written, because they have no column.
+  size_t droppedValues() const {
+    return _dropped_values;
+  }
+
+  void writeValue(const FieldLeaf& leaf, const Variant& value) override;
+
+  void writeBool(const FieldLeaf& leaf, bool value) override {
+    writeNumber(leaf, uint8_t(value ? 1 : 0));
+  }
+  void writeChar(const FieldLeaf& leaf, char value) override {
+    writeNumber(leaf, int(value));
+  }
+  void writeInt8(const FieldLeaf& leaf, int8_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeInt16(const FieldLeaf& leaf, int16_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeInt32(const FieldLeaf& leaf, int32_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeInt64(const FieldLeaf& leaf, int64_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeUInt8(const FieldLeaf& leaf, uint8_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeUInt16(const FieldLeaf& leaf, uint16_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeUInt32(const FieldLeaf& leaf, uint32_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeUInt64(const FieldLeaf& leaf, uint64_t value) override {
+    writeNumber(leaf, value);
+  }
+  void writeFloat32(const FieldLeaf& leaf, float value) override {
+    writeNumber(leaf, value);
+  }
+  void writeFloat64(const FieldLeaf& leaf, double value) override {
+    writeNumber(leaf, value);
+  }
+
+  void writeString(const FieldLeaf& leaf, const std::string& value) override {
+    writeString(leaf, std::string_view(value));
+  }
+  void writeString(const FieldLeaf& leaf, std::string_view value) override;
+
+  void writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& /*name*/) override {
+    writeNumber(leaf, value);
+  }
+
+  void writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) override;
+
+  void finish() override;
+
+ private:
+  // Move the output to the cell of the column of [leaf], and return false if the value
+  // has to be dropped.
+  bool beginCell(const FieldLeaf& leaf) {
+    if (!_row_open) {
+      beginRow();
+    }
+    uint32_t column;
+    if (_position < _column_at.size() && FieldLeafEqual()(_columns[_column_at[_position]], leaf)) {
+      column = _column_at[_position];
+    } else if (!findColumn(leaf, column)) {
+      _dropped_values++;
+      return false;
+    }
+    _position++;
+    // the columns are numbered from 1, after the timestamp
+    if (column + 1 <= _last_column) {
+      _dropped_values++;
+      return false;
+    }
+    _out->append(column + 1 - _last_column, _separator);
+    _last_column = column + 1;
+    return true;
+  }
+
+  template <typename T>
+  void writeNumber(const FieldLeaf& leaf, T value) {
+    if (beginCell(leaf)) {
+      appendNumber(value);
+    }
+  }
+
+  template <typename T>
+  void appendNumber(T value) {
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    _out->append(buffer, static_cast<size_t>(result.ptr - buffer));
+  }
+
+  void appendTime(const Time& time);
+  void appendQuoted(std::string_view str);
+  bool findColumn(const FieldLeaf& leaf, uint32_t& column);
+  // Add the columns of the FieldTree whose root is [root].
+  void layout(const FieldTreeNode* root);
+  void addColumns(const FieldTreeNode* node, FieldLeaf& leaf, bool is_root);
+  void addElementColumns(const FieldTreeNode* node, FieldLeaf& leaf);
+  bool addKeyedColumn(const FieldLeaf& leaf, uint32_t& column);
+  void beginRow();
+  // Remove the last row, and the header if it was not written before it.
+  void rollback(size_t output_size, bool header_written);
+
+  std::string* _output;
+  // where the row is written: _output, or _first_row until the header is known
+  std::string* _out;
+  std::string _first_row;
+  char _separator;
+  double _timestamp = 0;
+  bool _row_open = false;
+  bool _header_written = false;
+  bool _layout_done = false;
+  size_t _array_columns = 16;
+
+  std::vector<FieldLeaf> _columns;
+  std::unordered_map<FieldLeaf, uint32_t, FieldLeafHash, FieldLeafEqual> _column_index;
+  // column of the n-th value of the last messages
+  std::vector<uint32_t> _column_at;
+  size_t _position = 0;
+  uint32_t _last_column = 0;
+  size_t _dropped_values = 0;
+  FieldLeaf _element;
+  // the columns under a @key are added to a group, at the place of the keyed field
+  std::unordered_map<FieldLeaf, uint32_t, FieldLeafHash, FieldLeafEqual> _key_group_index;
+  // end of the columns of each group, in the order of the header
+  std::vector<uint32_t> _key_group_end;
+};
+
+template <class DeserializerT>
+inline bool CsvMessageWriter::append(const Parser& parser, Span<const uint8_t> buffer, double timestamp,
+                                     DeserializerT* deserializer) {
+  const size_t output_size = _output->size();
+  const bool header_written = _header_written;
+  if (!_layout_done) {
+    layout(parser.getSchema()->field_tree.croot());
+  }
+  setTimestamp(timestamp);
+  bool filtered_out = false;
+  bool entire_message_parsed = false;
+  try {
+    entire_message_parsed = parser.walkSchema(buffer, deserializer, this, &filtered_out);
+  } catch (...) {
+    rollback(output_size, header_written);
+    throw;
+  }
+  if (filtered_out) {
+    rollback(output_size, header_written);
+  }
+  return entire_message_parsed;
+}
+
+}  // namespace RosMsgParser
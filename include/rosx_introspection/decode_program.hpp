@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rosx_introspection/deserializer.hpp"
+#include "rosx_introspection/ros_message.hpp"
+
+namespace RosMsgParser {
+
+/// Size of the primitive values that make a builtin type: it determines its
+/// alignment. TIME and DURATION are a pair of uint32.
+inline size_t primitiveSize(BuiltinType type) {
+  return (type == TIME || type == DURATION) ? 4 : static_cast<size_t>(builtinSize(type));
+}
+
+/**
+ * @brief A single instruction of a DecodeProgram.
+ *
+ * Each non-constant field of a message is lowered into one instruction
+ * (SCALAR, STRING, ENUM, UNION or STRUCT) or, if it is an array, into the
+ * triplet BEGIN_SEQUENCE / element / END_SEQUENCE. The @key members of a
+ * struct are lowered into KEY_* instructions placed at the beginning of its
+ * sub-program, because their values must be known before any path is emitted.
+ */
+struct DecodeOp {
+  enum Code : uint8_t {
+    KEY_STRING,      // @key string: push its value as key suffix
+    KEY_ENUM,        // @key enum: push the name of the enumerator
+    KEY_BUILTIN,     // @key integral: push "name:value"
+    SCALAR,          // builtin value (not a string)
+    STRING,          // string value
+    ENUM,            // enum value, decoded as INT32
+    UNION,           // discriminated union, see DecodeProgram::unions
+    STRUCT,          // call the sub-program starting at `target`
+    BEGIN_SEQUENCE,  // read the length of an array and start iterating
+    END_SEQUENCE,    // jump back to the element instruction, if any is left
+    RETURN           // end of the sub-program
+  };
+
+  enum Flags : uint8_t {
+    OPTIONAL = 1 << 0,       // @optional: preceded by a presence flag
+    IN_SEQUENCE = 1 << 1,    // element of the enclosing BEGIN_SEQUENCE
+    PUSH_INDEX = 1 << 2,     // elements are identified by their index
+    ELEM_KEYED = 1 << 3,     // elements are identified by their @key
+    BYTE_ELEMENTS = 1 << 4,  // 1-byte elements: large arrays become blobs
+    BULK = 1 << 5,           // one-dimensional array of builtins, see MessageWriter::writeArray
+    DELIMITED = 1 << 6,      // elements that are not primitive: XCDR2 puts a DHEADER before the array
+  };
+
+  static constexpr uint32_t NO_TARGET = 0xFFFFFFFF;
+
+  Code code = RETURN;
+  uint8_t flags = 0;
+  BuiltinType type = OTHER;
+  /// STRUCT and UNION: extensibility declared by the type.
+  Extensibility extensibility = Extensibility::UNSPECIFIED;
+  /// Index of the field among the children of the parent FieldTreeNode.
+  uint16_t child = 0;
+  /// Number of instructions used by this field (1 or 3). Used to skip an absent @optional.
+  uint16_t length = 1;
+  /// Number of elements of a fixed array, or -1 if read from the stream.
+  int32_t array_size = 1;
+  /// STRUCT: entry point of the sub-program. UNION: index in DecodeProgram::unions.
+  /// ENUM and KEY_ENUM: index in DecodeProgram::enums.
+  uint32_t target = NO_TARGET;
+  /// STRUCT: index in DecodeProgram::fixed_structs, if the struct has a fixed layout.
+  uint32_t fixed = NO_TARGET;
+  /// SCALAR or STRUCT: index in DecodeProgram::fixed_structs of the run of fields with a
+  /// fixed layout that starts with this instruction, one instruction per member.
+  uint32_t run = NO_TARGET;
+  /// ID of the member in the EMHEADER of a mutable struct (PL_CDR2).
+  uint32_t member_id = 0;
+  const ROSField* field = nullptr;
+
+  bool hasFlag(Flags flag) const {
+    return (flags & flag) != 0;
+  }
+};
+
+/**
+ * @brief Map from integer keys (union discriminants, enum wire values) to a
+ * small value, built at compilation time. It is a dense array if the keys are
+ * close to each other (the common case), a sorted vector otherwise.
+ * Lookups never allocate.
+ */
+template <typename T>
+class IntegerTable {
+ public:
+  /// If a key is repeated, the first entry wins.
+  void build(std::vector<std::pair<int64_t, T>> entries, T missing) {
+    _missing = missing;
+    _dense.clear();
+    _sorted.clear();
+    std::stable_sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [](const auto& a, const auto& b) { return a.first == b.first; }),
+                  entries.end());
+    if (entries.empty()) {
+      return;
+    }
+    _min = entries.front().first;
+    const uint64_t range = static_cast<uint64_t>(entries.back().first) - static_cast<uint64_t>(_min);
+    if (range < MAX_DENSE_RANGE || range < 4 * entries.size()) {
+      _dense.resize(range + 1, missing);
+      for (const auto& [key, value] : entries) {
+        _dense[static_cast<uint64_t>(key) - static_cast<uint64_t>(_min)] = value;
+      }
+    } else {
+      _sorted = std::move(entries);
+    }
+  }
+
+  const T& find(int64_t key) const {
+    if (!_dense.empty()) {
+      const uint64_t index = static_cast<uint64_t>(key) - static_cast<uint64_t>(_min);
+      return (index < _dense.size()) ? _dense[index] : _missing;
+    }
+    auto it = std::lower_bound(_sorted.begin(), _sorted.end(), key,
+                               [](const auto& entry, int64_t k) { return entry.first < k; });
+    return (it != _sorted.end() && it->first == key) ? it->second : _missing;
+  }
+
+ private:
+  static constexpr uint64_t MAX_DENSE_RANGE = 256;
+  T _missing = {};
+  int64_t _min = 0;
+  std::vector<T> _dense;
+  std::vector<std::pair<int64_t, T>> _sorted;
+};
+
+/// Union information resolved at compilation time.
+struct DecodeUnion {
+  struct Case {
+    const UnionCaseField* field = nullptr;
+    /// Sub-program of a struct case, NO_TARGET otherwise.
+    uint32_t target = DecodeOp::NO_TARGET;
+    /// Extensibility declared by the struct of the case.
+    Extensibility extensibility = Extensibility::UNSPECIFIED;
+  };
+
+  const DiscriminatedUnion* definition = nullptr;
+  /// OTHER if the discriminant is an enum, decoded as INT32.
+  BuiltinType discriminant_type = OTHER;
+
+  std::vector<Case> cases;
+  /// Index in `cases` for each value of the discriminant, NO_TARGET if default_case applies.
+  IntegerTable<uint32_t> case_index;
+  Case default_case;
+
+  const Case& activeCase(int64_t discriminant) const {
+    const uint32_t index = case_index.find(discriminant);
+    return (index == DecodeOp::NO_TARGET) ? default_case : cases[index];
+  }
+};
+
+/// Names of the enumerators by wire (DDS-compat) value.
+using DecodeEnum = IntegerTable<const std::string*>;
+
+/**
+ * @brief Byte layout of a message type made only of fixed-size members: builtin
+ * values (not strings), fixed arrays and other fixed structs. Typical examples are
+ * geometry_msgs/Pose, Twist or PoseWithCovariance.
+ *
+ * Such a struct is decoded as a single block of memory, with one bounds check and
+ * a load at each precomputed offset. The offsets depend on how the encoding aligns
+ * primitive values, so they are computed once for each PrimitiveAlignment.
+ *
+ * The same layout describes a run of consecutive fields of a struct that is not
+ * fixed as a whole, for instance the scalars that follow a string (see DecodeOp::run).
+ */
+struct FixedStruct {
+  static constexpr size_t ALIGNMENT_KINDS = 3;
+
+  /// In XCDR2, a nested struct is preceded by a DHEADER unless it is final, and an array of
+  /// structs always is: the layout holds only if the block contains neither.
+  enum Xcdr2Layout : uint8_t {
+    XCDR2_VALID,     // no nested struct, or only @final ones
+    XCDR2_IF_FINAL,  // nested structs without annotation: valid if the encapsulation makes them final
+    XCDR2_INVALID,   // arrays of structs, @appendable or @mutable structs
+  };
+
+  struct Member {
+    const ROSField* field = nullptr;
+    /// Index of the field among the children of the parent FieldTreeNode.
+    uint16_t child = 0;
+    /// OTHER if the member is a struct.
+    BuiltinType type = OTHER;
+    /// Struct member: index of its type in DecodeProgram::fixed_structs.
+    uint32_t nested = DecodeOp::NO_TARGET;
+    bool is_array = false;
+    uint32_t count = 1;
+    /// Offset of the first element, relative to the beginning of the block.
+    std::array<uint32_t, ALIGNMENT_KINDS> offset = {};
+    /// Distance between two consecutive elements of an array.
+    std::array<uint32_t, ALIGNMENT_KINDS> stride = {};
+  };
+
+  std::vector<Member> members;
+
+  /// Size of the first primitive value. The block starts where it would be aligned.
+  uint32_t first_size = 0;
+
+  /// Longest array in the block. If it exceeds Parser::maxArraySize(), the
+  /// MaxArrayPolicy applies and the struct is decoded field by field.
+  uint32_t max_array_size = 0;
+
+  /// Size of the block, or 0 if its layout depends on the position where it
+  /// starts, i.e. the first member is less aligned than one of the others.
+  std::array<uint32_t, ALIGNMENT_KINDS> size = {};
+
+  /// Largest alignment of the primitive values in the block.
+  std::array<uint32_t, ALIGNMENT_KINDS> alignment = {};
+
+  Xcdr2Layout xcdr2_layout = XCDR2_VALID;
+
+  /// Size of the block with the given alignment rules, 0 if it can not be used.
+  /// [xcdr2_default] is the extensibility of the types without annotation in an XCDR2
+  /// stream, UNSPECIFIED if the stream has no XCDR2 headers (see Deserializer::defaultExtensibility()).
+  uint32_t blockSize(PrimitiveAlignment kind, Extensibility xcdr2_default = Extensibility::UNSPECIFIED) const {
+    const auto index = static_cast<size_t>(kind);
+    return (index < ALIGNMENT_KINDS && holdsWith(xcdr2_default)) ? size[index] : 0;
+  }
+
+  /// True if the layout holds with the XCDR2 headers of the stream, see blockSize().
+  bool holdsWith(Extensibility xcdr2_default) const {
+    switch (xcdr2_layout) {
+      case XCDR2_VALID:
+        return true;
+      case XCDR2_IF_FINAL:
+        return xcdr2_default == Extensibility::UNSPECIFIED || xcdr2_default == Extensibility::FINAL;
+      default:
+        return xcdr2_default == Extensibility::UNSPECIFIED;
+    }
+  }
+};
+
+/**
+ * @brief DecodeProgram is the linear form of a MessageSchema.
+ *
+ * The schema is compiled once per Parser: every message type becomes a
+ * sub-program (a range of instructions terminated by RETURN) stored
+ * contiguously in `ops`. Decisions that depend only on the schema (is it a
+ * constant, a @key, a keyed sequence, which sub-message, ...) are taken at
+ * compilation time, so that the interpreter only decodes bytes.
+ */
+struct DecodeProgram {
+  using Ptr = std::shared_ptr<const DecodeProgram>;
+
+  std::vector<DecodeOp> ops;
+  std::vector<DecodeUnion> unions;
+  std::vector<DecodeEnum> enums;
+  std::vector<FixedStruct> fixed_structs;
+
+  /// Entry point of the sub-program of each message type.
+  std::unordered_map<const ROSMessage*, uint32_t> entries;
+
+  /// Entry point of the root message.
+  uint32_t root_entry = 0;
+
+  /// Extensibility declared by the root message.
+  Extensibility root_extensibility = Extensibility::UNSPECIFIED;
+
+  /// Smallest number of bytes of a valid message, in the encodings that are not XCDR2:
+  /// each string and sequence is empty, each @optional absent and the values are not padded.
+  /// A shorter buffer is rejected before decoding it. This does not hold in the PL_CDR2
+  /// encoding, where any member of a struct may be absent.
+  uint32_t min_size = 0;
+
+  /// Like min_size, in PLAIN_CDR2 and DELIMIT_CDR2: the structs that are not final count
+  /// only for their DHEADER, since they may be sent by an older version of their type.
+  uint32_t min_size_xcdr2 = 0;
+
+  /// True if a message may contain @optional members. In XCDR1 their values are aligned
+  /// relative to the beginning of the member (see NanoCDR_Deserializer::setParameterList()).
+  bool has_optional_members = false;
+};
+
+/// Lower a MessageSchema into a DecodeProgram.
+/// The program stores raw pointers into the schema, that must outlive it.
+DecodeProgram::Ptr CompileDecodeProgram(const MessageSchema& schema);
+
+}  // namespace RosMsgParser
@@ -2,15 +2,28 @@
 
 // API adapted to FastCDR
 
+#include <cstring>
 #include <exception>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "rosx_introspection/builtin_types.hpp"
 #include "rosx_introspection/contrib/nanocdr.hpp"
+#include "rosx_introspection/idl_types.hpp"
 #include "rosx_introspection/variant.hpp"
 
 namespace RosMsgParser {
 
+/// How primitive values are aligned in the stream, relative to its origin.
+enum class PrimitiveAlignment : uint8_t {
+  PACKED,      // no padding (ROS1)
+  CDR,         // aligned to their size (CDR, XCDR1)
+  XCDR2,       // aligned to their size, but at most to 4 bytes
+  UNSPECIFIED  // unknown: values must be decoded one by one
+};
+
 class Deserializer {
  public:
   virtual void init(Span<const uint8_t> buffer) {
@@ -28,11 +41,50 @@ class Deserializer {
   // deserialize the current pointer into a variant (not a string)
   [[nodiscard]] virtual Variant deserialize(BuiltinType type) = 0;
 
+  /// Deserialize a value of [type] (not a string) into [dst], in host byte order,
+  /// without creating a Variant. [dst] must have room for builtinSize(type) bytes;
+  /// TIME and DURATION are stored as a Time.
+  /// The default implementation copies the value returned by deserialize().
+  virtual void readInto(BuiltinType type, void* dst) {
+    const Variant value = deserialize(type);
+    memcpy(dst, value.getRawStorage(), static_cast<size_t>(builtinSize(type)));
+  }
+
+  /// Deserialize [count] contiguous values of [type] (not strings) into [dst], in host byte order.
+  /// ROS_Deserializer and NanoCDR_Deserializer check the bounds once and copy the whole array,
+  /// swapping the bytes in bulk if needed (see details::swapBytesInBulk()).
+  /// The default implementation calls readInto() for each value.
+  virtual void readArrayInto(BuiltinType type, void* dst, size_t count) {
+    const size_t size = static_cast<size_t>(builtinSize(type));
+    for (size_t i = 0; i < count; i++) {
+      readInto(type, static_cast<uint8_t*>(dst) + i * size);
+    }
+  }
+
+  /// Deserialize a value of type T (a number, bool, char or Time).
+  /// ROS_Deserializer and NanoCDR_Deserializer hide this method with an inline
+  /// version, used when the concrete type is known (see Parser::walkSchema).
+  template <typename T>
+  [[nodiscard]] T read() {
+    T value;
+    readInto(getType<T>(), &value);
+    return value;
+  }
+
   [[nodiscard]] virtual Span<const uint8_t> deserializeByteSequence() = 0;
 
   // deserialize the current pointer into a string
   virtual void deserializeString(std::string& out) = 0;
 
+  /// Deserialize a string without copying it, if possible.
+  /// ROS_Deserializer and NanoCDR_Deserializer return a view of the characters in the
+  /// buffer. The default implementation copies them with deserializeString() into a string
+  /// of this deserializer, that is valid until the next call.
+  [[nodiscard]] virtual std::string_view deserializeStringView() {
+    deserializeString(_string_copy);
+    return _string_copy;
+  }
+
   [[nodiscard]] virtual uint32_t deserializeUInt32() = 0;
 
   [[nodiscard]] virtual const uint8_t* getCurrentPtr() const = 0;
@@ -47,26 +99,72 @@ class Deserializer {
     return true;
   }
 
+  /// Alignment rules of the stream. Structs with a fixed layout are decoded
+  /// as a single block of memory only if this is not UNSPECIFIED.
+  [[nodiscard]] virtual PrimitiveAlignment primitiveAlignment() const {
+    return PrimitiveAlignment::UNSPECIFIED;
+  }
+
+  /// True if the byte order of the stream is different from the one of the host.
+  [[nodiscard]] virtual bool needsByteSwap() const {
+    return false;
+  }
+
+  /// Skip the padding that precedes a primitive value of size [data_size].
+  virtual void alignTo(size_t /*data_size*/) {}
+
+  /// In the XCDR2 encodings, the extensibility of the types without annotation, given by
+  /// the encapsulation: FINAL (PLAIN_CDR2), APPENDABLE (DELIMIT_CDR2) or MUTABLE (PL_CDR2).
+  /// UNSPECIFIED if the stream is not XCDR2: its types have no DHEADER nor EMHEADER.
+  [[nodiscard]] virtual Extensibility defaultExtensibility() const {
+    return Extensibility::UNSPECIFIED;
+  }
+
   // reset the pointer to beginning of buffer
   virtual void reset() = 0;
 
  protected:
   Span<const uint8_t> _buffer;
+
+ private:
+  std::string _string_copy;
 };
 
 //-----------------------------------------------------------------
 
 // Specialization od deserializer that works with ROS1
-class ROS_Deserializer : public Deserializer {
+class ROS_Deserializer final : public Deserializer {
  public:
   Variant deserialize(BuiltinType type) override;
 
+  void readInto(BuiltinType type, void* dst) override;
+
+  void readArrayInto(BuiltinType type, void* dst, size_t count) override;
+
+  template <typename T>
+  [[nodiscard]] T read() {
+    if constexpr (std::is_same_v<T, RosMsgParser::Time>) {
+      RosMsgParser::Time tmp;
+      tmp.sec = deserialize<uint32_t>();
+      tmp.nsec = deserialize<uint32_t>();
+      return tmp;
+    } else {
+      return deserialize<T>();
+    }
+  }
+
   bool isROS2() const override {
     return false;
   }
 
+  PrimitiveAlignment primitiveAlignment() const override {
+    return PrimitiveAlignment::PACKED;
+  }
+
   void deserializeString(std::string& dst) override;
 
+  std::string_view deserializeStringView() override;
+
   uint32_t deserializeUInt32() override;
 
   Span<const uint8_t> deserializeByteSequence() override;
@@ -98,34 +196,443 @@ class ROS_Deserializer : public Deserializer {
 
 // Specialization od deserializer that works with ROS2
 // wrapping FastCDR
-class NanoCDR_Deserializer : public Deserializer {
+class NanoCDR_Deserializer final : public Deserializer {
  public:
   Variant deserialize(BuiltinType type) override;
 
+  void readInto(BuiltinType type, void* dst) override;
+
+  void readArrayInto(BuiltinType type, void* dst, size_t count) override;
+
+  template <typename T>
+  [[nodiscard]] T read();
+
   void deserializeString(std::string& dst) override;
 
+  std::string_view deserializeStringView() override;
+
   uint32_t deserializeUInt32() override;
 
   Span<const uint8_t> deserializeByteSequence() override;
 
   const uint8_t* getCurrentPtr() const override;
 
+  size_t bytesLeft() const override;
+
   void jump(size_t bytes) override;
 
-  virtual void reset() override;
+  void reset() override;
 
   bool isROS2() const override {
     return true;
   }
 
-  bool hasOptionalMember() override {
-    return _cdr_decoder->hasMember();
+  bool hasOptionalMember() override;
+
+  PrimitiveAlignment primitiveAlignment() const override;
+
+  bool needsByteSwap() const override;
+
+  void alignTo(size_t data_size) override;
+
+  Extensibility defaultExtensibility() const override;
+
+  /// The encapsulation does not tell whether an XCDR1 stream contains optional members,
+  /// that have a parameter header and whose values are aligned relative to the beginning
+  /// of the member. If [enabled], reset() decodes the XCDR1 streams with a nanocdr::Decoder,
+  /// that tracks them; otherwise, and for the XCDR2 streams, with a nanocdr::PlainDecoder.
+  /// The Parser enables it for the schemas with @optional members.
+  void setParameterList(bool enabled) {
+    _parameter_list = enabled;
   }
 
+  /// Invoke [function] with a NanoCDR_Reader of the decoder selected by reset(): its
+  /// methods are those of this class, without checking which decoder is in use.
+  template <class Function>
+  decltype(auto) visitDecoder(Function&& function);
+
  protected:
-  std::optional<nanocdr::Decoder> _cdr_decoder;
+  bool _parameter_list = false;
+  nanocdr::CdrHeader _header;
+  // One of them, selected by reset() from the encapsulation.
+  std::optional<nanocdr::PlainDecoder> _cdr_decoder;
+  std::optional<nanocdr::Decoder> _member_decoder;
+
+  template <class Function>
+  decltype(auto) withDecoder(Function&& function) {
+    if (_member_decoder) {
+      return function(*_member_decoder);
+    }
+    return function(*_cdr_decoder);
+  }
+
+  template <class Function>
+  decltype(auto) withDecoder(Function&& function) const {
+    if (_member_decoder) {
+      return function(*_member_decoder);
+    }
+    return function(*_cdr_decoder);
+  }
+};
+
+/**
+ * @brief The decoding methods of a NanoCDR_Deserializer for one of its decoders,
+ * known at compile time. The DecodeProgram is executed with it, see
+ * NanoCDR_Deserializer::visitDecoder(); the NanoCDR_Deserializer methods forward to it.
+ */
+template <class DecoderT>
+class NanoCDR_Reader {
+ public:
+  NanoCDR_Reader(NanoCDR_Deserializer& owner, DecoderT& decoder) : _owner(owner), _decoder(decoder) {}
+
+  template <typename T>
+  [[nodiscard]] T read() {
+    if constexpr (std::is_same_v<T, RosMsgParser::Time>) {
+      RosMsgParser::Time tmp;
+      tmp.sec = read<uint32_t>();
+      tmp.nsec = read<uint32_t>();
+      return tmp;
+    } else {
+      T tmp;
+      _decoder.decode(tmp);
+      return tmp;
+    }
+  }
+
+  [[nodiscard]] Variant deserialize(BuiltinType type);
+
+  void readInto(BuiltinType type, void* dst);
+
+  void deserializeString(std::string& dst) {
+    _decoder.decode(dst);
+  }
+
+  [[nodiscard]] std::string_view deserializeStringView();
+
+  [[nodiscard]] uint32_t deserializeUInt32() {
+    return read<uint32_t>();
+  }
+
+  [[nodiscard]] Span<const uint8_t> deserializeByteSequence();
+
+  [[nodiscard]] const uint8_t* getCurrentPtr() const {
+    return _decoder.currentBuffer().data();
+  }
+
+  [[nodiscard]] size_t bytesLeft() const {
+    return _decoder.currentBuffer().size();
+  }
+
+  void jump(size_t bytes) {
+    _decoder.jump(bytes);
+  }
+
+  void alignTo(size_t data_size) {
+    _decoder.align(data_size);
+  }
+
+  [[nodiscard]] bool hasOptionalMember() {
+    return _decoder.hasMember();
+  }
+
+  // the decoder is constructed again in the same place
+  void reset() {
+    _owner.reset();
+  }
+
+  [[nodiscard]] PrimitiveAlignment primitiveAlignment() const {
+    return _owner.primitiveAlignment();
+  }
+
+  [[nodiscard]] bool needsByteSwap() const {
+    return _owner.needsByteSwap();
+  }
+
+  [[nodiscard]] Extensibility defaultExtensibility() const {
+    return _owner.defaultExtensibility();
+  }
+
+ private:
+  NanoCDR_Deserializer& _owner;
+  DecoderT& _decoder;
 };
 
 using ROS2_Deserializer = NanoCDR_Deserializer;
 
+//-----------------------------------------------------------------
+// The methods invoked for each value are defined inline, so that they can
+// be folded into Parser::walkSchema<ROS_Deserializer / NanoCDR_Deserializer>
+
+inline Variant ROS_Deserializer::deserialize(BuiltinType type) {
+  switch (type) {
+    case BOOL:
+      return deserialize<bool>();
+    case CHAR:
+      return deserialize<char>();
+    case BYTE:
+    case UINT8:
+      return deserialize<uint8_t>();
+    case UINT16:
+      return deserialize<uint16_t>();
+    case UINT32:
+      return deserialize<uint32_t>();
+    case UINT64:
+      return deserialize<uint64_t>();
+
+    case INT8:
+      return deserialize<int8_t>();
+    case INT16:
+      return deserialize<int16_t>();
+    case INT32:
+      return deserialize<int32_t>();
+    case INT64:
+      return deserialize<int64_t>();
+
+    case FLOAT32:
+      return deserialize<float>();
+    case FLOAT64:
+      return deserialize<double>();
+
+    case DURATION:
+    case TIME: {
+      RosMsgParser::Time tmp;
+      tmp.sec = deserialize<uint32_t>();
+      tmp.nsec = deserialize<uint32_t>();
+      return tmp;
+    }
+
+    default:
+      throw std::runtime_error("ROS_Deserializer: type not recognized");
+  }
+
+  return {};
+}
+
+inline void ROS_Deserializer::readInto(BuiltinType type, void* dst) {
+  // the values are packed and stored in the byte order of the host
+  const int size = builtinSize(type);
+  if (size <= 0) {
+    throw std::runtime_error("ROS_Deserializer: type not recognized");
+  }
+  if (static_cast<size_t>(size) > _bytes_left) {
+    throw std::runtime_error("Buffer overrun in Deserializer");
+  }
+  memcpy(dst, _ptr, static_cast<size_t>(size));
+  _bytes_left -= static_cast<size_t>(size);
+  _ptr += size;
+}
+
+inline void ROS_Deserializer::deserializeString(std::string& dst) {
+  uint32_t string_size = deserialize<uint32_t>();
+
+  if (string_size > _bytes_left) {
+    throw std::runtime_error("Buffer overrun in ROS_Deserializer::deserializeString");
+  }
+
+  if (string_size == 0) {
+    dst = {};
+    return;
+  }
+
+  const char* buffer_ptr = reinterpret_cast<const char*>(_ptr);
+  dst.assign(buffer_ptr, string_size);
+
+  _ptr += string_size;
+  _bytes_left -= string_size;
+}
+
+inline std::string_view ROS_Deserializer::deserializeStringView() {
+  uint32_t string_size = deserialize<uint32_t>();
+
+  if (string_size > _bytes_left) {
+    throw std::runtime_error("Buffer overrun in ROS_Deserializer::deserializeStringView");
+  }
+  std::string_view out(reinterpret_cast<const char*>(_ptr), string_size);
+  _ptr += string_size;
+  _bytes_left -= string_size;
+  return out;
+}
+
+inline uint32_t ROS_Deserializer::deserializeUInt32() {
+  return deserialize<uint32_t>();
+}
+
+inline const uint8_t* ROS_Deserializer::getCurrentPtr() const {
+  return _ptr;
+}
+
+inline void ROS_Deserializer::jump(size_t bytes) {
+  if (bytes > _bytes_left) {
+    throw std::runtime_error("Buffer overrun");
+  }
+  _ptr += bytes;
+  _bytes_left -= bytes;
+}
+
+template <class DecoderT>
+inline Variant NanoCDR_Reader<DecoderT>::deserialize(BuiltinType type) {
+  switch (type) {
+    case BOOL:
+      return read<bool>();
+    case CHAR:
+      return read<char>();
+    case BYTE:
+    case UINT8:
+      return read<uint8_t>();
+    case UINT16:
+      return read<uint16_t>();
+    case UINT32:
+      return read<uint32_t>();
+    case UINT64:
+      return read<uint64_t>();
+
+    case INT8:
+      return read<int8_t>();
+    case INT16:
+      return read<int16_t>();
+    case INT32:
+      return read<int32_t>();
+    case INT64:
+      return read<int64_t>();
+
+    case FLOAT32:
+      return read<float>();
+    case FLOAT64:
+      return read<double>();
+
+    case DURATION:
+    case TIME:
+      return read<RosMsgParser::Time>();
+
+    default:
+      throw std::runtime_error("NanoCDR_Deserializer: type not recognized");
+  }
+
+  return {};
+}
+
+template <class DecoderT>
+inline void NanoCDR_Reader<DecoderT>::readInto(BuiltinType type, void* dst) {
+  auto copy = [dst](auto value) { memcpy(dst, &value, sizeof(value)); };
+  switch (type) {
+    case BOOL:
+      return copy(read<bool>());
+    case CHAR:
+      return copy(read<char>());
+    case BYTE:
+    case UINT8:
+      return copy(read<uint8_t>());
+    case UINT16:
+      return copy(read<uint16_t>());
+    case UINT32:
+      return copy(read<uint32_t>());
+    case UINT64:
+      return copy(read<uint64_t>());
+
+    case INT8:
+      return copy(read<int8_t>());
+    case INT16:
+      return copy(read<int16_t>());
+    case INT32:
+      return copy(read<int32_t>());
+    case INT64:
+      return copy(read<int64_t>());
+
+    case FLOAT32:
+      return copy(read<float>());
+    case FLOAT64:
+      return copy(read<double>());
+
+    case DURATION:
+    case TIME:
+      return copy(read<RosMsgParser::Time>());
+
+    default:
+      throw std::runtime_error("NanoCDR_Deserializer: type not recognized");
+  }
+}
+
+template <class DecoderT>
+inline std::string_view NanoCDR_Reader<DecoderT>::deserializeStringView() {
+  const uint32_t length = read<uint32_t>();
+  if (length > bytesLeft()) {
+    throw std::runtime_error("Buffer overrun in NanoCDR_Deserializer::deserializeStringView");
+  }
+  const char* chars = reinterpret_cast<const char*>(getCurrentPtr());
+  jump(length);
+  // the length includes the null terminator
+  return std::string_view(chars, (length > 0 && chars[length - 1] == '\0') ? length - 1 : length);
+}
+
+template <class DecoderT>
+inline Span<const uint8_t> NanoCDR_Reader<DecoderT>::deserializeByteSequence() {
+  const uint32_t length = read<uint32_t>();
+  if (length == 0) {
+    return {};
+  }
+  if (length > bytesLeft()) {
+    throw std::runtime_error("Buffer overrun in NanoCDR_Deserializer::deserializeByteSequence");
+  }
+  const uint8_t* ptr = getCurrentPtr();
+  jump(length);
+  return {ptr, length};
+}
+
+template <class Function>
+inline decltype(auto) NanoCDR_Deserializer::visitDecoder(Function&& function) {
+  return withDecoder([&](auto& decoder) {
+    NanoCDR_Reader reader(*this, decoder);
+    return function(reader);
+  });
+}
+
+template <typename T>
+inline T NanoCDR_Deserializer::read() {
+  return visitDecoder([](auto& reader) { return reader.template read<T>(); });
+}
+
+inline Variant NanoCDR_Deserializer::deserialize(BuiltinType type) {
+  return visitDecoder([type](auto& reader) { return reader.deserialize(type); });
+}
+
+inline void NanoCDR_Deserializer::readInto(BuiltinType type, void* dst) {
+  visitDecoder([type, dst](auto& reader) { reader.readInto(type, dst); });
+}
+
+inline void NanoCDR_Deserializer::deserializeString(std::string& dst) {
+  visitDecoder([&dst](auto& reader) { reader.deserializeString(dst); });
+}
+
+inline std::string_view NanoCDR_Deserializer::deserializeStringView() {
+  return visitDecoder([](auto& reader) { return reader.deserializeStringView(); });
+}
+
+inline uint32_t NanoCDR_Deserializer::deserializeUInt32() {
+  return read<uint32_t>();
+}
+
+inline Span<const uint8_t> NanoCDR_Deserializer::deserializeByteSequence() {
+  return visitDecoder([](auto& reader) { return reader.deserializeByteSequence(); });
+}
+
+inline const uint8_t* NanoCDR_Deserializer::getCurrentPtr() const {
+  return withDecoder([](const auto& decoder) { return decoder.currentBuffer().data(); });
+}
+
+inline size_t NanoCDR_Deserializer::bytesLeft() const {
+  return withDecoder([](const auto& decoder) { return decoder.currentBuffer().size(); });
+}
+
+inline void NanoCDR_Deserializer::jump(size_t bytes) {
+  withDecoder([bytes](auto& decoder) { decoder.jump(bytes); });
+}
+
+inline void NanoCDR_Deserializer::alignTo(size_t data_size) {
+  withDecoder([data_size](auto& decoder) { decoder.align(data_size); });
+}
+
+inline bool NanoCDR_Deserializer::hasOptionalMember() {
+  return visitDecoder([](auto& reader) { return reader.hasOptionalMember(); });
+}
+
 }  // namespace RosMsgParser
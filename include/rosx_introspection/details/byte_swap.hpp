@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace RosMsgParser {
+
+namespace details {
+
+/// Reverse the byte order of [count] values of [size] bytes (1, 2, 4 or 8), copying them from [src] to [dst].
+/// The buffers don't need to be aligned; they may be the same buffer, but must not overlap otherwise.
+///
+/// The values are swapped 16 or 32 bytes at a time with the SSSE3/AVX2 (x86) or NEON (ARM) shuffles,
+/// if the CPU supports them, and one at a time otherwise.
+void swapBytesInBulk(uint8_t* dst, const uint8_t* src, size_t count, size_t size);
+
+/// Instruction set used by swapBytesInBulk(): "avx2", "ssse3", "neon" or "portable".
+const char* swapBytesImplementation();
+
+}  // namespace details
+
+}  // namespace RosMsgParser
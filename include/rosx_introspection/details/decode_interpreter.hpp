@@ -0,0 +1,1400 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "rosx_introspection/decode_program.hpp"
+#include "rosx_introspection/details/byte_swap.hpp"
+#include "rosx_introspection/message_writer.hpp"
+#include "rosx_introspection/stringtree_leaf.hpp"
+
+namespace RosMsgParser {
+
+namespace details {
+
+/// Flags of a node of the FieldTree, see Parser::setFieldFilter() and Parser::setFieldPredicates().
+enum FieldFlags : uint8_t {
+  FIELD_STORED = 1 << 0,         // the field, or some of its children, are stored
+  FIELD_ENTIRE = 1 << 1,         // the field and all its children are stored, no predicate below
+  FIELD_PREDICATE = 1 << 2,      // the value of the field is tested by a predicate
+  FIELD_HAS_PREDICATE = 1 << 3,  // a child of the struct is tested by a predicate
+};
+
+/// Condition on the value of a field that is not an element of an array.
+struct FieldPredicate {
+  enum Compare : uint8_t { EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+  const FieldTreeNode* node = nullptr;
+  Compare compare = EQUAL;
+  /// Compare the text of a string or the name of an enumerator, rather than a number.
+  bool is_text = false;
+  double number = 0;
+  std::string text;
+
+  template <typename T>
+  bool holds(const T& value, const T& reference) const {
+    switch (compare) {
+      case EQUAL:
+        return value == reference;
+      case NOT_EQUAL:
+        return value != reference;
+      case LESS:
+        return value < reference;
+      case LESS_EQUAL:
+        return value <= reference;
+      case GREATER:
+        return value > reference;
+      case GREATER_EQUAL:
+        return value >= reference;
+    }
+    return false;
+  }
+
+  bool test(const Variant& value) const {
+    return holds(value.convert<double>(), number);
+  }
+
+  bool test(std::string_view value) const {
+    return holds(value, std::string_view(text));
+  }
+
+  bool test(int32_t enum_value, const std::string& enum_name) const {
+    return is_text ? test(std::string_view(enum_name)) : holds(double(enum_value), number);
+  }
+};
+
+/// Options of the Parser used by the interpreter.
+struct DecodeOptions {
+  uint32_t max_array_size = 100;
+  /// The arrays of BYTE or UINT8 larger than this are written with MessageWriter::writeBlob().
+  uint32_t max_byte_array_size = 100;
+  bool discard_large_arrays = true;
+  /// FieldFlags indexed by FieldTreeNode::nodeId(), nullptr if every field is stored.
+  const uint8_t* field_flags = nullptr;
+  /// Tested when the value of their field is decoded; the first failure stops the decoding.
+  Span<const FieldPredicate> predicates;
+};
+
+// Push a @key bracket value (content only; the renderer adds the surrounding
+// "[" "]"). A field can be reached through several @key levels (e.g. an outer
+// "ArmID:3" and an inner "J1"); the values accumulate in order and are rolled
+// back per scope by resizing key_suffixes.
+inline void pushKeySuffix(FieldLeaf& leaf, const char* data, int len) {
+  KeySuffix ks;
+  ks.assign(data, static_cast<size_t>(len));
+  leaf.key_suffixes.push_back(ks);
+}
+
+
+// Interpreter state of a sub-program (i.e. of a struct being decoded).
+// A struct decodes one field at a time, so a single sequence can be active.
+struct ProgramFrame {
+  uint32_t return_pc;
+  const FieldTreeNode* node;
+  bool store;
+  uint16_t saved_idx_size;
+  uint16_t saved_key_suffix_size;
+  // active sequence
+  uint32_t seq_index;
+  uint32_t seq_size;
+  bool seq_store;
+  // XCDR2: end of the struct given by its DHEADER, nullptr if it has none
+  const uint8_t* end;
+  // mutable struct: index of its first member in DecodeCursor::members, NO_TARGET otherwise
+  uint32_t members_begin;
+  // XCDR2: end of the active sequence given by its DHEADER, nullptr if it has none
+  const uint8_t* seq_end;
+  // beginArray() was invoked for the active sequence
+  bool seq_open;
+  // the struct is the active case of a union: endUnion() follows its endStruct()
+  bool union_case;
+};
+
+// Member of a mutable struct (PL_CDR2), located by its EMHEADER.
+struct EncodedMember {
+  uint32_t id;
+  const uint8_t* value;
+};
+
+template <typename T>
+inline T loadPrimitive(const uint8_t* ptr, bool swap) {
+  T value;
+  memcpy(&value, ptr, sizeof(T));
+  if constexpr (sizeof(T) >= 2) {
+    if (swap) {
+      nanocdr::swapEndianness(value);
+    }
+  }
+  return value;
+}
+
+// Pass a builtin value to the typed event of [writer] that matches [type], without
+// creating a Variant. read(T{}) must return the value as T (a Time for TIME and DURATION).
+template <class WriterT, class ReadFunction>
+void writeTypedValue(WriterT* writer, const FieldLeaf& leaf, BuiltinType type, ReadFunction&& read) {
+  switch (type) {
+    case BOOL:
+      return writer->writeBool(leaf, read(bool{}));
+    case CHAR:
+      return writer->writeChar(leaf, read(char{}));
+    case BYTE:
+    case UINT8:
+      return writer->writeUInt8(leaf, read(uint8_t{}));
+    case UINT16:
+      return writer->writeUInt16(leaf, read(uint16_t{}));
+    case UINT32:
+      return writer->writeUInt32(leaf, read(uint32_t{}));
+    case UINT64:
+      return writer->writeUInt64(leaf, read(uint64_t{}));
+    case INT8:
+      return writer->writeInt8(leaf, read(int8_t{}));
+    case INT16:
+      return writer->writeInt16(leaf, read(int16_t{}));
+    case INT32:
+      return writer->writeInt32(leaf, read(int32_t{}));
+    case INT64:
+      return writer->writeInt64(leaf, read(int64_t{}));
+    case FLOAT32:
+      return writer->writeFloat32(leaf, read(float{}));
+    case FLOAT64:
+      return writer->writeFloat64(leaf, read(double{}));
+    case DURATION:
+    case TIME:
+      return writer->writeValue(leaf, Variant(read(RosMsgParser::Time{})));
+    default:
+      throw std::runtime_error("writeTypedValue: type not recognized");
+  }
+}
+
+// Decode the next value of the stream and pass it to the typed event of [writer].
+template <class WriterT, class DeserializerT>
+void writeDecodedValue(WriterT* writer, const FieldLeaf& leaf, BuiltinType type, DeserializerT* deserializer) {
+  writeTypedValue(writer, leaf, type,
+                  [deserializer](auto zero) { return deserializer->template read<decltype(zero)>(); });
+}
+
+// Load a value stored at [ptr] in the byte order of the stream, and pass it to the typed event of [writer].
+template <class WriterT>
+void writeLoadedValue(WriterT* writer, const FieldLeaf& leaf, BuiltinType type, const uint8_t* ptr, bool swap) {
+  writeTypedValue(writer, leaf, type, [ptr, swap](auto zero) {
+    using T = decltype(zero);
+    if constexpr (std::is_same_v<T, bool>) {
+      return ptr[0] != 0;
+    } else if constexpr (std::is_same_v<T, RosMsgParser::Time>) {
+      RosMsgParser::Time tmp;
+      tmp.sec = loadPrimitive<uint32_t>(ptr, swap);
+      tmp.nsec = loadPrimitive<uint32_t>(ptr + 4, swap);
+      return tmp;
+    } else {
+      return loadPrimitive<T>(ptr, swap);
+    }
+  });
+}
+
+// Invoke writeString(leaf, std::string_view). A writer that overrides only writeString(leaf,
+// const std::string&) hides the other overload, that is then invoked through MessageWriter.
+template <class WriterT>
+void writeStringView(WriterT* writer, const FieldLeaf& leaf, std::string_view value) {
+  if constexpr (requires { writer->writeString(leaf, value); }) {
+    writer->writeString(leaf, value);
+  } else {
+    static_cast<MessageWriter*>(writer)->writeString(leaf, value);
+  }
+}
+
+// Invoke writeArray on [count] contiguous values of [type], stored in the byte
+// order of the stream. If swap is needed, they are converted into [scratch].
+template <class WriterT>
+void writeBulkArray(WriterT* writer, const FieldLeaf& leaf, BuiltinType type, const uint8_t* ptr, size_t count,
+                    bool swap, std::vector<uint8_t>& scratch) {
+  const size_t size = static_cast<size_t>(builtinSize(type));
+  const size_t unit = primitiveSize(type);
+  if (swap && unit > 1) {
+    scratch.resize(count * size);
+    swapBytesInBulk(scratch.data(), ptr, count * size / unit, unit);
+    ptr = scratch.data();
+  }
+  writer->writeArray(leaf, type, Span<const uint8_t>(ptr, count * size), count);
+}
+
+// Write all the values of a struct with a fixed layout, stored in [block].
+// leaf.node must be the node of the struct; it is restored before returning.
+template <class WriterT>
+void writeFixedStruct(const DecodeProgram& program, const FixedStruct& fixed, size_t kind, const uint8_t* block,
+                      bool swap, FieldLeaf& leaf, WriterT* writer, std::vector<uint8_t>& scratch) {
+  const FieldTreeNode* node = leaf.node;
+
+  for (const auto& member : fixed.members) {
+    leaf.node = node->child(member.child);
+    const uint8_t* ptr = block + member.offset[kind];
+
+    auto writeElement = [&](const uint8_t* elem_ptr) {
+      if (member.type == OTHER) {
+        writer->beginStruct(*member.field);
+        writeFixedStruct(program, program.fixed_structs[member.nested], kind, elem_ptr, swap, leaf, writer, scratch);
+        writer->endStruct();
+      } else {
+        writeLoadedValue(writer, leaf, member.type, elem_ptr, swap);
+      }
+    };
+
+    if (!member.is_array) {
+      writeElement(ptr);
+      continue;
+    }
+
+    const auto saved_idx_size = leaf.index_array.size();
+    const auto& dims = member.field->arrayDimensions();
+    const size_t num_dims = std::max<size_t>(1, dims.size());
+    for (size_t d = 0; d < num_dims; d++) {
+      leaf.index_array.push_back(0);
+    }
+    writer->beginArray(*member.field, member.count);
+    if (member.type != OTHER && dims.size() <= 1) {
+      writeBulkArray(writer, leaf, member.type, ptr, member.count, swap, scratch);
+      writer->endArray();
+      leaf.index_array.resize(saved_idx_size);
+      continue;
+    }
+    for (uint32_t i = 0; i < member.count; i++) {
+      if (dims.size() > 1) {
+        uint32_t flat = i;
+        for (int d = static_cast<int>(dims.size()) - 1; d >= 0; d--) {
+          leaf.index_array[saved_idx_size + d] = flat % dims[d];
+          flat /= dims[d];
+        }
+      } else {
+        leaf.index_array.back() = i;
+      }
+      writeElement(ptr + i * member.stride[kind]);
+    }
+    writer->endArray();
+    leaf.index_array.resize(saved_idx_size);
+  }
+  leaf.node = node;
+}
+
+
+// Where the values of a message are, valid for all the messages with the same shape.
+//
+// The shape of a message is the sequence of the length prefixes of its strings
+// and sequences. The path taken through the DecodeProgram depends only on them:
+// if the first prefix has the same value, the second one is at the same offset,
+// and so on. Two messages whose prefixes match have their values at the same
+// offsets, and their writer events can be replayed with direct loads.
+struct ShapeLayout {
+  // Length prefix of a string or of a sequence.
+  struct Prefix {
+    uint32_t offset;
+    uint32_t value;
+  };
+
+  // An invocation of the writer. Offsets are relative to the beginning of the buffer.
+  struct Event {
+    enum Kind : uint8_t {
+      VALUE,
+      STRING,
+      ENUM,
+      ARRAY,
+      BLOB,
+      FIXED_STRUCT,
+      FIXED_RUN,
+      BEGIN_STRUCT,
+      END_STRUCT,
+      BEGIN_ARRAY,
+      END_ARRAY
+    };
+    Kind kind;
+    BuiltinType type;
+    uint32_t offset;
+    // characters of a STRING, elements of an ARRAY or of a BEGIN_ARRAY, bytes of a BLOB
+    uint32_t count;
+    // index of the enum (ENUM) or of the FixedStruct (FIXED_STRUCT, FIXED_RUN)
+    uint32_t target;
+    const ROSField* field;
+    // FieldLeaf of the event: its node, and its array indices in ShapeLayout::indices
+    const FieldTreeNode* node;
+    uint32_t index_begin;
+    uint32_t index_count;
+  };
+
+  PrimitiveAlignment alignment = PrimitiveAlignment::UNSPECIFIED;
+  bool swap = false;
+  Extensibility xcdr2 = Extensibility::UNSPECIFIED;
+  std::vector<Prefix> prefixes;
+  std::vector<Event> events;
+  // array indices of the events; there are no @key values, see Parser::setShapeMemoization()
+  std::vector<uint16_t> indices;
+  // bytes read by the DecodeProgram
+  size_t message_size = 0;
+  bool entire_message_parsed = true;
+
+  bool matches(Span<const uint8_t> buffer, PrimitiveAlignment buffer_alignment, bool buffer_swap,
+               Extensibility buffer_xcdr2) const {
+    if (alignment != buffer_alignment || swap != buffer_swap || xcdr2 != buffer_xcdr2 ||
+        buffer.size() < message_size) {
+      return false;
+    }
+    for (const auto& prefix : prefixes) {
+      if (loadPrimitive<uint32_t>(buffer.data() + prefix.offset, swap) != prefix.value) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+// Execution state of a DecodeProgram that can be suspended and resumed later,
+// as long as the deserializer is left at the same position (see LazyMessageView).
+struct DecodeCursor {
+  /// Next instruction, NO_TARGET if the execution has not started yet.
+  uint32_t pc = DecodeOp::NO_TARGET;
+  SmallVector<ProgramFrame, 16> frames;
+  /// Members of the mutable structs being decoded, see ProgramFrame::members_begin.
+  SmallVector<EncodedMember, 16> members;
+  bool entire_message_parsed = true;
+  bool finished = false;
+  /// The decoding was stopped by a FieldPredicate that does not hold.
+  bool filtered_out = false;
+  /// Set by the writer to suspend the execution after the current instruction.
+  bool suspend = false;
+  /// If set, the prefixes and the writer events are appended to it, with
+  /// offsets relative to [record_origin] (see ShapeCache).
+  ShapeLayout* record = nullptr;
+  const uint8_t* record_origin = nullptr;
+};
+
+// Executes the DecodeProgram, from the beginning or from where [cursor] was
+// suspended. The recursion of the schema is replaced by an explicit stack of
+// frames: STRUCT pushes a frame and RETURN pops it.
+// FieldLeaf is mutated in place and restored after each field.
+// Returns false if parts of the message were skipped because of the MaxArrayPolicy.
+template <class DeserializerT, class WriterT>
+bool ResumeDecodeProgram(const DecodeProgram& program, const DecodeOptions& options, DecodeCursor& cursor,
+                         FieldLeaf& leaf, DeserializerT* deserializer, WriterT* writer) {
+  const DecodeOp* ops = program.ops.data();
+  const uint32_t max_array_size = options.max_array_size;
+  // the structs with a fixed layout are written as a block only if none of their arrays is limited
+  const uint32_t max_fixed_array_size = std::min(max_array_size, options.max_byte_array_size);
+  bool entire_message_parsed = cursor.entire_message_parsed;
+  const PrimitiveAlignment alignment = deserializer->primitiveAlignment();
+  const bool swap = deserializer->needsByteSwap();
+  const uint8_t* all_field_flags = options.field_flags;
+
+  // XCDR2: the types that are not final are preceded by a DHEADER (their size), and the
+  // members of the mutable ones by an EMHEADER (their id and size). The types without
+  // annotation take the extensibility given by the encapsulation.
+  const Extensibility xcdr2 = deserializer->defaultExtensibility();
+  auto resolve = [xcdr2](Extensibility declared) {
+    if (xcdr2 == Extensibility::UNSPECIFIED) {
+      return Extensibility::FINAL;
+    }
+    return (declared == Extensibility::UNSPECIFIED) ? xcdr2 : declared;
+  };
+
+  auto& frames = cursor.frames;
+  auto& members = cursor.members;
+  ProgramFrame* frame = nullptr;
+  std::vector<uint8_t> scratch;
+  static const std::string empty_str;
+  char buf[96];
+  ShapeLayout* const record = cursor.record;
+
+  auto recordEvent = [&](ShapeLayout::Event::Kind kind, const uint8_t* ptr, BuiltinType type, uint32_t count = 0,
+                         uint32_t target = 0, const ROSField* field = nullptr) {
+    record->events.push_back({kind, type, static_cast<uint32_t>(ptr - cursor.record_origin), count, target, field,
+                              leaf.node, static_cast<uint32_t>(record->indices.size()),
+                              static_cast<uint32_t>(leaf.index_array.size())});
+    record->indices.insert(record->indices.end(), leaf.index_array.begin(), leaf.index_array.end());
+  };
+
+  // Record the length prefix at the current position, and return the pointer to the data that follows it.
+  auto recordPrefix = [&]() -> const uint8_t* {
+    deserializer->alignTo(sizeof(uint32_t));
+    const uint8_t* ptr = deserializer->getCurrentPtr();
+    if (deserializer->bytesLeft() >= sizeof(uint32_t)) {
+      record->prefixes.push_back(
+          {static_cast<uint32_t>(ptr - cursor.record_origin), loadPrimitive<uint32_t>(ptr, swap)});
+    }
+    return ptr + sizeof(uint32_t);
+  };
+
+  // The XCDR2 headers determine where the values are, like the length prefixes.
+  auto readHeader = [&]() -> uint32_t {
+    if (record) {
+      recordPrefix();
+    }
+    return deserializer->deserializeUInt32();
+  };
+
+  // Read a DHEADER and return the end of the value that follows it.
+  auto readDHeader = [&]() -> const uint8_t* {
+    const uint32_t size = readHeader();
+    if (size > deserializer->bytesLeft()) {
+      throw std::runtime_error("Buffer overrun in walkSchema (DHEADER)");
+    }
+    return deserializer->getCurrentPtr() + size;
+  };
+
+  // Move to [ptr]. The members of a mutable struct may be decoded out of order,
+  // so it may precede the current position.
+  auto seekTo = [&](const uint8_t* ptr) {
+    if (ptr < deserializer->getCurrentPtr()) {
+      deserializer->reset();
+    }
+    deserializer->jump(static_cast<size_t>(ptr - deserializer->getCurrentPtr()));
+  };
+
+  // Read an EMHEADER and return the id of the member. The deserializer is left at
+  // its value, that is [size] bytes long.
+  auto readMemberHeader = [&](size_t& size) -> uint32_t {
+    const uint32_t header = readHeader();
+    const uint32_t length_code = (header >> 28) & 0x7;
+    if (length_code < 4) {
+      size = size_t(1) << length_code;
+    } else if (length_code == 4) {
+      size = readHeader();
+    } else {
+      // NEXTINT is also the beginning of the value: the length of a sequence or a DHEADER
+      if (record) {
+        recordPrefix();
+      }
+      deserializer->alignTo(sizeof(uint32_t));
+      if (deserializer->bytesLeft() < sizeof(uint32_t)) {
+        throw std::runtime_error("Buffer overrun in walkSchema (EMHEADER)");
+      }
+      const uint32_t next_int = loadPrimitive<uint32_t>(deserializer->getCurrentPtr(), swap);
+      static constexpr size_t UNIT[] = {1, 4, 8};
+      size = sizeof(uint32_t) + size_t(next_int) * UNIT[length_code - 5];
+    }
+    if (size > deserializer->bytesLeft()) {
+      throw std::runtime_error("Buffer overrun in walkSchema (EMHEADER)");
+    }
+    return header & 0x0FFFFFFF;
+  };
+
+  // Locate the members of a mutable struct that ends at [end].
+  auto scanMembers = [&](const uint8_t* end) {
+    while (end - deserializer->getCurrentPtr() >= static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+      deserializer->alignTo(sizeof(uint32_t));
+      if (end - deserializer->getCurrentPtr() < static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+        break;
+      }
+      size_t size = 0;
+      const uint32_t id = readMemberHeader(size);
+      if (size > static_cast<size_t>(end - deserializer->getCurrentPtr())) {
+        throw std::runtime_error("Buffer overrun in walkSchema: a member exceeds its mutable struct");
+      }
+      members.push_back({id, deserializer->getCurrentPtr()});
+      deserializer->jump(size);
+    }
+  };
+
+  auto findMember = [&](uint32_t id) -> const uint8_t* {
+    for (size_t i = frame->members_begin; i < members.size(); i++) {
+      if (members[i].id == id) {
+        return members[i].value;
+      }
+    }
+    return nullptr;
+  };
+
+  if (cursor.pc == DecodeOp::NO_TARGET) {
+    const Extensibility root_extensibility = resolve(program.root_extensibility);
+    const uint32_t min_size = (xcdr2 == Extensibility::UNSPECIFIED) ? program.min_size : program.min_size_xcdr2;
+    if (xcdr2 != Extensibility::MUTABLE && root_extensibility != Extensibility::MUTABLE &&
+        deserializer->bytesLeft() < min_size) {
+      throw std::runtime_error("Buffer overrun in walkSchema: the message is shorter than its minimum size");
+    }
+    frames.clear();
+    members.clear();
+    frames.push_back(
+        {DecodeOp::NO_TARGET, leaf.node, true, 0, 0, 0, 0, false, nullptr, DecodeOp::NO_TARGET, nullptr, false, false});
+    if (root_extensibility != Extensibility::FINAL) {
+      frames.back().end = readDHeader();
+      if (root_extensibility == Extensibility::MUTABLE) {
+        frames.back().members_begin = 0;
+        scanMembers(frames.back().end);
+      }
+    }
+    cursor.pc = program.root_entry;
+  }
+  frame = &frames.back();
+
+  auto flagsOf = [&](const FieldTreeNode* node) -> uint8_t {
+    return all_field_flags ? all_field_flags[node->nodeId()] : (FIELD_STORED | FIELD_ENTIRE);
+  };
+
+  // Select the FieldTreeNode of a field of the current struct.
+  auto enterField = [&](const DecodeOp& op, uint8_t& field_flags) -> bool {
+    if (op.child < frame->node->children().size()) {
+      leaf.node = frame->node->child(op.child);
+      field_flags = flagsOf(leaf.node);
+      return frame->store && (field_flags & FIELD_STORED);
+    }
+    leaf.node = frame->node;
+    field_flags = 0;
+    return false;
+  };
+
+  auto predicateHolds = [&](auto&&... value) -> bool {
+    for (const auto& predicate : options.predicates) {
+      if (predicate.node == leaf.node && !predicate.test(value...)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // A message rejected by a predicate is abandoned where it is.
+  auto filterOut = [&]() {
+    cursor.filtered_out = true;
+    cursor.finished = true;
+    cursor.entire_message_parsed = entire_message_parsed;
+    return entire_message_parsed;
+  };
+
+  auto restoreLeaf = [&]() {
+    leaf.index_array.resize(frame->saved_idx_size);
+    leaf.key_suffixes.resize(frame->saved_key_suffix_size);
+  };
+
+  auto beginArray = [&](const ROSField& field, uint32_t size) {
+    writer->beginArray(field, size);
+    if (record) {
+      recordEvent(ShapeLayout::Event::BEGIN_ARRAY, cursor.record_origin, OTHER, size, 0, &field);
+    }
+  };
+
+  auto endArray = [&]() {
+    writer->endArray();
+    if (record) {
+      recordEvent(ShapeLayout::Event::END_ARRAY, cursor.record_origin, OTHER);
+    }
+  };
+
+  // End the active sequence, after its last element or when the rest is skipped.
+  auto endSequence = [&]() {
+    if (frame->seq_open) {
+      frame->seq_open = false;
+      endArray();
+    }
+    restoreLeaf();
+  };
+
+  // Prepare the leaf for the element [frame->seq_index] of the active sequence.
+  auto beginElement = [&](const DecodeOp& op) {
+    const uint32_t i = frame->seq_index;
+    // Roll back @key brackets pushed by the previous keyed element so they
+    // do not accumulate across iterations of the sequence.
+    if (op.hasFlag(DecodeOp::ELEM_KEYED)) {
+      leaf.key_suffixes.resize(frame->saved_key_suffix_size);
+    }
+    if (frame->seq_store && i >= max_array_size) {
+      frame->seq_store = false;
+    }
+    if (op.hasFlag(DecodeOp::PUSH_INDEX) && frame->seq_store) {
+      const auto& dims = op.field->arrayDimensions();
+      if (dims.size() > 1) {
+        // Compute multi-dimensional indices from flat index
+        uint32_t flat = i;
+        for (int d = static_cast<int>(dims.size()) - 1; d >= 0; d--) {
+          leaf.index_array[frame->saved_idx_size + d] = flat % dims[d];
+          flat /= dims[d];
+        }
+      } else {
+        leaf.index_array.back() = i;
+      }
+    }
+  };
+
+  // Structural events are emitted only for the structs that are stored.
+  // [end] is given by the DHEADER of the struct, if any; the members of a mutable
+  // struct are located up to [members_end].
+  auto callStruct = [&](const ROSField& field, uint32_t target, uint32_t return_pc, bool store,
+                        const uint8_t* end = nullptr, const uint8_t* members_end = nullptr) {
+    if (store) {
+      writer->beginStruct(field);
+      if (record) {
+        recordEvent(ShapeLayout::Event::BEGIN_STRUCT, cursor.record_origin, OTHER, 0, 0, &field);
+      }
+    }
+    uint32_t members_begin = DecodeOp::NO_TARGET;
+    if (members_end) {
+      members_begin = static_cast<uint32_t>(members.size());
+      scanMembers(members_end);
+    }
+    frames.push_back({return_pc, leaf.node, store, static_cast<uint16_t>(leaf.index_array.size()),
+                      static_cast<uint16_t>(leaf.key_suffixes.size()), 0, 0, false, end, members_begin, nullptr,
+                      false, false});
+    frame = &frames.back();
+    return target;
+  };
+
+  // Move past a builtin value that is not stored, without decoding it.
+  auto skipValue = [&](BuiltinType type) {
+    if (alignment == PrimitiveAlignment::UNSPECIFIED) {
+      (void)deserializer->deserialize(type);
+      return;
+    }
+    const size_t size = static_cast<size_t>(builtinSize(type));
+    deserializer->alignTo(primitiveSize(type));
+    if (size > deserializer->bytesLeft()) {
+      throw std::runtime_error("Buffer overrun in walkSchema");
+    }
+    deserializer->jump(size);
+  };
+
+  // A string is a sequence of bytes, prefixed by its length.
+  auto skipString = [&]() { (void)deserializer->deserializeByteSequence(); };
+
+  // Move past [count] consecutive structs with a fixed layout in a single jump.
+  // Returns false if [elem] is not such a struct.
+  auto skipFixedStructs = [&](const DecodeOp& elem, uint32_t count) -> bool {
+    if (elem.code != DecodeOp::STRUCT || elem.fixed == DecodeOp::NO_TARGET ||
+        resolve(elem.extensibility) != Extensibility::FINAL) {
+      return false;
+    }
+    const FixedStruct& fixed = program.fixed_structs[elem.fixed];
+    const size_t block_size = fixed.blockSize(alignment, xcdr2);
+    if (block_size == 0) {
+      return false;
+    }
+    const size_t block_alignment = fixed.alignment[static_cast<size_t>(alignment)];
+    const size_t stride = (block_size + block_alignment - 1) / block_alignment * block_alignment;
+    const size_t total_bytes = stride * (count - 1) + block_size;
+    deserializer->alignTo(fixed.first_size);
+    if (total_bytes > deserializer->bytesLeft()) {
+      throw std::runtime_error("Buffer overrun in walkSchema (fixed struct)");
+    }
+    deserializer->jump(total_bytes);
+    return true;
+  };
+
+  // Decode the run of fields with a fixed layout that starts with [op], if any, validating
+  // all of them with a single bounds check. Returns the number of instructions consumed, or 0.
+  // The fields are decoded one by one if they are filtered, since they may be stored differently,
+  // or if the run does not fit in the DHEADER of the struct, that may be an older version of the type.
+  auto decodeFixedRun = [&](const DecodeOp& op, bool store) -> uint32_t {
+    if (op.run == DecodeOp::NO_TARGET || all_field_flags || frame->members_begin != DecodeOp::NO_TARGET) {
+      return 0;
+    }
+    const FixedStruct& run = program.fixed_structs[op.run];
+    const uint32_t block_size = run.blockSize(alignment, xcdr2);
+    if (block_size == 0 || run.max_array_size > max_fixed_array_size) {
+      return 0;
+    }
+    if (frame->end && deserializer->getCurrentPtr() >= frame->end) {
+      return 0;
+    }
+    deserializer->alignTo(run.first_size);
+    if (frame->end && block_size > static_cast<size_t>(frame->end - deserializer->getCurrentPtr())) {
+      return 0;
+    }
+    if (block_size > deserializer->bytesLeft()) {
+      throw std::runtime_error("Buffer overrun in walkSchema (fixed run)");
+    }
+    if (store) {
+      leaf.node = frame->node;
+      if (record) {
+        recordEvent(ShapeLayout::Event::FIXED_RUN, deserializer->getCurrentPtr(), OTHER, 0, op.run);
+      }
+      writeFixedStruct(program, run, static_cast<size_t>(alignment), deserializer->getCurrentPtr(), swap, leaf, writer,
+                       scratch);
+    }
+    deserializer->jump(block_size);
+    return static_cast<uint32_t>(run.members.size());
+  };
+
+  // Write a struct with a fixed layout as a single block of memory. Returns false if it
+  // has no such layout, or if the block does not fit before [end] (if not nullptr).
+  auto decodeFixedStruct = [&](const DecodeOp& op, const uint8_t* end) -> bool {
+    if (op.fixed == DecodeOp::NO_TARGET) {
+      return false;
+    }
+    const FixedStruct& fixed = program.fixed_structs[op.fixed];
+    const uint32_t block_size = fixed.blockSize(alignment, xcdr2);
+    if (block_size == 0 || fixed.max_array_size > max_fixed_array_size) {
+      return false;
+    }
+    deserializer->alignTo(fixed.first_size);
+    if (end && block_size > static_cast<size_t>(end - deserializer->getCurrentPtr())) {
+      return false;
+    }
+    if (block_size > deserializer->bytesLeft()) {
+      throw std::runtime_error("Buffer overrun in walkSchema (fixed struct)");
+    }
+    writer->beginStruct(*op.field);
+    if (record) {
+      recordEvent(ShapeLayout::Event::FIXED_STRUCT, deserializer->getCurrentPtr(), OTHER, 0, op.fixed, op.field);
+    }
+    writeFixedStruct(program, fixed, static_cast<size_t>(alignment), deserializer->getCurrentPtr(), swap, leaf, writer,
+                     scratch);
+    deserializer->jump(block_size);
+    writer->endStruct();
+    return true;
+  };
+
+  uint32_t pc = cursor.pc;
+  cursor.suspend = false;
+
+  while (true) {
+    const DecodeOp& op = ops[pc];
+
+    // Fields that are not elements of a sequence select their own node.
+    // An absent @optional field, an absent member of a mutable struct, or a member after
+    // the end of an appendable struct (sent by an older version of the type) is skipped
+    // entirely, unless a predicate needs its value.
+    bool store = frame->seq_store;
+    uint8_t field_flags = FIELD_STORED | FIELD_ENTIRE;
+    if (op.hasFlag(DecodeOp::IN_SEQUENCE)) {
+      field_flags = flagsOf(leaf.node);
+    } else if (op.code <= DecodeOp::BEGIN_SEQUENCE) {
+      bool present = true;
+      if (frame->members_begin != DecodeOp::NO_TARGET) {
+        const uint8_t* value = findMember(op.member_id);
+        present = (value != nullptr);
+        if (present) {
+          seekTo(value);
+        }
+      } else if (frame->end && deserializer->getCurrentPtr() >= frame->end) {
+        present = false;
+      } else if (op.hasFlag(DecodeOp::OPTIONAL)) {
+        present = deserializer->hasOptionalMember();
+      }
+      if (!present) {
+        if (all_field_flags && op.code >= DecodeOp::SCALAR && op.child < frame->node->children().size() &&
+            (flagsOf(frame->node->child(op.child)) & (FIELD_PREDICATE | FIELD_HAS_PREDICATE))) {
+          return filterOut();
+        }
+        pc += op.length;
+        continue;
+      }
+      if (op.code >= DecodeOp::SCALAR) {
+        store = enterField(op, field_flags);
+      }
+    }
+
+    switch (op.code) {
+      case DecodeOp::KEY_STRING: {
+        if (!frame->store) {
+          skipString();
+          pc++;
+          break;
+        }
+        const std::string_view key = deserializer->deserializeStringView();
+        pushKeySuffix(leaf, key.data(), static_cast<int>(key.size()));
+        frame->saved_key_suffix_size++;
+        pc++;
+      } break;
+
+      case DecodeOp::KEY_ENUM: {
+        if (!frame->store) {
+          skipValue(INT32);
+          pc++;
+          break;
+        }
+        int32_t enum_int = deserializer->template read<int32_t>();
+        const std::string* enum_name = program.enums[op.target].find(enum_int);
+        if (enum_name) {
+          pushKeySuffix(leaf, enum_name->data(), static_cast<int>(enum_name->size()));
+        } else {
+          int len = snprintf(buf, sizeof(buf), "%d", enum_int);
+          pushKeySuffix(leaf, buf, len);
+        }
+        frame->saved_key_suffix_size++;
+        pc++;
+      } break;
+
+      case DecodeOp::KEY_BUILTIN: {
+        if (!frame->store) {
+          skipValue(op.type);
+          pc++;
+          break;
+        }
+        Variant var = deserializer->deserialize(op.type);
+        int len = snprintf(buf, sizeof(buf), "%s:%ld", op.field->name().c_str(), (long)var.convert<int64_t>());
+        pushKeySuffix(leaf, buf, len);
+        frame->saved_key_suffix_size++;
+        pc++;
+      } break;
+
+      case DecodeOp::SCALAR: {
+        if (const uint32_t run_length = decodeFixedRun(op, store)) {
+          pc += run_length;
+          break;
+        }
+        if (field_flags & FIELD_PREDICATE) {
+          const Variant value = deserializer->deserialize(op.type);
+          if (!predicateHolds(value)) {
+            return filterOut();
+          }
+          if (store) {
+            writer->writeValue(leaf, value);
+          }
+        } else if (store) {
+          writeDecodedValue(writer, leaf, op.type, deserializer);
+          if (record) {
+            recordEvent(ShapeLayout::Event::VALUE, deserializer->getCurrentPtr() - builtinSize(op.type), op.type);
+          }
+        } else {
+          skipValue(op.type);
+        }
+        pc++;
+      } break;
+
+      case DecodeOp::STRING: {
+        const uint8_t* chars = record ? recordPrefix() : nullptr;
+        if (store || (field_flags & FIELD_PREDICATE)) {
+          const std::string_view value = deserializer->deserializeStringView();
+          if ((field_flags & FIELD_PREDICATE) && !predicateHolds(value)) {
+            return filterOut();
+          }
+          if (store) {
+            writeStringView(writer, leaf, value);
+            if (record) {
+              recordEvent(ShapeLayout::Event::STRING, chars, STRING, static_cast<uint32_t>(value.size()));
+            }
+          }
+        } else {
+          skipString();
+        }
+        pc++;
+      } break;
+
+      case DecodeOp::ENUM: {
+        if (store || (field_flags & FIELD_PREDICATE)) {
+          int32_t enum_int = deserializer->template read<int32_t>();
+          const std::string* enum_name = program.enums[op.target].find(enum_int);
+          if ((field_flags & FIELD_PREDICATE) && !predicateHolds(enum_int, enum_name ? *enum_name : empty_str)) {
+            return filterOut();
+          }
+          if (store) {
+            writer->writeEnum(leaf, enum_int, enum_name ? *enum_name : empty_str);
+            if (record) {
+              recordEvent(ShapeLayout::Event::ENUM, deserializer->getCurrentPtr() - sizeof(int32_t), INT32, 0,
+                          op.target);
+            }
+          }
+        } else {
+          skipValue(INT32);
+        }
+        pc++;
+      } break;
+
+      case DecodeOp::UNION: {
+        const Extensibility extensibility = resolve(op.extensibility);
+        const uint8_t* union_end = nullptr;
+        size_t member_size = 0;
+        if (extensibility != Extensibility::FINAL) {
+          union_end = readDHeader();
+          if (!store && !(field_flags & FIELD_HAS_PREDICATE)) {
+            seekTo(union_end);
+            pc++;
+            break;
+          }
+          if (extensibility == Extensibility::MUTABLE) {
+            (void)readMemberHeader(member_size);
+          }
+        }
+        const DecodeUnion& compiled = program.unions[op.target];
+        const int64_t discriminant =
+            (compiled.discriminant_type == OTHER)
+                ? deserializer->template read<int32_t>()
+                : deserializer->deserialize(compiled.discriminant_type).template convert<int64_t>();
+        const DecodeUnion::Case* active_case = &compiled.activeCase(discriminant);
+
+        pc++;
+        if (active_case->field) {
+          if (extensibility == Extensibility::MUTABLE) {
+            (void)readMemberHeader(member_size);
+          }
+          const ROSType& case_type = active_case->field->type;
+          if (store) {
+            writer->beginUnion(*op.field, active_case->field->field_name);
+          }
+          if (case_type.typeID() == STRING) {
+            if (store) {
+              writeStringView(writer, leaf, deserializer->deserializeStringView());
+            } else {
+              skipString();
+            }
+          } else if (case_type.isBuiltin()) {
+            if (store) {
+              writeDecodedValue(writer, leaf, case_type.typeID(), deserializer);
+            } else {
+              skipValue(case_type.typeID());
+            }
+          } else if (active_case->target != DecodeOp::NO_TARGET) {
+            const Extensibility case_extensibility = resolve(active_case->extensibility);
+            const uint8_t* struct_end = (case_extensibility != Extensibility::FINAL) ? readDHeader() : nullptr;
+            // the members of the case are written under its node, a child of the union
+            const ROSField* case_field = op.field;
+            if (active_case->field->child < leaf.node->children().size()) {
+              leaf.node = leaf.node->child(active_case->field->child);
+              case_field = leaf.node->value();
+            }
+            pc = callStruct(*case_field, active_case->target, pc, store, union_end ? union_end : struct_end,
+                            (case_extensibility == Extensibility::MUTABLE) ? struct_end : nullptr);
+            frame->union_case = store;
+            break;
+          }
+          if (store) {
+            writer->endUnion();
+          }
+        }
+        if (union_end) {
+          seekTo(union_end);
+        }
+      } break;
+
+      case DecodeOp::STRUCT: {
+        if (const uint32_t run_length = decodeFixedRun(op, store)) {
+          pc += run_length;
+          break;
+        }
+        const Extensibility extensibility = resolve(op.extensibility);
+        if (extensibility != Extensibility::FINAL) {
+          // The DHEADER gives the size of the struct: a struct that is not stored is
+          // skipped in constant time, whatever it contains.
+          const uint8_t* end = readDHeader();
+          if (!store && !(field_flags & FIELD_HAS_PREDICATE)) {
+            seekTo(end);
+            pc++;
+            break;
+          }
+          // The members of an appendable struct are in order, followed by the ones
+          // appended by newer versions of the type.
+          if (extensibility == Extensibility::APPENDABLE && store && (field_flags & FIELD_ENTIRE) &&
+              decodeFixedStruct(op, end)) {
+            seekTo(end);
+            pc++;
+            break;
+          }
+          pc = callStruct(*op.field, op.target, pc + 1, store, end,
+                          (extensibility == Extensibility::MUTABLE) ? end : nullptr);
+          break;
+        }
+        if (!store && !(field_flags & FIELD_HAS_PREDICATE) && skipFixedStructs(op, 1)) {
+          pc++;
+          break;
+        }
+        // Fast path: a struct with a fixed layout is a single block of memory,
+        // if all its fields are stored.
+        if (store && (field_flags & FIELD_ENTIRE) && decodeFixedStruct(op, nullptr)) {
+          pc++;
+          break;
+        }
+        pc = callStruct(*op.field, op.target, pc + 1, store);
+      } break;
+
+      case DecodeOp::BEGIN_SEQUENCE: {
+        // XCDR2: arrays of elements that are not primitive are preceded by a DHEADER
+        const uint8_t* seq_end = nullptr;
+        if (op.hasFlag(DecodeOp::DELIMITED) && xcdr2 != Extensibility::UNSPECIFIED) {
+          seq_end = readDHeader();
+        }
+        if (record && op.array_size == -1) {
+          recordPrefix();
+        }
+        uint32_t array_size =
+            (op.array_size == -1) ? deserializer->deserializeUInt32() : static_cast<uint32_t>(op.array_size);
+
+        if (op.hasFlag(DecodeOp::PUSH_INDEX)) {
+          const size_t dims = std::max<size_t>(1, op.field->arrayDimensions().size());
+          for (size_t d = 0; d < dims; d++) {
+            leaf.index_array.push_back(0);
+          }
+        }
+
+        if (op.hasFlag(DecodeOp::BYTE_ELEMENTS) && array_size > options.max_byte_array_size) {
+          if (array_size > deserializer->bytesLeft()) {
+            throw std::runtime_error("Buffer overrun in walkSchema (blob)");
+          }
+          if (store) {
+            writer->writeBlob(leaf, Span<const uint8_t>(deserializer->getCurrentPtr(), array_size));
+            if (record) {
+              recordEvent(ShapeLayout::Event::BLOB, deserializer->getCurrentPtr(), BYTE, array_size);
+            }
+          }
+          deserializer->jump(array_size);
+          restoreLeaf();
+          pc += op.length;
+          break;
+        }
+        if (array_size > max_array_size) {
+          if (options.discard_large_arrays) {
+            store = false;
+          }
+          entire_message_parsed = false;
+        }
+
+        if (array_size == 0 || (seq_end && !store)) {
+          if (seq_end) {
+            seekTo(seq_end);
+          }
+          if (store) {
+            beginArray(*op.field, 0);
+            endArray();
+          }
+          restoreLeaf();
+          pc += op.length;
+          break;
+        }
+
+        // Builtin elements are contiguous: validate the whole array once and
+        // write the elements that are stored with a single writeArray.
+        if (op.hasFlag(DecodeOp::BULK) && alignment != PrimitiveAlignment::UNSPECIFIED) {
+          const size_t elem_size = static_cast<size_t>(builtinSize(op.type));
+          deserializer->alignTo(primitiveSize(op.type));
+          const size_t array_bytes = elem_size * array_size;
+          if (array_bytes > deserializer->bytesLeft()) {
+            throw std::runtime_error("Buffer overrun in walkSchema (array)");
+          }
+          if (store) {
+            const uint32_t stored = std::min(array_size, max_array_size);
+            beginArray(*op.field, stored);
+            writeBulkArray(writer, leaf, op.type, deserializer->getCurrentPtr(), stored, swap, scratch);
+            if (record) {
+              recordEvent(ShapeLayout::Event::ARRAY, deserializer->getCurrentPtr(), op.type, stored);
+            }
+            endArray();
+          }
+          deserializer->jump(array_bytes);
+          restoreLeaf();
+          pc += op.length;
+          break;
+        }
+
+        if (!store && skipFixedStructs(ops[pc + 1], array_size)) {
+          restoreLeaf();
+          pc += op.length;
+          break;
+        }
+
+        frame->seq_index = 0;
+        frame->seq_size = array_size;
+        frame->seq_store = store;
+        frame->seq_end = seq_end;
+        frame->seq_open = store;
+        if (store) {
+          beginArray(*op.field, std::min(array_size, max_array_size));
+        }
+        beginElement(ops[pc + 2]);
+        pc++;
+      } break;
+
+      case DecodeOp::END_SEQUENCE: {
+        if (++frame->seq_index < frame->seq_size) {
+          beginElement(op);
+          // The elements left after max_array_size may be jumped over at once.
+          if (!frame->seq_store && frame->seq_end) {
+            seekTo(frame->seq_end);
+            endSequence();
+            pc++;
+          } else if (!frame->seq_store && skipFixedStructs(ops[pc - 1], frame->seq_size - frame->seq_index)) {
+            endSequence();
+            pc++;
+          } else {
+            pc--;
+          }
+        } else {
+          endSequence();
+          pc++;
+        }
+      } break;
+
+      case DecodeOp::RETURN: {
+        leaf.node = frame->node;
+        // the members appended by newer versions of the type are skipped
+        if (frame->end) {
+          if (frame->members_begin == DecodeOp::NO_TARGET && deserializer->getCurrentPtr() > frame->end) {
+            throw std::runtime_error("Buffer overrun in walkSchema: the struct exceeds its DHEADER");
+          }
+          seekTo(frame->end);
+          if (frame->members_begin != DecodeOp::NO_TARGET) {
+            members.resize(frame->members_begin);
+          }
+        }
+        if (frames.size() == 1) {
+          cursor.finished = true;
+          cursor.entire_message_parsed = entire_message_parsed;
+          return entire_message_parsed;
+        }
+        pc = frame->return_pc;
+        const bool stored = frame->store;
+        const bool union_case = frame->union_case;
+        frames.pop_back();
+        frame = &frames.back();
+        if (stored) {
+          writer->endStruct();
+          if (record) {
+            recordEvent(ShapeLayout::Event::END_STRUCT, cursor.record_origin, OTHER);
+          }
+          if (union_case) {
+            writer->endUnion();
+          }
+        }
+        // @key brackets pushed by the struct are rolled back with the field.
+        leaf.key_suffixes.resize(frame->saved_key_suffix_size);
+      } break;
+    }
+
+    if (cursor.suspend) {
+      cursor.pc = pc;
+      cursor.entire_message_parsed = entire_message_parsed;
+      return entire_message_parsed;
+    }
+  }
+}
+
+// A NanoCDR_Deserializer is executed with the decoder selected by its reset(), so that
+// the instructions don't check which one is in use for each value.
+template <class WriterT>
+bool ResumeDecodeProgram(const DecodeProgram& program, const DecodeOptions& options, DecodeCursor& cursor,
+                         FieldLeaf& leaf, NanoCDR_Deserializer* deserializer, WriterT* writer) {
+  return deserializer->visitDecoder(
+      [&](auto& reader) { return ResumeDecodeProgram(program, options, cursor, leaf, &reader, writer); });
+}
+
+// Start decoding [buffer]. The XCDR1 optional members need the parameter-list
+// decoder of NanoCDR_Deserializer, that reset() selects if the program has any.
+template <class DeserializerT>
+void InitDeserializer(const DecodeProgram& program, Span<const uint8_t> buffer, DeserializerT* deserializer) {
+  if constexpr (std::is_same_v<DeserializerT, NanoCDR_Deserializer>) {
+    deserializer->setParameterList(program.has_optional_members);
+  } else if constexpr (std::is_same_v<DeserializerT, Deserializer>) {
+    if (auto* cdr_deserializer = dynamic_cast<NanoCDR_Deserializer*>(deserializer)) {
+      cdr_deserializer->setParameterList(program.has_optional_members);
+    }
+  }
+  deserializer->init(buffer);
+}
+
+// Executes the whole DecodeProgram, see ResumeDecodeProgram.
+template <class DeserializerT, class WriterT>
+bool RunDecodeProgram(const DecodeProgram& program, const DecodeOptions& options, FieldLeaf& leaf,
+                      DeserializerT* deserializer, WriterT* writer) {
+  DecodeCursor cursor;
+  return ResumeDecodeProgram(program, options, cursor, leaf, deserializer, writer);
+}
+
+// Invoke the writer as the DecodeProgram did for the message of [layout],
+// loading the values of [buffer] at the recorded offsets.
+// The buffer must match the layout (see ShapeLayout::matches()).
+template <class WriterT>
+bool ReplayShapeLayout(const DecodeProgram& program, const ShapeLayout& layout, Span<const uint8_t> buffer,
+                       WriterT* writer) {
+  const uint8_t* origin = buffer.data();
+  const bool swap = layout.swap;
+  std::vector<uint8_t> scratch;
+  static const std::string empty_str;
+  FieldLeaf leaf;
+
+  auto leafOf = [&](const ShapeLayout::Event& event) -> FieldLeaf& {
+    const uint16_t* indices = layout.indices.data() + event.index_begin;
+    leaf.node = event.node;
+    leaf.index_array.clear();
+    leaf.index_array.append(indices, indices + event.index_count);
+    return leaf;
+  };
+
+  for (const auto& event : layout.events) {
+    const uint8_t* ptr = origin + event.offset;
+    switch (event.kind) {
+      case ShapeLayout::Event::VALUE:
+        writeLoadedValue(writer, leafOf(event), event.type, ptr, swap);
+        break;
+      case ShapeLayout::Event::STRING:
+        writeStringView(writer, leafOf(event), std::string_view(reinterpret_cast<const char*>(ptr), event.count));
+        break;
+      case ShapeLayout::Event::ENUM: {
+        const int32_t enum_int = loadPrimitive<int32_t>(ptr, swap);
+        const std::string* enum_name = program.enums[event.target].find(enum_int);
+        writer->writeEnum(leafOf(event), enum_int, enum_name ? *enum_name : empty_str);
+      } break;
+      case ShapeLayout::Event::ARRAY:
+        writeBulkArray(writer, leafOf(event), event.type, ptr, event.count, swap, scratch);
+        break;
+      case ShapeLayout::Event::BLOB:
+        writer->writeBlob(leafOf(event), Span<const uint8_t>(ptr, event.count));
+        break;
+      case ShapeLayout::Event::FIXED_STRUCT:
+        writer->beginStruct(*event.field);
+        writeFixedStruct(program, program.fixed_structs[event.target], static_cast<size_t>(layout.alignment), ptr,
+                         swap, leafOf(event), writer, scratch);
+        writer->endStruct();
+        break;
+      case ShapeLayout::Event::FIXED_RUN:
+        // the leaf has the node of the struct that contains the run
+        writeFixedStruct(program, program.fixed_structs[event.target], static_cast<size_t>(layout.alignment), ptr,
+                         swap, leafOf(event), writer, scratch);
+        break;
+      case ShapeLayout::Event::BEGIN_STRUCT:
+        writer->beginStruct(*event.field);
+        break;
+      case ShapeLayout::Event::END_STRUCT:
+        writer->endStruct();
+        break;
+      case ShapeLayout::Event::BEGIN_ARRAY:
+        writer->beginArray(*event.field, event.count);
+        break;
+      case ShapeLayout::Event::END_ARRAY:
+        writer->endArray();
+        break;
+    }
+  }
+  return layout.entire_message_parsed;
+}
+
+// The ShapeLayouts of the last messages decoded by a Parser. The layouts are
+// immutable once stored, and the cache can be used by several threads at the
+// same time: find() reads an immutable snapshot of the list, without locking,
+// and store() publishes a new snapshot, under a mutex that serializes the writers.
+// The snapshots that are replaced are deleted once no find() is running.
+class ShapeCache {
+ public:
+  ShapeCache() = default;
+
+  ShapeCache(ShapeCache&& other) noexcept {
+    *this = std::move(other);
+  }
+
+  // Not thread safe, like the other changes of the configuration.
+  ShapeCache& operator=(ShapeCache&& other) noexcept {
+    _capacity = other._capacity;
+    _snapshots = std::move(other._snapshots);
+    _snapshot.store(other._snapshot.exchange(nullptr));
+    _clock = other._clock.load(std::memory_order_relaxed);
+    _hits = other._hits.load(std::memory_order_relaxed);
+    _misses = other._misses.load(std::memory_order_relaxed);
+    return *this;
+  }
+
+  // Maximum number of layouts; 0 disables the cache.
+  void setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(_store_mutex);
+    _capacity = capacity;
+    publish(nullptr);
+    _hits = 0;
+    _misses = 0;
+  }
+
+  size_t capacity() const {
+    return _capacity;
+  }
+
+  // Forget the layouts, because the DecodeOptions changed.
+  void clear() {
+    std::lock_guard<std::mutex> lock(_store_mutex);
+    publish(nullptr);
+  }
+
+  // The layout that matches [buffer], or nullptr.
+  std::shared_ptr<const ShapeLayout> find(Span<const uint8_t> buffer, PrimitiveAlignment alignment, bool swap,
+                                          Extensibility xcdr2) {
+    std::shared_ptr<const ShapeLayout> found;
+    // sequentially consistent with publish(): a snapshot seen here is not deleted before the decrement
+    _readers.fetch_add(1);
+    if (const Snapshot* snapshot = _snapshot.load()) {
+      for (const auto& entry : *snapshot) {
+        if (entry->layout->matches(buffer, alignment, swap, xcdr2)) {
+          entry->last_used.store(_clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+          found = entry->layout;
+          break;
+        }
+      }
+    }
+    _readers.fetch_sub(1);
+    (found ? _hits : _misses).fetch_add(1, std::memory_order_relaxed);
+    return found;
+  }
+
+  // Empty layout, to be filled by the DecodeProgram and then passed to store().
+  static std::shared_ptr<ShapeLayout> startRecording(PrimitiveAlignment alignment, bool swap, Extensibility xcdr2) {
+    auto layout = std::make_shared<ShapeLayout>();
+    layout->alignment = alignment;
+    layout->swap = swap;
+    layout->xcdr2 = xcdr2;
+    return layout;
+  }
+
+  // Add a recorded layout, replacing the least recently used one if the cache is full.
+  void store(std::shared_ptr<const ShapeLayout> layout) {
+    std::lock_guard<std::mutex> lock(_store_mutex);
+    if (_capacity == 0) {
+      return;
+    }
+    auto entry = std::make_shared<Entry>();
+    entry->layout = std::move(layout);
+    entry->last_used = _clock.fetch_add(1, std::memory_order_relaxed);
+
+    auto snapshot = std::make_unique<Snapshot>();
+    if (const Snapshot* current = _snapshot.load()) {
+      *snapshot = *current;
+    }
+    if (snapshot->size() == _capacity) {
+      auto oldest = std::min_element(snapshot->begin(), snapshot->end(), [](const auto& a, const auto& b) {
+        return a->last_used.load(std::memory_order_relaxed) < b->last_used.load(std::memory_order_relaxed);
+      });
+      snapshot->erase(oldest);
+    }
+    snapshot->insert(snapshot->begin(), std::move(entry));
+    publish(std::move(snapshot));
+  }
+
+  size_t hits() const {
+    return _hits.load(std::memory_order_relaxed);
+  }
+
+  size_t misses() const {
+    return _misses.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Entry {
+    std::shared_ptr<const ShapeLayout> layout;
+    // value of _clock when the layout was last stored or found
+    std::atomic<uint64_t> last_used = 0;
+  };
+  // the most recently stored layout first
+  using Snapshot = std::vector<std::shared_ptr<Entry>>;
+
+  // Replace the current snapshot, under _store_mutex. The previous ones may still be read
+  // by a find(): they are deleted by the first publish() that sees no reader.
+  void publish(std::unique_ptr<const Snapshot> snapshot) {
+    const Snapshot* current = snapshot.get();
+    if (snapshot) {
+      _snapshots.push_back(std::move(snapshot));
+    }
+    _snapshot.store(current);
+    if (_readers.load() == 0) {
+      _snapshots.erase(std::remove_if(_snapshots.begin(), _snapshots.end(),
+                                      [current](const auto& kept) { return kept.get() != current; }),
+                       _snapshots.end());
+    }
+  }
+
+  size_t _capacity = 0;
+  std::mutex _store_mutex;
+  // the published snapshot, and the replaced ones that are not deleted yet
+  std::vector<std::unique_ptr<const Snapshot>> _snapshots;
+  std::atomic<const Snapshot*> _snapshot = nullptr;
+  // number of find() running
+  std::atomic<uint32_t> _readers = 0;
+  std::atomic<uint64_t> _clock = 0;
+  std::atomic<size_t> _hits = 0;
+  std::atomic<size_t> _misses = 0;
+};
+
+}  // namespace details
+
+}  // namespace RosMsgParser
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RosMsgParser {
+
+/**
+ * @brief Runs independent tasks on a fixed set of workers, see Parser::deserializeBatch().
+ *
+ * Each worker has an index in [0, concurrency()), that the tasks can use to
+ * select their own resources (deserializer, buffers, etc.): two tasks with the
+ * same worker index are never executed at the same time.
+ */
+class Executor {
+ public:
+  /// Invoked on the items [begin, end) by the worker [worker].
+  using RangeTask = std::function<void(size_t worker, size_t begin, size_t end)>;
+
+  virtual ~Executor() = default;
+
+  /// Number of workers.
+  virtual size_t concurrency() const = 0;
+
+  /// Split the items [0, count) into ranges and execute [task] on all of them,
+  /// returning when they are done. The first exception thrown by a task is
+  /// rethrown here, after the other tasks are done.
+  virtual void parallelFor(size_t count, const RangeTask& task) = 0;
+};
+
+/// Executes the tasks in the calling thread.
+class InlineExecutor final : public Executor {
+ public:
+  size_t concurrency() const override {
+    return 1;
+  }
+
+  void parallelFor(size_t count, const RangeTask& task) override {
+    if (count > 0) {
+      task(0, 0, count);
+    }
+  }
+};
+
+/// A pool of threads that is created once and reused by each parallelFor().
+/// The calling thread takes part in the work, as worker 0.
+class ThreadPoolExecutor final : public Executor {
+ public:
+  /// @param num_workers  number of workers, including the calling thread (0: one per core).
+  explicit ThreadPoolExecutor(size_t num_workers = 0);
+
+  ~ThreadPoolExecutor() override;
+
+  ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+  ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+  size_t concurrency() const override {
+    return _threads.size() + 1;
+  }
+
+  /// Not reentrant: a single parallelFor() can run at a time.
+  void parallelFor(size_t count, const RangeTask& task) override;
+
+ private:
+  void workerLoop(size_t worker);
+  // Execute ranges of the current job until none is left.
+  void work(size_t worker);
+
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _job_available;
+  std::condition_variable _job_done;
+  bool _stop = false;
+
+  // current job, protected by _mutex
+  const RangeTask* _task = nullptr;
+  size_t _count = 0;
+  size_t _chunk = 1;
+  size_t _next = 0;
+  size_t _generation = 0;
+  size_t _busy_workers = 0;
+  std::exception_ptr _error;
+};
+
+}  // namespace RosMsgParser
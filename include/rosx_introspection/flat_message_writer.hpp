@@ -1,31 +1,149 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 
 #include "rosx_introspection/message_writer.hpp"
+#include "rosx_introspection/ros_message.hpp"
 
 namespace RosMsgParser {
 
-struct FlatMessage;
-class Parser;
+struct FlatMessage {
+  std::shared_ptr<MessageSchema> schema;
 
-class FlatMessageWriter : public MessageWriter {
+  /// List of all those parsed fields that can be represented by a
+  /// builtin value different from "string".
+  std::vector<std::pair<FieldLeaf, Variant>> value;
+
+  /// Store "blobs", i.e all those fields which are vectors of BYTES (AKA uint8_t),
+  /// where the vector size is greater than the argument [max_array_size].
+  std::vector<std::pair<FieldLeaf, Span<const uint8_t>>> blob;
+
+  std::vector<std::vector<uint8_t>> blob_storage;
+
+  /// The message was rejected by a predicate, see Parser::setFieldPredicates().
+  bool filtered_out = false;
+};
+
+/// The methods invoked for each value are defined inline, so that the
+/// instance Parser::walkSchema<DeserializerT, FlatMessageWriter> can fold them
+/// into the decoding loop.
+class FlatMessageWriter final : public MessageWriter {
  public:
   FlatMessageWriter(FlatMessage* flat, int blob_policy);
-  ~FlatMessageWriter() override;
 
   FlatMessageWriter(const FlatMessageWriter&) = delete;
   FlatMessageWriter& operator=(const FlatMessageWriter&) = delete;
 
-  void writeValue(const FieldLeaf& leaf, const Variant& value) override;
-  void writeString(const FieldLeaf& leaf, const std::string& str) override;
-  void writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& name) override;
+  void writeValue(const FieldLeaf& leaf, const Variant& value) override {
+    auto& entry = nextValue();
+    entry.first = leaf;
+    entry.second = value;
+  }
+
+  void writeBool(const FieldLeaf& leaf, bool value) override {
+    writeTyped(leaf, value);
+  }
+  void writeChar(const FieldLeaf& leaf, char value) override {
+    writeTyped(leaf, value);
+  }
+  void writeInt8(const FieldLeaf& leaf, int8_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeInt16(const FieldLeaf& leaf, int16_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeInt32(const FieldLeaf& leaf, int32_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeInt64(const FieldLeaf& leaf, int64_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeUInt8(const FieldLeaf& leaf, uint8_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeUInt16(const FieldLeaf& leaf, uint16_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeUInt32(const FieldLeaf& leaf, uint32_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeUInt64(const FieldLeaf& leaf, uint64_t value) override {
+    writeTyped(leaf, value);
+  }
+  void writeFloat32(const FieldLeaf& leaf, float value) override {
+    writeTyped(leaf, value);
+  }
+  void writeFloat64(const FieldLeaf& leaf, double value) override {
+    writeTyped(leaf, value);
+  }
+
+  void writeString(const FieldLeaf& leaf, const std::string& str) override {
+    auto& entry = nextValue();
+    entry.first = leaf;
+    entry.second = str;
+  }
+
+  void writeString(const FieldLeaf& leaf, std::string_view str) override {
+    auto& entry = nextValue();
+    entry.first = leaf;
+    const auto* chars = reinterpret_cast<const uint8_t*>(str.data());
+    if (!_referenced.empty() && chars >= _referenced.data() &&
+        chars + str.size() <= _referenced.data() + _referenced.size()) {
+      entry.second.assignStringReference(str);
+    } else {
+      entry.second.assign(str.data(), str.size());
+    }
+  }
+
+  /// Store the strings that are part of [buffer] as references to it, instead of copies
+  /// (see Parser::STORE_STRING_AS_REFERENCE). [buffer] must outlive the FlatMessage.
+  void referenceStrings(Span<const uint8_t> buffer) {
+    _referenced = buffer;
+  }
+
+  void writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& /*name*/) override {
+    writeTyped(leaf, value);
+  }
+
+  void writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) override {
+    if (_flat->value.size() < _value_index + count) {
+      _flat->value.resize(std::max(_value_index + count, _flat->value.size() * 2));
+    }
+    auto* entries = &_flat->value[_value_index];
+    _value_index += count;
+    ForEachArrayValue(type, raw, count, [&](size_t index, const Variant& value) {
+      entries[index].first = leaf;
+      entries[index].first.index_array.back() = static_cast<uint16_t>(index);
+      entries[index].second = value;
+    });
+  }
+
   void writeBlob(const FieldLeaf& leaf, Span<const uint8_t> data) override;
   void finish() override;
 
  private:
-  struct Impl;
-  std::unique_ptr<Impl> _impl;
+  // assign the value to the Variant in place, instead of copying a temporary one
+  template <typename T>
+  void writeTyped(const FieldLeaf& leaf, T value) {
+    auto& entry = nextValue();
+    entry.first = leaf;
+    entry.second.assign(value);
+  }
+
+  std::pair<FieldLeaf, Variant>& nextValue() {
+    if (_flat->value.size() <= _value_index) {
+      _flat->value.resize(std::max(size_t(32), _flat->value.size() * 2));
+    }
+    return _flat->value[_value_index++];
+  }
+
+  FlatMessage* _flat;
+  int _blob_policy;
+  Span<const uint8_t> _referenced;
+  size_t _value_index = 0;
+  size_t _blob_index = 0;
+  size_t _blob_storage_index = 0;
 };
 
 }  // namespace RosMsgParser
@@ -36,7 +36,7 @@ ENUM_DCL        <- KW_ENUM IDENTIFIER OPEN_BRACE ENUMERATOR (COMMA ENUMERATOR)*
 ENUMERATOR      <- ANNOTATION* IDENTIFIER (EQUAL_OP CONST_EXPR)?
 
 # Unions
-UNION_DCL       <- KW_UNION IDENTIFIER WS? KW_SWITCH OPEN_PAREN SWITCH_TYPE CLOSE_PAREN
+UNION_DCL       <- ANNOTATION* KW_UNION IDENTIFIER WS? KW_SWITCH OPEN_PAREN SWITCH_TYPE CLOSE_PAREN
                    OPEN_BRACE CASE+ CLOSE_BRACE
 SWITCH_TYPE     <- TYPE_SPEC
 CASE            <- CASE_LABEL+ ANNOTATION* TYPE_SPEC DECLARATOR SEMICOLON
@@ -9,6 +9,13 @@
 
 namespace RosMsgParser {
 
+/// Extensibility of an IDL struct or union (@final, @appendable, @mutable).
+/// In the XCDR2 encodings, it determines the headers that precede the type:
+/// none (FINAL), a DHEADER with its size (APPENDABLE), or a DHEADER and an
+/// EMHEADER before each member (MUTABLE). The types without annotation take
+/// the extensibility implied by the encapsulation of the stream.
+enum class Extensibility : uint8_t { UNSPECIFIED, FINAL, APPENDABLE, MUTABLE };
+
 struct EnumValue {
   std::string name;
   int32_t value = 0;
@@ -36,6 +43,11 @@ struct UnionCaseField {
   std::string field_name;
   bool is_array = false;
   int array_size = 1;  // 1=scalar, -1=sequence, >1=fixed array
+  /// Position of the case among the cases of the union; the labels of a case share it.
+  uint16_t declaration = 0;
+  /// Struct case: index of its node among the children of the union field in the
+  /// FieldTree. The labels of a case share the node.
+  uint16_t child = 0;
 };
 
 struct DiscriminatedUnion {
@@ -44,6 +56,7 @@ struct DiscriminatedUnion {
   // Key: discriminant value as string (enum name or integer)
   std::unordered_map<std::string, UnionCaseField> cases;
   std::optional<UnionCaseField> default_case;
+  Extensibility extensibility = Extensibility::UNSPECIFIED;
 };
 
 struct TypedefAlias {
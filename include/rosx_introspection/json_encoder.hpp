@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "rosx_introspection/ros_message.hpp"
+#include "rosx_introspection/serializer.hpp"
+
+namespace RosMsgParser {
+
+/**
+ * @brief Index of each name of a set, found with a perfect hash: the seed of the
+ * hash is chosen at construction so that no two names share a slot. A lookup
+ * hashes the key once and compares it with a single name.
+ */
+class NameTable {
+ public:
+  static constexpr uint16_t NOT_FOUND = 0xFFFF;
+
+  /// The names must be unique, and their characters must outlive the table.
+  void build(std::vector<std::string_view> names);
+
+  uint16_t find(std::string_view name) const {
+    if (_slots.empty()) {
+      return NOT_FOUND;
+    }
+    const uint16_t index = _slots[hash(name, _seed) & _mask];
+    return (index != NOT_FOUND && _names[index] == name) ? index : NOT_FOUND;
+  }
+
+  static uint32_t hash(std::string_view name, uint32_t seed) {
+    // FNV-1a, with a final mix: the low bits select the slot
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : name) {
+      h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    return h ^ (h >> 13);
+  }
+
+ private:
+  std::vector<std::string_view> _names;
+  std::vector<uint16_t> _slots;
+  uint32_t _seed = 0;
+  uint32_t _mask = 0;
+};
+
+/**
+ * @brief A field of a JsonEncoder::Struct, or a case of a JsonEncoder::Union.
+ */
+struct JsonField {
+  enum Kind : uint8_t {
+    SCALAR,  // builtin value, see `type`
+    STRING,  // string
+    TIME,    // TIME or DURATION: an object {"secs": ..., "nsecs": ...}
+    ENUM,    // integer or name of an enumerator, encoded as INT32
+    UNION,   // object with a single member, the active case
+    STRUCT   // object
+  };
+  static constexpr uint32_t NO_TARGET = 0xFFFFFFFF;
+
+  std::string_view name;
+  Kind kind = SCALAR;
+  BuiltinType type = OTHER;
+  bool is_array = false;
+  bool is_optional = false;
+  /// Number of elements of a fixed array, or -1 for a sequence.
+  int32_t array_size = 1;
+  /// Index in JsonEncoder::structs, unions or enums. NO_TARGET if the type of a
+  /// STRUCT is missing in the library.
+  uint32_t target = NO_TARGET;
+};
+
+/**
+ * @brief JsonEncoder is the form of a MessageSchema used by Parser::serializeFromJson().
+ *
+ * It is compiled once per Parser, like the DecodeProgram: every message type
+ * reached from the root becomes a Struct, with its non-constant fields in the
+ * order of the CDR stream and a NameTable to find them by their JSON key.
+ */
+struct JsonEncoder {
+  using Ptr = std::shared_ptr<const JsonEncoder>;
+
+  struct Struct {
+    const ROSMessage* msg = nullptr;
+    std::vector<JsonField> fields;
+    NameTable names;
+  };
+
+  struct Union {
+    const DiscriminatedUnion* definition = nullptr;
+    /// INT32 if the discriminant is an enum.
+    BuiltinType discriminant_type = INT32;
+    /// One per case name, by increasing discriminant; the default case, if any, is the last one.
+    std::vector<JsonField> cases;
+    /// Value of the discriminant that selects each case.
+    std::vector<int64_t> discriminants;
+    NameTable names;
+  };
+
+  struct Enum {
+    /// Wire value of each enumerator.
+    std::vector<int32_t> values;
+    NameTable names;
+  };
+
+  std::vector<Struct> structs;
+  std::vector<Union> unions;
+  std::vector<Enum> enums;
+  uint32_t root = 0;
+};
+
+JsonEncoder::Ptr CompileJsonEncoder(const MessageSchema& schema);
+
+/**
+ * @brief Serialize the message in the JSON text [json]. The text is parsed in situ by the
+ * SAX interface of RapidJSON, into a flat list of tokens rather than a document: the keys
+ * are found with the NameTable of each struct and the values are written directly with
+ * the typed methods of the [serializer].
+ *
+ * The format is the one of JsonMessageWriter, plus:
+ *
+ * - the members of an object can be in any order: the values of the members that come
+ *   before their turn are parsed when it comes. Unknown members are ignored; if a member
+ *   is repeated, the first one is used.
+ * - absent members, and null values, are encoded as a default value: zero, false, an
+ *   empty string, an empty sequence; the fixed arrays and the structs are made of defaults.
+ * - an enum is either the integer value or the name of an enumerator.
+ * - an absent union is encoded as the case with the lowest discriminant, with a default value.
+ *
+ * Throws std::runtime_error if the text is not valid JSON or a value does not match the
+ * type of its field, or if the library was built without ROSX_HAS_JSON. @optional members
+ * are not supported.
+ */
+void EncodeJson(const JsonEncoder& encoder, std::string_view json, Serializer* serializer);
+
+}  // namespace RosMsgParser
@@ -1,32 +1,90 @@
 #pragma once
 
-#include <memory>
+#include <cstdint>
+#include <string>
+#include <string_view>
 
 #include "rosx_introspection/message_writer.hpp"
 
-#ifdef ROSX_HAS_JSON
-
 namespace RosMsgParser {
 
-class JsonMessageWriter : public MessageWriter {
+/**
+ * @brief MessageWriter that appends a message to a JSON text, as the values arrive:
+ * there is no intermediate document, and nothing is allocated but the output.
+ *
+ * The message is an object, with a member per field, in the order of the definition:
+ *
+ * - structs are objects, arrays (fixed size or not) are arrays.
+ * - TIME and DURATION are objects {"secs": ..., "nsecs": ...}, CHAR is a string of
+ *   one character and the enums are their integer value.
+ * - a union is an object with a single member, its active case: {"case": value}.
+ * - absent fields (@optional, excluded by Parser::setFieldFilter(), arrays discarded by
+ *   the MaxArrayPolicy) and the blobs are omitted. Floating point numbers that are not
+ *   finite are written as NaN, Infinity and -Infinity.
+ *
+ *   std::string json;
+ *   JsonMessageWriter writer(&json, 2);
+ *   parser.walkSchema(buffer, &deserializer, &writer);
+ */
+class JsonMessageWriter final : public MessageWriter {
  public:
-  JsonMessageWriter(void* doc, bool ignore_constants);
-  ~JsonMessageWriter() override;
+  /// Append to [output]. If [indent] is 0, the JSON is compact, otherwise each value
+  /// is on its own line, indented by [indent] spaces per level.
+  explicit JsonMessageWriter(std::string* output, int indent = 0);
 
   JsonMessageWriter(const JsonMessageWriter&) = delete;
   JsonMessageWriter& operator=(const JsonMessageWriter&) = delete;
 
   void writeValue(const FieldLeaf& leaf, const Variant& value) override;
-  void writeString(const FieldLeaf& leaf, const std::string& str) override;
+  void writeBool(const FieldLeaf& leaf, bool value) override;
+  void writeChar(const FieldLeaf& leaf, char value) override;
+  void writeInt8(const FieldLeaf& leaf, int8_t value) override;
+  void writeInt16(const FieldLeaf& leaf, int16_t value) override;
+  void writeInt32(const FieldLeaf& leaf, int32_t value) override;
+  void writeInt64(const FieldLeaf& leaf, int64_t value) override;
+  void writeUInt8(const FieldLeaf& leaf, uint8_t value) override;
+  void writeUInt16(const FieldLeaf& leaf, uint16_t value) override;
+  void writeUInt32(const FieldLeaf& leaf, uint32_t value) override;
+  void writeUInt64(const FieldLeaf& leaf, uint64_t value) override;
+  void writeFloat32(const FieldLeaf& leaf, float value) override;
+  void writeFloat64(const FieldLeaf& leaf, double value) override;
+  void writeString(const FieldLeaf& leaf, const std::string& value) override;
+  void writeString(const FieldLeaf& leaf, std::string_view value) override;
   void writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& name) override;
+  void writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) override;
   void beginStruct(const ROSField& field) override;
   void endStruct() override;
+  void beginArray(const ROSField& field, uint32_t size) override;
+  void endArray() override;
+  void beginUnion(const ROSField& field, const std::string& case_name) override;
+  void endUnion() override;
+  void finish() override;
 
  private:
-  struct Impl;
-  std::unique_ptr<Impl> _impl;
+  enum ScopeFlags : uint8_t {
+    ARRAY = 1 << 0,
+    NOT_EMPTY = 1 << 1,
+    UNION = 1 << 2,
+  };
+
+  // Write the separator and, in an object, the key of the next value.
+  void beginValue(std::string_view name);
+  void beginValue(const FieldLeaf& leaf);
+  void openScope(char bracket, uint8_t flags);
+  void closeScope();
+  void newLine();
+
+  template <typename T>
+  void appendValue(T value);
+  void appendTime(const Time& time);
+  void appendString(std::string_view str);
+
+  std::string* _output;
+  int _indent;
+  // ScopeFlags of each open object and array, the root object first
+  SmallVector<uint8_t, 16> _scopes;
+  // key of the value of the innermost UNION object
+  std::string_view _union_case;
 };
 
 }  // namespace RosMsgParser
-
-#endif  // ROSX_HAS_JSON
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "rosx_introspection/ros_parser.hpp"
+
+namespace RosMsgParser {
+
+/**
+ * @brief Read a few fields of a message, without deserializing all of it.
+ *
+ * The message is decoded on demand: get() executes the DecodeProgram of the
+ * Parser only until the requested field is reached, and suspends it there.
+ * Only the requested field is decoded: the values that precede it are skipped,
+ * like the fields excluded by Parser::setFieldFilter(). The values read are
+ * cached, and a later get() either finds its field in the cache or resumes the
+ * decoding where it stopped; a field that precedes it is searched again from
+ * the beginning of the message. The fields after the last one requested are
+ * never read.
+ *
+ *   LazyMessageView view(parser, &deserializer);
+ *   FieldLeaf stamp;
+ *   view.resolve("header/stamp/sec", stamp);  // once
+ *
+ *   view.reset(buffer);                       // for each message
+ *   std::optional<uint32_t> sec = view.get<uint32_t>(stamp);
+ *   std::optional<std::string> frame = view.get<std::string>("header/frame_id");
+ *
+ * A path is relative to the message; the elements of an array are selected by
+ * index ("poses[2]/position/x") and those of a keyed sequence by the value of
+ * their @key, as printed in the FlatMessage ("joints[J1]/position").
+ *
+ * The buffer must outlive the view. The deserializer can be used by others
+ * between two calls of get(): the view restores its position. A std::string_view
+ * returned by get() is valid until the next reset() of the view.
+ */
+class LazyMessageView {
+ public:
+  LazyMessageView(const Parser& parser, Deserializer* deserializer);
+
+  LazyMessageView(const Parser& parser, Span<const uint8_t> buffer, Deserializer* deserializer);
+
+  /// Start reading a new message, reusing the memory of the cache.
+  void reset(Span<const uint8_t> buffer);
+
+  /// Find the node and the indices of a field. Returns false if the path does not exist in the schema.
+  bool resolve(std::string_view path, FieldLeaf& leaf) const;
+
+  /**
+   * @brief Value of a field, converted to T (a number, std::string or std::string_view).
+   * Enums can be read both as integer and as string (the name of the enumerator).
+   *
+   * @return std::nullopt if the field is not part of this message: unknown path,
+   * array shorter than the index, union case not active, absent @optional, large
+   * array discarded by the MaxArrayPolicy.
+   */
+  template <typename T>
+  std::optional<T> get(std::string_view path);
+
+  template <typename T>
+  std::optional<T> get(const FieldLeaf& leaf);
+
+  /// Field that is not an element of an array.
+  template <typename T>
+  std::optional<T> get(const FieldTreeNode* node) {
+    FieldLeaf leaf;
+    leaf.node = node;
+    return get<T>(leaf);
+  }
+
+  /// True if the entire message has been decoded.
+  bool finished() const {
+    return _cursor.finished;
+  }
+
+  /// Number of values decoded so far: the fields requested, and the other
+  /// elements of their arrays that were met on the way.
+  size_t decodedCount() const {
+    return _decoded_count;
+  }
+
+ private:
+  struct CachedValue {
+    Variant value;
+    /// Index in _strings of a string or of the name of an enumerator, -1 otherwise.
+    int32_t string_index = -1;
+    /// False if the field is not part of the message.
+    bool present = true;
+  };
+
+  class Recorder;
+
+  const CachedValue* find(const FieldLeaf& leaf);
+
+  template <class DeserializerT>
+  const CachedValue* search(DeserializerT* deserializer, const FieldLeaf& target);
+
+  template <class DeserializerT>
+  const CachedValue* resume(DeserializerT* deserializer, const FieldLeaf& target);
+
+  const Parser* _parser;
+  Deserializer* _deserializer;
+  Span<const uint8_t> _buffer;
+  details::DecodeOptions _options;
+  /// FieldFlags of each node: only the target of the search and the structs that contain it are stored.
+  std::vector<uint8_t> _field_flags;
+
+  details::DecodeCursor _cursor;
+  FieldLeaf _leaf;
+  /// Position of the deserializer where the decoding was suspended.
+  size_t _offset = 0;
+
+  std::unordered_map<FieldLeaf, CachedValue, FieldLeafHash, FieldLeafEqual> _values;
+  size_t _decoded_count = 0;
+  // a deque: the strings don't move when more are added, see get<std::string_view>()
+  std::deque<std::string> _strings;
+  size_t _strings_used = 0;
+};
+
+//----------------------------------------------------
+
+template <typename T>
+inline std::optional<T> LazyMessageView::get(std::string_view path) {
+  FieldLeaf leaf;
+  if (!resolve(path, leaf)) {
+    return std::nullopt;
+  }
+  return get<T>(leaf);
+}
+
+template <typename T>
+inline std::optional<T> LazyMessageView::get(const FieldLeaf& leaf) {
+  const CachedValue* cached = find(leaf);
+  if (!cached) {
+    return std::nullopt;
+  }
+  if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+    if (cached->string_index < 0) {
+      throw std::runtime_error("LazyMessageView: the field is not a string or an enum");
+    }
+    return T(_strings[cached->string_index]);
+  } else {
+    return cached->value.convert<T>();
+  }
+}
+
+}  // namespace RosMsgParser
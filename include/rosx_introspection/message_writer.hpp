@@ -1,11 +1,78 @@
 #pragma once
 
+#include <cstring>
+#include <string>
+#include <string_view>
+
 #include "rosx_introspection/stringtree_leaf.hpp"
 
 namespace RosMsgParser {
 
 class ROSField;
 
+/// Invoke fn(index, value) for each of the [count] values of type [type] stored
+/// contiguously in [raw], in host byte order (the memory doesn't need to be aligned).
+/// [value] has the C++ type of [type]: bool, char, uint8_t, ..., double or Time.
+template <class Function>
+void ForEachTypedArrayValue(BuiltinType type, Span<const uint8_t> raw, size_t count, Function&& fn) {
+  auto expand = [&](auto zero) {
+    using T = decltype(zero);
+    for (size_t i = 0; i < count; i++) {
+      T value;
+      memcpy(&value, raw.data() + i * sizeof(T), sizeof(T));
+      fn(i, value);
+    }
+  };
+  switch (type) {
+    case BOOL:
+      for (size_t i = 0; i < count; i++) {
+        fn(i, raw[i] != 0);
+      }
+      break;
+    case CHAR:
+      return expand(char(0));
+    case BYTE:
+    case UINT8:
+      return expand(uint8_t(0));
+    case UINT16:
+      return expand(uint16_t(0));
+    case UINT32:
+      return expand(uint32_t(0));
+    case UINT64:
+      return expand(uint64_t(0));
+    case INT8:
+      return expand(int8_t(0));
+    case INT16:
+      return expand(int16_t(0));
+    case INT32:
+      return expand(int32_t(0));
+    case INT64:
+      return expand(int64_t(0));
+    case FLOAT32:
+      return expand(float(0));
+    case FLOAT64:
+      return expand(double(0));
+    case DURATION:
+    case TIME:
+      for (size_t i = 0; i < count; i++) {
+        Time value;
+        memcpy(&value.sec, raw.data() + i * 8, 4);
+        memcpy(&value.nsec, raw.data() + i * 8 + 4, 4);
+        fn(i, value);
+      }
+      break;
+    default:
+      throw std::runtime_error("ForEachArrayValue: type not recognized");
+  }
+}
+
+/// Invoke fn(index, Variant) for each of the [count] values of type [type] stored
+/// contiguously in [raw], in host byte order (the memory doesn't need to be aligned).
+template <class Function>
+void ForEachArrayValue(BuiltinType type, Span<const uint8_t> raw, size_t count, Function&& fn) {
+  ForEachTypedArrayValue(type, raw, count, [&](size_t index, auto value) { fn(index, Variant(value)); });
+}
+
 /// Abstract interface for consuming deserialized schema values.
 /// Implement this to produce different output formats (FlatMessage, JSON, msgpack, etc.)
 /// from the same schema walk.
@@ -16,12 +83,74 @@ class MessageWriter {
   /// Called for each scalar/builtin value (not string, not enum)
   virtual void writeValue(const FieldLeaf& leaf, const Variant& value) = 0;
 
+  /// Typed versions of writeValue(), called for the scalar values decoded by the
+  /// schema walk (TIME and DURATION excepted). BYTE values are passed to writeUInt8().
+  /// Writers can override them to receive the value without a Variant; the default
+  /// implementations forward to writeValue().
+  virtual void writeBool(const FieldLeaf& leaf, bool value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeChar(const FieldLeaf& leaf, char value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeInt8(const FieldLeaf& leaf, int8_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeInt16(const FieldLeaf& leaf, int16_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeInt32(const FieldLeaf& leaf, int32_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeInt64(const FieldLeaf& leaf, int64_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeUInt8(const FieldLeaf& leaf, uint8_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeUInt16(const FieldLeaf& leaf, uint16_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeUInt32(const FieldLeaf& leaf, uint32_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeUInt64(const FieldLeaf& leaf, uint64_t value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeFloat32(const FieldLeaf& leaf, float value) {
+    writeValue(leaf, Variant(value));
+  }
+  virtual void writeFloat64(const FieldLeaf& leaf, double value) {
+    writeValue(leaf, Variant(value));
+  }
+
   /// Called for each string value
   virtual void writeString(const FieldLeaf& leaf, const std::string& value) = 0;
 
+  /// Called for each string value decoded by the schema walk. [value] is valid only
+  /// during this call; it usually references the characters in the message buffer.
+  /// The default implementation copies it and invokes writeString(leaf, const std::string&).
+  virtual void writeString(const FieldLeaf& leaf, std::string_view value) {
+    _string_copy.assign(value);
+    writeString(leaf, _string_copy);
+  }
+
   /// Called for each enum value
   virtual void writeEnum(const FieldLeaf& leaf, int32_t int_value, const std::string& enum_name) = 0;
 
+  /// Called for an array of builtin values (not strings or enums) decoded in bulk.
+  /// [raw] contains [count] contiguous values of [type] in host byte order, but
+  /// not necessarily aligned; it is valid only during this call.
+  /// The last element of leaf.index_array is the index of the array, set to 0.
+  /// The default implementation invokes writeValue() for each element.
+  virtual void writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) {
+    FieldLeaf element = leaf;
+    ForEachArrayValue(type, raw, count, [&](size_t index, const Variant& value) {
+      element.index_array.back() = static_cast<uint16_t>(index);
+      writeValue(element, value);
+    });
+  }
+
   /// Called for blob data (large byte arrays exceeding max_array_size)
   virtual void writeBlob(const FieldLeaf& /*leaf*/, Span<const uint8_t> /*data*/) {}
 
@@ -29,8 +158,22 @@ class MessageWriter {
   virtual void beginStruct(const ROSField& /*field*/) {}
   virtual void endStruct() {}
 
+  /// Called before the active case of the union [field], named [case_name], and endUnion()
+  /// after it. The case is either a value written at the leaf of the union field, or a struct.
+  virtual void beginUnion(const ROSField& /*field*/, const std::string& /*case_name*/) {}
+  virtual void endUnion() {}
+
+  /// Called before the [size] elements of the array [field] (values, a writeArray() or
+  /// structs), and endArray() after them, also for empty arrays. Not called for the
+  /// blobs, nor for the arrays discarded by the MaxArrayPolicy.
+  virtual void beginArray(const ROSField& /*field*/, uint32_t /*size*/) {}
+  virtual void endArray() {}
+
   /// Called when the schema walk finishes. Writers can use this to finalize output.
   virtual void finish() {}
+
+ private:
+  std::string _string_copy;
 };
 
 }  // namespace RosMsgParser
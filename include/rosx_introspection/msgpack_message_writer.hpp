@@ -14,13 +14,27 @@ class MsgpackMessageWriter : public MessageWriter {
   explicit MsgpackMessageWriter(std::vector<uint8_t>* output);
 
   void writeValue(const FieldLeaf& leaf, const Variant& value) override;
+  void writeBool(const FieldLeaf& leaf, bool value) override;
+  void writeChar(const FieldLeaf& leaf, char value) override;
+  void writeInt8(const FieldLeaf& leaf, int8_t value) override;
+  void writeInt16(const FieldLeaf& leaf, int16_t value) override;
+  void writeInt32(const FieldLeaf& leaf, int32_t value) override;
+  void writeInt64(const FieldLeaf& leaf, int64_t value) override;
+  void writeUInt8(const FieldLeaf& leaf, uint8_t value) override;
+  void writeUInt16(const FieldLeaf& leaf, uint16_t value) override;
+  void writeUInt32(const FieldLeaf& leaf, uint32_t value) override;
+  void writeUInt64(const FieldLeaf& leaf, uint64_t value) override;
+  void writeFloat32(const FieldLeaf& leaf, float value) override;
+  void writeFloat64(const FieldLeaf& leaf, double value) override;
   void writeString(const FieldLeaf& leaf, const std::string& value) override;
+  void writeString(const FieldLeaf& leaf, std::string_view value) override;
   void writeEnum(const FieldLeaf& leaf, int32_t int_value, const std::string& enum_name) override;
   void finish() override;
 
  private:
   void ensureCapacity(size_t additional);
   void writeKey(const FieldLeaf& leaf);
+  void writeInteger(const FieldLeaf& leaf, int64_t value);
 
   std::vector<uint8_t>* _output;
   size_t _offset = 0;
@@ -26,6 +26,7 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
@@ -127,6 +128,16 @@ class ROSField {
     _is_key = key;
   }
 
+  /// Member ID set by an IDL @id annotation. The other members are numbered
+  /// sequentially, from the previous ID (see DecodeOp::member_id).
+  std::optional<uint32_t> memberId() const {
+    return _member_id;
+  }
+
+  void setMemberId(uint32_t id) {
+    _member_id = id;
+  }
+
   const EnumDefinition* getEnum() const {
     return _enum_ptr;
   }
@@ -145,6 +156,8 @@ class ROSField {
 
   friend class ROSMessage;
 
+  /// The message of a field of type OTHER. The result is cached for [library]:
+  /// only the first call with a library writes the cache (see Parser).
   std::shared_ptr<ROSMessage> getMessagePtr(const RosMessageLibrary& library) const;
 
  protected:
@@ -159,6 +172,7 @@ class ROSField {
   SmallVector<int, 2> _array_dims;  // multi-dimensional: {3, 4} for [3][4]
   bool _is_optional = false;
   bool _is_key = false;
+  std::optional<uint32_t> _member_id;
 
   const EnumDefinition* _enum_ptr = nullptr;
   const DiscriminatedUnion* _union_ptr = nullptr;
@@ -60,9 +60,19 @@ class ROSMessage {
     _type = new_type;
   }
 
+  /// Extensibility declared by an IDL annotation, UNSPECIFIED for ROS messages.
+  Extensibility extensibility() const {
+    return _extensibility;
+  }
+
+  void setExtensibility(Extensibility extensibility) {
+    _extensibility = extensibility;
+  }
+
  private:
   ROSType _type;
   std::vector<ROSField> _fields;
+  Extensibility _extensibility = Extensibility::UNSPECIFIED;
 };
 
 typedef details::TreeNode<const ROSField*> FieldTreeNode;
@@ -77,6 +87,9 @@ struct MessageSchema {
   RosMessageLibrary msg_library;
   /// Owns the root field that is stored as a raw pointer in field_tree
   std::unique_ptr<ROSField> root_field;
+  /// Owns the fields of the struct cases of the unions, that are stored in field_tree
+  /// as children of the union fields.
+  std::vector<std::unique_ptr<ROSField>> union_case_fields;
 
   // IDL type registries (empty for ROS .msg schemas)
   std::unordered_map<ROSType, EnumDefinition> enum_library;
@@ -100,6 +113,8 @@ std::vector<ROSMessage::Ptr> ParseMessageDefinitions(const std::string& multi_de
 
 MessageSchema::Ptr BuildMessageSchema(const std::string& topic_name, const std::vector<ROSMessage::Ptr>& parsed_msgs);
 
+/// Cache the path of each node of the tree (see TreeNode::cachedPath()) and
+/// number the nodes in depth-first order (see TreeNode::nodeId()), starting from 0 at the root.
 void CacheFieldTreePaths(FieldTree& tree, const RosMessageLibrary& library);
 
 }  // namespace RosMsgParser
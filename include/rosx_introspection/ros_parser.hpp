@@ -22,32 +22,40 @@
  */
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
 #include <unordered_set>
 
+#include "rosx_introspection/decode_program.hpp"
 #include "rosx_introspection/deserializer.hpp"
+#include "rosx_introspection/details/decode_interpreter.hpp"
+#include "rosx_introspection/executor.hpp"
+#include "rosx_introspection/flat_message_writer.hpp"
 #include "rosx_introspection/idl_parser.hpp"
+#include "rosx_introspection/json_encoder.hpp"
 #include "rosx_introspection/message_writer.hpp"
 #include "rosx_introspection/serializer.hpp"
 #include "rosx_introspection/stringtree_leaf.hpp"
 
 namespace RosMsgParser {
 
-struct FlatMessage {
-  std::shared_ptr<MessageSchema> schema;
-
-  /// List of all those parsed fields that can be represented by a
-  /// builtin value different from "string".
-  std::vector<std::pair<FieldLeaf, Variant>> value;
-
-  /// Store "blobs", i.e all those fields which are vectors of BYTES (AKA uint8_t),
-  /// where the vector size is greater than the argument [max_array_size].
-  std::vector<std::pair<FieldLeaf, Span<const uint8_t>>> blob;
-
-  std::vector<std::vector<uint8_t>> blob_storage;
-};
-
 enum SchemaFormat { ROS_MSG, DDS_IDL };
 
+/**
+ * @brief Deserializes the messages of a topic, given their type and schema.
+ *
+ * Thread safety: a Parser can be shared by several threads without locking.
+ * Its const methods (deserialize(), walkSchema(), deserializeBatch(), etc.) can
+ * be invoked at the same time, as long as each thread uses its own Deserializer,
+ * MessageWriter and FlatMessage: the schema is fully resolved by the constructor
+ * and never written afterwards. The methods that change the configuration
+ * (setMaxArrayPolicy(), setFieldFilter(), etc.) must not be invoked while a
+ * message is being decoded.
+ */
 class Parser {
  public:
   /**
@@ -66,6 +74,7 @@ class Parser {
   void setMaxArrayPolicy(MaxArrayPolicy discard_entire_array, size_t max_array_size) {
     _discard_large_array = discard_entire_array;
     _max_array_size = max_array_size;
+    _shape_cache.clear();
     if (_max_array_size > 10000) {
       throw std::runtime_error("max_array_size limited to 10000 at most");
     }
@@ -93,6 +102,72 @@ class Parser {
     return _blob_policy;
   }
 
+  enum StringPolicy { STORE_STRING_AS_COPY, STORE_STRING_AS_REFERENCE };
+
+  // If set to STORE_STRING_AS_COPY, each string is copied into its Variant in the
+  // FlatMessage. If STORE_STRING_AS_REFERENCE is used instead, the Variant references the
+  // characters in the buffer passed to deserialize() (see Variant::isStringReference()):
+  // no memory is allocated, but the buffer must outlive the FlatMessage.
+  void setStringPolicy(StringPolicy policy) {
+    _string_policy = policy;
+  }
+
+  StringPolicy stringPolicy() const {
+    return _string_policy;
+  }
+
+  /// Store only the fields that match at least one of the patterns.
+  ///
+  /// The other fields are skipped without being decoded, and the writer is
+  /// never invoked for them. A pattern is a path relative to the message, where
+  /// `*` matches any part of a field name and `**` any number of fields:
+  ///
+  ///   "header/stamp"      the field and all its children
+  ///   "pose/*/x"          "pose/position/x" and "pose/orientation/x"
+  ///   "joint_*"           the fields whose name starts with "joint_"
+  ///   "**/covariance"     "covariance" at any depth
+  ///
+  /// Patterns select fields, not elements: array indices are not accepted.
+  /// They are matched once against the FieldTree; an empty list removes the filter.
+  void setFieldFilter(const std::vector<std::string>& patterns);
+
+  /// Decode a message only if all the conditions hold, for instance:
+  ///
+  ///   parser.setFieldPredicates({"header/frame_id == \"base_link\"", "status < 3"});
+  ///
+  /// A condition compares a field with a number or a quoted string, using one of
+  /// ==, !=, <, <=, >, >=. An enum can be compared with the name of an enumerator
+  /// (quoted or not) or with its value. The field must not be an array, an element
+  /// of an array, a union or a @key.
+  ///
+  /// Each condition is tested as soon as its field is decoded: if it fails, the
+  /// rest of the message is neither decoded nor written (see walkSchema()).
+  /// An absent @optional field fails the condition. An empty list removes the predicates.
+  void setFieldPredicates(const std::vector<std::string>& conditions);
+
+  /// Remember where the values are in the last [max_shapes] shapes of the message.
+  ///
+  /// The shape of a message is the sequence of the lengths of its strings and
+  /// arrays. Streams often repeat the same shape (same number of joints, same
+  /// frame_id): when a message has the shape of a recent one, walkSchema() loads
+  /// its values from the offsets recorded for that shape, instead of executing
+  /// the DecodeProgram. Otherwise, the message is decoded as usual and its
+  /// layout replaces the least recently used one.
+  ///
+  /// Not applied if the message contains unions, @optional or @key fields, or
+  /// if predicates are set. 0 (default) disables it.
+  void setShapeMemoization(size_t max_shapes);
+
+  /// Number of messages decoded from a memoized layout, see setShapeMemoization().
+  size_t shapeCacheHits() const {
+    return _shape_cache.hits();
+  }
+
+  /// Number of messages whose shape was not in the cache.
+  size_t shapeCacheMisses() const {
+    return _shape_cache.misses();
+  }
+
   /**
    * @brief getSchema provides some metadata amount a registered ROSMessage.
    */
@@ -119,14 +194,61 @@ class Parser {
    *                       avoid memory allocations and speed up the parsing.
    *
    * @return true if the entire message was parsed or false if parts of the message were
-   *         skipped because an array has (size > max_array_size)
+   *         skipped because an array has (size > max_array_size).
+   *         If the message is rejected by a predicate (see setFieldPredicates()),
+   *         flat_output is empty and flat_output->filtered_out is set.
    */
   bool deserialize(Span<const uint8_t> buffer, FlatMessage* flat_output, Deserializer* deserializer) const;
 
-  bool deserializeIntoJson(
-      Span<const uint8_t> buffer, std::string* json_txt, Deserializer* deserializer, int indent = 0,
-      bool ignore_constants = false) const;
+  /**
+   * @brief Deserialize a batch of messages of this topic in parallel, as deserialize() does.
+   *
+   * The messages are distributed among the workers of the executor; each worker
+   * uses its own DeserializerT. The FlatMessages are reused as in deserialize(),
+   * so it is recommended to pass the same outputs to each batch.
+   *
+   *   ThreadPoolExecutor executor;
+   *   std::vector<FlatMessage> outputs(buffers.size());
+   *   parser.deserializeBatch(Span<const Span<const uint8_t>>(buffers), Span<FlatMessage>(outputs), executor);
+   *
+   * @param buffers  raw messages; they must not be modified until the batch is done.
+   * @param outputs  one FlatMessage for each buffer.
+   * @return true if all the messages were parsed entirely.
+   */
+  template <class DeserializerT = NanoCDR_Deserializer>
+  bool deserializeBatch(Span<const Span<const uint8_t>> buffers, Span<FlatMessage> outputs, Executor& executor) const;
+
+  /**
+   * @brief deserializeIntoJson writes the message in [buffer] as a JSON object into [json_txt],
+   * with walkSchema() and a JsonMessageWriter (see there for the format).
+   *
+   * The field filter and the predicates apply as in deserialize(): [json_txt] is empty if
+   * the message is rejected by a predicate. The MaxArrayPolicy does not: the arrays are
+   * written entirely, except the arrays of BYTE and UINT8 larger than maxArraySize(), that
+   * are left out of the object.
+   *
+   * @param indent  spaces per level; 0 for a compact JSON on a single line.
+   * @return false if parts of the message were skipped.
+   */
+  bool deserializeIntoJson(Span<const uint8_t> buffer, std::string* json_txt, Deserializer* deserializer,
+                           int indent = 0) const;
+
+  /// The constants are not part of the message, and never written: [ignore_constants] is unused.
+  [[deprecated("use the overload without ignore_constants")]]
+  bool deserializeIntoJson(Span<const uint8_t> buffer, std::string* json_txt, Deserializer* deserializer, int indent,
+                           bool ignore_constants) const {
+    (void)ignore_constants;
+    return deserializeIntoJson(buffer, json_txt, deserializer, indent);
+  }
 
+  /**
+   * @brief serializeFromJson resets the [serializer] and writes into it the message in [json_string],
+   * with a JsonEncoder compiled from the schema (see EncodeJson() for the format).
+   *
+   * The JSON written by deserializeIntoJson() can be serialized back.
+   *
+   * Throws std::runtime_error if the text is not valid JSON or does not match the schema.
+   */
   bool serializeFromJson(const std::string_view json_string, Serializer* serializer) const;
 
   typedef std::function<void(const ROSType&, Span<uint8_t>&)> VisitingCallback;
@@ -150,18 +272,31 @@ class Parser {
 
   /// Walk the schema and write deserialized values to a MessageWriter.
   /// This is the unified deserialization path used by deserialize() and deserializeIntoJson().
-  bool walkSchema(Span<const uint8_t> buffer, Deserializer* deserializer, MessageWriter* writer) const;
-
- private:
-  struct WalkState {
-    Deserializer* deserializer;
-    MessageWriter* writer;
-    bool entire_message_parsed = true;
-  };
-
-  void walkImpl(const ROSMessage* msg, FieldLeaf& leaf, bool store, WalkState& state) const;
+  ///
+  /// Returns false if parts of the message were skipped because of the MaxArrayPolicy.
+  /// If [filtered_out] is given, it is set when the walk was abandoned because a
+  /// predicate does not hold (see setFieldPredicates()); the writer has received
+  /// only the values that precede the field of that predicate.
+  bool walkSchema(Span<const uint8_t> buffer, Deserializer* deserializer, MessageWriter* writer,
+                  bool* filtered_out = nullptr) const;
+
+  /// Same as above, but the types of deserializer and writer are known at compile time.
+  /// If they are final classes (as NanoCDR_Deserializer, ROS_Deserializer and
+  /// FlatMessageWriter), their methods are invoked directly and can be inlined
+  /// into the walker, for instance:
+  ///
+  ///   parser.walkSchema<NanoCDR_Deserializer, FlatMessageWriter>(buffer, &deserializer, &writer);
+  ///
+  /// Otherwise, the virtual methods are invoked as usual.
+  template <class DeserializerT, class WriterT>
+  bool walkSchema(Span<const uint8_t> buffer, DeserializerT* deserializer, WriterT* writer,
+                  bool* filtered_out = nullptr) const;
+
+  /// The schema lowered into a linear program, executed by walkSchema().
+  const DecodeProgram::Ptr& getDecodeProgram() const {
+    return _program;
+  }
 
- public:
   /// Change where the warning messages are displayed.
   void setWarningsStream(std::ostream* output) {
     _global_warnings = output;
@@ -179,7 +314,23 @@ class Parser {
 
   void deserializeImpl(const ROSMessage* msg, FieldLeaf& leaf, bool store, DeserializeState& state) const;
 
+  details::DecodeOptions decodeOptions() const;
+
+  template <class DeserializerT, class WriterT>
+  bool walkSchemaWith(Span<const uint8_t> buffer, DeserializerT* deserializer, WriterT* writer, bool* filtered_out,
+                      details::ShapeCache& shape_cache, const details::DecodeOptions& options) const;
+
+  template <class DeserializerT>
+  bool deserializeWith(Span<const uint8_t> buffer, FlatMessage* flat_output, DeserializerT* deserializer,
+                       details::ShapeCache& shape_cache) const;
+
+  // Combine the field filter and the predicates into _field_flags.
+  // Returns, for each pattern of the filter, whether it matches at least one field.
+  std::vector<bool> updateFieldFlags();
+
   std::shared_ptr<MessageSchema> _schema;
+  DecodeProgram::Ptr _program;
+  JsonEncoder::Ptr _json_encoder;
 
   std::ostream* _global_warnings;
 
@@ -191,12 +342,139 @@ class Parser {
   MaxArrayPolicy _discard_large_array;
   size_t _max_array_size;
   BlobPolicy _blob_policy;
-  mutable size_t _estimated_field_count = 0;
+  StringPolicy _string_policy;
+  std::vector<std::string> _field_filter;
+  std::vector<details::FieldPredicate> _predicates;
+  /// details::FieldFlags of each node of the FieldTree, empty if there is neither a filter nor a predicate.
+  std::vector<uint8_t> _field_flags;
+  /// False if the path through the DecodeProgram depends on more than the length prefixes.
+  bool _shape_memoizable = false;
+  mutable details::ShapeCache _shape_cache;
+  /// Number of values of a message without arrays, to reserve the FlatMessage.
+  size_t _estimated_field_count = 0;
   std::shared_ptr<ROSField> _dummy_root_field;
 
   std::unique_ptr<Deserializer> _deserializer;
 };
 
+template <class DeserializerT, class WriterT>
+inline bool Parser::walkSchema(Span<const uint8_t> buffer, DeserializerT* deserializer, WriterT* writer,
+                               bool* filtered_out) const {
+  return walkSchemaWith(buffer, deserializer, writer, filtered_out, _shape_cache, decodeOptions());
+}
+
+inline details::DecodeOptions Parser::decodeOptions() const {
+  details::DecodeOptions options;
+  options.max_array_size = static_cast<uint32_t>(_max_array_size);
+  options.max_byte_array_size = options.max_array_size;
+  options.discard_large_arrays = _discard_large_array;
+  options.field_flags = _field_flags.empty() ? nullptr : _field_flags.data();
+  options.predicates = Span<const details::FieldPredicate>(_predicates.data(), _predicates.size());
+  return options;
+}
+
+template <class DeserializerT, class WriterT>
+inline bool Parser::walkSchemaWith(Span<const uint8_t> buffer, DeserializerT* deserializer, WriterT* writer,
+                                   bool* filtered_out, details::ShapeCache& shape_cache,
+                                   const details::DecodeOptions& options) const {
+  static_assert(std::is_base_of_v<Deserializer, DeserializerT>, "DeserializerT must derive from Deserializer");
+  static_assert(std::is_base_of_v<MessageWriter, WriterT>, "WriterT must derive from MessageWriter");
+
+  details::InitDeserializer(*_program, buffer, deserializer);
+
+  FieldLeaf rootnode;
+  rootnode.node = _schema->field_tree.croot();
+
+  details::DecodeCursor cursor;
+  std::shared_ptr<details::ShapeLayout> recording;
+  const PrimitiveAlignment alignment = deserializer->primitiveAlignment();
+  if (shape_cache.capacity() > 0 && _shape_memoizable && _predicates.empty() &&
+      alignment != PrimitiveAlignment::UNSPECIFIED) {
+    const bool swap = deserializer->needsByteSwap();
+    const Extensibility xcdr2 = deserializer->defaultExtensibility();
+    if (const auto layout = shape_cache.find(buffer, alignment, swap, xcdr2)) {
+      const bool entire_message_parsed = details::ReplayShapeLayout(*_program, *layout, buffer, writer);
+      deserializer->jump(layout->message_size - static_cast<size_t>(deserializer->getCurrentPtr() - buffer.data()));
+      writer->finish();
+      if (filtered_out) {
+        *filtered_out = false;
+      }
+      return entire_message_parsed;
+    }
+    recording = details::ShapeCache::startRecording(alignment, swap, xcdr2);
+    cursor.record = recording.get();
+    cursor.record_origin = buffer.data();
+  }
+
+  const bool entire_message_parsed =
+      details::ResumeDecodeProgram(*_program, options, cursor, rootnode, deserializer, writer);
+  if (recording) {
+    recording->message_size = static_cast<size_t>(deserializer->getCurrentPtr() - buffer.data());
+    recording->entire_message_parsed = entire_message_parsed;
+    shape_cache.store(std::move(recording));
+  }
+  writer->finish();
+  if (filtered_out) {
+    *filtered_out = cursor.filtered_out;
+  }
+  return entire_message_parsed;
+}
+
+// The instance used by the virtual interface is compiled once, in ros_parser.cpp
+extern template bool Parser::walkSchema<Deserializer, MessageWriter>(Span<const uint8_t>, Deserializer*,
+                                                                      MessageWriter*, bool*) const;
+
+template <class DeserializerT>
+inline bool Parser::deserializeWith(Span<const uint8_t> buffer, FlatMessage* flat_container,
+                                    DeserializerT* deserializer, details::ShapeCache& shape_cache) const {
+  flat_container->schema = _schema;
+  if (flat_container->value.capacity() < _estimated_field_count) {
+    flat_container->value.reserve(_estimated_field_count);
+  }
+
+  FlatMessageWriter writer(flat_container, _blob_policy);
+  if (_string_policy == STORE_STRING_AS_REFERENCE) {
+    writer.referenceStrings(buffer);
+  }
+  const bool entire_message_parsed =
+      walkSchemaWith(buffer, deserializer, &writer, &flat_container->filtered_out, shape_cache, decodeOptions());
+  if (flat_container->filtered_out) {
+    flat_container->value.clear();
+    flat_container->blob.clear();
+  }
+  return entire_message_parsed;
+}
+
+template <class DeserializerT>
+inline bool Parser::deserializeBatch(Span<const Span<const uint8_t>> buffers, Span<FlatMessage> outputs,
+                                     Executor& executor) const {
+  static_assert(std::is_base_of_v<Deserializer, DeserializerT>, "DeserializerT must derive from Deserializer");
+  if (outputs.size() != buffers.size()) {
+    throw std::runtime_error("deserializeBatch: the number of outputs is different from the number of buffers");
+  }
+
+  struct Worker {
+    DeserializerT deserializer;
+    bool entire_messages_parsed = true;
+  };
+  std::vector<Worker> workers(executor.concurrency());
+
+  executor.parallelFor(buffers.size(), [&](size_t index, size_t begin, size_t end) {
+    Worker& worker = workers[index];
+    for (size_t i = begin; i < end; i++) {
+      if (!deserializeWith(buffers[i], &outputs[i], &worker.deserializer, _shape_cache)) {
+        worker.entire_messages_parsed = false;
+      }
+    }
+  });
+
+  bool entire_messages_parsed = true;
+  for (const auto& worker : workers) {
+    entire_messages_parsed = entire_messages_parsed && worker.entire_messages_parsed;
+  }
+  return entire_messages_parsed;
+}
+
 //--------------------------------------------------------------------------
 
 typedef std::vector<std::pair<std::string, double>> RenamedValues;
@@ -247,4 +525,157 @@ class ParsersCollection {
   std::unique_ptr<Deserializer> _deserializer;
 };
 
+//--------------------------------------------------------------------------
+
+/**
+ * @brief A ParsersCollection that can be used by several threads at the same time.
+ *
+ * Each topic is identified by the integer handle returned by registerParser():
+ * the handles are consecutive, starting from 0, and finding the Parser of a
+ * handle is a lookup in an array, without locking. Topics can be registered
+ * while other threads are decoding.
+ *
+ * Each thread that invokes deserialize() gets its own DeserializerT and its own
+ * FlatMessage for each topic; they are released when the collection is destroyed.
+ *
+ *   ConcurrentParsersCollection<NanoCDR_Deserializer> collection;
+ *   auto handle = collection.registerParser("/joint_states", ROSType("sensor_msgs/JointState"), definition);
+ *   // in any thread
+ *   const FlatMessage* msg = collection.deserialize(handle, buffer);
+ */
+template <class DeserializerT>
+class ConcurrentParsersCollection {
+ public:
+  using TopicHandle = uint32_t;
+  static constexpr TopicHandle INVALID_HANDLE = 0xFFFFFFFF;
+
+  ConcurrentParsersCollection() : _id(NextCollectionId()) {}
+
+  ConcurrentParsersCollection(const ConcurrentParsersCollection&) = delete;
+  ConcurrentParsersCollection& operator=(const ConcurrentParsersCollection&) = delete;
+
+  /// Create the Parser of a topic, unless it is already registered.
+  /// @return the handle of the topic.
+  TopicHandle registerParser(const std::string& topic_name, const ROSType& msg_type, const std::string& definition,
+                             SchemaFormat format = ROS_MSG) {
+    if (TopicHandle handle = findTopic(topic_name); handle != INVALID_HANDLE) {
+      return handle;
+    }
+    // the schema is parsed without holding the lock
+    return registerParser(topic_name, Parser(topic_name, msg_type, definition, format));
+  }
+
+  /// Add a Parser that was already configured (setMaxArrayPolicy(), setFieldFilter(), etc.).
+  /// If the topic is already registered, [parser] is discarded.
+  TopicHandle registerParser(const std::string& topic_name, Parser&& parser) {
+    std::unique_lock lock(_mutex);
+    auto it = _handles.find(topic_name);
+    if (it != _handles.end()) {
+      return it->second;
+    }
+    const TopicHandle handle = _size.load(std::memory_order_relaxed);
+    if (handle >= CHUNK_SIZE * MAX_CHUNKS) {
+      throw std::runtime_error("ConcurrentParsersCollection: too many topics");
+    }
+    auto& chunk = _chunks[handle / CHUNK_SIZE];
+    if (!chunk) {
+      chunk = std::make_unique<Chunk>();
+    }
+    (*chunk)[handle % CHUNK_SIZE] = std::make_unique<Parser>(std::move(parser));
+    _handles.insert({topic_name, handle});
+    // publish the Parser to the threads that read _size
+    _size.store(handle + 1, std::memory_order_release);
+    return handle;
+  }
+
+  /// Handle of a registered topic, or INVALID_HANDLE.
+  TopicHandle findTopic(const std::string& topic_name) const {
+    std::shared_lock lock(_mutex);
+    auto it = _handles.find(topic_name);
+    return (it != _handles.end()) ? it->second : INVALID_HANDLE;
+  }
+
+  /// Number of registered topics.
+  size_t size() const {
+    return _size.load(std::memory_order_acquire);
+  }
+
+  const Parser* getParser(TopicHandle handle) const {
+    if (handle >= _size.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return (*_chunks[handle / CHUNK_SIZE])[handle % CHUNK_SIZE].get();
+  }
+
+  /// Deserialize a message of the topic [handle], using the deserializer of the
+  /// calling thread. Returns nullptr if the handle is not valid.
+  /// The FlatMessage belongs to the calling thread: it is valid until the same
+  /// thread deserializes another message of the same topic.
+  const FlatMessage* deserialize(TopicHandle handle, Span<const uint8_t> buffer) {
+    const Parser* parser = getParser(handle);
+    if (!parser) {
+      return nullptr;
+    }
+    ThreadState& state = threadState();
+    if (state.outputs.size() <= handle) {
+      state.outputs.resize(handle + 1);
+    }
+    FlatMessage& output = state.outputs[handle];
+    parser->deserialize(buffer, &output, &state.deserializer);
+    return &output;
+  }
+
+ private:
+  static constexpr size_t CHUNK_SIZE = 64;
+  static constexpr size_t MAX_CHUNKS = 1024;
+  // The chunks are never moved: a Parser keeps its address while others are added.
+  using Chunk = std::array<std::unique_ptr<Parser>, CHUNK_SIZE>;
+
+  struct ThreadState {
+    DeserializerT deserializer;
+    // indexed by handle; a deque, so that growing it doesn't move the FlatMessages
+    std::deque<FlatMessage> outputs;
+  };
+
+  static uint64_t NextCollectionId() {
+    static std::atomic<uint64_t> next_id = 0;
+    return next_id++;
+  }
+
+  ThreadState& threadState() {
+    // The ThreadStates used recently by this thread, identified by the id of
+    // their collection: it is never reused, unlike the address.
+    thread_local SmallVector<std::pair<uint64_t, ThreadState*>, 4> recent;
+    for (const auto& [id, state] : recent) {
+      if (id == _id) {
+        return *state;
+      }
+    }
+    ThreadState* state = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(_states_mutex);
+      auto& owned = _thread_states[std::this_thread::get_id()];
+      if (!owned) {
+        owned = std::make_unique<ThreadState>();
+      }
+      state = owned.get();
+    }
+    if (recent.size() == 4) {
+      recent.erase(recent.begin());
+    }
+    recent.push_back({_id, state});
+    return *state;
+  }
+
+  const uint64_t _id;
+
+  mutable std::shared_mutex _mutex;
+  std::unordered_map<std::string, TopicHandle> _handles;
+  std::array<std::unique_ptr<Chunk>, MAX_CHUNKS> _chunks;
+  std::atomic<TopicHandle> _size = 0;
+
+  std::mutex _states_mutex;
+  std::unordered_map<std::thread::id, std::unique_ptr<ThreadState>> _thread_states;
+};
+
 }  // namespace RosMsgParser
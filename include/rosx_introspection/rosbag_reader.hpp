@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rosx_introspection/builtin_types.hpp"
+
+namespace RosMsgParser {
+
+/// Connection of a ROS1 bag: a topic, with the type and the definition of its messages,
+/// that can be passed to a Parser (with the ROS_Deserializer).
+struct RosbagConnection {
+  uint32_t id = 0;
+  std::string topic;
+  std::string datatype;
+  std::string md5sum;
+  std::string definition;
+  std::string callerid;
+  bool latching = false;
+};
+
+/// Message of a ROS1 bag. [data] references the chunk that contains it, and is
+/// valid only until the reader moves to the next chunk.
+struct RosbagMessage {
+  const RosbagConnection* connection = nullptr;
+  Time stamp = {0, 0};
+  Span<const uint8_t> data;
+};
+
+/**
+ * @brief Reads the messages of a ROS1 bag (format 2.0), without the ROS1 libraries.
+ *
+ * The file is read sequentially, one chunk at a time: the messages are returned
+ * in the order in which they are stored, as spans over the decompressed chunk,
+ * without copying them. The connections are known when their first message is read.
+ *
+ *   RosbagReader bag("data.bag");
+ *   std::unordered_map<uint32_t, Parser> parsers;
+ *   ROS_Deserializer deserializer;
+ *   bag.readMessages([&](const RosbagMessage& msg) {
+ *     auto it = parsers.find(msg.connection->id);
+ *     if (it == parsers.end()) {
+ *       const auto& conn = *msg.connection;
+ *       it = parsers.emplace(conn.id, Parser(conn.topic, ROSType(conn.datatype), conn.definition)).first;
+ *     }
+ *     it->second.deserialize(msg.data, &flat, &deserializer);
+ *     return true;
+ *   });
+ *
+ * The chunks may be uncompressed, or compressed with "bz2" or "lz4" if the library
+ * was built with them (see supportsCompression()).
+ */
+class RosbagReader {
+ public:
+  /// Return false to stop reading.
+  using MessageCallback = std::function<bool(const RosbagMessage&)>;
+
+  /// Invoked with all the messages of a chunk, that are valid at the same time
+  /// (for instance to pass them to Parser::deserializeBatch()). Return false to stop reading.
+  using ChunkCallback = std::function<bool(Span<const RosbagMessage>)>;
+
+  /// Throws std::runtime_error if the file can not be opened, or it is not a bag of version 2.0.
+  explicit RosbagReader(const std::string& filename);
+
+  ~RosbagReader();
+
+  RosbagReader(const RosbagReader&) = delete;
+  RosbagReader& operator=(const RosbagReader&) = delete;
+
+  /// Read the messages from the beginning of the file.
+  void readMessages(const MessageCallback& callback);
+
+  /// Read the messages from the beginning of the file, a chunk at a time.
+  void readChunks(const ChunkCallback& callback);
+
+  /// Connections read so far, by id.
+  const std::unordered_map<uint32_t, RosbagConnection>& connections() const {
+    return _connections;
+  }
+
+  /// True if the chunks compressed with [compression] ("none", "bz2" or "lz4") can be read.
+  static bool supportsCompression(const std::string& compression);
+
+ private:
+  struct Record;
+
+  bool readRecord(Record& record);
+  void readConnection(const Record& record);
+  void decompressChunk(const Record& record);
+
+  std::ifstream _file;
+  std::unordered_map<uint32_t, RosbagConnection> _connections;
+  // buffers reused by all the records
+  std::vector<uint8_t> _header;
+  std::vector<uint8_t> _data;
+  std::vector<uint8_t> _chunk;
+  std::vector<RosbagMessage> _messages;
+  // decompression context of lz4, if available
+  struct Lz4Context;
+  std::unique_ptr<Lz4Context> _lz4;
+};
+
+}  // namespace RosMsgParser
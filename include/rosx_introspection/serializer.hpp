@@ -3,6 +3,7 @@
 // API adapted to FastCDR
 
 #include <exception>
+#include <string_view>
 #include <vector>
 
 #include "rosx_introspection/builtin_types.hpp"
@@ -24,8 +25,25 @@ class Serializer {
 
   virtual void serializeString(const std::string& str) = 0;
 
+  /// Serialize a string that is not stored in a std::string.
+  /// The default implementation copies it and calls serializeString().
+  virtual void serializeStringView(std::string_view str) {
+    serializeString(std::string(str));
+  }
+
   virtual void serializeUInt32(uint32_t value) = 0;
 
+  /// Serialize a value of [type] (not a string) read from [src], in host byte order,
+  /// without creating a Variant. TIME and DURATION are read from a Time.
+  /// The default implementation calls serialize() with a Variant.
+  virtual void writeFrom(BuiltinType type, const void* src);
+
+  /// Serialize a value of type T (a number, bool or char).
+  template <typename T>
+  void write(const T& value) {
+    writeFrom(getType<T>(), &value);
+  }
+
   virtual void reset() = 0;
 
   virtual const char* getBufferData() const = 0;
@@ -87,8 +105,12 @@ class NanoCDR_Serializer : public Serializer {
 
   void serializeString(const std::string& str) override;
 
+  void serializeStringView(std::string_view str) override;
+
   void serializeUInt32(uint32_t value) override;
 
+  void writeFrom(BuiltinType type, const void* src) override;
+
   void reset() override;
 
   const char* getBufferData() const override;
@@ -107,6 +107,28 @@ struct FieldLeaf {
   }
 };
 
+/// Two leaves are equal if they have the same node, array indices and @key values,
+/// i.e. they have the same path. To use FieldLeaf as the key of an unordered container.
+struct FieldLeafEqual {
+  bool operator()(const FieldLeaf& a, const FieldLeaf& b) const {
+    if (a.node != b.node || a.index_array != b.index_array || a.key_suffixes.size() != b.key_suffixes.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a.key_suffixes.size(); i++) {
+      const auto& ka = a.key_suffixes[i];
+      const auto& kb = b.key_suffixes[i];
+      if (ka.len != kb.len || std::memcmp(ka.data, kb.data, ka.len) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+struct FieldLeafHash {
+  size_t operator()(const FieldLeaf& leaf) const;
+};
+
 // Keep FieldsVector for backward compatibility
 struct FieldsVector {
   FieldsVector() = default;
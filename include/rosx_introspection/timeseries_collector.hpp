@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "rosx_introspection/message_writer.hpp"
+#include "rosx_introspection/ros_parser.hpp"
+
+namespace RosMsgParser {
+
+/// Values of a single field (a FieldTreeNode, with its array indices and @key values)
+/// across messages. Only the buffer of [type] is used; [time] has the same size.
+struct TimeSeriesColumn {
+  enum Type : uint8_t {
+    FLOAT64,  // FLOAT32, FLOAT64, TIME and DURATION (in seconds)
+    INT64,    // the integers, BOOL, CHAR and the enums. UINT64 values above INT64_MAX wrap around.
+    STRING    // ids in TimeSeriesCollector::strings()
+  };
+
+  FieldLeaf leaf;
+  Type type = FLOAT64;
+
+  std::vector<double> time;
+  std::vector<double> float_values;
+  std::vector<int64_t> int_values;
+  std::vector<uint32_t> string_ids;
+
+  size_t size() const {
+    return time.size();
+  }
+
+  /// Path of the field, e.g. "topic/pose/position/x" (rendered on request, not when appending).
+  std::string name() const {
+    return leaf.toStdString();
+  }
+};
+
+/**
+ * @brief MessageWriter that appends the values of the messages of a topic to
+ * one typed column per field, without rendering the path of the fields.
+ *
+ *   TimeSeriesCollector collector;
+ *   for (const auto& [timestamp, buffer] : messages) {
+ *     collector.collect(parser, buffer, timestamp, &deserializer);
+ *   }
+ *   for (const auto& column : collector.columns()) {
+ *     plot(column.name(), column.time, column.float_values);
+ *   }
+ *
+ * A column is identified by the FieldTreeNode of the field, its array indices and its
+ * @key values. The n-th value of a message usually goes to the same column as the n-th
+ * value of the previous message: the column of each position is cached, and compared
+ * with the field before appending the value, so that the hash map of the columns is
+ * used only when the shape of the messages changes (arrays of different size).
+ * For this reason, use one collector per topic.
+ *
+ * The blobs (see Parser::setBlobPolicy()) are not collected.
+ */
+class TimeSeriesCollector final : public MessageWriter {
+ public:
+  TimeSeriesCollector() = default;
+
+  TimeSeriesCollector(const TimeSeriesCollector&) = delete;
+  TimeSeriesCollector& operator=(const TimeSeriesCollector&) = delete;
+
+  /// Append the values of the message in [buffer], at [timestamp]. If the message
+  /// is rejected by a predicate of the parser (see Parser::setFieldPredicates()),
+  /// nothing is appended. Returns the result of Parser::walkSchema().
+  template <class DeserializerT>
+  bool collect(const Parser& parser, Span<const uint8_t> buffer, double timestamp, DeserializerT* deserializer);
+
+  /// Columns in order of creation. The references remain valid when new columns are added.
+  const std::deque<TimeSeriesColumn>& columns() const {
+    return _columns;
+  }
+
+  /// Strings referenced by the columns of type STRING. Equal strings have the same id.
+  const std::vector<std::string>& strings() const {
+    return _strings;
+  }
+
+  /// Remove the values of all the columns, but keep the columns.
+  void clear();
+
+  /// Set the timestamp of the next values, when this is used directly with Parser::walkSchema().
+  void setTimestamp(double timestamp) {
+    _timestamp = timestamp;
+    _position = 0;
+  }
+
+  void writeValue(const FieldLeaf& leaf, const Variant& value) override;
+
+  void writeBool(const FieldLeaf& leaf, bool value) override {
+    appendInt(leaf, value);
+  }
+  void writeChar(const FieldLeaf& leaf, char value) override {
+    appendInt(leaf, value);
+  }
+  void writeInt8(const FieldLeaf& leaf, int8_t value) override {
+    appendInt(leaf, value);
+  }
+  void writeInt16(const FieldLeaf& leaf, int16_t value) override {
+    appendInt(leaf, value);
+  }
+  void writeInt32(const FieldLeaf& leaf, int32_t value) override {
+    appendInt(leaf, value);
+  }
+  void writeInt64(const FieldLeaf& leaf, int64_t value) override {
+    appendInt(leaf, value);
+  }
+  void writeUInt8(const FieldLeaf& leaf, uint8_t value) override {
+    appendInt(leaf, value);
+  }
+  void writeUInt16(const FieldLeaf& leaf, uint16_t value) override {
+    appendInt(leaf, value);
+  }
+  void writeUInt32(const FieldLeaf& leaf, uint32_t value) override {
+    appendInt(leaf, value);
+  }
+  void writeUInt64(const FieldLeaf& leaf, uint64_t value) override {
+    appendInt(leaf, static_cast<int64_t>(value));
+  }
+  void writeFloat32(const FieldLeaf& leaf, float value) override {
+    appendFloat(leaf, value);
+  }
+  void writeFloat64(const FieldLeaf& leaf, double value) override {
+    appendFloat(leaf, value);
+  }
+
+  void writeString(const FieldLeaf& leaf, const std::string& value) override {
+    writeString(leaf, std::string_view(value));
+  }
+
+  void writeString(const FieldLeaf& leaf, std::string_view value) override {
+    auto& column = columnAt(leaf, TimeSeriesColumn::STRING);
+    column.time.push_back(_timestamp);
+    column.string_ids.push_back(stringId(column, value));
+  }
+
+  void writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& /*name*/) override {
+    appendInt(leaf, value);
+  }
+
+  void writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) override;
+
+  void finish() override {
+    _message_size = _position;
+    _position = 0;
+  }
+
+ private:
+  // The column of the value at the current position of the message.
+  TimeSeriesColumn& columnAt(const FieldLeaf& leaf, TimeSeriesColumn::Type type) {
+    if (_position < _column_at.size()) {
+      TimeSeriesColumn* column = _column_at[_position];
+      if (FieldLeafEqual()(column->leaf, leaf)) {
+        _position++;
+        return *column;
+      }
+    }
+    return findColumn(leaf, type);
+  }
+
+  template <typename T>
+  void appendInt(const FieldLeaf& leaf, T value) {
+    auto& column = columnAt(leaf, TimeSeriesColumn::INT64);
+    column.time.push_back(_timestamp);
+    column.int_values.push_back(static_cast<int64_t>(value));
+  }
+
+  void appendFloat(const FieldLeaf& leaf, double value) {
+    auto& column = columnAt(leaf, TimeSeriesColumn::FLOAT64);
+    column.time.push_back(_timestamp);
+    column.float_values.push_back(value);
+  }
+
+  TimeSeriesColumn& findColumn(const FieldLeaf& leaf, TimeSeriesColumn::Type type);
+  uint32_t stringId(TimeSeriesColumn& column, std::string_view value);
+  // Remove the last value of the columns of the first [count] positions.
+  void rollback(size_t count);
+
+  std::deque<TimeSeriesColumn> _columns;
+  std::unordered_map<FieldLeaf, TimeSeriesColumn*, FieldLeafHash, FieldLeafEqual> _column_index;
+  // column of the n-th value of the last messages
+  std::vector<TimeSeriesColumn*> _column_at;
+  size_t _position = 0;
+  // number of values of the last message
+  size_t _message_size = 0;
+  double _timestamp = 0;
+
+  std::vector<std::string> _strings;
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const {
+      return std::hash<std::string_view>()(str);
+    }
+  };
+  std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>> _string_ids;
+  FieldLeaf _element;
+};
+
+template <class DeserializerT>
+inline bool TimeSeriesCollector::collect(const Parser& parser, Span<const uint8_t> buffer, double timestamp,
+                                         DeserializerT* deserializer) {
+  setTimestamp(timestamp);
+  bool filtered_out = false;
+  bool entire_message_parsed = false;
+  try {
+    entire_message_parsed = parser.walkSchema(buffer, deserializer, this, &filtered_out);
+  } catch (...) {
+    rollback(_position);
+    _position = 0;
+    throw;
+  }
+  if (filtered_out) {
+    rollback(_message_size);
+  }
+  return entire_message_parsed;
+}
+
+}  // namespace RosMsgParser
@@ -56,15 +56,8 @@ class Variant {
   ~Variant();
 
   Variant(const Variant& other) : _type(OTHER) {
-    if (other._type == STRING) {
-      const char* raw = other._storage.raw_string;
-      const uint32_t size = *(reinterpret_cast<const uint32_t*>(&raw[0]));
-      const char* data = (&raw[4]);
-      assign(data, size);
-    } else {
-      _type = other._type;
-      _storage.raw_data = other._storage.raw_data;
-    }
+    _storage.raw_string = nullptr;
+    *this = other;
   }
 
   Variant(Variant&& other) : _type(OTHER) {
@@ -72,6 +65,7 @@ class Variant {
       _storage.raw_string = nullptr;
       std::swap(_storage.raw_string, other._storage.raw_string);
       std::swap(_type, other._type);
+      std::swap(_string_ref_size, other._string_ref_size);
     } else {
       _type = other._type;
       _storage.raw_data = other._storage.raw_data;
@@ -79,14 +73,18 @@ class Variant {
   }
 
   Variant& operator=(const Variant& other) {
-    if (other._type == STRING) {
-      const char* raw = other._storage.raw_string;
-      const uint32_t size = *(reinterpret_cast<const uint32_t*>(&raw[0]));
-      const char* data = (&raw[4]);
-      assign(data, size);
+    if (this == &other) {
+      return *this;
+    }
+    if (other._type == STRING && !other.isStringReference()) {
+      const std::string_view value = other.stringView();
+      assign(value.data(), value.size());
     } else {
+      // a reference is copied as a reference
+      clearStringIfNecessary();
       _type = other._type;
       _storage.raw_data = other._storage.raw_data;
+      _string_ref_size = other._string_ref_size;
     }
     return *this;
   }
@@ -110,10 +108,21 @@ class Variant {
 
   void assign(const char* buffer, size_t length);
 
+  /// Hold a STRING that references [value], instead of a copy of it.
+  /// The characters must outlive this Variant and its copies (see Parser::setStringPolicy).
+  void assignStringReference(std::string_view value);
+
+  /// True if this Variant holds a STRING assigned with assignStringReference().
+  bool isStringReference() const {
+    return _type == STRING && _string_ref_size != NOT_A_REFERENCE;
+  }
+
   // Direct access to raw data. Undefined behavior if this variant holds a STRING
   const uint8_t* getRawStorage() const;
 
  private:
+  static constexpr uint32_t NOT_A_REFERENCE = std::numeric_limits<uint32_t>::max();
+
   union {
     std::array<uint8_t, 8> raw_data;
     char* raw_string;
@@ -121,7 +130,12 @@ class Variant {
 
   void clearStringIfNecessary();
 
+  // characters of a STRING, either owned or referenced
+  std::string_view stringView() const;
+
   BuiltinType _type;
+  // size of the characters referenced by _storage.raw_string, if they are not owned
+  uint32_t _string_ref_size = NOT_A_REFERENCE;
 };
 
 //----------------------- Implementation ----------------------------------------------
@@ -167,14 +181,21 @@ inline T Variant::extract() const {
   return *reinterpret_cast<const T*>(&_storage.raw_data[0]);
 }
 
+inline std::string_view Variant::stringView() const {
+  if (_string_ref_size != NOT_A_REFERENCE) {
+    return std::string_view(_storage.raw_string, _string_ref_size);
+  }
+  const uint32_t size = *(reinterpret_cast<const uint32_t*>(&_storage.raw_string[0]));
+  const char* data = static_cast<const char*>(&_storage.raw_string[4]);
+  return std::string_view(data, size);
+}
+
 template <>
 inline std::string_view Variant::extract() const {
   if (_type != STRING) {
     throw TypeException("Variant::extract -> wrong type");
   }
-  const uint32_t size = *(reinterpret_cast<const uint32_t*>(&_storage.raw_string[0]));
-  char* data = static_cast<char*>(&_storage.raw_string[4]);
-  return std::string_view(data, size);
+  return stringView();
 }
 
 template <>
@@ -182,9 +203,7 @@ inline std::string Variant::extract() const {
   if (_type != STRING) {
     throw TypeException("Variant::extract -> wrong type");
   }
-  const uint32_t size = *(reinterpret_cast<const uint32_t*>(&_storage.raw_string[0]));
-  char* data = static_cast<char*>(&_storage.raw_string[4]);
-  return std::string(data, size);
+  return std::string(stringView());
 }
 
 //-------------------------------------
@@ -201,9 +220,22 @@ inline void Variant::assign(const T& value) {
 
 inline void Variant::clearStringIfNecessary() {
   if (_storage.raw_string && _type == STRING) {
-    delete[] _storage.raw_string;
+    if (_string_ref_size == NOT_A_REFERENCE) {
+      delete[] _storage.raw_string;
+    }
     _storage.raw_string = nullptr;
   }
+  _string_ref_size = NOT_A_REFERENCE;
+}
+
+inline void Variant::assignStringReference(std::string_view value) {
+  if (value.size() >= NOT_A_REFERENCE) {
+    throw TypeException("Variant::assignStringReference -> string too long");
+  }
+  clearStringIfNecessary();
+  _type = STRING;
+  _storage.raw_string = const_cast<char*>(value.data());
+  _string_ref_size = static_cast<uint32_t>(value.size());
 }
 
 inline void Variant::assign(const char* buffer, size_t size) {
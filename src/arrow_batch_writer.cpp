@@ -0,0 +1,693 @@
+#include "rosx_introspection/arrow_batch_writer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#include "rosx_introspection/ros_field.hpp"
+
+namespace RosMsgParser {
+
+namespace {
+
+void setBit(std::vector<uint8_t>& bits, size_t index, bool value) {
+  if (bits.size() <= index / 8) {
+    bits.resize(std::max(index / 8 + 1, bits.size() * 2), 0);
+  }
+  const uint8_t mask = static_cast<uint8_t>(1u << (index % 8));
+  if (value) {
+    bits[index / 8] |= mask;
+  } else {
+    bits[index / 8] &= static_cast<uint8_t>(~mask);
+  }
+}
+
+bool getBit(const std::vector<uint8_t>& bits, size_t index) {
+  return (bits[index / 8] >> (index % 8)) & 1;
+}
+
+// Format string of the builtin types, see the Arrow C Data Interface
+const char* builtinFormat(BuiltinType type) {
+  switch (type) {
+    case BOOL:
+      return "b";
+    case CHAR:
+    case INT8:
+      return "c";
+    case BYTE:
+    case UINT8:
+      return "C";
+    case INT16:
+      return "s";
+    case UINT16:
+      return "S";
+    case INT32:
+      return "i";
+    case UINT32:
+      return "I";
+    case INT64:
+      return "l";
+    case UINT64:
+      return "L";
+    case FLOAT32:
+      return "f";
+    case FLOAT64:
+      return "g";
+    case TIME:
+      return "tsn:";
+    case DURATION:
+      return "tDn";
+    case STRING:
+      return "u";
+    default:
+      return nullptr;
+  }
+}
+
+int64_t toNanoseconds(const Time& time) {
+  return static_cast<int64_t>(time.sec) * 1000000000 + time.nsec;
+}
+
+struct ExportedSchema {
+  std::string format;
+  std::string name;
+  std::vector<ArrowSchema> children;
+  std::vector<ArrowSchema*> children_ptr;
+};
+
+void releaseSchema(ArrowSchema* schema) {
+  auto* exported = static_cast<ExportedSchema*>(schema->private_data);
+  for (ArrowSchema* child : exported->children_ptr) {
+    if (child->release) {
+      child->release(child);
+    }
+  }
+  delete exported;
+  schema->release = nullptr;
+}
+
+// The buffers of an exported array, moved out of its column.
+struct ExportedArray {
+  std::vector<uint8_t> validity;
+  std::vector<uint8_t> values;
+  std::vector<int32_t> offsets;
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> views;
+  std::vector<int64_t> variadic_sizes;
+  std::vector<const void*> buffers;
+  std::vector<ArrowArray> children;
+  std::vector<ArrowArray*> children_ptr;
+};
+
+void releaseArray(ArrowArray* array) {
+  auto* exported = static_cast<ExportedArray*>(array->private_data);
+  for (ArrowArray* child : exported->children_ptr) {
+    if (child->release) {
+      child->release(child);
+    }
+  }
+  delete exported;
+  array->release = nullptr;
+}
+
+}  // namespace
+
+//---------------------------------------------------------
+
+struct ArrowBatchWriter::Column {
+  enum Kind : uint8_t { FIXED, BOOLEAN, UTF8, BINARY_VIEW, STRUCT, LIST };
+
+  // A value of binary_view: [length] bytes at [offset] of the data of the column
+  // (buffer == -1) or of external[buffer].
+  struct View {
+    uint32_t length;
+    int32_t buffer;
+    uint32_t offset;
+  };
+
+  Kind kind = STRUCT;
+  BuiltinType type = OTHER;
+  uint8_t width = 0;
+  std::string name;
+  std::string format;
+  // struct that contains the column; for the element of a list, the list.
+  Column* parent = nullptr;
+  std::vector<std::unique_ptr<Column>> children;
+
+  size_t length = 0;
+  size_t null_count = 0;
+  std::vector<uint8_t> validity;
+  // FIXED: the values; BOOLEAN: a bit per value
+  std::vector<uint8_t> values;
+  // UTF8 and LIST: the beginning of each slot; the end of the last one is data.size() or the length of the child
+  std::vector<int32_t> offsets;
+  // UTF8: the characters; BINARY_VIEW: the values that are copied
+  std::vector<uint8_t> data;
+  std::vector<View> views;
+  std::vector<Span<const uint8_t>> external;
+
+  Column* element() const {
+    return children.front().get();
+  }
+
+  // Index of the slot of the parent that is being written.
+  size_t parentSlot() const {
+    return parent->length - 1;
+  }
+
+  void appendValidity(bool valid) {
+    setBit(validity, length, valid);
+    length++;
+    if (!valid) {
+      null_count++;
+    }
+  }
+
+  // Make sure that the list has a slot for the current slot of its parent.
+  void openList() {
+    const size_t slot = parentSlot();
+    if (length <= slot) {
+      padTo(slot);
+      offsets.push_back(static_cast<int32_t>(element()->length));
+      appendValidity(true);
+    }
+  }
+
+  // Empty lists and null values, up to [size] slots.
+  void padTo(size_t size) {
+    while (length < size) {
+      switch (kind) {
+        case FIXED:
+          values.resize(values.size() + width, 0);
+          break;
+        case BOOLEAN:
+          setBit(values, length, false);
+          break;
+        case UTF8:
+          offsets.push_back(static_cast<int32_t>(data.size()));
+          break;
+        case BINARY_VIEW:
+          views.push_back({0, -1, 0});
+          break;
+        case STRUCT:
+          break;
+        case LIST:
+          offsets.push_back(static_cast<int32_t>(element()->length));
+          appendValidity(true);
+          continue;
+      }
+      appendValidity(false);
+    }
+  }
+
+  // Pad the children of the structs to the length of their parent, before exporting.
+  void padChildren() {
+    for (auto& child : children) {
+      if (kind == STRUCT) {
+        child->padTo(length);
+      }
+      child->padChildren();
+    }
+  }
+
+  void truncate(size_t size) {
+    if (length <= size) {
+      return;
+    }
+    for (size_t i = size; i < length; i++) {
+      if (!getBit(validity, i)) {
+        null_count--;
+      }
+    }
+    switch (kind) {
+      case FIXED:
+        values.resize(size * width);
+        break;
+      case BOOLEAN:
+        break;
+      case UTF8:
+        data.resize(static_cast<size_t>(offsets[size]));
+        offsets.resize(size);
+        break;
+      case BINARY_VIEW: {
+        for (size_t i = size; i < length; i++) {
+          const View& view = views[i];
+          if (view.buffer == -1 && view.length > 0) {
+            data.resize(std::min<size_t>(data.size(), view.offset));
+          } else if (view.buffer >= 0) {
+            external.resize(std::min<size_t>(external.size(), static_cast<size_t>(view.buffer)));
+          }
+        }
+        views.resize(size);
+      } break;
+      case STRUCT:
+        for (auto& child : children) {
+          child->truncate(size);
+        }
+        break;
+      case LIST:
+        element()->truncate(static_cast<size_t>(offsets[size]));
+        offsets.resize(size);
+        break;
+    }
+    length = size;
+  }
+
+  template <typename T>
+  void appendFixed(T value) {
+    const size_t pos = values.size();
+    values.resize(pos + sizeof(T));
+    memcpy(values.data() + pos, &value, sizeof(T));
+    appendValidity(true);
+  }
+
+  void appendVariant(const Variant& value) {
+    switch (type) {
+      case BOOL:
+        setBit(values, length, value.convert<uint8_t>() != 0);
+        appendValidity(true);
+        break;
+      case CHAR:
+      case INT8:
+        return appendFixed(value.convert<int8_t>());
+      case BYTE:
+      case UINT8:
+        return appendFixed(value.convert<uint8_t>());
+      case INT16:
+        return appendFixed(value.convert<int16_t>());
+      case UINT16:
+        return appendFixed(value.convert<uint16_t>());
+      case INT32:
+        return appendFixed(value.convert<int32_t>());
+      case UINT32:
+        return appendFixed(value.convert<uint32_t>());
+      case INT64:
+        return appendFixed(value.convert<int64_t>());
+      case UINT64:
+        return appendFixed(value.convert<uint64_t>());
+      case FLOAT32:
+        return appendFixed(value.convert<float>());
+      case FLOAT64:
+        return appendFixed(value.convert<double>());
+      case TIME:
+      case DURATION:
+        return appendFixed(toNanoseconds(value.convert<Time>()));
+      case STRING:
+        appendString(value.extract<std::string_view>());
+        break;
+      default:
+        throw std::runtime_error("ArrowBatchWriter: unexpected value for the field " + name);
+    }
+  }
+
+  void appendString(std::string_view str) {
+    if (kind != UTF8) {
+      throw std::runtime_error("ArrowBatchWriter: unexpected string for the field " + name);
+    }
+    offsets.push_back(static_cast<int32_t>(data.size()));
+    data.insert(data.end(), str.begin(), str.end());
+    appendValidity(true);
+  }
+
+  // Append [bytes] to the binary value of the current slot of the parent.
+  void appendBytes(Span<const uint8_t> bytes) {
+    const size_t slot = parentSlot();
+    if (length <= slot) {
+      padTo(slot);
+      views.push_back({0, -1, static_cast<uint32_t>(data.size())});
+      appendValidity(true);
+    }
+    data.insert(data.end(), bytes.data(), bytes.data() + bytes.size());
+    views.back().length += static_cast<uint32_t>(bytes.size());
+  }
+
+  void appendReference(Span<const uint8_t> bytes) {
+    padTo(parentSlot());
+    views.push_back({static_cast<uint32_t>(bytes.size()), static_cast<int32_t>(external.size()), 0});
+    external.push_back(bytes);
+    appendValidity(true);
+  }
+
+  void exportSchema(ArrowSchema* schema) const {
+    auto* exported = new ExportedSchema;
+    exported->format = format;
+    exported->name = name;
+    exported->children.resize(children.size());
+    for (size_t i = 0; i < children.size(); i++) {
+      children[i]->exportSchema(&exported->children[i]);
+      exported->children_ptr.push_back(&exported->children[i]);
+    }
+    schema->format = exported->format.c_str();
+    schema->name = exported->name.c_str();
+    schema->metadata = nullptr;
+    schema->flags = ARROW_FLAG_NULLABLE;
+    schema->n_children = static_cast<int64_t>(exported->children_ptr.size());
+    schema->children = exported->children_ptr.data();
+    schema->dictionary = nullptr;
+    schema->release = &releaseSchema;
+    schema->private_data = exported;
+  }
+
+  // Move the content of the column into [array], and leave the column empty.
+  void exportArray(ArrowArray* array) {
+    auto* exported = new ExportedArray;
+
+    exported->validity = std::move(validity);
+    exported->buffers.push_back(null_count > 0 ? exported->validity.data() : nullptr);
+
+    switch (kind) {
+      case FIXED:
+      case BOOLEAN:
+        exported->values = std::move(values);
+        exported->buffers.push_back(exported->values.data());
+        break;
+      case UTF8:
+        exported->offsets = std::move(offsets);
+        exported->offsets.push_back(static_cast<int32_t>(data.size()));
+        exported->data = std::move(data);
+        exported->buffers.push_back(exported->offsets.data());
+        exported->buffers.push_back(exported->data.data());
+        break;
+      case LIST:
+        exported->offsets = std::move(offsets);
+        exported->offsets.push_back(static_cast<int32_t>(element()->length));
+        exported->buffers.push_back(exported->offsets.data());
+        break;
+      case BINARY_VIEW:
+        exportViews(*exported);
+        break;
+      case STRUCT:
+        break;
+    }
+
+    exported->children.resize(children.size());
+    for (size_t i = 0; i < children.size(); i++) {
+      children[i]->exportArray(&exported->children[i]);
+      exported->children_ptr.push_back(&exported->children[i]);
+    }
+
+    array->length = static_cast<int64_t>(length);
+    array->null_count = static_cast<int64_t>(null_count);
+    array->offset = 0;
+    array->n_buffers = static_cast<int64_t>(exported->buffers.size());
+    array->n_children = static_cast<int64_t>(exported->children_ptr.size());
+    array->buffers = exported->buffers.data();
+    array->children = exported->children_ptr.data();
+    array->dictionary = nullptr;
+    array->release = &releaseArray;
+    array->private_data = exported;
+
+    length = 0;
+    null_count = 0;
+    validity = {};
+    values = {};
+    offsets = {};
+    data = {};
+    views = {};
+    external = {};
+  }
+
+  // 16 bytes per value: the length, then the value if it fits in 12 bytes, otherwise its
+  // first 4 bytes, the index of the variadic buffer and the offset in it.
+  // The data of the column is the variadic buffer 0, the external buffers follow.
+  void exportViews(ExportedArray& exported) {
+    exported.data = std::move(data);
+    exported.views.resize(length * 16, 0);
+    for (size_t i = 0; i < length; i++) {
+      const View& view = views[i];
+      const uint8_t* bytes = (view.buffer == -1) ? exported.data.data() + view.offset
+                                                 : external[static_cast<size_t>(view.buffer)].data();
+      uint8_t* out = exported.views.data() + i * 16;
+      memcpy(out, &view.length, 4);
+      if (view.length <= 12) {
+        if (view.length > 0) {
+          memcpy(out + 4, bytes, view.length);
+        }
+      } else {
+        const int32_t buffer_index = view.buffer + 1;
+        memcpy(out + 4, bytes, 4);
+        memcpy(out + 8, &buffer_index, 4);
+        memcpy(out + 12, &view.offset, 4);
+      }
+    }
+    exported.buffers.push_back(exported.views.data());
+    exported.buffers.push_back(exported.data.data());
+    exported.variadic_sizes.push_back(static_cast<int64_t>(exported.data.size()));
+    for (const auto& buffer : external) {
+      exported.buffers.push_back(buffer.data());
+      exported.variadic_sizes.push_back(static_cast<int64_t>(buffer.size()));
+    }
+    exported.buffers.push_back(exported.variadic_sizes.data());
+  }
+};
+
+//---------------------------------------------------------
+
+ArrowBatchWriter::ArrowBatchWriter(const Parser& parser) : _parser(parser) {
+  const auto& schema = parser.getSchema();
+  const FieldTreeNode* root = schema->field_tree.croot();
+
+  _root = std::make_unique<Column>();
+  _root->format = "+s";
+  _root->name = schema->topic_name;
+
+  std::function<void(const FieldTreeNode*, Column*)> addChildren = [&](const FieldTreeNode* node, Column* parent) {
+    for (const auto& child_node : node->children()) {
+      const ROSField* field = child_node.value();
+      // the writer is not told which case of a union is active
+      if (field->getUnion()) {
+        continue;
+      }
+      auto column = std::make_unique<Column>();
+      column->name = field->name();
+      column->parent = parent;
+
+      const BuiltinType type = field->getEnum() ? INT32 : field->type().typeID();
+      Column* element = column.get();
+      if (field->isArray() && (type == BYTE || type == UINT8)) {
+        column->kind = Column::BINARY_VIEW;
+        column->format = "vz";
+      } else if (field->isArray()) {
+        column->kind = Column::LIST;
+        column->format = "+l";
+        column->children.push_back(std::make_unique<Column>());
+        element = column->element();
+        element->name = "item";
+        element->parent = column.get();
+      }
+      if (column->kind != Column::BINARY_VIEW) {
+        element->type = type;
+        if (type == OTHER) {
+          element->kind = Column::STRUCT;
+          element->format = "+s";
+          addChildren(&child_node, element);
+        } else {
+          element->kind = (type == STRING) ? Column::UTF8 : (type == BOOL) ? Column::BOOLEAN : Column::FIXED;
+          element->format = builtinFormat(type);
+          if (element->kind == Column::FIXED) {
+            element->width = static_cast<uint8_t>(builtinSize(type));
+          }
+        }
+      }
+      _columns[child_node.nodeId()] = column.get();
+      parent->children.push_back(std::move(column));
+    }
+  };
+  // a slot for each node, including the members of the union cases that have no column
+  std::function<uint32_t(const FieldTreeNode*)> lastNodeId = [&](const FieldTreeNode* node) {
+    return node->isLeaf() ? node->nodeId() : lastNodeId(&node->children().back());
+  };
+  _columns.resize(lastNodeId(root) + 1, nullptr);
+  addChildren(root, _root.get());
+}
+
+ArrowBatchWriter::~ArrowBatchWriter() = default;
+
+void ArrowBatchWriter::exportSchema(ArrowSchema* schema) const {
+  _root->exportSchema(schema);
+}
+
+void ArrowBatchWriter::exportBatch(ArrowArray* array) {
+  truncate(_rows);
+  _root->padChildren();
+  _root->exportArray(array);
+  _rows = 0;
+}
+
+void ArrowBatchWriter::truncate(size_t rows) {
+  _root->truncate(rows);
+  _rows = rows;
+  _row_open = false;
+}
+
+void ArrowBatchWriter::beginRow() {
+  _root->appendValidity(true);
+  _struct_nodes.clear();
+  _struct_nodes.push_back(_parser.getSchema()->field_tree.croot());
+  _row_open = true;
+}
+
+ArrowBatchWriter::Column* ArrowBatchWriter::openColumn(const FieldTreeNode* node) {
+  if (!_row_open) {
+    beginRow();
+  }
+  Column* column = _columns[node->nodeId()];
+  if (!column || column->kind == Column::BINARY_VIEW) {
+    return column;
+  }
+  if (column->kind == Column::LIST) {
+    column->openList();
+    return column->element();
+  }
+  column->padTo(column->parentSlot());
+  return column;
+}
+
+template <typename T>
+void ArrowBatchWriter::appendValue(const FieldLeaf& leaf, T value) {
+  Column* column = openColumn(leaf.node);
+  if (!column) {
+    return;
+  }
+  if (column->kind == Column::BINARY_VIEW) {
+    const auto byte = static_cast<uint8_t>(value);
+    column->appendBytes(Span<const uint8_t>(&byte, 1));
+  } else if (column->kind == Column::FIXED && column->type == getType<T>()) {
+    column->appendFixed(value);
+  } else {
+    column->appendVariant(Variant(value));
+  }
+}
+
+void ArrowBatchWriter::writeValue(const FieldLeaf& leaf, const Variant& value) {
+  Column* column = openColumn(leaf.node);
+  if (!column) {
+    return;
+  }
+  if (column->kind == Column::BINARY_VIEW) {
+    const auto byte = value.convert<uint8_t>();
+    column->appendBytes(Span<const uint8_t>(&byte, 1));
+  } else {
+    column->appendVariant(value);
+  }
+}
+
+void ArrowBatchWriter::writeBool(const FieldLeaf& leaf, bool value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeChar(const FieldLeaf& leaf, char value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeInt8(const FieldLeaf& leaf, int8_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeInt16(const FieldLeaf& leaf, int16_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeInt32(const FieldLeaf& leaf, int32_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeInt64(const FieldLeaf& leaf, int64_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeUInt8(const FieldLeaf& leaf, uint8_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeUInt16(const FieldLeaf& leaf, uint16_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeUInt32(const FieldLeaf& leaf, uint32_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeUInt64(const FieldLeaf& leaf, uint64_t value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeFloat32(const FieldLeaf& leaf, float value) {
+  appendValue(leaf, value);
+}
+void ArrowBatchWriter::writeFloat64(const FieldLeaf& leaf, double value) {
+  appendValue(leaf, value);
+}
+
+void ArrowBatchWriter::writeString(const FieldLeaf& leaf, const std::string& value) {
+  writeString(leaf, std::string_view(value));
+}
+
+void ArrowBatchWriter::writeString(const FieldLeaf& leaf, std::string_view value) {
+  if (Column* column = openColumn(leaf.node)) {
+    column->appendString(value);
+  }
+}
+
+void ArrowBatchWriter::writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& /*name*/) {
+  appendValue(leaf, value);
+}
+
+void ArrowBatchWriter::writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) {
+  Column* column = openColumn(leaf.node);
+  if (!column) {
+    return;
+  }
+  if (column->kind == Column::BINARY_VIEW) {
+    column->appendBytes(raw);
+  } else if (column->kind == Column::FIXED && column->type == type && type != TIME && type != DURATION) {
+    // the values are already in the layout of the column
+    column->values.insert(column->values.end(), raw.data(), raw.data() + count * column->width);
+    for (size_t i = 0; i < count; i++) {
+      column->appendValidity(true);
+    }
+  } else {
+    ForEachArrayValue(type, raw, count, [column](size_t, const Variant& value) { column->appendVariant(value); });
+  }
+}
+
+void ArrowBatchWriter::writeBlob(const FieldLeaf& leaf, Span<const uint8_t> data) {
+  Column* column = openColumn(leaf.node);
+  if (!column || column->kind != Column::BINARY_VIEW) {
+    return;
+  }
+  if (_parser.blobPolicy() == Parser::STORE_BLOB_AS_REFERENCE) {
+    column->appendReference(data);
+  } else {
+    column->appendBytes(data);
+  }
+}
+
+void ArrowBatchWriter::beginStruct(const ROSField& field) {
+  if (!_row_open) {
+    beginRow();
+  }
+  const FieldTreeNode* parent = _struct_nodes.back();
+  const FieldTreeNode* node = nullptr;
+  if (parent) {
+    for (const auto& child : parent->children()) {
+      if (child.value() == &field) {
+        node = &child;
+        break;
+      }
+    }
+  }
+  _struct_nodes.push_back(node);
+  if (node) {
+    if (Column* column = openColumn(node)) {
+      column->appendValidity(true);
+    }
+  }
+}
+
+void ArrowBatchWriter::endStruct() {
+  if (_struct_nodes.size() > 1) {
+    _struct_nodes.pop_back();
+  }
+}
+
+void ArrowBatchWriter::finish() {
+  if (!_row_open) {
+    beginRow();
+  }
+  _row_open = false;
+  _rows++;
+}
+
+}  // namespace RosMsgParser
@@ -0,0 +1,168 @@
+#include "rosx_introspection/details/byte_swap.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ROSX_SWAP_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define ROSX_SWAP_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace RosMsgParser::details {
+
+namespace {
+
+// Compilers turn these into a single bswap instruction.
+inline uint16_t byteSwap(uint16_t v) {
+  return static_cast<uint16_t>((v >> 8) | (v << 8));
+}
+
+inline uint32_t byteSwap(uint32_t v) {
+  return ((v & 0xFFu) << 24) | ((v & 0xFF00u) << 8) | ((v >> 8) & 0xFF00u) | (v >> 24);
+}
+
+inline uint64_t byteSwap(uint64_t v) {
+  return (uint64_t(byteSwap(uint32_t(v))) << 32) | byteSwap(uint32_t(v >> 32));
+}
+
+template <typename T>
+void swapPortable(uint8_t* dst, const uint8_t* src, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    T value;
+    memcpy(&value, src + i * sizeof(T), sizeof(T));
+    value = byteSwap(value);
+    memcpy(dst + i * sizeof(T), &value, sizeof(T));
+  }
+}
+
+#if defined(ROSX_SWAP_X86)
+
+// Indices of a byte shuffle that reverses each group of N bytes of a 16 bytes lane
+// (the AVX2 shuffle works on two independent lanes).
+template <size_t N>
+struct ShuffleMask {
+  alignas(32) uint8_t bytes[32] = {};
+
+  constexpr ShuffleMask() {
+    for (size_t i = 0; i < 32; i++) {
+      const size_t lane_index = i % 16;
+      bytes[i] = static_cast<uint8_t>(lane_index / N * N + (N - 1 - lane_index % N));
+    }
+  }
+};
+
+template <typename T>
+constexpr ShuffleMask<sizeof(T)> SHUFFLE_MASK{};
+
+template <typename T>
+__attribute__((target("ssse3"))) void swapSSSE3(uint8_t* dst, const uint8_t* src, size_t count) {
+  const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(SHUFFLE_MASK<T>.bytes));
+  const size_t bytes = count * sizeof(T);
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+  }
+  swapPortable<T>(dst + i, src + i, (bytes - i) / sizeof(T));
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void swapAVX2(uint8_t* dst, const uint8_t* src, size_t count) {
+  const __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(SHUFFLE_MASK<T>.bytes));
+  const size_t bytes = count * sizeof(T);
+  size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v0, mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), _mm256_shuffle_epi8(v1, mask));
+  }
+  for (; i + 32 <= bytes; i += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v, mask));
+  }
+  swapPortable<T>(dst + i, src + i, (bytes - i) / sizeof(T));
+}
+
+#elif defined(ROSX_SWAP_NEON)
+
+template <typename T>
+void swapNEON(uint8_t* dst, const uint8_t* src, size_t count) {
+  const size_t bytes = count * sizeof(T);
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    const uint8x16_t v = vld1q_u8(src + i);
+    if constexpr (sizeof(T) == 2) {
+      vst1q_u8(dst + i, vrev16q_u8(v));
+    } else if constexpr (sizeof(T) == 4) {
+      vst1q_u8(dst + i, vrev32q_u8(v));
+    } else {
+      vst1q_u8(dst + i, vrev64q_u8(v));
+    }
+  }
+  swapPortable<T>(dst + i, src + i, (bytes - i) / sizeof(T));
+}
+
+#endif
+
+using SwapFunction = void (*)(uint8_t*, const uint8_t*, size_t);
+
+struct SwapKernels {
+  SwapFunction swap2;
+  SwapFunction swap4;
+  SwapFunction swap8;
+  const char* name;
+};
+
+SwapKernels selectKernels() {
+#if defined(ROSX_SWAP_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {swapAVX2<uint16_t>, swapAVX2<uint32_t>, swapAVX2<uint64_t>, "avx2"};
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return {swapSSSE3<uint16_t>, swapSSSE3<uint32_t>, swapSSSE3<uint64_t>, "ssse3"};
+  }
+#elif defined(ROSX_SWAP_NEON)
+  return {swapNEON<uint16_t>, swapNEON<uint32_t>, swapNEON<uint64_t>, "neon"};
+#endif
+  return {swapPortable<uint16_t>, swapPortable<uint32_t>, swapPortable<uint64_t>, "portable"};
+}
+
+// The CPU is inspected once, the first time a value is swapped.
+const SwapKernels& kernels() {
+  static const SwapKernels selected = selectKernels();
+  return selected;
+}
+
+}  // namespace
+
+void swapBytesInBulk(uint8_t* dst, const uint8_t* src, size_t count, size_t size) {
+  switch (size) {
+    case 1:
+      if (dst != src) {
+        memcpy(dst, src, count);
+      }
+      return;
+    case 2:
+      kernels().swap2(dst, src, count);
+      return;
+    case 4:
+      kernels().swap4(dst, src, count);
+      return;
+    case 8:
+      kernels().swap8(dst, src, count);
+      return;
+  }
+  throw std::runtime_error("swapBytesInBulk: unsupported size " + std::to_string(size));
+}
+
+const char* swapBytesImplementation() {
+  return kernels().name;
+}
+
+}  // namespace RosMsgParser::details
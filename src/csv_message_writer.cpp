@@ -0,0 +1,270 @@
+#include "rosx_introspection/csv_message_writer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace RosMsgParser {
+
+CsvMessageWriter::CsvMessageWriter(std::string* output, char separator)
+  : _output(output), _out(&_first_row), _separator(separator) {}
+
+void CsvMessageWriter::beginRow() {
+  _row_open = true;
+  _position = 0;
+  _last_column = 0;
+  appendNumber(_timestamp);
+}
+
+bool CsvMessageWriter::findColumn(const FieldLeaf& leaf, uint32_t& column) {
+  if (!_layout_done) {
+    // used directly with Parser::walkSchema()
+    const FieldTreeNode* root = leaf.node;
+    while (root->parent()) {
+      root = root->parent();
+    }
+    layout(root);
+  }
+  auto it = _column_index.find(leaf);
+  if (it != _column_index.end()) {
+    column = it->second;
+  } else if (_header_written || leaf.key_suffixes.empty() || !addKeyedColumn(leaf, column)) {
+    return false;
+  }
+
+  if (_position >= _column_at.size()) {
+    _column_at.resize(_position + 1);
+  }
+  _column_at[_position] = column;
+  return true;
+}
+
+void CsvMessageWriter::layout(const FieldTreeNode* root) {
+  _layout_done = true;
+  FieldLeaf leaf;
+  addColumns(root, leaf, true);
+}
+
+void CsvMessageWriter::addColumns(const FieldTreeNode* node, FieldLeaf& leaf, bool is_root) {
+  leaf.node = node;
+  if (node->bracketKeyMask() != 0) {
+    // the paths depend on the values of the keys: see addKeyedColumn()
+    _key_group_index.emplace(leaf, static_cast<uint32_t>(_key_group_end.size()));
+    _key_group_end.push_back(static_cast<uint32_t>(_columns.size()));
+    return;
+  }
+  const ROSField* field = node->value();
+  if (is_root || !field || !field->isArray()) {
+    addElementColumns(node, leaf);
+    return;
+  }
+
+  size_t count = _array_columns;
+  if (field->arraySize() > 0) {
+    count = static_cast<size_t>(field->arraySize());
+  } else if (field->isUpperBound()) {
+    count = std::min(count, static_cast<size_t>(field->maxSize()));
+  }
+  const auto& dims = field->arrayDimensions();
+  const size_t saved_idx_size = leaf.index_array.size();
+  for (size_t d = 0; d < std::max<size_t>(1, dims.size()); d++) {
+    leaf.index_array.push_back(0);
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (dims.size() > 1) {
+      size_t flat = i;
+      for (int d = static_cast<int>(dims.size()) - 1; d >= 0; d--) {
+        leaf.index_array[saved_idx_size + d] = static_cast<uint16_t>(flat % dims[d]);
+        flat /= dims[d];
+      }
+    } else {
+      leaf.index_array.back() = static_cast<uint16_t>(i);
+    }
+    addElementColumns(node, leaf);
+  }
+  leaf.index_array.resize(saved_idx_size);
+}
+
+void CsvMessageWriter::addElementColumns(const FieldTreeNode* node, FieldLeaf& leaf) {
+  const ROSField* field = node->value();
+  bool has_value = false;
+  if (field && field->getUnion()) {
+    // the builtin and string cases are values of the union field
+    const DiscriminatedUnion& def = *field->getUnion();
+    for (const auto& [label, case_field] : def.cases) {
+      has_value |= case_field.type.isBuiltin();
+    }
+    has_value |= def.default_case && def.default_case->type.isBuiltin();
+  } else if (field && node->isLeaf()) {
+    has_value = field->type().isBuiltin() || field->getEnum();
+  }
+  if (has_value) {
+    leaf.node = node;
+    _column_index.emplace(leaf, static_cast<uint32_t>(_columns.size()));
+    _columns.push_back(leaf);
+  }
+  for (const auto& child : node->children()) {
+    addColumns(&child, leaf, false);
+  }
+}
+
+// The columns under a @key are those of the first message, in its order: they are
+// inserted at the end of the group of the keyed field, before the columns that are
+// not written yet.
+bool CsvMessageWriter::addKeyedColumn(const FieldLeaf& leaf, uint32_t& column) {
+  FieldLeaf group;
+  group.node = leaf.node;
+  while (group.node->parent() && group.node->parent()->bracketKeyMask() != 0) {
+    group.node = group.node->parent();
+  }
+  const size_t prefix = group.node->parent() ? group.node->parent()->bracketCount() : 0;
+  group.index_array.append(leaf.index_array.begin(),
+                           leaf.index_array.begin() + std::min(prefix, leaf.index_array.size()));
+  auto it = _key_group_index.find(group);
+  if (it == _key_group_index.end()) {
+    // e.g. in an element beyond setArrayColumns()
+    return false;
+  }
+  column = _key_group_end[it->second];
+  for (size_t i = it->second; i < _key_group_end.size(); i++) {
+    _key_group_end[i]++;
+  }
+  for (auto& [other, index] : _column_index) {
+    if (index >= column) {
+      index++;
+    }
+  }
+  _columns.insert(_columns.begin() + column, leaf);
+  _column_index.emplace(leaf, column);
+  return true;
+}
+
+void CsvMessageWriter::appendTime(const Time& time) {
+  // exact, unlike the conversion to double
+  appendNumber(time.sec);
+  char nsec[10] = {'.', '0', '0', '0', '0', '0', '0', '0', '0', '0'};
+  char digits[10];
+  const auto result = std::to_chars(digits, digits + sizeof(digits), time.nsec);
+  const auto length = static_cast<size_t>(result.ptr - digits);
+  if (length <= 9) {
+    memcpy(nsec + 10 - length, digits, length);
+  }
+  _out->append(nsec, sizeof(nsec));
+}
+
+void CsvMessageWriter::appendQuoted(std::string_view str) {
+  bool quote = false;
+  for (char c : str) {
+    if (c == _separator || c == '"' || c == '\n' || c == '\r') {
+      quote = true;
+      break;
+    }
+  }
+  if (!quote) {
+    _out->append(str);
+    return;
+  }
+  _out->push_back('"');
+  for (char c : str) {
+    if (c == '"') {
+      _out->push_back('"');
+    }
+    _out->push_back(c);
+  }
+  _out->push_back('"');
+}
+
+void CsvMessageWriter::writeValue(const FieldLeaf& leaf, const Variant& value) {
+  switch (value.getTypeID()) {
+    case TIME:
+    case DURATION:
+      if (beginCell(leaf)) {
+        appendTime(value.extract<Time>());
+      }
+      break;
+    case STRING:
+      writeString(leaf, value.extract<std::string_view>());
+      break;
+    case FLOAT32:
+      writeNumber(leaf, value.extract<float>());
+      break;
+    case FLOAT64:
+      writeNumber(leaf, value.extract<double>());
+      break;
+    case UINT64:
+      writeNumber(leaf, value.extract<uint64_t>());
+      break;
+    default:
+      writeNumber(leaf, value.convert<int64_t>());
+      break;
+  }
+}
+
+void CsvMessageWriter::writeString(const FieldLeaf& leaf, std::string_view value) {
+  if (beginCell(leaf)) {
+    appendQuoted(value);
+  }
+}
+
+void CsvMessageWriter::writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) {
+  // each element has its own column
+  _element = leaf;
+  ForEachTypedArrayValue(type, raw, count, [this](size_t index, auto value) {
+    using T = decltype(value);
+    _element.index_array.back() = static_cast<uint16_t>(index);
+    if constexpr (std::is_same_v<T, Time>) {
+      if (beginCell(_element)) {
+        appendTime(value);
+      }
+    } else if constexpr (std::is_same_v<T, bool>) {
+      writeBool(_element, value);
+    } else if constexpr (std::is_same_v<T, char>) {
+      writeChar(_element, value);
+    } else {
+      writeNumber(_element, value);
+    }
+  });
+}
+
+void CsvMessageWriter::finish() {
+  if (!_row_open) {
+    beginRow();
+  }
+  _out->append(_columns.size() - _last_column, _separator);
+  _out->push_back('\n');
+  _row_open = false;
+
+  if (!_header_written) {
+    std::string path;
+    _out = _output;
+    _output->append("timestamp");
+    for (const auto& column : _columns) {
+      _output->push_back(_separator);
+      path.clear();
+      column.toStr(path);
+      appendQuoted(path);
+    }
+    _output->push_back('\n');
+    _output->append(_first_row);
+    _first_row.clear();
+    _header_written = true;
+  }
+}
+
+void CsvMessageWriter::rollback(size_t output_size, bool header_written) {
+  _output->resize(output_size);
+  _first_row.clear();
+  _row_open = false;
+  _position = 0;
+  if (!header_written) {
+    _header_written = false;
+    _out = &_first_row;
+    _layout_done = false;
+    _columns.clear();
+    _column_index.clear();
+    _column_at.clear();
+    _key_group_index.clear();
+    _key_group_end.clear();
+  }
+}
+
+}  // namespace RosMsgParser
@@ -0,0 +1,586 @@
+#include "rosx_introspection/decode_program.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <stdexcept>
+
+namespace RosMsgParser {
+
+namespace {
+
+// True if `msg` declares at least one @key member.
+bool hasKeyMember(const ROSMessage& msg) {
+  for (const auto& f : msg.fields()) {
+    if (!f.isConstant() && f.isKey()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Alignment of a primitive value of `size` bytes, for each PrimitiveAlignment.
+uint32_t primitiveAlignment(size_t kind, uint32_t size) {
+  switch (static_cast<PrimitiveAlignment>(kind)) {
+    case PrimitiveAlignment::PACKED:
+      return 1;
+    case PrimitiveAlignment::XCDR2:
+      return std::min<uint32_t>(size, 4);
+    default:
+      return size;
+  }
+}
+
+uint32_t alignUp(uint32_t offset, uint32_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Integer value of a union case label, if it is written as the decoder prints
+// a discriminant (the canonical decimal form).
+std::optional<int64_t> integerLabel(const std::string& label) {
+  int64_t value = 0;
+  const char* end = label.data() + label.size();
+  auto [ptr, ec] = std::from_chars(label.data(), end, value);
+  if (ec != std::errc() || ptr != end || std::to_string(value) != label) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+class ProgramCompiler {
+ public:
+  ProgramCompiler(const MessageSchema& schema, DecodeProgram& program) : _schema(schema), _program(program) {}
+
+  void compile() {
+    const auto* root = _schema.root_msg.get();
+    enqueue(root);
+    // Sub-programs can not be nested into each other, so the messages
+    // reached by a STRUCT are queued and compiled after the current one.
+    for (size_t i = 0; i < _queue.size(); i++) {
+      compileMessage(_queue[i]);
+    }
+    for (const auto& [op_index, msg] : _calls) {
+      _program.ops[op_index].target = _program.entries.at(msg);
+    }
+    for (auto& compiled : _program.unions) {
+      for (auto& union_case : compiled.cases) {
+        resolveCase(union_case);
+      }
+      resolveCase(compiled.default_case);
+    }
+    _program.root_entry = _program.entries.at(root);
+    _program.root_extensibility = root->extensibility();
+    _program.min_size = minSize(_program.root_entry, false);
+    _program.min_size_xcdr2 = minStructSize(_program.root_entry, root->extensibility(), true);
+    _program.has_optional_members = std::any_of(_program.ops.begin(), _program.ops.end(),
+                                                 [](const DecodeOp& op) { return op.hasFlag(DecodeOp::OPTIONAL); });
+  }
+
+ private:
+  void enqueue(const ROSMessage* msg) {
+    if (_program.entries.count(msg) == 0) {
+      _program.entries.insert({msg, DecodeOp::NO_TARGET});
+      _queue.push_back(msg);
+    }
+  }
+
+  const ROSMessage* structOf(const ROSField& field) const {
+    auto msg = field.getMessagePtr(_schema.msg_library);
+    if (!msg) {
+      throw std::runtime_error("Missing ROSType in library: " + field.type().baseName());
+    }
+    return msg.get();
+  }
+
+  void compileMessage(const ROSMessage* msg) {
+    _program.entries[msg] = static_cast<uint32_t>(_program.ops.size());
+
+    // Members without @id follow the previous one (XTypes sequential IDs).
+    std::unordered_map<const ROSField*, uint32_t> member_ids;
+    uint32_t next_id = 0;
+    for (const ROSField& field : msg->fields()) {
+      if (!field.isConstant()) {
+        next_id = field.memberId().value_or(next_id);
+        member_ids[&field] = next_id++;
+      }
+    }
+
+    // @key fields are decoded first: their values are part of the path of every other field.
+    for (const ROSField& field : msg->fields()) {
+      if (field.isConstant() || !field.isKey()) {
+        continue;
+      }
+      DecodeOp op;
+      op.field = &field;
+      op.type = field.type().typeID();
+      op.member_id = member_ids[&field];
+      if (op.type == STRING) {
+        op.code = DecodeOp::KEY_STRING;
+      } else if (field.getEnum() != nullptr) {
+        op.code = DecodeOp::KEY_ENUM;
+        op.target = compileEnum(*field.getEnum());
+      } else if (field.type().isBuiltin()) {
+        op.code = DecodeOp::KEY_BUILTIN;
+      } else {
+        continue;
+      }
+      _program.ops.push_back(op);
+    }
+
+    // The child index must match the one used by the FieldTree, that has a node
+    // for each non-constant field (including @key fields).
+    uint16_t child = 0;
+    for (const ROSField& field : msg->fields()) {
+      if (field.isConstant()) {
+        continue;
+      }
+      if (!field.isKey()) {
+        compileField(field, child, member_ids[&field]);
+      }
+      child++;
+    }
+
+    DecodeOp ret;
+    ret.code = DecodeOp::RETURN;
+    _program.ops.push_back(ret);
+
+    compileFixedRuns(_program.entries[msg], static_cast<uint32_t>(_program.ops.size() - 1));
+  }
+
+  // Group the consecutive fields of [begin, end) that have a fixed size into runs,
+  // that are validated with a single bounds check (see DecodeOp::run).
+  void compileFixedRuns(uint32_t begin, uint32_t end) {
+    auto& ops = _program.ops;
+    auto isFixedField = [&](const DecodeOp& op) {
+      return op.flags == 0 && (op.code == DecodeOp::SCALAR ||
+                               (op.code == DecodeOp::STRUCT && op.fixed != DecodeOp::NO_TARGET));
+    };
+    // a longer run must be usable with all the alignment rules of the shorter one
+    auto keepsAlignments = [](const FixedStruct& shorter, const FixedStruct& longer) {
+      for (size_t k = 0; k < FixedStruct::ALIGNMENT_KINDS; k++) {
+        if (shorter.size[k] != 0 && longer.size[k] == 0) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    uint32_t pc = begin;
+    while (pc < end) {
+      if (!isFixedField(ops[pc])) {
+        pc++;
+        continue;
+      }
+      std::vector<std::pair<const ROSField*, uint16_t>> fields = {{ops[pc].field, ops[pc].child}};
+      FixedStruct run;
+      buildFixedLayout(fields, run);
+      uint32_t next = pc + 1;
+      for (; next < end && isFixedField(ops[next]); next++) {
+        fields.push_back({ops[next].field, ops[next].child});
+        FixedStruct longer;
+        if (!buildFixedLayout(fields, longer) || !keepsAlignments(run, longer)) {
+          fields.pop_back();
+          break;
+        }
+        run = std::move(longer);
+      }
+      if (fields.size() > 1) {
+        ops[pc].run = static_cast<uint32_t>(_program.fixed_structs.size());
+        _program.fixed_structs.push_back(std::move(run));
+      }
+      pc = next;
+    }
+  }
+
+  void compileField(const ROSField& field, uint16_t child, uint32_t member_id) {
+    DecodeOp op = elementOp(field);
+    op.child = child;
+    op.member_id = member_id;
+
+    const uint8_t optional = field.isOptional() ? DecodeOp::OPTIONAL : 0;
+    if (!field.isArray()) {
+      op.flags |= optional;
+      _program.ops.push_back(op);
+      return;
+    }
+
+    DecodeOp begin;
+    begin.code = DecodeOp::BEGIN_SEQUENCE;
+    begin.field = &field;
+    begin.type = field.type().typeID();
+    begin.child = child;
+    begin.length = 3;
+    begin.array_size = field.arraySize();
+    begin.member_id = member_id;
+
+    // A sequence/array of keyed structs identifies its elements by @key value
+    // rather than by position, so the numeric index is suppressed: the
+    // element's @key fills the bracket instead (see cachePathsImpl).
+    const bool elem_keyed = op.code == DecodeOp::STRUCT && hasKeyMember(*structOf(field));
+    begin.flags = optional | (elem_keyed ? DecodeOp::ELEM_KEYED : DecodeOp::PUSH_INDEX);
+    if (builtinSize(begin.type) == 1) {
+      begin.flags |= DecodeOp::BYTE_ELEMENTS;
+    }
+    if (op.code == DecodeOp::SCALAR && field.arrayDimensions().size() <= 1) {
+      begin.flags |= DecodeOp::BULK;
+    }
+    if (op.code == DecodeOp::STRING || op.code == DecodeOp::UNION || op.code == DecodeOp::STRUCT) {
+      begin.flags |= DecodeOp::DELIMITED;
+    }
+
+    DecodeOp end = begin;
+    end.code = DecodeOp::END_SEQUENCE;
+    end.flags &= ~DecodeOp::OPTIONAL;
+
+    op.flags |= DecodeOp::IN_SEQUENCE;
+    op.array_size = begin.array_size;
+
+    _program.ops.push_back(begin);
+    _program.ops.push_back(op);
+    _program.ops.push_back(end);
+  }
+
+  DecodeOp elementOp(const ROSField& field) {
+    DecodeOp op;
+    op.field = &field;
+    op.type = field.type().typeID();
+
+    if (field.getEnum() != nullptr) {
+      op.code = DecodeOp::ENUM;
+      op.type = INT32;
+      op.target = compileEnum(*field.getEnum());
+    } else if (field.getUnion() != nullptr) {
+      op.code = DecodeOp::UNION;
+      op.target = compileUnion(*field.getUnion());
+      op.extensibility = field.getUnion()->extensibility;
+    } else if (op.type == STRING) {
+      op.code = DecodeOp::STRING;
+    } else if (field.type().isBuiltin()) {
+      op.code = DecodeOp::SCALAR;
+    } else {
+      op.code = DecodeOp::STRUCT;
+      const ROSMessage* msg = structOf(field);
+      op.extensibility = msg->extensibility();
+      op.fixed = fixedStruct(msg);
+      enqueue(msg);
+      _calls.push_back({_program.ops.size() + (field.isArray() ? 1 : 0), msg});
+    }
+    return op;
+  }
+
+  // Index of the FixedStruct of `msg` or NO_TARGET, if its size is not known at compilation time.
+  uint32_t fixedStruct(const ROSMessage* msg) {
+    auto it = _fixed.find(msg);
+    if (it != _fixed.end()) {
+      return it->second;
+    }
+    _fixed[msg] = DecodeOp::NO_TARGET;
+    FixedStruct fixed;
+    if (!buildFixedStruct(*msg, fixed)) {
+      return DecodeOp::NO_TARGET;
+    }
+    const auto index = static_cast<uint32_t>(_program.fixed_structs.size());
+    _program.fixed_structs.push_back(std::move(fixed));
+    _fixed[msg] = index;
+    return index;
+  }
+
+  bool buildFixedStruct(const ROSMessage& msg, FixedStruct& fixed) {
+    std::vector<std::pair<const ROSField*, uint16_t>> fields;
+    uint16_t child = 0;
+    for (const ROSField& field : msg.fields()) {
+      if (!field.isConstant()) {
+        fields.push_back({&field, child++});
+      }
+    }
+    return buildFixedLayout(fields, fixed);
+  }
+
+  // Layout of a sequence of fields, given with their child index. False if one of them has a variable size.
+  bool buildFixedLayout(const std::vector<std::pair<const ROSField*, uint16_t>>& fields, FixedStruct& fixed) {
+    constexpr size_t KINDS = FixedStruct::ALIGNMENT_KINDS;
+    std::array<uint32_t, KINDS> cursor = {};
+    std::array<bool, KINDS> valid = {true, true, true};
+    fixed.alignment = {1, 1, 1};
+
+    for (const auto& [field_ptr, child] : fields) {
+      const ROSField& field = *field_ptr;
+      if (field.isKey() || field.isOptional() || field.getEnum() != nullptr || field.getUnion() != nullptr) {
+        return false;
+      }
+      FixedStruct::Member member;
+      member.field = &field;
+      member.child = child;
+      member.type = field.type().typeID();
+      if (member.type == STRING) {
+        return false;
+      }
+      if (field.isArray()) {
+        if (field.arraySize() <= 0) {
+          return false;
+        }
+        member.is_array = true;
+        member.count = static_cast<uint32_t>(field.arraySize());
+        fixed.max_array_size = std::max(fixed.max_array_size, member.count);
+      }
+
+      // size and alignment of a single element
+      uint32_t first_size = 0;
+      std::array<uint32_t, KINDS> elem_size = {};
+      std::array<uint32_t, KINDS> elem_align = {};
+      if (member.type == OTHER) {
+        const ROSMessage* nested_msg = structOf(field);
+        member.nested = fixedStruct(nested_msg);
+        if (member.nested == DecodeOp::NO_TARGET) {
+          return false;
+        }
+        const FixedStruct& nested = _program.fixed_structs[member.nested];
+        auto xcdr2_layout = nested.xcdr2_layout;
+        if (member.is_array || nested_msg->extensibility() == Extensibility::APPENDABLE ||
+            nested_msg->extensibility() == Extensibility::MUTABLE) {
+          xcdr2_layout = FixedStruct::XCDR2_INVALID;
+        } else if (nested_msg->extensibility() == Extensibility::UNSPECIFIED) {
+          xcdr2_layout = std::max(xcdr2_layout, FixedStruct::XCDR2_IF_FINAL);
+        }
+        fixed.xcdr2_layout = std::max(fixed.xcdr2_layout, xcdr2_layout);
+        first_size = nested.first_size;
+        fixed.max_array_size = std::max(fixed.max_array_size, nested.max_array_size);
+        elem_size = nested.size;
+        elem_align = nested.alignment;
+      } else {
+        const auto size = static_cast<uint32_t>(builtinSize(member.type));
+        first_size = static_cast<uint32_t>(primitiveSize(member.type));
+        for (size_t k = 0; k < KINDS; k++) {
+          elem_size[k] = size;
+          elem_align[k] = primitiveAlignment(k, first_size);
+        }
+      }
+      if (fixed.first_size == 0) {
+        fixed.first_size = first_size;
+      }
+
+      for (size_t k = 0; k < KINDS; k++) {
+        if (elem_size[k] == 0) {
+          valid[k] = false;
+          continue;
+        }
+        // Elements of an array start where their first member is aligned
+        member.offset[k] = alignUp(cursor[k], elem_align[k]);
+        member.stride[k] = alignUp(elem_size[k], elem_align[k]);
+        cursor[k] = member.offset[k] + (member.count - 1) * member.stride[k] + elem_size[k];
+        fixed.alignment[k] = std::max(fixed.alignment[k], elem_align[k]);
+      }
+      fixed.members.push_back(member);
+    }
+
+    if (fixed.first_size == 0) {
+      return false;
+    }
+    // The offsets are valid only if the beginning of the block is aligned as
+    // its most aligned member, i.e. if the first member is the most aligned.
+    for (size_t k = 0; k < KINDS; k++) {
+      const bool aligned = primitiveAlignment(k, fixed.first_size) == fixed.alignment[k];
+      fixed.size[k] = (valid[k] && aligned) ? cursor[k] : 0;
+    }
+    return true;
+  }
+
+  // Smallest size of the sub-program starting at [entry], see DecodeProgram::min_size
+  // and DecodeProgram::min_size_xcdr2.
+  uint32_t minSize(uint32_t entry, bool xcdr2) {
+    auto& min_sizes = _min_sizes[xcdr2];
+    auto it = min_sizes.find(entry);
+    if (it != min_sizes.end()) {
+      return it->second;
+    }
+    // a struct that contains itself: its sub-program is entered only if it is present
+    min_sizes[entry] = 0;
+    uint64_t total = 0;
+    for (uint32_t pc = entry; _program.ops[pc].code != DecodeOp::RETURN;) {
+      const DecodeOp& op = _program.ops[pc];
+      if (op.hasFlag(DecodeOp::OPTIONAL)) {
+        pc += op.length;
+        continue;
+      }
+      if (op.code == DecodeOp::BEGIN_SEQUENCE) {
+        total += (op.array_size < 0) ? sizeof(uint32_t)
+                                     : uint64_t(op.array_size) * minOpSize(_program.ops[pc + 1], xcdr2);
+        pc += op.length;
+        continue;
+      }
+      total += minOpSize(op, xcdr2);
+      pc++;
+    }
+    const auto size = static_cast<uint32_t>(std::min<uint64_t>(total, UINT32_MAX));
+    min_sizes[entry] = size;
+    return size;
+  }
+
+  // All the members of a mutable struct may be absent. In XCDR2, an appendable struct may
+  // be an older version of the type, with only its DHEADER; a type without annotation is
+  // appendable in DELIMIT_CDR2, and final in PLAIN_CDR2.
+  uint32_t minStructSize(uint32_t entry, Extensibility extensibility, bool xcdr2) {
+    if (extensibility == Extensibility::MUTABLE) {
+      return 0;
+    }
+    const uint32_t size = minSize(entry, xcdr2);
+    if (!xcdr2 || extensibility == Extensibility::FINAL) {
+      return size;
+    }
+    const uint32_t dheader = sizeof(uint32_t);
+    return (extensibility == Extensibility::APPENDABLE) ? dheader : std::min(size, dheader);
+  }
+
+  uint32_t minOpSize(const DecodeOp& op, bool xcdr2) {
+    switch (op.code) {
+      case DecodeOp::KEY_BUILTIN:
+      case DecodeOp::SCALAR:
+        return static_cast<uint32_t>(builtinSize(op.type));
+      case DecodeOp::KEY_STRING:
+      case DecodeOp::STRING:
+      case DecodeOp::KEY_ENUM:
+      case DecodeOp::ENUM:
+        return sizeof(uint32_t);
+      case DecodeOp::UNION: {
+        const BuiltinType type = _program.unions[op.target].discriminant_type;
+        return (type == OTHER) ? sizeof(int32_t) : static_cast<uint32_t>(builtinSize(type));
+      }
+      case DecodeOp::STRUCT:
+        return minStructSize(op.target, op.extensibility, xcdr2);
+      default:
+        return 0;
+    }
+  }
+
+  uint32_t compileUnion(const DiscriminatedUnion& def) {
+    for (size_t i = 0; i < _program.unions.size(); i++) {
+      if (_program.unions[i].definition == &def) {
+        return static_cast<uint32_t>(i);
+      }
+    }
+    const auto index = static_cast<uint32_t>(_program.unions.size());
+    _program.unions.emplace_back();
+    DecodeUnion& compiled = _program.unions.back();
+    compiled.definition = &def;
+    compiled.discriminant_type = toBuiltinType(def.discriminant_type);
+
+    std::unordered_map<std::string, uint32_t> case_by_label;
+    for (const auto& [label, case_field] : def.cases) {
+      case_by_label[label] = static_cast<uint32_t>(compiled.cases.size());
+      compiled.cases.push_back({&case_field, DecodeOp::NO_TARGET});
+      enqueueCase(case_field);
+    }
+
+    // The labels are the names of the enumerators or integers: map each value
+    // of the discriminant to its label, as the decoder would print it.
+    std::vector<std::pair<int64_t, uint32_t>> entries;
+    auto addEntry = [&](int64_t value, const std::string& label) {
+      auto it = case_by_label.find(label);
+      if (it != case_by_label.end()) {
+        entries.push_back({value, it->second});
+      }
+    };
+    const EnumDefinition* discriminant_enum = nullptr;
+    if (compiled.discriminant_type == OTHER) {
+      auto enum_it = _schema.enum_library.find(ROSType(def.discriminant_type));
+      if (enum_it != _schema.enum_library.end()) {
+        discriminant_enum = &enum_it->second;
+      }
+    }
+    // An enum discriminant is printed as the name of the first enumerator with that value, if any.
+    auto enumeratorName = [&](int64_t value) -> const std::string* {
+      if (discriminant_enum) {
+        for (const auto& ev : discriminant_enum->values) {
+          if (ev.value == value) {
+            return &ev.name;
+          }
+        }
+      }
+      return nullptr;
+    };
+    if (discriminant_enum) {
+      for (const auto& ev : discriminant_enum->values) {
+        addEntry(ev.value, *enumeratorName(ev.value));
+      }
+    }
+    // An enum discriminant is decoded as INT32 and an enumerator name takes precedence.
+    const bool is_enum = compiled.discriminant_type == OTHER;
+    for (const auto& [label, case_field] : def.cases) {
+      if (auto value = integerLabel(label)) {
+        if (is_enum && (*value < INT32_MIN || *value > INT32_MAX || enumeratorName(*value))) {
+          continue;
+        }
+        addEntry(*value, label);
+      }
+    }
+    compiled.case_index.build(std::move(entries), DecodeOp::NO_TARGET);
+
+    if (def.default_case) {
+      compiled.default_case.field = &def.default_case.value();
+      enqueueCase(def.default_case.value());
+    }
+
+    return index;
+  }
+
+  uint32_t compileEnum(const EnumDefinition& def) {
+    auto it = _enums.find(&def);
+    if (it != _enums.end()) {
+      return it->second;
+    }
+    std::vector<std::pair<int64_t, const std::string*>> entries;
+    for (const auto& ev : def.values) {
+      entries.push_back({ev.ddsCompatValue(), &ev.name});
+    }
+    const auto index = static_cast<uint32_t>(_program.enums.size());
+    _program.enums.emplace_back();
+    _program.enums.back().build(std::move(entries), nullptr);
+    _enums[&def] = index;
+    return index;
+  }
+
+  // A struct case is walked like a STRUCT, but a case type missing in the
+  // library is simply ignored.
+  const ROSMessage* caseStruct(const UnionCaseField& case_field) const {
+    if (case_field.type.isBuiltin()) {
+      return nullptr;
+    }
+    auto it = _schema.msg_library.find(case_field.type);
+    return (it == _schema.msg_library.end()) ? nullptr : it->second.get();
+  }
+
+  void enqueueCase(const UnionCaseField& case_field) {
+    if (const auto* msg = caseStruct(case_field)) {
+      enqueue(msg);
+    }
+  }
+
+  void resolveCase(DecodeUnion::Case& union_case) const {
+    if (union_case.field) {
+      if (const auto* msg = caseStruct(*union_case.field)) {
+        union_case.target = _program.entries.at(msg);
+        union_case.extensibility = msg->extensibility();
+      }
+    }
+  }
+
+  const MessageSchema& _schema;
+  DecodeProgram& _program;
+  std::vector<const ROSMessage*> _queue;
+  std::vector<std::pair<size_t, const ROSMessage*>> _calls;
+  std::unordered_map<const ROSMessage*, uint32_t> _fixed;
+  std::unordered_map<const EnumDefinition*, uint32_t> _enums;
+  // by sub-program, without and with XCDR2
+  std::unordered_map<uint32_t, uint32_t> _min_sizes[2];
+};
+
+}  // namespace
+
+DecodeProgram::Ptr CompileDecodeProgram(const MessageSchema& schema) {
+  auto program = std::make_shared<DecodeProgram>();
+  ProgramCompiler compiler(schema, *program);
+  compiler.compile();
+  return program;
+}
+
+}  // namespace RosMsgParser
@@ -1,77 +1,11 @@
 #include "rosx_introspection/deserializer.hpp"
 
 #include "rosx_introspection/contrib/nanocdr.hpp"
+#include "rosx_introspection/decode_program.hpp"
+#include "rosx_introspection/details/byte_swap.hpp"
 
 namespace RosMsgParser {
 
-Variant ROS_Deserializer::deserialize(BuiltinType type) {
-  switch (type) {
-    case BOOL:
-      return deserialize<bool>();
-    case CHAR:
-      return deserialize<char>();
-    case BYTE:
-    case UINT8:
-      return deserialize<uint8_t>();
-    case UINT16:
-      return deserialize<uint16_t>();
-    case UINT32:
-      return deserialize<uint32_t>();
-    case UINT64:
-      return deserialize<uint64_t>();
-
-    case INT8:
-      return deserialize<int8_t>();
-    case INT16:
-      return deserialize<int16_t>();
-    case INT32:
-      return deserialize<int32_t>();
-    case INT64:
-      return deserialize<int64_t>();
-
-    case FLOAT32:
-      return deserialize<float>();
-    case FLOAT64:
-      return deserialize<double>();
-
-    case DURATION:
-    case TIME: {
-      RosMsgParser::Time tmp;
-      tmp.sec = deserialize<uint32_t>();
-      tmp.nsec = deserialize<uint32_t>();
-      return tmp;
-    }
-
-    default:
-      throw std::runtime_error("ROS_Deserializer: type not recognized");
-  }
-
-  return {};
-}
-
-void ROS_Deserializer::deserializeString(std::string& dst) {
-  uint32_t string_size = deserialize<uint32_t>();
-
-  if (string_size > _bytes_left) {
-    throw std::runtime_error("Buffer overrun in ROS_Deserializer::deserializeString");
-  }
-
-  if (string_size == 0) {
-    dst = {};
-    return;
-  }
-
-  const char* buffer_ptr = reinterpret_cast<const char*>(_ptr);
-  dst.assign(buffer_ptr, string_size);
-
-  _ptr += string_size;
-  _bytes_left -= string_size;
-}
-
-uint32_t ROS_Deserializer::deserializeUInt32() {
-  return deserialize<uint32_t>();
-}
-
 Span<const uint8_t> ROS_Deserializer::deserializeByteSequence() {
   uint32_t vect_size = deserialize<uint32_t>();
   if (vect_size > _bytes_left) {
@@ -87,16 +21,20 @@ Span<const uint8_t> ROS_Deserializer::deserializeByteSequence() {
   return out;
 }
 
-const uint8_t* ROS_Deserializer::getCurrentPtr() const {
-  return _ptr;
-}
-
-void ROS_Deserializer::jump(size_t bytes) {
+void ROS_Deserializer::readArrayInto(BuiltinType type, void* dst, size_t count) {
+  // the values are packed and stored in the byte order of the host
+  const int size = builtinSize(type);
+  if (size <= 0) {
+    throw std::runtime_error("ROS_Deserializer: type not recognized");
+  }
+  const size_t bytes = static_cast<size_t>(size) * count;
   if (bytes > _bytes_left) {
-    throw std::runtime_error("Buffer overrun");
+    throw std::runtime_error("Buffer overrun in ROS_Deserializer::readArrayInto");
   }
-  _ptr += bytes;
-  _bytes_left -= bytes;
+  if (bytes > 0) {
+    memcpy(dst, _ptr, bytes);
+  }
+  jump(bytes);
 }
 
 void ROS_Deserializer::reset() {
@@ -106,90 +44,65 @@ void ROS_Deserializer::reset() {
 
 // ----------------------------------------------
 
-template <typename T>
-static T Deserialize(nanocdr::Decoder& decoder) {
-  T tmp;
-  decoder.decode(tmp);
-  return tmp;
-}
-
-Variant NanoCDR_Deserializer::deserialize(BuiltinType type) {
-  switch (type) {
-    case BOOL:
-      return Deserialize<bool>(*_cdr_decoder);
-    case CHAR:
-      return Deserialize<char>(*_cdr_decoder);
-    case BYTE:
-    case UINT8:
-      return Deserialize<uint8_t>(*_cdr_decoder);
-    case UINT16:
-      return Deserialize<uint16_t>(*_cdr_decoder);
-    case UINT32:
-      return Deserialize<uint32_t>(*_cdr_decoder);
-    case UINT64:
-      return Deserialize<uint64_t>(*_cdr_decoder);
-
-    case INT8:
-      return Deserialize<int8_t>(*_cdr_decoder);
-    case INT16:
-      return Deserialize<int16_t>(*_cdr_decoder);
-    case INT32:
-      return Deserialize<int32_t>(*_cdr_decoder);
-    case INT64:
-      return Deserialize<int64_t>(*_cdr_decoder);
-
-    case FLOAT32:
-      return Deserialize<float>(*_cdr_decoder);
-    case FLOAT64:
-      return Deserialize<double>(*_cdr_decoder);
-
-    case DURATION:
-    case TIME: {
-      RosMsgParser::Time tmp;
-      tmp.sec = Deserialize<uint32_t>(*_cdr_decoder);
-      tmp.nsec = Deserialize<uint32_t>(*_cdr_decoder);
-      return tmp;
-    }
-
-    default:
-      throw std::runtime_error("NanoCDR_Deserializer: type not recognized");
+void NanoCDR_Deserializer::readArrayInto(BuiltinType type, void* dst, size_t count) {
+  const int size = builtinSize(type);
+  if (size <= 0) {
+    throw std::runtime_error("NanoCDR_Deserializer: type not recognized");
   }
-
-  return {};
+  if (count == 0) {
+    return;
+  }
+  // the first value is aligned, the following ones are contiguous
+  const size_t unit = primitiveSize(type);
+  alignTo(unit);
+  const size_t bytes = static_cast<size_t>(size) * count;
+  if (bytes > bytesLeft()) {
+    throw std::runtime_error("Buffer overrun in NanoCDR_Deserializer::readArrayInto");
+  }
+  if (unit > 1 && needsByteSwap()) {
+    details::swapBytesInBulk(static_cast<uint8_t*>(dst), getCurrentPtr(), bytes / unit, unit);
+  } else {
+    memcpy(dst, getCurrentPtr(), bytes);
+  }
+  jump(bytes);
 }
 
-void NanoCDR_Deserializer::deserializeString(std::string& dst) {
-  _cdr_decoder->decode(dst);
+PrimitiveAlignment NanoCDR_Deserializer::primitiveAlignment() const {
+  return (_header.version == nanocdr::CdrVersion::XCDRv2) ? PrimitiveAlignment::XCDR2 : PrimitiveAlignment::CDR;
 }
 
-uint32_t NanoCDR_Deserializer::deserializeUInt32() {
-  return Deserialize<uint32_t>(*_cdr_decoder);
+bool NanoCDR_Deserializer::needsByteSwap() const {
+  return _header.endianness != nanocdr::getCurrentEndianness();
 }
 
-Span<const uint8_t> NanoCDR_Deserializer::deserializeByteSequence() {
-  uint32_t seqLength = 0;
-  _cdr_decoder->decode(seqLength);
-
-  if (seqLength == 0) {
-    return {};
+Extensibility NanoCDR_Deserializer::defaultExtensibility() const {
+  switch (_header.encoding) {
+    case nanocdr::EncodingFlag::PLAIN_CDR2:
+      return Extensibility::FINAL;
+    case nanocdr::EncodingFlag::DELIMIT_CDR2:
+      return Extensibility::APPENDABLE;
+    case nanocdr::EncodingFlag::PL_CDR2:
+      return Extensibility::MUTABLE;
+    default:
+      return Extensibility::UNSPECIFIED;
   }
-
-  const auto* ptr = _cdr_decoder->currentBuffer().data();
-  _cdr_decoder->jump(seqLength);
-  return {reinterpret_cast<const uint8_t*>(ptr), seqLength};
-}
-
-const uint8_t* NanoCDR_Deserializer::getCurrentPtr() const {
-  return reinterpret_cast<const uint8_t*>(_cdr_decoder->currentBuffer().data());
-}
-
-void NanoCDR_Deserializer::jump(size_t bytes) {
-  _cdr_decoder->jump(bytes);
 }
 
 void NanoCDR_Deserializer::reset() {
-  nanocdr::ConstBuffer nano_buffer(_buffer.data(), _buffer.size());
-  _cdr_decoder.emplace(nano_buffer);
+  nanocdr::PlainDecoder decoder(nanocdr::ConstBuffer(_buffer.data(), _buffer.size()), nanocdr::CdrVersion::XCDRv2);
+  _header = decoder.header();
+  // the XCDR2 encapsulations are accepted, the parameter lists of XCDR1 are not
+  if (_header.encoding == nanocdr::EncodingFlag::PL_CDR) {
+    throw std::runtime_error("NanoCDR_Deserializer: the PL_CDR encoding is not supported");
+  }
+  // Only the XCDR1 optional members have a parameter header.
+  if (_parameter_list && _header.version != nanocdr::CdrVersion::XCDRv2) {
+    _cdr_decoder.reset();
+    _member_decoder.emplace(decoder);
+  } else {
+    _member_decoder.reset();
+    _cdr_decoder.emplace(decoder);
+  }
 }
 
 }  // namespace RosMsgParser
@@ -0,0 +1,103 @@
+#include "rosx_introspection/executor.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace RosMsgParser {
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t num_workers) {
+  if (num_workers == 0) {
+    num_workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t worker = 1; worker < num_workers; worker++) {
+    _threads.emplace_back([this, worker]() { workerLoop(worker); });
+  }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _job_available.notify_all();
+  for (auto& thread : _threads) {
+    thread.join();
+  }
+}
+
+void ThreadPoolExecutor::parallelFor(size_t count, const RangeTask& task) {
+  if (count == 0) {
+    return;
+  }
+  if (_threads.empty()) {
+    task(0, 0, count);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _task = &task;
+    _count = count;
+    // a few ranges per worker, to balance messages of different size
+    _chunk = std::max<size_t>(1, count / (concurrency() * 4));
+    _next = 0;
+    _error = nullptr;
+    _busy_workers = _threads.size();
+    _generation++;
+  }
+  _job_available.notify_all();
+
+  work(0);
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _job_done.wait(lock, [this]() { return _busy_workers == 0; });
+  _task = nullptr;
+  if (_error) {
+    std::rethrow_exception(std::exchange(_error, nullptr));
+  }
+}
+
+void ThreadPoolExecutor::workerLoop(size_t worker) {
+  size_t last_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _job_available.wait(lock, [&]() { return _stop || _generation != last_generation; });
+      if (_stop) {
+        return;
+      }
+      last_generation = _generation;
+    }
+    work(worker);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _busy_workers--;
+    }
+    _job_done.notify_one();
+  }
+}
+
+void ThreadPoolExecutor::work(size_t worker) {
+  while (true) {
+    size_t begin = 0;
+    size_t end = 0;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_next >= _count || _error) {
+        return;
+      }
+      begin = _next;
+      end = std::min(_count, begin + _chunk);
+      _next = end;
+    }
+    try {
+      (*_task)(worker, begin, end);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!_error) {
+        _error = std::current_exception();
+      }
+    }
+  }
+}
+
+}  // namespace RosMsgParser
@@ -14,60 +14,28 @@ inline void ExpandVectorIfNecessary(Container& container, size_t new_size) {
 }
 }  // namespace
 
-struct FlatMessageWriter::Impl {
-  FlatMessage* flat;
-  Parser::BlobPolicy blob_policy;
-  size_t value_index = 0;
-  size_t blob_index = 0;
-  size_t blob_storage_index = 0;
-};
-
-FlatMessageWriter::FlatMessageWriter(FlatMessage* flat, int blob_policy)
-    : _impl(std::make_unique<Impl>()) {
-  _impl->flat = flat;
-  _impl->blob_policy = static_cast<Parser::BlobPolicy>(blob_policy);
-}
-
-FlatMessageWriter::~FlatMessageWriter() = default;
-
-void FlatMessageWriter::writeValue(const FieldLeaf& leaf, const Variant& value) {
-  ExpandVectorIfNecessary(_impl->flat->value, _impl->value_index);
-  _impl->flat->value[_impl->value_index].first = leaf;
-  _impl->flat->value[_impl->value_index].second = value;
-  _impl->value_index++;
-}
-
-void FlatMessageWriter::writeString(const FieldLeaf& leaf, const std::string& str) {
-  ExpandVectorIfNecessary(_impl->flat->value, _impl->value_index);
-  _impl->flat->value[_impl->value_index].first = leaf;
-  _impl->flat->value[_impl->value_index].second = str;
-  _impl->value_index++;
-}
-
-void FlatMessageWriter::writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& /*name*/) {
-  writeValue(leaf, Variant(value));
-}
+FlatMessageWriter::FlatMessageWriter(FlatMessage* flat, int blob_policy) : _flat(flat), _blob_policy(blob_policy) {}
 
 void FlatMessageWriter::writeBlob(const FieldLeaf& leaf, Span<const uint8_t> data) {
-  ExpandVectorIfNecessary(_impl->flat->blob, _impl->blob_index);
-  _impl->flat->blob[_impl->blob_index].first = leaf;
+  ExpandVectorIfNecessary(_flat->blob, _blob_index);
+  _flat->blob[_blob_index].first = leaf;
 
-  if (_impl->blob_policy == Parser::STORE_BLOB_AS_COPY) {
-    ExpandVectorIfNecessary(_impl->flat->blob_storage, _impl->blob_storage_index);
-    auto& storage = _impl->flat->blob_storage[_impl->blob_storage_index];
+  if (_blob_policy == Parser::STORE_BLOB_AS_COPY) {
+    ExpandVectorIfNecessary(_flat->blob_storage, _blob_storage_index);
+    auto& storage = _flat->blob_storage[_blob_storage_index];
     storage.assign(data.data(), data.data() + data.size());
-    _impl->flat->blob[_impl->blob_index].second = Span<const uint8_t>(storage.data(), storage.size());
-    _impl->blob_storage_index++;
+    _flat->blob[_blob_index].second = Span<const uint8_t>(storage.data(), storage.size());
+    _blob_storage_index++;
   } else {
-    _impl->flat->blob[_impl->blob_index].second = data;
+    _flat->blob[_blob_index].second = data;
   }
-  _impl->blob_index++;
+  _blob_index++;
 }
 
 void FlatMessageWriter::finish() {
-  _impl->flat->value.resize(_impl->value_index);
-  _impl->flat->blob.resize(_impl->blob_index);
-  _impl->flat->blob_storage.resize(_impl->blob_storage_index);
+  _flat->value.resize(_value_index);
+  _flat->blob.resize(_blob_index);
+  _flat->blob_storage.resize(_blob_storage_index);
 }
 
 }  // namespace RosMsgParser
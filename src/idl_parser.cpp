@@ -2,11 +2,13 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <functional>
 #include <map>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <unordered_map>
 
 #include "rosx_introspection/contrib/peglib.h"
 #include "rosx_introspection/idl_grammar.hpp"
@@ -202,6 +204,7 @@ std::string getSequenceInnerType(const std::shared_ptr<peg::Ast>& ast) {
 struct AnnotationFlags {
   bool is_key = false;
   bool is_optional = false;
+  std::optional<uint32_t> member_id;
 };
 
 // Extract the name from an ANNOTATION node (handles both token and structured forms)
@@ -231,6 +234,27 @@ std::string getAnnotationParam(const std::shared_ptr<peg::Ast>& node) {
   return {};
 }
 
+// Extensibility set by an annotation of a struct or a union (@final, @appendable,
+// @mutable or @extensibility(KIND)), UNSPECIFIED for the other annotations.
+Extensibility getExtensibility(const std::shared_ptr<peg::Ast>& node) {
+  std::string name = getAnnotationName(node);
+  if (name == "extensibility") {
+    name = getAnnotationParam(node);
+    TrimString(name);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+  }
+  if (name == "final") {
+    return Extensibility::FINAL;
+  }
+  if (name == "appendable") {
+    return Extensibility::APPENDABLE;
+  }
+  if (name == "mutable") {
+    return Extensibility::MUTABLE;
+  }
+  return Extensibility::UNSPECIFIED;
+}
+
 // Main AST walker class
 class IDLAstWalker {
  public:
@@ -295,6 +319,10 @@ class IDLAstWalker {
         } else if (!child->nodes.empty()) {
           base_type = child->nodes[0]->token_to_string();
         }
+      } else if (role == "ANNOTATION") {
+        if (auto extensibility = getExtensibility(child); extensibility != Extensibility::UNSPECIFIED) {
+          msg->setExtensibility(extensibility);
+        }
       } else if (role == "MEMBER") {
         auto fields = parseMember(child, module_path);
         for (auto& f : fields) {
@@ -359,6 +387,8 @@ class IDLAstWalker {
           flags.is_key = true;
         } else if (ann_name == "optional") {
           flags.is_optional = true;
+        } else if (ann_name == "id") {
+          flags.member_id = static_cast<uint32_t>(std::stoul(getAnnotationParam(child), nullptr, 0));
         }
       } else if (role == "TYPE_SPEC") {
         if (isSequenceType(child)) {
@@ -407,6 +437,9 @@ class IDLAstWalker {
       }
       field.setIsKey(flags.is_key);
       field.setOptional(flags.is_optional);
+      if (flags.member_id) {
+        field.setMemberId(*flags.member_id);
+      }
       fields.push_back(std::move(field));
     }
     return fields;
@@ -483,11 +516,16 @@ class IDLAstWalker {
   void handleUnion(const std::shared_ptr<peg::Ast>& ast, const std::string& module_path) {
     std::string union_name;
     DiscriminatedUnion def;
+    uint16_t declaration = 0;
 
     for (const auto& child : ast->nodes) {
       auto role = roleName(child);
       if (role == "IDENTIFIER" && union_name.empty()) {
         union_name = child->token_to_string();
+      } else if (role == "ANNOTATION") {
+        if (auto extensibility = getExtensibility(child); extensibility != Extensibility::UNSPECIFIED) {
+          def.extensibility = extensibility;
+        }
       } else if (role == "SWITCH_TYPE") {
         if (child->is_token) {
           def.discriminant_type = child->token_to_string();
@@ -497,7 +535,7 @@ class IDLAstWalker {
           def.discriminant_type = extractTypeName(child);
         }
       } else if (role == "CASE") {
-        handleCase(child, def, module_path);
+        handleCase(child, def, module_path, declaration++);
       }
     }
 
@@ -507,7 +545,7 @@ class IDLAstWalker {
   }
 
   void handleCase(const std::shared_ptr<peg::Ast>& ast, DiscriminatedUnion& union_def,
-                  const std::string& module_path) {
+                  const std::string& module_path, uint16_t declaration) {
     // CASE children: CASE_LABEL+ [ANNOTATION*] TYPE_SPEC DECLARATOR
     std::vector<std::string> labels;
     bool is_default = false;
@@ -577,6 +615,7 @@ class IDLAstWalker {
     case_field.field_name = field_name;
     case_field.is_array = (array_size != 1);
     case_field.array_size = array_size;
+    case_field.declaration = declaration;
 
     if (is_default) {
       union_def.default_case = std::move(case_field);
@@ -853,6 +892,30 @@ MessageSchema::Ptr ParseIDL(const std::string& topic_name, const ROSType& root_t
     }
   }
 
+  // Number the struct cases of each union in the order of declaration.
+  std::unordered_map<const DiscriminatedUnion*, std::vector<const UnionCaseField*>> union_struct_cases;
+  for (auto& [id, def] : schema->union_library) {
+    std::vector<UnionCaseField*> cases;
+    for (auto& [label, case_field] : def.cases) {
+      cases.push_back(&case_field);
+    }
+    if (def.default_case) {
+      cases.push_back(&def.default_case.value());
+    }
+    std::sort(cases.begin(), cases.end(),
+              [](const UnionCaseField* a, const UnionCaseField* b) { return a->declaration < b->declaration; });
+    auto& struct_cases = union_struct_cases[&def];
+    for (auto* case_field : cases) {
+      if (case_field->type.isBuiltin() || schema->msg_library.count(case_field->type) == 0) {
+        continue;
+      }
+      if (struct_cases.empty() || struct_cases.back()->declaration != case_field->declaration) {
+        struct_cases.push_back(case_field);
+      }
+      case_field->child = static_cast<uint16_t>(struct_cases.size() - 1);
+    }
+  }
+
   // Build field tree (reusing the existing BuildMessageSchema pattern)
   // Create synthetic root field
   schema->root_field = std::make_unique<ROSField>(root_type, topic_name);
@@ -860,6 +923,24 @@ MessageSchema::Ptr ParseIDL(const std::string& topic_name, const ROSType& root_t
 
   std::function<void(const ROSMessage&, details::TreeNode<const ROSField*>*)> recursiveTreeCreator;
 
+  // The struct cases of a union are children of the union field, a node per case in the
+  // order of declaration: the labels of a case share its node (see UnionCaseField::child).
+  // Builtin and string cases are values of the union field itself.
+  std::map<std::pair<const DiscriminatedUnion*, uint16_t>, const ROSField*> case_fields;
+  auto addUnionCases = [&](const DiscriminatedUnion& def, details::TreeNode<const ROSField*>* node) {
+    const auto& struct_cases = union_struct_cases[&def];
+    node->children().reserve(struct_cases.size());
+    for (uint16_t child = 0; child < struct_cases.size(); child++) {
+      const UnionCaseField* case_field = struct_cases[child];
+      const ROSField*& field = case_fields[{&def, child}];
+      if (!field) {
+        schema->union_case_fields.push_back(std::make_unique<ROSField>(case_field->type, case_field->field_name));
+        field = schema->union_case_fields.back().get();
+      }
+      recursiveTreeCreator(*schema->msg_library.at(case_field->type), node->addChild(field));
+    }
+  };
+
   recursiveTreeCreator = [&](const ROSMessage& msg, details::TreeNode<const ROSField*>* node) {
     // Must reserve capacity before adding children (tree uses assert on capacity)
     node->children().reserve(msg.fields().size());
@@ -873,15 +954,14 @@ MessageSchema::Ptr ParseIDL(const std::string& topic_name, const ROSType& root_t
 
       if (!field.type().isBuiltin()) {
         // Check if it's a struct (recurse into it)
-        if (field.getEnum() == nullptr && field.getUnion() == nullptr) {
+        if (field.getUnion() != nullptr) {
+          addUnionCases(*field.getUnion(), new_node);
+        } else if (field.getEnum() == nullptr) {
           auto child_it = schema->msg_library.find(field.type());
           if (child_it != schema->msg_library.end()) {
             recursiveTreeCreator(*child_it->second, new_node);
           }
         }
-        // For unions, we don't recurse into cases in the field tree.
-        // Union case resolution happens at deserialization time.
-        // The field tree just has the union field as a leaf-like node.
       }
     }
   };
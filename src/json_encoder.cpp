@@ -0,0 +1,830 @@
+#include "rosx_introspection/json_encoder.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifdef ROSX_HAS_JSON
+#include "rapidjson/error/en.h"
+#include "rapidjson/reader.h"
+#endif
+
+namespace RosMsgParser {
+
+void NameTable::build(std::vector<std::string_view> names) {
+  if (names.size() >= NOT_FOUND) {
+    throw std::runtime_error("NameTable: too many names");
+  }
+  _names = std::move(names);
+  _slots.clear();
+  if (_names.empty()) {
+    return;
+  }
+  size_t size = 4;
+  while (size < 2 * _names.size()) {
+    size *= 2;
+  }
+  // Try a few seeds for each size of the table, then double it: a small table
+  // without collisions is found almost immediately for the usual structs.
+  for (;; size *= 2) {
+    _mask = static_cast<uint32_t>(size - 1);
+    for (uint32_t seed = 0; seed < 256; seed++) {
+      _slots.assign(size, NOT_FOUND);
+      bool collision = false;
+      for (size_t i = 0; i < _names.size() && !collision; i++) {
+        uint16_t& slot = _slots[hash(_names[i], seed) & _mask];
+        if (slot == NOT_FOUND) {
+          slot = static_cast<uint16_t>(i);
+        } else {
+          // a repeated name keeps its first index
+          collision = (_names[slot] != _names[i]);
+        }
+      }
+      if (!collision) {
+        _seed = seed;
+        return;
+      }
+    }
+  }
+}
+
+namespace {
+
+// Integer value of a union case label, if it is written in the canonical decimal form.
+std::optional<int64_t> integerLabel(const std::string& label) {
+  int64_t value = 0;
+  const char* end = label.data() + label.size();
+  auto [ptr, ec] = std::from_chars(label.data(), end, value);
+  if (ec != std::errc() || ptr != end || std::to_string(value) != label) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+class EncoderCompiler {
+ public:
+  EncoderCompiler(const MessageSchema& schema, JsonEncoder& encoder) : _schema(schema), _encoder(encoder) {}
+
+  uint32_t compileStruct(const ROSMessage* msg) {
+    auto it = _structs.find(msg);
+    if (it != _structs.end()) {
+      return it->second;
+    }
+    const auto index = static_cast<uint32_t>(_encoder.structs.size());
+    _structs[msg] = index;
+    _encoder.structs.emplace_back();
+
+    JsonEncoder::Struct compiled;
+    compiled.msg = msg;
+    std::vector<std::string_view> names;
+    for (const ROSField& field : msg->fields()) {
+      if (field.isConstant()) {
+        continue;
+      }
+      compiled.fields.push_back(compileField(field));
+      names.push_back(field.name());
+    }
+    compiled.names.build(std::move(names));
+    // the recursion may have moved the vector
+    _encoder.structs[index] = std::move(compiled);
+    return index;
+  }
+
+ private:
+  JsonField compileField(const ROSField& field) {
+    JsonField compiled;
+    compiled.name = field.name();
+    compiled.type = field.type().typeID();
+    compiled.is_array = field.isArray();
+    compiled.array_size = field.isArray() ? field.arraySize() : 1;
+    compiled.is_optional = field.isOptional();
+    if (field.getEnum() != nullptr) {
+      compiled.kind = JsonField::ENUM;
+      compiled.target = compileEnum(*field.getEnum());
+    } else if (field.getUnion() != nullptr) {
+      compiled.kind = JsonField::UNION;
+      compiled.target = compileUnion(*field.getUnion());
+    } else if (compiled.type == OTHER) {
+      compiled.kind = JsonField::STRUCT;
+      if (auto msg = field.getMessagePtr(_schema.msg_library)) {
+        compiled.target = compileStruct(msg.get());
+      }
+    } else {
+      setBuiltinKind(compiled);
+    }
+    return compiled;
+  }
+
+  static void setBuiltinKind(JsonField& compiled) {
+    switch (compiled.type) {
+      case STRING:
+        compiled.kind = JsonField::STRING;
+        break;
+      case TIME:
+      case DURATION:
+        compiled.kind = JsonField::TIME;
+        break;
+      default:
+        compiled.kind = JsonField::SCALAR;
+        break;
+    }
+  }
+
+  // A union case has no ROSField: its type is resolved in the libraries of the schema.
+  JsonField compileCase(const UnionCaseField& case_field) {
+    JsonField compiled;
+    compiled.name = case_field.field_name;
+    compiled.type = case_field.type.typeID();
+    compiled.is_array = case_field.is_array;
+    compiled.array_size = case_field.is_array ? case_field.array_size : 1;
+    if (case_field.type.isBuiltin()) {
+      setBuiltinKind(compiled);
+      return compiled;
+    }
+    auto enum_it = _schema.enum_library.find(case_field.type);
+    if (enum_it != _schema.enum_library.end()) {
+      compiled.kind = JsonField::ENUM;
+      compiled.target = compileEnum(enum_it->second);
+      return compiled;
+    }
+    compiled.kind = JsonField::STRUCT;
+    auto msg_it = _schema.msg_library.find(case_field.type);
+    if (msg_it != _schema.msg_library.end()) {
+      compiled.target = compileStruct(msg_it->second.get());
+    }
+    return compiled;
+  }
+
+  uint32_t compileUnion(const DiscriminatedUnion& def) {
+    auto it = _unions.find(&def);
+    if (it != _unions.end()) {
+      return it->second;
+    }
+    const auto index = static_cast<uint32_t>(_encoder.unions.size());
+    _unions[&def] = index;
+    _encoder.unions.emplace_back();
+
+    JsonEncoder::Union compiled;
+    compiled.definition = &def;
+    const BuiltinType discriminant_type = toBuiltinType(def.discriminant_type);
+    const EnumDefinition* discriminant_enum = nullptr;
+    if (discriminant_type == OTHER) {
+      auto enum_it = _schema.enum_library.find(ROSType(def.discriminant_type));
+      if (enum_it != _schema.enum_library.end()) {
+        discriminant_enum = &enum_it->second;
+      }
+    } else {
+      compiled.discriminant_type = discriminant_type;
+    }
+
+    // The labels are the names of the enumerators or integers (see CompileDecodeProgram).
+    // A case with several labels is selected by the lowest value.
+    std::map<std::string_view, std::pair<int64_t, const UnionCaseField*>> by_name;
+    std::vector<int64_t> used;
+    for (const auto& [label, case_field] : def.cases) {
+      std::optional<int64_t> value;
+      if (discriminant_enum) {
+        for (const auto& ev : discriminant_enum->values) {
+          if (ev.name == label) {
+            value = ev.value;
+            break;
+          }
+        }
+      }
+      if (!value) {
+        value = integerLabel(label);
+      }
+      if (!value) {
+        continue;
+      }
+      used.push_back(*value);
+      auto [name_it, inserted] = by_name.try_emplace(case_field.field_name, *value, &case_field);
+      if (!inserted && *value < name_it->second.first) {
+        name_it->second = {*value, &case_field};
+      }
+    }
+    std::vector<std::pair<int64_t, const UnionCaseField*>> cases;
+    for (const auto& [name, entry] : by_name) {
+      cases.push_back(entry);
+    }
+    std::sort(cases.begin(), cases.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // The default case is selected by a value without label.
+    if (def.default_case && by_name.count(def.default_case->field_name) == 0) {
+      auto unused = [&used](int64_t value) { return std::find(used.begin(), used.end(), value) == used.end(); };
+      std::optional<int64_t> value;
+      if (discriminant_enum) {
+        for (const auto& ev : discriminant_enum->values) {
+          if (unused(ev.value)) {
+            value = ev.value;
+            break;
+          }
+        }
+      } else {
+        for (int64_t candidate = 0; !value; candidate++) {
+          if (unused(candidate)) {
+            value = candidate;
+          }
+        }
+      }
+      if (value) {
+        cases.push_back({*value, &def.default_case.value()});
+      }
+    }
+
+    std::vector<std::string_view> names;
+    for (const auto& [value, case_field] : cases) {
+      compiled.cases.push_back(compileCase(*case_field));
+      compiled.discriminants.push_back(value);
+      names.push_back(case_field->field_name);
+    }
+    compiled.names.build(std::move(names));
+    _encoder.unions[index] = std::move(compiled);
+    return index;
+  }
+
+  uint32_t compileEnum(const EnumDefinition& def) {
+    auto it = _enums.find(&def);
+    if (it != _enums.end()) {
+      return it->second;
+    }
+    JsonEncoder::Enum compiled;
+    std::vector<std::string_view> names;
+    for (const auto& ev : def.values) {
+      compiled.values.push_back(ev.ddsCompatValue());
+      names.push_back(ev.name);
+    }
+    compiled.names.build(std::move(names));
+    const auto index = static_cast<uint32_t>(_encoder.enums.size());
+    _encoder.enums.push_back(std::move(compiled));
+    _enums[&def] = index;
+    return index;
+  }
+
+  const MessageSchema& _schema;
+  JsonEncoder& _encoder;
+  std::unordered_map<const ROSMessage*, uint32_t> _structs;
+  std::unordered_map<const DiscriminatedUnion*, uint32_t> _unions;
+  std::unordered_map<const EnumDefinition*, uint32_t> _enums;
+};
+
+//-----------------------------------------------------------------------------
+
+#ifdef ROSX_HAS_JSON
+
+/**
+ * The events of a rapidjson::Reader, recorded in a flat list of tokens: the encoder
+ * looks ahead (the length of a sequence comes before its elements) and back (the
+ * members of an object may come before their turn). The text is parsed in situ,
+ * in a copy: the strings are views of the copy, unescaped in place.
+ */
+class JsonTokens : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, JsonTokens> {
+ public:
+  // the integers are INT if negative, UINT otherwise
+  enum Kind : uint8_t {
+    NULL_VALUE,
+    FALSE_VALUE,
+    TRUE_VALUE,
+    INT,
+    UINT,
+    DOUBLE,
+    STRING,
+    KEY,
+    BEGIN_OBJECT,
+    END_OBJECT,
+    BEGIN_ARRAY,
+    END_ARRAY
+  };
+
+  struct Token {
+    Kind kind;
+    /// Length of a STRING or KEY, number of elements after BEGIN_ARRAY.
+    uint32_t size;
+    union {
+      int64_t int_value;
+      uint64_t uint_value;
+      double double_value;
+      const char* str;
+      /// BEGIN_OBJECT and BEGIN_ARRAY: index of the matching END.
+      uint32_t end;
+    };
+  };
+
+  void parse(std::string_view json) {
+    _text.assign(json.data(), json.size());
+    _tokens.clear();
+    _open.clear();
+    rapidjson::InsituStringStream stream(_text.data());
+    rapidjson::Reader reader;
+    constexpr unsigned flags =
+        rapidjson::kParseInsituFlag | rapidjson::kParseFullPrecisionFlag | rapidjson::kParseNanAndInfFlag;
+    const rapidjson::ParseResult result = reader.Parse<flags>(stream, *this);
+    if (result.IsError()) {
+      throw std::runtime_error("Failed to parse JSON input at offset " + std::to_string(result.Offset()) + ": " +
+                               rapidjson::GetParseError_En(result.Code()));
+    }
+  }
+
+  const Token& operator[](size_t index) const {
+    return _tokens[index];
+  }
+
+  // rapidjson::Reader handler
+
+  bool Null() {
+    push(NULL_VALUE);
+    return true;
+  }
+  bool Bool(bool value) {
+    push(value ? TRUE_VALUE : FALSE_VALUE);
+    return true;
+  }
+  bool Int(int value) {
+    return Int64(value);
+  }
+  bool Uint(unsigned value) {
+    return Uint64(value);
+  }
+  bool Int64(int64_t value) {
+    if (value >= 0) {
+      return Uint64(static_cast<uint64_t>(value));
+    }
+    push(INT).int_value = value;
+    return true;
+  }
+  bool Uint64(uint64_t value) {
+    push(UINT).uint_value = value;
+    return true;
+  }
+  bool Double(double value) {
+    push(DOUBLE).double_value = value;
+    return true;
+  }
+  bool String(const char* str, rapidjson::SizeType length, bool /*copy*/) {
+    pushString(STRING, str, length);
+    return true;
+  }
+  bool Key(const char* str, rapidjson::SizeType length, bool /*copy*/) {
+    pushString(KEY, str, length);
+    return true;
+  }
+  bool StartObject() {
+    _open.push_back(static_cast<uint32_t>(_tokens.size()));
+    push(BEGIN_OBJECT);
+    return true;
+  }
+  bool EndObject(rapidjson::SizeType /*member_count*/) {
+    close(END_OBJECT);
+    return true;
+  }
+  bool StartArray() {
+    _open.push_back(static_cast<uint32_t>(_tokens.size()));
+    push(BEGIN_ARRAY);
+    return true;
+  }
+  bool EndArray(rapidjson::SizeType element_count) {
+    _tokens[_open.back()].size = element_count;
+    close(END_ARRAY);
+    return true;
+  }
+
+ private:
+  Token& push(Kind kind) {
+    Token& token = _tokens.emplace_back();
+    token.kind = kind;
+    token.size = 0;
+    token.uint_value = 0;
+    return token;
+  }
+
+  void pushString(Kind kind, const char* str, rapidjson::SizeType length) {
+    Token& token = push(kind);
+    token.str = str;
+    token.size = length;
+  }
+
+  void close(Kind kind) {
+    _tokens[_open.back()].end = static_cast<uint32_t>(_tokens.size());
+    _open.pop_back();
+    push(kind);
+  }
+
+  std::string _text;
+  std::vector<Token> _tokens;
+  // index of the BEGIN of the objects and arrays that are open
+  std::vector<uint32_t> _open;
+};
+
+[[noreturn]] void fieldError(const char* what, const JsonField& field) {
+  throw std::runtime_error(what + std::string(field.name));
+}
+
+class StreamEncoder {
+ public:
+  StreamEncoder(const JsonEncoder& encoder, const JsonTokens& tokens, Serializer* serializer)
+    : _encoder(encoder), _tokens(tokens), _serializer(serializer) {}
+
+  void encodeRoot() {
+    if (peek() != JsonTokens::BEGIN_OBJECT) {
+      throw std::runtime_error("JSON root must be an object");
+    }
+    encodeStruct(_encoder.structs[_encoder.root]);
+  }
+
+ private:
+  static constexpr uint32_t NO_POSITION = 0xFFFFFFFF;
+
+  JsonTokens::Kind peek() const {
+    return _tokens[_pos].kind;
+  }
+
+  bool consume(JsonTokens::Kind kind) {
+    if (peek() == kind) {
+      _pos++;
+      return true;
+    }
+    return false;
+  }
+
+  // A STRING or a KEY.
+  std::string_view readString() {
+    const JsonTokens::Token& token = _tokens[_pos++];
+    return std::string_view(token.str, token.size);
+  }
+
+  void skipValue() {
+    const JsonTokens::Token& token = _tokens[_pos];
+    const bool nested = (token.kind == JsonTokens::BEGIN_OBJECT || token.kind == JsonTokens::BEGIN_ARRAY);
+    _pos = nested ? token.end + 1 : _pos + 1;
+  }
+
+  void encodeStruct(const JsonEncoder::Struct& compiled) {
+    const size_t count = compiled.fields.size();
+    // position of the values that came before the turn of their field
+    SmallVector<uint32_t, 16> pending(count, NO_POSITION);
+    size_t next = 0;
+    _pos++;
+    while (!consume(JsonTokens::END_OBJECT)) {
+      const std::string_view key = readString();
+      // the keys are usually in the order of the fields
+      const size_t index = (next < count && key == compiled.fields[next].name) ? next : compiled.names.find(key);
+      if (index == next) {
+        encodeField(compiled.fields[next++]);
+        for (; next < count && pending[next] != NO_POSITION; next++) {
+          encodeAt(pending[next], compiled.fields[next]);
+        }
+      } else {
+        // unknown keys and repeated fields are ignored
+        if (index != NameTable::NOT_FOUND && index > next && pending[index] == NO_POSITION) {
+          pending[index] = _pos;
+        }
+        skipValue();
+      }
+    }
+    for (; next < count; next++) {
+      if (pending[next] != NO_POSITION) {
+        encodeAt(pending[next], compiled.fields[next]);
+      } else {
+        encodeDefault(compiled.fields[next]);
+      }
+    }
+  }
+
+  void encodeAt(uint32_t position, const JsonField& field) {
+    const uint32_t current = _pos;
+    _pos = position;
+    encodeField(field);
+    _pos = current;
+  }
+
+  void encodeField(const JsonField& field) {
+    if (field.is_optional) {
+      fieldError("serializeFromJson does not support @optional field: ", field);
+    }
+    if (consume(JsonTokens::NULL_VALUE)) {
+      encodeDefault(field);
+      return;
+    }
+    if ((peek() == JsonTokens::BEGIN_ARRAY) != field.is_array) {
+      fieldError("IsArray() mismatch in field: ", field);
+    }
+    if (!field.is_array) {
+      encodeElement(field);
+      return;
+    }
+    const uint32_t count = _tokens[_pos++].size;
+    if (field.array_size < 0) {
+      _serializer->serializeUInt32(count);
+    } else if (count != static_cast<uint32_t>(field.array_size)) {
+      fieldError("Fixed array size mismatch in field: ", field);
+    }
+    while (!consume(JsonTokens::END_ARRAY)) {
+      encodeElement(field);
+    }
+  }
+
+  void encodeElement(const JsonField& field) {
+    switch (field.kind) {
+      case JsonField::SCALAR:
+        encodeScalar(field);
+        break;
+      case JsonField::STRING:
+        if (peek() != JsonTokens::STRING) {
+          fieldError("Expected string in field: ", field);
+        }
+        _serializer->serializeStringView(readString());
+        break;
+      case JsonField::TIME:
+        encodeTime(field);
+        break;
+      case JsonField::ENUM:
+        encodeEnum(field);
+        break;
+      case JsonField::UNION:
+        encodeUnion(field);
+        break;
+      case JsonField::STRUCT:
+        if (field.target == JsonField::NO_TARGET) {
+          fieldError("Missing ROSType in library for field: ", field);
+        }
+        if (peek() != JsonTokens::BEGIN_OBJECT) {
+          throw std::runtime_error("Expected JSON object while serializing nested message");
+        }
+        encodeStruct(_encoder.structs[field.target]);
+        break;
+    }
+  }
+
+  template <typename T>
+  T readInteger(const JsonField& field) {
+    const JsonTokens::Token& token = _tokens[_pos++];
+    if (token.kind == JsonTokens::UINT) {
+      if (token.uint_value > static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+        fieldError("Value out of range in field: ", field);
+      }
+      return static_cast<T>(token.uint_value);
+    }
+    if (token.kind == JsonTokens::INT) {
+      if (!std::is_signed_v<T> || token.int_value < static_cast<int64_t>(std::numeric_limits<T>::min())) {
+        fieldError("Value out of range in field: ", field);
+      }
+      return static_cast<T>(token.int_value);
+    }
+    fieldError(std::is_signed_v<T> ? "Expected integer in field: " : "Expected unsigned integer in field: ", field);
+  }
+
+  template <typename T>
+  T readFloat(const JsonField& field) {
+    const JsonTokens::Token& token = _tokens[_pos++];
+    double value = 0;
+    switch (token.kind) {
+      case JsonTokens::DOUBLE:
+        value = token.double_value;
+        break;
+      case JsonTokens::INT:
+        value = static_cast<double>(token.int_value);
+        break;
+      case JsonTokens::UINT:
+        value = static_cast<double>(token.uint_value);
+        break;
+      default:
+        fieldError("Expected number in field: ", field);
+    }
+    // a float32 is rounded from the float64: out of its range, it is infinite
+    if (std::abs(value) > std::numeric_limits<T>::max()) {
+      return (value < 0) ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+    }
+    return static_cast<T>(value);
+  }
+
+  void encodeScalar(const JsonField& field) {
+    switch (field.type) {
+      case BOOL:
+        if (peek() != JsonTokens::TRUE_VALUE && peek() != JsonTokens::FALSE_VALUE) {
+          fieldError("Expected boolean in field: ", field);
+        }
+        _serializer->write<bool>(_tokens[_pos++].kind == JsonTokens::TRUE_VALUE);
+        break;
+      case CHAR: {
+        if (peek() != JsonTokens::STRING) {
+          fieldError("Expected string in field: ", field);
+        }
+        const std::string_view str = readString();
+        _serializer->write<char>(str.empty() ? '\0' : str[0]);
+      } break;
+      case BYTE:
+      case UINT8:
+        _serializer->write(readInteger<uint8_t>(field));
+        break;
+      case UINT16:
+        _serializer->write(readInteger<uint16_t>(field));
+        break;
+      case UINT32:
+        _serializer->write(readInteger<uint32_t>(field));
+        break;
+      case UINT64:
+        _serializer->write(readInteger<uint64_t>(field));
+        break;
+      case INT8:
+        _serializer->write(readInteger<int8_t>(field));
+        break;
+      case INT16:
+        _serializer->write(readInteger<int16_t>(field));
+        break;
+      case INT32:
+        _serializer->write(readInteger<int32_t>(field));
+        break;
+      case INT64:
+        _serializer->write(readInteger<int64_t>(field));
+        break;
+      case FLOAT32:
+        _serializer->write(readFloat<float>(field));
+        break;
+      case FLOAT64:
+        _serializer->write(readFloat<double>(field));
+        break;
+      default:
+        fieldError("Unsupported type in field: ", field);
+    }
+  }
+
+  void encodeTime(const JsonField& field) {
+    if (!consume(JsonTokens::BEGIN_OBJECT)) {
+      fieldError("Expected time/duration object in field: ", field);
+    }
+    std::optional<int32_t> secs;
+    std::optional<int32_t> nsecs;
+    while (!consume(JsonTokens::END_OBJECT)) {
+      const std::string_view key = readString();
+      if (key == "secs" && !secs) {
+        secs = readInteger<int32_t>(field);
+      } else if (key == "nsecs" && !nsecs) {
+        nsecs = readInteger<int32_t>(field);
+      } else {
+        skipValue();
+      }
+    }
+    if (!secs || !nsecs) {
+      fieldError("Missing secs/nsecs in field: ", field);
+    }
+    _serializer->serializeUInt32(static_cast<uint32_t>(*secs));
+    _serializer->serializeUInt32(static_cast<uint32_t>(*nsecs));
+  }
+
+  void encodeEnum(const JsonField& field) {
+    const JsonEncoder::Enum& compiled = _encoder.enums[field.target];
+    if (peek() != JsonTokens::STRING) {
+      _serializer->write(readInteger<int32_t>(field));
+      return;
+    }
+    const std::string_view name = readString();
+    const uint16_t index = compiled.names.find(name);
+    if (index == NameTable::NOT_FOUND) {
+      throw std::runtime_error("Unknown enumerator '" + std::string(name) + "' in field: " + std::string(field.name));
+    }
+    _serializer->write(compiled.values[index]);
+  }
+
+  void encodeUnion(const JsonField& field) {
+    const JsonEncoder::Union& compiled = _encoder.unions[field.target];
+    if (!consume(JsonTokens::BEGIN_OBJECT) || peek() != JsonTokens::KEY) {
+      fieldError("Expected an object with the active case in union field: ", field);
+    }
+    const std::string_view name = readString();
+    const uint16_t index = compiled.names.find(name);
+    if (index == NameTable::NOT_FOUND) {
+      throw std::runtime_error("Unknown case '" + std::string(name) + "' in union field: " + std::string(field.name));
+    }
+    writeInteger(compiled.discriminant_type, compiled.discriminants[index]);
+    encodeField(compiled.cases[index]);
+    if (!consume(JsonTokens::END_OBJECT)) {
+      fieldError("Expected a single case in union field: ", field);
+    }
+  }
+
+  void encodeDefault(const JsonField& field) {
+    if (field.is_optional) {
+      fieldError("serializeFromJson does not support @optional field: ", field);
+    }
+    if (field.is_array && field.array_size < 0) {
+      _serializer->serializeUInt32(0);
+      return;
+    }
+    for (int32_t i = 0; i < field.array_size; i++) {
+      encodeDefaultElement(field);
+    }
+  }
+
+  void encodeDefaultElement(const JsonField& field) {
+    switch (field.kind) {
+      case JsonField::SCALAR: {
+        // zero, false or '\0'
+        const uint64_t zero = 0;
+        _serializer->writeFrom(field.type, &zero);
+      } break;
+      case JsonField::STRING:
+        _serializer->serializeStringView(std::string_view());
+        break;
+      case JsonField::TIME:
+        _serializer->serializeUInt32(0);
+        _serializer->serializeUInt32(0);
+        break;
+      case JsonField::ENUM:
+        _serializer->write<int32_t>(0);
+        break;
+      case JsonField::UNION: {
+        const JsonEncoder::Union& compiled = _encoder.unions[field.target];
+        if (compiled.cases.empty()) {
+          writeInteger(compiled.discriminant_type, 0);
+        } else {
+          writeInteger(compiled.discriminant_type, compiled.discriminants[0]);
+          encodeDefault(compiled.cases[0]);
+        }
+      } break;
+      case JsonField::STRUCT:
+        if (field.target == JsonField::NO_TARGET) {
+          fieldError("Missing ROSType in library for field: ", field);
+        }
+        for (const JsonField& child : _encoder.structs[field.target].fields) {
+          encodeDefault(child);
+        }
+        break;
+    }
+  }
+
+  void writeInteger(BuiltinType type, int64_t value) {
+    switch (type) {
+      case BOOL:
+        _serializer->write<bool>(value != 0);
+        break;
+      case CHAR:
+        _serializer->write(static_cast<char>(value));
+        break;
+      case BYTE:
+      case UINT8:
+        _serializer->write(static_cast<uint8_t>(value));
+        break;
+      case INT8:
+        _serializer->write(static_cast<int8_t>(value));
+        break;
+      case UINT16:
+        _serializer->write(static_cast<uint16_t>(value));
+        break;
+      case INT16:
+        _serializer->write(static_cast<int16_t>(value));
+        break;
+      case UINT32:
+        _serializer->write(static_cast<uint32_t>(value));
+        break;
+      case UINT64:
+        _serializer->write(static_cast<uint64_t>(value));
+        break;
+      case INT64:
+        _serializer->write(value);
+        break;
+      default:
+        _serializer->write(static_cast<int32_t>(value));
+        break;
+    }
+  }
+
+  const JsonEncoder& _encoder;
+  const JsonTokens& _tokens;
+  Serializer* _serializer;
+  // index of the next token
+  uint32_t _pos = 0;
+};
+
+#endif  // ROSX_HAS_JSON
+
+}  // namespace
+
+JsonEncoder::Ptr CompileJsonEncoder(const MessageSchema& schema) {
+  auto encoder = std::make_shared<JsonEncoder>();
+  EncoderCompiler compiler(schema, *encoder);
+  encoder->root = compiler.compileStruct(schema.root_msg.get());
+  return encoder;
+}
+
+#ifdef ROSX_HAS_JSON
+void EncodeJson(const JsonEncoder& encoder, std::string_view json, Serializer* serializer) {
+  JsonTokens tokens;
+  tokens.parse(json);
+  StreamEncoder stream(encoder, tokens, serializer);
+  stream.encodeRoot();
+}
+#else
+void EncodeJson(const JsonEncoder&, std::string_view, Serializer*) {
+  throw std::runtime_error("This version of rosx_introspection was built without JSON support");
+}
+#endif
+
+}  // namespace RosMsgParser
@@ -1,100 +1,298 @@
 #include "rosx_introspection/json_message_writer.hpp"
 
-#ifdef ROSX_HAS_JSON
+#include <charconv>
+#include <cmath>
+#include <type_traits>
 
-#include "rapidjson/document.h"
+#include "rosx_introspection/ros_message.hpp"
 
-#include <vector>
+namespace RosMsgParser {
 
-#include "rosx_introspection/ros_field.hpp"
-#include "rosx_introspection/variant.hpp"
+JsonMessageWriter::JsonMessageWriter(std::string* output, int indent) : _output(output), _indent(indent) {}
 
-namespace RosMsgParser {
+void JsonMessageWriter::newLine() {
+  if (_indent > 0) {
+    _output->push_back('\n');
+    _output->append(_scopes.size() * static_cast<size_t>(_indent), ' ');
+  }
+}
 
-struct JsonMessageWriter::Impl {
-  rapidjson::Document& doc;
-  rapidjson::Document::AllocatorType& alloc;
-  bool ignore_constants;
-  std::vector<rapidjson::Value*> json_stack;
+void JsonMessageWriter::openScope(char bracket, uint8_t flags) {
+  _output->push_back(bracket);
+  _scopes.push_back(flags);
+}
 
-  Impl(rapidjson::Document& d, bool ignore)
-      : doc(d), alloc(d.GetAllocator()), ignore_constants(ignore) {
-    doc.SetObject();
-    json_stack.push_back(&doc);
+void JsonMessageWriter::closeScope() {
+  const uint8_t flags = _scopes.back();
+  _scopes.pop_back();
+  if (flags & NOT_EMPTY) {
+    newLine();
   }
+  _output->push_back((flags & ARRAY) ? ']' : '}');
+}
 
-  void addToCurrentJson(const FieldLeaf& leaf, rapidjson::Value&& val) {
-    (void)leaf;
-    (void)val;
-    // TODO: build hierarchical JSON. For now, fall back to the legacy implementation.
+void JsonMessageWriter::beginValue(std::string_view name) {
+  // the root struct has no beginStruct()
+  if (_scopes.empty()) {
+    openScope('{', 0);
+  }
+  uint8_t& flags = _scopes.back();
+  if (flags & NOT_EMPTY) {
+    _output->push_back(',');
   }
-};
+  flags |= NOT_EMPTY;
+  const bool in_array = (flags & ARRAY);
+  newLine();
+  if (!in_array) {
+    _output->push_back('"');
+    _output->append(name);
+    _output->append(_indent > 0 ? "\": " : "\":");
+  }
+}
 
-JsonMessageWriter::JsonMessageWriter(void* doc, bool ignore_constants)
-    : _impl(std::make_unique<Impl>(*static_cast<rapidjson::Document*>(doc), ignore_constants)) {}
+void JsonMessageWriter::beginValue(const FieldLeaf& leaf) {
+  if (!_scopes.empty() && (_scopes.back() & ARRAY)) {
+    beginValue(std::string_view());
+  } else if (!_scopes.empty() && (_scopes.back() & UNION)) {
+    beginValue(_union_case);
+  } else {
+    beginValue(leaf.node->value()->name());
+  }
+}
+
+template <typename T>
+void JsonMessageWriter::appendValue(T value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    _output->append(value ? "true" : "false");
+  } else if constexpr (std::is_same_v<T, char>) {
+    appendString(std::string_view(&value, 1));
+  } else if constexpr (std::is_same_v<T, Time>) {
+    appendTime(value);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    if (!std::isfinite(value)) {
+      _output->append(std::isnan(value) ? "NaN" : (value < 0 ? "-Infinity" : "Infinity"));
+      return;
+    }
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    const std::string_view number(buffer, static_cast<size_t>(result.ptr - buffer));
+    _output->append(number);
+    // keep the value a floating point number for the readers
+    if (number.find_first_of(".e") == std::string_view::npos) {
+      _output->append(".0");
+    }
+  } else {
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    _output->append(buffer, static_cast<size_t>(result.ptr - buffer));
+  }
+}
 
-JsonMessageWriter::~JsonMessageWriter() = default;
+void JsonMessageWriter::appendTime(const Time& time) {
+  openScope('{', 0);
+  beginValue("secs");
+  appendValue(static_cast<int32_t>(time.sec));
+  beginValue("nsecs");
+  appendValue(static_cast<int32_t>(time.nsec));
+  closeScope();
+}
+
+void JsonMessageWriter::appendString(std::string_view str) {
+  static const char* hex = "0123456789ABCDEF";
+  _output->push_back('"');
+  size_t begin = 0;
+  for (size_t i = 0; i < str.size(); i++) {
+    const auto c = static_cast<unsigned char>(str[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    _output->append(str.data() + begin, i - begin);
+    begin = i + 1;
+    switch (c) {
+      case '"':
+        _output->append("\\\"");
+        break;
+      case '\\':
+        _output->append("\\\\");
+        break;
+      case '\b':
+        _output->append("\\b");
+        break;
+      case '\f':
+        _output->append("\\f");
+        break;
+      case '\n':
+        _output->append("\\n");
+        break;
+      case '\r':
+        _output->append("\\r");
+        break;
+      case '\t':
+        _output->append("\\t");
+        break;
+      default: {
+        const char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+        _output->append(escaped, sizeof(escaped));
+      } break;
+    }
+  }
+  _output->append(str.data() + begin, str.size() - begin);
+  _output->push_back('"');
+}
 
 void JsonMessageWriter::writeValue(const FieldLeaf& leaf, const Variant& value) {
-  rapidjson::Value json_val;
+  beginValue(leaf);
   switch (value.getTypeID()) {
     case BOOL:
-      json_val.SetBool(value.convert<uint8_t>());
+      appendValue(value.convert<uint8_t>() != 0);
+      break;
+    case CHAR:
+      appendValue(static_cast<char>(value.convert<int8_t>()));
       break;
-    case CHAR: {
-      char c = value.convert<int8_t>();
-      json_val.SetString(&c, 1, _impl->alloc);
-    } break;
     case BYTE:
     case UINT8:
     case UINT16:
     case UINT32:
-      json_val.SetUint(value.convert<uint32_t>());
-      break;
     case UINT64:
-      json_val.SetUint64(value.convert<uint64_t>());
-      break;
-    case INT8:
-    case INT16:
-    case INT32:
-      json_val.SetInt(value.convert<int32_t>());
-      break;
-    case INT64:
-      json_val.SetInt64(value.convert<int64_t>());
+      appendValue(value.convert<uint64_t>());
       break;
     case FLOAT32:
-      json_val.SetFloat(value.convert<float>());
+      appendValue(value.extract<float>());
       break;
     case FLOAT64:
-      json_val.SetDouble(value.convert<double>());
+      appendValue(value.extract<double>());
       break;
     case TIME:
     case DURATION:
-      json_val.SetInt(value.convert<int32_t>());
+      appendTime(value.extract<Time>());
+      break;
+    case STRING:
+      appendString(value.extract<std::string_view>());
       break;
     default:
-      json_val.SetNull();
+      appendValue(value.convert<int64_t>());
       break;
   }
-  _impl->addToCurrentJson(leaf, std::move(json_val));
 }
 
-void JsonMessageWriter::writeString(const FieldLeaf& leaf, const std::string& str) {
-  rapidjson::Value json_val;
-  json_val.SetString(str.c_str(), str.length(), _impl->alloc);
-  _impl->addToCurrentJson(leaf, std::move(json_val));
+void JsonMessageWriter::writeBool(const FieldLeaf& leaf, bool value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeChar(const FieldLeaf& leaf, char value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeInt8(const FieldLeaf& leaf, int8_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeInt16(const FieldLeaf& leaf, int16_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeInt32(const FieldLeaf& leaf, int32_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeInt64(const FieldLeaf& leaf, int64_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeUInt8(const FieldLeaf& leaf, uint8_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeUInt16(const FieldLeaf& leaf, uint16_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeUInt32(const FieldLeaf& leaf, uint32_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeUInt64(const FieldLeaf& leaf, uint64_t value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeFloat32(const FieldLeaf& leaf, float value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeFloat64(const FieldLeaf& leaf, double value) {
+  beginValue(leaf);
+  appendValue(value);
+}
+
+void JsonMessageWriter::writeString(const FieldLeaf& leaf, const std::string& value) {
+  writeString(leaf, std::string_view(value));
+}
+
+void JsonMessageWriter::writeString(const FieldLeaf& leaf, std::string_view value) {
+  beginValue(leaf);
+  appendString(value);
 }
 
 void JsonMessageWriter::writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& /*name*/) {
-  rapidjson::Value json_val;
-  json_val.SetInt(value);
-  _impl->addToCurrentJson(leaf, std::move(json_val));
+  beginValue(leaf);
+  appendValue(value);
 }
 
-void JsonMessageWriter::beginStruct(const ROSField& /*field*/) {}
+void JsonMessageWriter::writeArray(const FieldLeaf& /*leaf*/, BuiltinType type, Span<const uint8_t> raw,
+                                   size_t count) {
+  // the elements of the array opened by beginArray()
+  ForEachTypedArrayValue(type, raw, count, [this](size_t /*index*/, auto value) {
+    beginValue(std::string_view());
+    appendValue(value);
+  });
+}
 
-void JsonMessageWriter::endStruct() {}
+void JsonMessageWriter::beginStruct(const ROSField& field) {
+  beginValue(field.name());
+  openScope('{', 0);
+}
 
-}  // namespace RosMsgParser
+void JsonMessageWriter::endStruct() {
+  closeScope();
+}
+
+void JsonMessageWriter::beginArray(const ROSField& field, uint32_t /*size*/) {
+  beginValue(field.name());
+  openScope('[', ARRAY);
+}
+
+void JsonMessageWriter::endArray() {
+  closeScope();
+}
+
+void JsonMessageWriter::beginUnion(const ROSField& field, const std::string& case_name) {
+  beginValue(field.name());
+  openScope('{', UNION);
+  _union_case = case_name;
+}
+
+void JsonMessageWriter::endUnion() {
+  closeScope();
+}
+
+void JsonMessageWriter::finish() {
+  if (_scopes.empty()) {
+    openScope('{', 0);
+  }
+  while (!_scopes.empty()) {
+    closeScope();
+  }
+}
 
-#endif  // ROSX_HAS_JSON
+}  // namespace RosMsgParser
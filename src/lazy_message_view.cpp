@@ -0,0 +1,234 @@
+#include "rosx_introspection/lazy_message_view.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+namespace RosMsgParser {
+
+namespace {
+
+uint32_t countNodes(const FieldTreeNode* node) {
+  uint32_t count = 1;
+  for (const auto& child : node->children()) {
+    count += countNodes(&child);
+  }
+  return count;
+}
+
+}  // namespace
+
+// Caches the values written by the DecodeProgram and suspends it once the target is found.
+// Only the target node is stored, plus the elements of the arrays that contain it.
+class LazyMessageView::Recorder final : public MessageWriter {
+ public:
+  Recorder(LazyMessageView& view, const FieldLeaf& target) : _view(view), _target(target) {}
+
+  void writeValue(const FieldLeaf& leaf, const Variant& value) override {
+    if (CachedValue* cached = add(leaf)) {
+      cached->value = value;
+    }
+  }
+
+  void writeString(const FieldLeaf& leaf, const std::string& value) override {
+    writeString(leaf, std::string_view(value));
+  }
+
+  void writeString(const FieldLeaf& leaf, std::string_view value) override {
+    if (CachedValue* cached = add(leaf)) {
+      cached->string_index = storeString(value);
+    }
+  }
+
+  void writeEnum(const FieldLeaf& leaf, int32_t int_value, const std::string& enum_name) override {
+    if (CachedValue* cached = add(leaf)) {
+      cached->value = Variant(int_value);
+      cached->string_index = storeString(enum_name);
+    }
+  }
+
+  const CachedValue* found() const {
+    return _found;
+  }
+
+ private:
+  int32_t storeString(std::string_view value) {
+    auto& strings = _view._strings;
+    if (_view._strings_used == strings.size()) {
+      strings.emplace_back();
+    }
+    strings[_view._strings_used] = value;
+    return static_cast<int32_t>(_view._strings_used++);
+  }
+
+  // The entry of a value decoded for the first time, nullptr if it is already cached.
+  CachedValue* add(const FieldLeaf& leaf) {
+    auto [it, inserted] = _view._values.try_emplace(leaf);
+    if (!_found && FieldLeafEqual()(leaf, _target)) {
+      _found = &it->second;
+      _view._cursor.suspend = true;
+    }
+    if (!inserted) {
+      return nullptr;
+    }
+    _view._decoded_count++;
+    return &it->second;
+  }
+
+  LazyMessageView& _view;
+  const FieldLeaf& _target;
+  const CachedValue* _found = nullptr;
+};
+
+LazyMessageView::LazyMessageView(const Parser& parser, Deserializer* deserializer)
+    : _parser(&parser), _deserializer(deserializer) {
+  _options.max_array_size = static_cast<uint32_t>(parser.maxArraySize());
+  _options.max_byte_array_size = _options.max_array_size;
+  _options.discard_large_arrays = parser.maxArrayPolicy();
+  _field_flags.resize(countNodes(parser.getSchema()->field_tree.croot()), 0);
+  _options.field_flags = _field_flags.data();
+}
+
+LazyMessageView::LazyMessageView(const Parser& parser, Span<const uint8_t> buffer, Deserializer* deserializer)
+    : LazyMessageView(parser, deserializer) {
+  reset(buffer);
+}
+
+void LazyMessageView::reset(Span<const uint8_t> buffer) {
+  _buffer = buffer;
+  _cursor = details::DecodeCursor();
+  _offset = 0;
+  _values.clear();
+  _decoded_count = 0;
+  _strings_used = 0;
+}
+
+bool LazyMessageView::resolve(std::string_view path, FieldLeaf& leaf) const {
+  const FieldTreeNode* node = _parser->getSchema()->field_tree.croot();
+  // Content of the brackets, in order: array indices or @key values
+  SmallVector<std::string_view, 4> brackets;
+
+  auto parseBrackets = [&](std::string_view& text) -> bool {
+    while (!text.empty() && text.front() == '[') {
+      const size_t close = text.find(']');
+      if (close == std::string_view::npos) {
+        return false;
+      }
+      brackets.push_back(text.substr(1, close - 1));
+      text.remove_prefix(close + 1);
+    }
+    return true;
+  };
+
+  if (!path.empty() && path.front() == '/') {
+    path.remove_prefix(1);
+  }
+  // the root message can be a keyed struct
+  if (!parseBrackets(path)) {
+    return false;
+  }
+  while (!path.empty()) {
+    if (path.front() == '/') {
+      path.remove_prefix(1);
+    }
+    const size_t name_end = std::min(path.find('/'), path.find('['));
+    const std::string_view name = path.substr(0, name_end);
+    path.remove_prefix(name.size());
+
+    const FieldTreeNode* next = nullptr;
+    for (const auto& child : node->children()) {
+      if (child.value()->name() == name) {
+        next = &child;
+        break;
+      }
+    }
+    if (!next || !parseBrackets(path) || (!path.empty() && path.front() != '/')) {
+      return false;
+    }
+    node = next;
+  }
+
+  if (brackets.size() != node->bracketCount()) {
+    return false;
+  }
+  leaf = FieldLeaf();
+  leaf.node = node;
+  for (size_t i = 0; i < brackets.size(); i++) {
+    const std::string_view text = brackets[i];
+    if (node->bracketKeyMask() & (1u << i)) {
+      KeySuffix key;
+      key.assign(text.data(), text.size());
+      leaf.key_suffixes.push_back(key);
+    } else {
+      uint16_t index = 0;
+      auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), index);
+      if (ec != std::errc() || ptr != text.data() + text.size()) {
+        return false;
+      }
+      leaf.index_array.push_back(index);
+    }
+  }
+  return true;
+}
+
+const LazyMessageView::CachedValue* LazyMessageView::find(const FieldLeaf& leaf) {
+  if (!leaf.node) {
+    return nullptr;
+  }
+  auto it = _values.find(leaf);
+  if (it != _values.end()) {
+    return it->second.present ? &it->second : nullptr;
+  }
+  // The deserializers of the library are final: select the instance of the
+  // interpreter where their methods are called directly.
+  const CachedValue* found = nullptr;
+  if (auto* cdr_deserializer = dynamic_cast<NanoCDR_Deserializer*>(_deserializer)) {
+    found = search(cdr_deserializer, leaf);
+  } else if (auto* ros_deserializer = dynamic_cast<ROS_Deserializer*>(_deserializer)) {
+    found = search(ros_deserializer, leaf);
+  } else {
+    found = search(_deserializer, leaf);
+  }
+  if (!found) {
+    // the whole message was searched: remember that the field is absent
+    _values.try_emplace(leaf).first->second.present = false;
+  }
+  return found;
+}
+
+template <class DeserializerT>
+const LazyMessageView::CachedValue* LazyMessageView::search(DeserializerT* deserializer, const FieldLeaf& target) {
+  // Store the target and the structs and arrays that contain it; every other field is skipped.
+  std::fill(_field_flags.begin(), _field_flags.end(), 0);
+  _field_flags[target.node->nodeId()] = details::FIELD_STORED | details::FIELD_ENTIRE;
+  for (const FieldTreeNode* node = target.node->parent(); node; node = node->parent()) {
+    _field_flags[node->nodeId()] = details::FIELD_STORED;
+  }
+
+  // Resume from where the previous search stopped. If the field precedes it,
+  // search again from the beginning of the message.
+  const bool from_start = (_cursor.pc == DecodeOp::NO_TARGET);
+  const CachedValue* found = _cursor.finished ? nullptr : resume(deserializer, target);
+  if (!found && !from_start) {
+    _cursor = details::DecodeCursor();
+    found = resume(deserializer, target);
+  }
+  return found;
+}
+
+template <class DeserializerT>
+const LazyMessageView::CachedValue* LazyMessageView::resume(DeserializerT* deserializer, const FieldLeaf& target) {
+  details::InitDeserializer(*_parser->getDecodeProgram(), _buffer, deserializer);
+  if (_cursor.pc == DecodeOp::NO_TARGET) {
+    _leaf = FieldLeaf();
+    _leaf.node = _parser->getSchema()->field_tree.croot();
+  } else {
+    deserializer->jump(_offset - static_cast<size_t>(deserializer->getCurrentPtr() - _buffer.data()));
+  }
+
+  Recorder recorder(*this, target);
+  details::ResumeDecodeProgram(*_parser->getDecodeProgram(), _options, _cursor, _leaf, deserializer, &recorder);
+  _offset = static_cast<size_t>(deserializer->getCurrentPtr() - _buffer.data());
+  return recorder.found();
+}
+
+}  // namespace RosMsgParser
@@ -58,19 +58,87 @@ void MsgpackMessageWriter::writeValue(const FieldLeaf& leaf, const Variant& valu
   _count++;
 }
 
+void MsgpackMessageWriter::writeInteger(const FieldLeaf& leaf, int64_t value) {
+  writeKey(leaf);
+  ensureCapacity(9);
+  _offset += msgpack::pack_int(_output->data() + _offset, value);
+  _count++;
+}
+
+void MsgpackMessageWriter::writeBool(const FieldLeaf& leaf, bool value) {
+  writeKey(leaf);
+  ensureCapacity(1);
+  _offset += msgpack::pack_bool(_output->data() + _offset, value);
+  _count++;
+}
+
+void MsgpackMessageWriter::writeChar(const FieldLeaf& leaf, char value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeInt8(const FieldLeaf& leaf, int8_t value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeInt16(const FieldLeaf& leaf, int16_t value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeInt32(const FieldLeaf& leaf, int32_t value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeInt64(const FieldLeaf& leaf, int64_t value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeUInt8(const FieldLeaf& leaf, uint8_t value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeUInt16(const FieldLeaf& leaf, uint16_t value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeUInt32(const FieldLeaf& leaf, uint32_t value) {
+  writeInteger(leaf, value);
+}
+
+void MsgpackMessageWriter::writeUInt64(const FieldLeaf& leaf, uint64_t value) {
+  writeKey(leaf);
+  ensureCapacity(9);
+  _offset += msgpack::pack_uint(_output->data() + _offset, value);
+  _count++;
+}
+
+void MsgpackMessageWriter::writeFloat32(const FieldLeaf& leaf, float value) {
+  writeKey(leaf);
+  ensureCapacity(5);
+  _offset += msgpack::pack_float(_output->data() + _offset, value);
+  _count++;
+}
+
+void MsgpackMessageWriter::writeFloat64(const FieldLeaf& leaf, double value) {
+  writeKey(leaf);
+  ensureCapacity(9);
+  _offset += msgpack::pack_double(_output->data() + _offset, value);
+  _count++;
+}
+
 void MsgpackMessageWriter::writeString(const FieldLeaf& leaf, const std::string& value) {
+  writeString(leaf, std::string_view(value));
+}
+
+void MsgpackMessageWriter::writeString(const FieldLeaf& leaf, std::string_view value) {
   writeKey(leaf);
   ensureCapacity(5 + value.size());
-  _offset += msgpack::pack_string(_output->data() + _offset, value);
+  _offset += msgpack::pack_string(_output->data() + _offset, value.data(), value.size());
   _count++;
 }
 
 void MsgpackMessageWriter::writeEnum(const FieldLeaf& leaf, int32_t int_value,
                                     const std::string& /*enum_name*/) {
-  writeKey(leaf);
-  ensureCapacity(9);
-  _offset += msgpack::pack_int(_output->data() + _offset, int_value);
-  _count++;
+  writeInteger(leaf, int_value);
 }
 
 void MsgpackMessageWriter::finish() {
@@ -214,7 +214,8 @@ static int structKeyCount(const ROSField* field, const RosMessageLibrary& librar
 // that owns it; for a sequence of keyed structs the key replaces the array
 // index, so the numeric index is suppressed.
 static void cachePathsImpl(FieldTreeNode* node, const std::string& parent_path, uint8_t parent_mask,
-                           uint8_t parent_brackets, bool is_root, const RosMessageLibrary& library) {
+                           uint8_t parent_brackets, bool is_root, const RosMessageLibrary& library,
+                           uint32_t& next_id) {
   const ROSField* field = node->value();
   std::string path;
   uint8_t mask = parent_mask;
@@ -256,13 +257,15 @@ static void cachePathsImpl(FieldTreeNode* node, const std::string& parent_path,
   }
   node->setCachedPath(path);
   node->setBracketKeyMask(mask);
+  node->setNodeId(next_id++);
   for (auto& child : node->children()) {
-    cachePathsImpl(&child, path, mask, bracket_count, false, library);
+    cachePathsImpl(&child, path, mask, bracket_count, false, library, next_id);
   }
 }
 
 void CacheFieldTreePaths(FieldTree& tree, const RosMessageLibrary& library) {
-  cachePathsImpl(tree.root(), "", 0, 0, true, library);
+  uint32_t next_id = 0;
+  cachePathsImpl(tree.root(), "", 0, 0, true, library, next_id);
 }
 
 }  // namespace RosMsgParser
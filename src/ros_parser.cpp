@@ -23,66 +23,39 @@
 
 #include "rosx_introspection/ros_parser.hpp"
 
-#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
 #include <limits>
-#include <type_traits>
 
-#include "rosx_introspection/flat_message_writer.hpp"
-
-#ifdef ROSX_HAS_JSON
-#include "rapidjson/document.h"
-#include "rapidjson/prettywriter.h"
-#include "rapidjson/stringbuffer.h"
-#include "rapidjson/writer.h"
-#include "rosx_introspection/deserializer.hpp"
-#endif
+#include "rosx_introspection/json_message_writer.hpp"
 
 namespace RosMsgParser {
 inline bool operator==(const std::string& a, const std::string_view& b) {
   return (a.size() == b.size() && std::strncmp(a.data(), b.data(), a.size()) == 0);
 }
 
-// Resolve the name of an enum value from a wire (CDR) value, matching against
-// the DDS-compat (ordinal) value so that @value-annotated enums resolve
-// correctly. Returns nullptr if there is no matching enumerator.
-static const std::string* enumNameForDDSCompatValue(const EnumDefinition* enum_def,
-                                                    int32_t enum_int) {
-  if (!enum_def) {
-    return nullptr;
+// Opt D: Estimate field count for pre-reservation
+static size_t estimateFieldCount(const ROSMessage* msg, const RosMessageLibrary& lib, int depth = 0) {
+  if (depth > 10) {
+    return 0;  // prevent infinite recursion
   }
-  for (const auto& ev : enum_def->values) {
-    if (ev.ddsCompatValue() == enum_int) {
-      return &ev.name;
+  size_t count = 0;
+  for (const auto& field : msg->fields()) {
+    if (field.isConstant()) {
+      continue;
     }
-  }
-  return nullptr;
-}
-
-// Push a @key bracket value (content only; the renderer adds the surrounding
-// "[" "]"). A field can be reached through several @key levels (e.g. an outer
-// "ArmID:3" and an inner "J1"); the values accumulate in order and are rolled
-// back per scope by resizing key_suffixes.
-static void pushKeySuffix(FieldLeaf& leaf, const char* data, int len) {
-  KeySuffix ks;
-  ks.assign(data, static_cast<size_t>(len));
-  leaf.key_suffixes.push_back(ks);
-}
-
-// True if `field`'s type is a struct that declares at least one @key member.
-static bool structHasKey(const ROSField& field, const RosMessageLibrary& library) {
-  if (field.type().isBuiltin()) {
-    return false;
-  }
-  auto msg = field.getMessagePtr(library);
-  if (!msg) {
-    return false;
-  }
-  for (const auto& f : msg->fields()) {
-    if (!f.isConstant() && f.isKey()) {
-      return true;
+    if (field.type().isBuiltin() || field.getEnum() || field.getUnion()) {
+      count++;
+    } else {
+      auto it = lib.find(field.type());
+      if (it != lib.end()) {
+        count += estimateFieldCount(it->second.get(), lib, depth + 1);
+      }
     }
   }
-  return false;
+  return count;
 }
 
 Parser::Parser(const std::string& topic_name, const ROSType& msg_type, const std::string& definition,
@@ -92,6 +65,7 @@ Parser::Parser(const std::string& topic_name, const ROSType& msg_type, const std
       _discard_large_array(DISCARD_LARGE_ARRAYS),
       _max_array_size(100),
       _blob_policy(STORE_BLOB_AS_COPY),
+      _string_policy(STORE_STRING_AS_COPY),
       _dummy_root_field(new ROSField(msg_type, topic_name)) {
   if (format == DDS_IDL) {
     _schema = ParseIDL(topic_name, msg_type, definition);
@@ -99,6 +73,22 @@ Parser::Parser(const std::string& topic_name, const ROSType& msg_type, const std
     auto parsed_msgs = ParseMessageDefinitions(definition, msg_type);
     _schema = BuildMessageSchema(topic_name, parsed_msgs);
   }
+  _program = CompileDecodeProgram(*_schema);
+  _json_encoder = CompileJsonEncoder(*_schema);
+
+  // Resolve the lazy caches of the schema now: the const methods, that can be
+  // invoked by several threads at the same time, must not write them.
+  const auto& library = _schema->msg_library;
+  for (const auto& [type, msg] : library) {
+    for (const auto& field : msg->fields()) {
+      field.getMessagePtr(library);
+    }
+  }
+  // Opt D: pre-reserve the FlatMessage based on schema field count
+  auto root_msg = _schema->field_tree.croot()->value()->getMessagePtr(library);
+  if (root_msg) {
+    _estimated_field_count = estimateFieldCount(root_msg.get(), library);
+  }
 }
 
 const std::shared_ptr<MessageSchema>& Parser::getSchema() const {
@@ -115,753 +105,313 @@ ROSMessage::Ptr Parser::getMessageByType(const ROSType& type) const {
 }
 
 //=============================================================================
-// Unified schema walk: walkSchema()
+// Field filter
 //=============================================================================
 
-bool Parser::walkSchema(Span<const uint8_t> buffer, Deserializer* deserializer, MessageWriter* writer) const {
-  deserializer->init(buffer);
-
-  WalkState state;
-  state.deserializer = deserializer;
-  state.writer = writer;
-
-  FieldLeaf rootnode;
-  rootnode.node = _schema->field_tree.croot();
-  auto root_msg = _schema->field_tree.croot()->value()->getMessagePtr(_schema->msg_library);
-
-  walkImpl(root_msg.get(), rootnode, true, state);
-  writer->finish();
+namespace {
 
-  return state.entire_message_parsed;
+// Glob matching of a field name, where '*' matches any sequence of characters.
+bool matchName(std::string_view pattern, std::string_view name) {
+  size_t p = 0;
+  size_t n = 0;
+  size_t star = std::string_view::npos;
+  size_t star_n = 0;
+  while (n < name.size()) {
+    if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      star_n = n;
+    } else if (p < pattern.size() && pattern[p] == name[n]) {
+      p++;
+      n++;
+    } else if (star != std::string_view::npos) {
+      // let the last '*' consume one more character
+      p = star + 1;
+      n = ++star_n;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+  return p == pattern.size();
 }
 
-// Opt A: Direct method instead of std::function (eliminates type erasure + indirect call)
-// Opt B: FieldLeaf by reference with save/restore (eliminates SmallVector + string copy per field)
-// Opt C: snprintf for key suffixes (eliminates std::to_string temporaries)
-void Parser::walkImpl(const ROSMessage* msg, FieldLeaf& leaf, bool store, WalkState& state) const {
-  auto* deserializer = state.deserializer;
-  auto* writer = state.writer;
-  size_t index_s = 0;
-
-  // --- @key fields: process first, add path suffixes ---
-  for (size_t fi = 0; fi < msg->fields().size(); fi++) {
-    const ROSField& field = msg->field(fi);
-    if (field.isConstant() || !field.isKey()) {
-      continue;
-    }
+using PathNames = std::vector<std::string_view>;
 
-    char buf[96];
-    if (field.type().typeID() == STRING) {
-      std::string str;
-      deserializer->deserializeString(str);
-      pushKeySuffix(leaf, str.data(), static_cast<int>(str.size()));
-    } else if (field.getEnum() != nullptr) {
-      Variant var = deserializer->deserialize(INT32);
-      int32_t enum_int = var.convert<int32_t>();
-      const std::string* enum_name = enumNameForDDSCompatValue(field.getEnum(), enum_int);
-      if (enum_name) {
-        pushKeySuffix(leaf, enum_name->data(), static_cast<int>(enum_name->size()));
-      } else {
-        int len = snprintf(buf, sizeof(buf), "%d", enum_int);
-        pushKeySuffix(leaf, buf, len);
+// True if the names of [path], from index n, match the pattern from index p.
+// "**" matches any number of names.
+bool matchPath(const PathNames& pattern, size_t p, const PathNames& path, size_t n) {
+  if (p == pattern.size()) {
+    return n == path.size();
+  }
+  if (pattern[p] == "**") {
+    for (size_t k = n; k <= path.size(); k++) {
+      if (matchPath(pattern, p + 1, path, k)) {
+        return true;
       }
-    } else if (field.type().isBuiltin()) {
-      Variant var = deserializer->deserialize(field.type().typeID());
-      int len = snprintf(buf, sizeof(buf), "%s:%ld", field.name().c_str(), (long)var.convert<int64_t>());
-      pushKeySuffix(leaf, buf, len);
     }
+    return false;
   }
+  return n < path.size() && matchName(pattern[p], path[n]) && matchPath(pattern, p + 1, path, n + 1);
+}
 
-  // Save leaf state for restore after each field (Opt B)
-  const auto* saved_node = leaf.node;
-  const auto saved_idx_size = leaf.index_array.size();
-  const auto saved_key_suffix_size = leaf.key_suffixes.size();
-
-  // --- Process non-key fields ---
-  for (const ROSField& field : msg->fields()) {
-    bool DO_STORE = store;
-    if (field.isConstant()) {
-      continue;
-    }
-    if (field.isKey()) {
-      index_s++;
-      continue;
+// Split a path into the names of its fields, ignoring empty ones (leading or trailing '/').
+PathNames splitPath(std::string_view text) {
+  PathNames names;
+  while (!text.empty()) {
+    const size_t sep = text.find('/');
+    const auto name = text.substr(0, sep);
+    if (!name.empty()) {
+      names.push_back(name);
     }
+    text.remove_prefix(sep == std::string_view::npos ? text.size() : sep + 1);
+  }
+  return names;
+}
 
-    const ROSType& field_type = field.type();
+std::string_view trim(std::string_view text) {
+  while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
 
-    if (field.isOptional()) {
-      if (!deserializer->hasOptionalMember()) {
-        index_s++;
-        continue;
+struct FieldFlagsBuilder {
+  std::vector<PathNames> patterns;
+  std::vector<bool> used;
+  const std::vector<details::FieldPredicate>* predicates = nullptr;
+  std::vector<uint8_t> flags;
+  PathNames path;
+
+  uint8_t select(const FieldTreeNode* node, bool emit) {
+    for (size_t i = 0; i < patterns.size(); i++) {
+      if (matchPath(patterns[i], 0, path, 0)) {
+        used[i] = true;
+        emit = true;
       }
     }
-
-    // Mutate leaf in-place instead of copying (Opt B).
-    //
-    // The field tree intentionally models a DDS union as a single leaf node: it
-    // does NOT contain child nodes for the members of the union's active-case
-    // struct (see recursiveTreeCreator in idl_parser.cpp / ros_message.cpp,
-    // which does not recurse into union cases). When deserialization resolves a
-    // union case to a struct and walks it, saved_node therefore has no child for
-    // index_s. We must still walk the case struct so its bytes are consumed and
-    // the CDR cursor stays aligned, but there is no cached path to emit values
-    // against, so descend in non-storing mode and keep leaf.node valid.
-    if (index_s < saved_node->children().size()) {
-      leaf.node = saved_node->child(index_s);
-    } else {
-      leaf.node = saved_node;
-      DO_STORE = false;
+    uint8_t children = 0;
+    for (const auto& child : node->children()) {
+      path.push_back(child.value()->name());
+      children |= select(&child, emit);
+      path.pop_back();
     }
 
-    int32_t array_size = field.arraySize();
-    if (array_size == -1) {
-      array_size = deserializer->deserializeUInt32();
+    uint8_t result = 0;
+    if (emit || (children & details::FIELD_STORED)) {
+      result |= details::FIELD_STORED;
     }
-
-    const bool is_array = field.isArray();
-    const auto& dims = field.arrayDimensions();
-    const bool is_multidim = dims.size() > 1;
-
-    // A sequence/array of keyed structs identifies its elements by @key value
-    // rather than by position, so the numeric index is suppressed: the
-    // element's @key fills the bracket instead (see cachePathsImpl).
-    const bool elem_keyed = is_array && structHasKey(field, _schema->msg_library);
-    const bool push_index = is_array && !elem_keyed;
-
-    if (push_index) {
-      if (is_multidim) {
-        // Push one index entry per dimension
-        for (size_t d = 0; d < dims.size(); d++) {
-          leaf.index_array.push_back(0);
-        }
-      } else {
-        leaf.index_array.push_back(0);
-      }
+    if (children & (details::FIELD_PREDICATE | details::FIELD_HAS_PREDICATE)) {
+      result |= details::FIELD_HAS_PREDICATE;
+    } else if (emit) {
+      result |= details::FIELD_ENTIRE;
     }
-
-    bool IS_BLOB = false;
-
-    if (array_size > static_cast<int32_t>(_max_array_size)) {
-      if (builtinSize(field_type.typeID()) == 1) {
-        IS_BLOB = true;
-      } else {
-        if (_discard_large_array) {
-          DO_STORE = false;
-        }
-        state.entire_message_parsed = false;
+    for (const auto& predicate : *predicates) {
+      if (predicate.node == node) {
+        result |= details::FIELD_PREDICATE;
       }
     }
-
-    if (IS_BLOB) {
-      if (array_size > static_cast<int32_t>(deserializer->bytesLeft())) {
-        throw std::runtime_error("Buffer overrun in walkSchema (blob)");
-      }
-      if (DO_STORE) {
-        writer->writeBlob(leaf, Span<const uint8_t>(deserializer->getCurrentPtr(), array_size));
-      }
-      deserializer->jump(array_size);
-    } else {
-      bool DO_STORE_ARRAY = DO_STORE;
-      for (int i = 0; i < array_size; i++) {
-        // Roll back @key brackets pushed by the previous keyed element so they
-        // do not accumulate across iterations of the sequence.
-        if (elem_keyed) {
-          leaf.key_suffixes.resize(saved_key_suffix_size);
-        }
-        if (DO_STORE_ARRAY && i >= static_cast<int32_t>(_max_array_size)) {
-          DO_STORE_ARRAY = false;
-        }
-        if (push_index && DO_STORE_ARRAY) {
-          if (is_multidim) {
-            // Compute multi-dimensional indices from flat index
-            int flat = i;
-            for (int d = static_cast<int>(dims.size()) - 1; d >= 0; d--) {
-              leaf.index_array[saved_idx_size + d] = flat % dims[d];
-              flat /= dims[d];
-            }
-          } else {
-            leaf.index_array.back() = i;
-          }
-        }
-
-        if (field.getEnum() != nullptr) {
-          Variant var = deserializer->deserialize(INT32);
-          if (DO_STORE_ARRAY) {
-            int32_t enum_int = var.convert<int32_t>();
-            const std::string* enum_name = enumNameForDDSCompatValue(field.getEnum(), enum_int);
-            static const std::string empty_str;
-            writer->writeEnum(leaf, enum_int, enum_name ? *enum_name : empty_str);
-          }
-        } else if (field.getUnion() != nullptr) {
-          const auto* union_def = field.getUnion();
-          auto disc_type = toBuiltinType(union_def->discriminant_type);
-          std::string disc_value_str;
-
-          if (disc_type == OTHER) {
-            Variant disc_var = deserializer->deserialize(INT32);
-            int32_t disc_int = disc_var.convert<int32_t>();
-            auto enum_it = _schema->enum_library.find(ROSType(union_def->discriminant_type));
-            if (enum_it != _schema->enum_library.end()) {
-              for (const auto& ev : enum_it->second.values) {
-                if (ev.value == disc_int) {
-                  disc_value_str = ev.name;
-                  break;
-                }
-              }
-            }
-            if (disc_value_str.empty()) {
-              char buf[32];
-              snprintf(buf, sizeof(buf), "%d", disc_int);
-              disc_value_str = buf;
-            }
-          } else {
-            Variant disc_var = deserializer->deserialize(disc_type);
-            char buf[32];
-            snprintf(buf, sizeof(buf), "%ld", (long)disc_var.convert<int64_t>());
-            disc_value_str = buf;
-          }
-
-          auto case_it = union_def->cases.find(disc_value_str);
-          const UnionCaseField* active_case = nullptr;
-          if (case_it != union_def->cases.end()) {
-            active_case = &case_it->second;
-          } else if (union_def->default_case) {
-            active_case = &union_def->default_case.value();
-          }
-
-          if (active_case) {
-            if (active_case->type.typeID() == STRING) {
-              std::string str;
-              deserializer->deserializeString(str);
-              if (DO_STORE_ARRAY) {
-                writer->writeString(leaf, str);
-              }
-            } else if (active_case->type.isBuiltin()) {
-              Variant var = deserializer->deserialize(active_case->type.typeID());
-              if (DO_STORE_ARRAY) {
-                writer->writeValue(leaf, var);
-              }
-            } else {
-              auto case_msg_it = _schema->msg_library.find(active_case->type);
-              if (case_msg_it != _schema->msg_library.end()) {
-                writer->beginStruct(field);
-                walkImpl(case_msg_it->second.get(), leaf, DO_STORE_ARRAY, state);
-                writer->endStruct();
-              }
-            }
-          }
-        } else if (field_type.typeID() == STRING) {
-          std::string str;
-          deserializer->deserializeString(str);
-          if (DO_STORE_ARRAY) {
-            writer->writeString(leaf, str);
-          }
-        } else if (field_type.isBuiltin()) {
-          Variant var = deserializer->deserialize(field_type.typeID());
-          if (DO_STORE_ARRAY) {
-            writer->writeValue(leaf, var);
-          }
-        } else {
-          auto msg_node = field.getMessagePtr(_schema->msg_library);
-          writer->beginStruct(field);
-          walkImpl(msg_node.get(), leaf, DO_STORE_ARRAY, state);
-          writer->endStruct();
-        }
-      }
+    if (flags.size() <= node->nodeId()) {
+      flags.resize(node->nodeId() + 1, 0);
     }
-
-    // Restore leaf state (Opt B)
-    leaf.index_array.resize(saved_idx_size);
-    leaf.key_suffixes.resize(saved_key_suffix_size);
-    index_s++;
+    flags[node->nodeId()] = result;
+    return result;
   }
+};
 
-  // Restore node pointer
-  leaf.node = saved_node;
-}
+}  // namespace
 
-// Opt D: Estimate field count for pre-reservation
-static size_t estimateFieldCount(const ROSMessage* msg, const RosMessageLibrary& lib, int depth = 0) {
-  if (depth > 10) {
-    return 0;  // prevent infinite recursion
+std::vector<bool> Parser::updateFieldFlags() {
+  _field_flags.clear();
+  _shape_cache.clear();
+  if (_field_filter.empty() && _predicates.empty()) {
+    return {};
   }
-  size_t count = 0;
-  for (const auto& field : msg->fields()) {
-    if (field.isConstant()) {
-      continue;
-    }
-    if (field.type().isBuiltin() || field.getEnum() || field.getUnion()) {
-      count++;
-    } else {
-      auto it = lib.find(field.type());
-      if (it != lib.end()) {
-        count += estimateFieldCount(it->second.get(), lib, depth + 1);
-      }
-    }
+  FieldFlagsBuilder builder;
+  for (const auto& pattern : _field_filter) {
+    builder.patterns.push_back(splitPath(pattern));
   }
-  return count;
+  builder.used.resize(_field_filter.size(), false);
+  builder.predicates = &_predicates;
+  // without a filter, every field is stored
+  builder.select(_schema->field_tree.croot(), _field_filter.empty());
+  _field_flags = std::move(builder.flags);
+  return builder.used;
 }
 
-bool Parser::deserialize(Span<const uint8_t> buffer, FlatMessage* flat_container, Deserializer* deserializer) const {
-  flat_container->schema = _schema;
-
-  // Opt D: pre-reserve based on schema field count (cached after first call)
-  if (_estimated_field_count == 0) {
-    auto root_msg = _schema->field_tree.croot()->value()->getMessagePtr(_schema->msg_library);
-    if (root_msg) {
-      _estimated_field_count = estimateFieldCount(root_msg.get(), _schema->msg_library);
+void Parser::setFieldFilter(const std::vector<std::string>& patterns) {
+  for (const auto& pattern : patterns) {
+    if (pattern.find('[') != std::string::npos) {
+      throw std::runtime_error("setFieldFilter: array indices are not supported in [" + pattern + "]");
     }
   }
-  if (flat_container->value.capacity() < _estimated_field_count) {
-    flat_container->value.reserve(_estimated_field_count);
-  }
-
-  FlatMessageWriter writer(flat_container, _blob_policy);
-  return walkSchema(buffer, deserializer, &writer);
-}
-
-//=============================================================================
-// JSON support
-//=============================================================================
+  _field_filter = patterns;
+  const auto used = updateFieldFlags();
 
-#ifndef ROSX_HAS_JSON
-bool Parser::deserializeIntoJson(
-    Span<const uint8_t> buffer, std::string* json_txt, Deserializer* deserializer, int indent,
-    bool ignore_constants) const {
-  throw std::runtime_error("This version of rosx_introspection was built without JSON support");
-  return false;
-}
-bool Parser::serializeFromJson(const std::string_view json_string, Serializer* serializer) const {
-  throw std::runtime_error("This version of rosx_introspection was built without JSON support");
-  return false;
+  for (size_t i = 0; i < patterns.size(); i++) {
+    if (!used[i] && _global_warnings) {
+      (*_global_warnings) << "setFieldFilter: no field of " << _topic_name << " matches [" << patterns[i] << "]"
+                          << std::endl;
+    }
+  }
 }
 
-#else
-
-// For now, deserializeIntoJson uses the legacy implementation with IDL support added.
-// A full JsonMessageWriter that builds hierarchical JSON from the walkSchema events
-// is planned as a follow-up.
-bool Parser::deserializeIntoJson(
-    Span<const uint8_t> buffer, std::string* json_txt, Deserializer* deserializer, int indent,
-    bool ignore_constants) const {
-  deserializer->init(buffer);
-
-  rapidjson::Document json_document;
-  rapidjson::Document::AllocatorType& alloc = json_document.GetAllocator();
-
-  std::function<void(const ROSMessage*, rapidjson::Value&)> deserializeImpl;
-
-  deserializeImpl = [&](const ROSMessage* msg_node, rapidjson::Value& json_value) {
-    for (const ROSField& field : msg_node->fields()) {
-      if (field.isConstant() && ignore_constants) {
-        continue;
+void Parser::setFieldPredicates(const std::vector<std::string>& conditions) {
+  using details::FieldPredicate;
+  static const std::pair<const char*, FieldPredicate::Compare> operators[] = {
+      {"==", FieldPredicate::EQUAL},      {"!=", FieldPredicate::NOT_EQUAL}, {"<=", FieldPredicate::LESS_EQUAL},
+      {">=", FieldPredicate::GREATER_EQUAL}, {"<", FieldPredicate::LESS},    {">", FieldPredicate::GREATER}};
+
+  std::vector<FieldPredicate> predicates;
+  for (const auto& condition : conditions) {
+    auto fail = [&](const char* reason) {
+      return std::runtime_error(std::string("setFieldPredicates: ") + reason + " in [" + condition + "]");
+    };
+
+    const size_t op_pos = condition.find_first_of("=!<>");
+    if (op_pos == std::string::npos) {
+      throw fail("missing comparison operator");
+    }
+    FieldPredicate predicate;
+    std::string_view literal;
+    bool found_operator = false;
+    for (const auto& [symbol, compare] : operators) {
+      if (condition.compare(op_pos, strlen(symbol), symbol) == 0) {
+        predicate.compare = compare;
+        literal = trim(std::string_view(condition).substr(op_pos + strlen(symbol)));
+        found_operator = true;
+        break;
       }
-      // Note: @key fields are included in JSON output as regular fields.
-      // In FlatMessage they become path suffixes, but JSON has no path concept.
-
-      const ROSType& field_type = field.type();
-      auto field_name = rapidjson::StringRef(field.name().data(), field.name().size());
+    }
+    if (!found_operator || literal.empty()) {
+      throw fail("invalid comparison");
+    }
 
-      // Handle @optional fields
-      if (field.isOptional()) {
-        bool is_present = deserializer->hasOptionalMember();
-        if (!is_present) {
-          continue;
+    // the field
+    const std::string_view path = trim(std::string_view(condition).substr(0, op_pos));
+    if (path.find('[') != std::string_view::npos) {
+      throw fail("array indices are not supported");
+    }
+    const FieldTreeNode* node = _schema->field_tree.croot();
+    for (const auto& name : splitPath(path)) {
+      const FieldTreeNode* next = nullptr;
+      for (const auto& child : node->children()) {
+        if (child.value()->name() == name) {
+          next = &child;
+          break;
         }
       }
-
-      int32_t array_size = field.arraySize();
-      if (array_size == -1) {
-        array_size = deserializer->deserializeUInt32();
+      if (!next) {
+        throw fail("unknown field");
       }
-
-      const bool skip_large_byte_array =
-          field.isArray() && array_size > static_cast<int32_t>(_max_array_size) && field_type.isBuiltin() &&
-          builtinSize(field_type.typeID()) == 1;
-
-      if (skip_large_byte_array) {
-        if (array_size > static_cast<int32_t>(deserializer->bytesLeft())) {
-          throw std::runtime_error("Buffer overrun in blob");
-        }
-        deserializer->jump(array_size);
-      } else {
-        rapidjson::Value array_value(rapidjson::kArrayType);
-
-        for (int i = 0; i < array_size; i++) {
-          rapidjson::Value new_value;
-          new_value.SetObject();
-
-          // Handle enum fields
-          if (field.getEnum() != nullptr) {
-            new_value.SetInt(deserializer->deserialize(INT32).convert<int32_t>());
-          }
-          // Handle union fields
-          else if (field.getUnion() != nullptr) {
-            const auto* union_def = field.getUnion();
-            auto disc_type = toBuiltinType(union_def->discriminant_type);
-            std::string disc_value_str;
-
-            if (disc_type == OTHER) {
-              Variant disc_var = deserializer->deserialize(INT32);
-              int32_t disc_int = disc_var.convert<int32_t>();
-              auto enum_it = _schema->enum_library.find(ROSType(union_def->discriminant_type));
-              if (enum_it != _schema->enum_library.end()) {
-                for (const auto& ev : enum_it->second.values) {
-                  if (ev.value == disc_int) {
-                    disc_value_str = ev.name;
-                    break;
-                  }
-                }
-              }
-              if (disc_value_str.empty()) {
-                disc_value_str = std::to_string(disc_int);
-              }
-            } else {
-              Variant disc_var = deserializer->deserialize(disc_type);
-              disc_value_str = std::to_string(disc_var.convert<int64_t>());
-            }
-
-            auto case_it = union_def->cases.find(disc_value_str);
-            const UnionCaseField* active_case = nullptr;
-            if (case_it != union_def->cases.end()) {
-              active_case = &case_it->second;
-            } else if (union_def->default_case) {
-              active_case = &union_def->default_case.value();
-            }
-
-            if (active_case) {
-              if (active_case->type.typeID() == STRING) {
-                std::string s;
-                deserializer->deserializeString(s);
-                new_value.SetString(s.c_str(), s.length(), alloc);
-              } else if (active_case->type.isBuiltin()) {
-                auto v = deserializer->deserialize(active_case->type.typeID());
-                switch (active_case->type.typeID()) {
-                  case FLOAT32:
-                    new_value.SetFloat(v.convert<float>());
-                    break;
-                  case FLOAT64:
-                    new_value.SetDouble(v.convert<double>());
-                    break;
-                  case UINT64:
-                    new_value.SetUint64(v.convert<uint64_t>());
-                    break;
-                  case INT64:
-                    new_value.SetInt64(v.convert<int64_t>());
-                    break;
-                  default:
-                    new_value.SetInt(v.convert<int32_t>());
-                    break;
-                }
-              } else {
-                auto case_msg_it = _schema->msg_library.find(active_case->type);
-                if (case_msg_it != _schema->msg_library.end()) {
-                  deserializeImpl(case_msg_it->second.get(), new_value);
-                }
-              }
-            }
-          } else {
-            // Standard field handling
-            switch (field_type.typeID()) {
-              case BOOL:
-                new_value.SetBool(deserializer->deserialize(field_type.typeID()).convert<uint8_t>());
-                break;
-              case CHAR: {
-                char c = deserializer->deserialize(field_type.typeID()).convert<int8_t>();
-                new_value.SetString(&c, 1, alloc);
-              } break;
-              case BYTE:
-              case UINT8:
-              case UINT16:
-              case UINT32:
-                new_value.SetUint(deserializer->deserialize(field_type.typeID()).convert<uint32_t>());
-                break;
-              case UINT64:
-                new_value.SetUint64(deserializer->deserialize(field_type.typeID()).convert<uint64_t>());
-                break;
-              case INT8:
-              case INT16:
-              case INT32:
-                new_value.SetInt(deserializer->deserialize(field_type.typeID()).convert<int32_t>());
-                break;
-              case INT64:
-                new_value.SetInt64(deserializer->deserialize(field_type.typeID()).convert<int64_t>());
-                break;
-              case FLOAT32:
-                new_value.SetFloat(deserializer->deserialize(field_type.typeID()).convert<float>());
-                break;
-              case FLOAT64:
-                new_value.SetDouble(deserializer->deserialize(field_type.typeID()).convert<double>());
-                break;
-              case TIME:
-              case DURATION: {
-                int sec = deserializer->deserialize(INT32).convert<int32_t>();
-                int nsec = deserializer->deserialize(INT32).convert<int32_t>();
-                rapidjson::Value sec_val;
-                sec_val.SetInt(sec);
-                new_value.AddMember("secs", sec_val, alloc);
-                rapidjson::Value nsec_val;
-                nsec_val.SetInt(nsec);
-                new_value.AddMember("nsecs", nsec_val, alloc);
-              } break;
-              case STRING: {
-                std::string s;
-                deserializer->deserializeString(s);
-                new_value.SetString(s.c_str(), s.length(), alloc);
-              } break;
-              case OTHER: {
-                auto msg_node_child = field.getMessagePtr(_schema->msg_library);
-                deserializeImpl(msg_node_child.get(), new_value);
-              } break;
-            }
-          }
-
-          if (field.isArray()) {
-            array_value.PushBack(new_value, alloc);
-          } else {
-            json_value.AddMember(field_name, new_value, alloc);
-          }
-        }
-
-        if (field.isArray()) {
-          json_value.AddMember(field_name, array_value, alloc);
-        }
-      }
-    }
-  };
-
-  rapidjson::Value& json_node = json_document.SetObject();
-  auto root_msg = _schema->field_tree.croot()->value()->getMessagePtr(_schema->msg_library);
-  deserializeImpl(root_msg.get(), json_node);
-
-  thread_local rapidjson::StringBuffer json_buffer;
-  json_buffer.Reserve(65536);
-  json_buffer.Clear();
-
-  if (indent == 0) {
-    rapidjson::Writer<
-        rapidjson::StringBuffer, rapidjson::UTF8<>, rapidjson::UTF8<>, rapidjson::CrtAllocator,
-        rapidjson::kWriteDefaultFlags | rapidjson::kWriteNanAndInfFlag>
-        json_writer(json_buffer);
-    json_document.Accept(json_writer);
-    *json_txt = json_buffer.GetString();
-  } else {
-    rapidjson::PrettyWriter<rapidjson::StringBuffer> json_writer(json_buffer);
-    json_writer.SetIndent(' ', indent);
-    json_document.Accept(json_writer);
-    *json_txt = json_buffer.GetString();
-  }
-
-  return true;
-}
-
-//-----------------------------------------------------------------------------
-// serializeFromJson
-//-----------------------------------------------------------------------------
-
-namespace {
-template <typename T>
-T readJsonValue(rapidjson::Value* value_field, std::string_view field_name) {
-  if (!value_field) {
-    return T{};
-  }
-  if constexpr (std::is_unsigned_v<T> && std::is_integral_v<T>) {
-    if (!value_field->IsUint64()) {
-      throw std::runtime_error("Expected unsigned integer in field: " + std::string(field_name));
+      node = next;
     }
-    auto v = value_field->GetUint64();
-    if (v > std::numeric_limits<T>::max()) {
-      throw std::runtime_error("Value out of range in field: " + std::string(field_name));
+    const ROSField* field = node->value();
+    if (node == _schema->field_tree.croot() || !node->isLeaf() || field->getUnion() || field->isKey()) {
+      throw fail("the field must be a number, a string or an enum");
     }
-    return static_cast<T>(v);
-  } else if constexpr (std::is_signed_v<T> && std::is_integral_v<T>) {
-    if (!value_field->IsInt64()) {
-      throw std::runtime_error("Expected integer in field: " + std::string(field_name));
+    for (const FieldTreeNode* n = node; n != _schema->field_tree.croot(); n = n->parent()) {
+      if (n->value()->isArray()) {
+        throw fail("fields in arrays are not supported");
+      }
     }
-    auto v = value_field->GetInt64();
-    if (v < std::numeric_limits<T>::min() || v > std::numeric_limits<T>::max()) {
-      throw std::runtime_error("Value out of range in field: " + std::string(field_name));
+    predicate.node = node;
+
+    // the value
+    const bool quoted = literal.size() >= 2 && (literal.front() == '"' || literal.front() == '\'');
+    if (quoted && literal.back() == literal.front()) {
+      predicate.is_text = true;
+      predicate.text = std::string(literal.substr(1, literal.size() - 2));
+    } else if (literal == "true" || literal == "false") {
+      predicate.number = (literal == "true") ? 1 : 0;
+    } else {
+      auto [ptr, ec] = std::from_chars(literal.data(), literal.data() + literal.size(), predicate.number);
+      if (ec != std::errc() || ptr != literal.data() + literal.size()) {
+        predicate.is_text = true;
+        predicate.text = std::string(literal);
+      }
     }
-    return static_cast<T>(v);
-  } else {
-    static_assert(std::is_floating_point_v<T>);
-    if (!value_field->IsNumber()) {
-      throw std::runtime_error("Expected number in field: " + std::string(field_name));
+    const bool is_string = field->type().typeID() == STRING;
+    const bool is_enum = field->getEnum() != nullptr;
+    if (!is_enum && predicate.is_text != is_string) {
+      throw fail(is_string ? "a string must be compared with a quoted string"
+                           : "a number must be compared with a number");
     }
-    return static_cast<T>(value_field->GetDouble());
+    predicates.push_back(std::move(predicate));
   }
+  _predicates = std::move(predicates);
+  updateFieldFlags();
 }
-}  // namespace
-
-bool Parser::serializeFromJson(const std::string_view json_string, Serializer* serializer) const {
-  rapidjson::Document json_document;
-  json_document.Parse(json_string.data(), json_string.size());
-  if (json_document.HasParseError()) {
-    throw std::runtime_error("Failed to parse JSON input");
-  }
-  if (!json_document.IsObject()) {
-    throw std::runtime_error("JSON root must be an object");
-  }
-  serializer->reset();
-
-  std::function<void(const ROSMessage*, rapidjson::Value*)> serializeImpl;
-
-  serializeImpl = [&](const ROSMessage* msg_node, rapidjson::Value* json_value) {
-    if (json_value && !json_value->IsObject()) {
-      throw std::runtime_error("Expected JSON object while serializing nested message");
-    }
 
-    for (const ROSField& field : msg_node->fields()) {
-      if (field.isConstant()) {
-        continue;
-      }
-      const ROSType& field_type = field.type();
-      const auto field_name = rapidjson::StringRef(field.name().data(), field.name().size());
-
-      // Handle enum fields: serialize as INT32
-      if (field.getEnum() != nullptr) {
-        rapidjson::Value* field_json_value = nullptr;
-        if (json_value && json_value->HasMember(field_name.s)) {
-          field_json_value = &((*json_value)[field_name.s]);
-        }
-        int32_t val = field_json_value ? readJsonValue<int32_t>(field_json_value, field.name()) : 0;
-        serializer->serialize(INT32, Variant(val));
-        continue;
-      }
-
-      // Handle union fields: not supported in JSON serialization
-      if (field.getUnion() != nullptr) {
-        throw std::runtime_error("serializeFromJson not supported for union fields: " + field.name());
-      }
-
-      rapidjson::Value* field_json_value = nullptr;
-      if (json_value && json_value->HasMember(field_name.s)) {
-        field_json_value = &((*json_value)[field_name.s]);
-      }
+void Parser::setShapeMemoization(size_t max_shapes) {
+  // Keys, union discriminants and presence flags also decide what is decoded.
+  _shape_memoizable = std::none_of(_program->ops.begin(), _program->ops.end(), [](const DecodeOp& op) {
+    return op.code == DecodeOp::KEY_STRING || op.code == DecodeOp::KEY_ENUM || op.code == DecodeOp::KEY_BUILTIN ||
+           op.code == DecodeOp::UNION || op.hasFlag(DecodeOp::OPTIONAL);
+  });
+  _shape_cache.setCapacity(max_shapes);
+}
 
-      const bool has_json_value = (field_json_value != nullptr);
-      const bool is_array = field.isArray();
-      const bool is_dynamic_array = is_array && field.arraySize() == -1;
-      const bool is_fixed_array = is_array && field.arraySize() != -1;
+//=============================================================================
+// Unified schema walk: walkSchema()
+//=============================================================================
 
-      if (has_json_value && (is_array != field_json_value->IsArray())) {
-        throw std::runtime_error(std::string("IsArray() mismatch in field: ") + field.name());
-      }
+template bool Parser::walkSchema<Deserializer, MessageWriter>(Span<const uint8_t>, Deserializer*, MessageWriter*,
+                                                               bool*) const;
 
-      uint32_t array_size = field.arraySize();
-      if (is_dynamic_array) {
-        array_size = has_json_value ? static_cast<uint32_t>(field_json_value->GetArray().Size()) : 0;
-        serializer->serializeUInt32(array_size);
-      }
-      if (has_json_value && is_fixed_array) {
-        auto actual_size = static_cast<uint32_t>(field_json_value->GetArray().Size());
-        if (array_size != actual_size) {
-          throw std::runtime_error(std::string("Fixed array size mismatch in field: ") + field.name());
-        }
-      }
-
-      const auto type_id = field_type.typeID();
-      const auto fname = field.name();
+bool Parser::walkSchema(Span<const uint8_t> buffer, Deserializer* deserializer, MessageWriter* writer,
+                        bool* filtered_out) const {
+  return walkSchema<Deserializer, MessageWriter>(buffer, deserializer, writer, filtered_out);
+}
 
-      for (uint32_t i = 0; i < array_size; i++) {
-        rapidjson::Value* value_field = nullptr;
-        if (has_json_value) {
-          value_field = is_array ? &(field_json_value->GetArray()[i]) : field_json_value;
-        }
+bool Parser::deserialize(Span<const uint8_t> buffer, FlatMessage* flat_container, Deserializer* deserializer) const {
+  // The deserializers of the library are final: select the instance of the
+  // walker where their methods are called directly.
+  if (auto* cdr_deserializer = dynamic_cast<NanoCDR_Deserializer*>(deserializer)) {
+    return deserializeWith(buffer, flat_container, cdr_deserializer, _shape_cache);
+  }
+  if (auto* ros_deserializer = dynamic_cast<ROS_Deserializer*>(deserializer)) {
+    return deserializeWith(buffer, flat_container, ros_deserializer, _shape_cache);
+  }
+  return deserializeWith(buffer, flat_container, deserializer, _shape_cache);
+}
 
-        switch (type_id) {
-          case BOOL: {
-            bool value = value_field ? value_field->GetBool() : false;
-            serializer->serialize(type_id, value);
-          } break;
-          case CHAR: {
-            char c = '\0';
-            if (value_field && value_field->IsString() && value_field->GetStringLength() > 0) {
-              c = value_field->GetString()[0];
-            }
-            serializer->serialize(type_id, c);
-          } break;
-          case BYTE:
-          case UINT8:
-            serializer->serialize(type_id, readJsonValue<uint8_t>(value_field, fname));
-            break;
-          case UINT16:
-            serializer->serialize(type_id, readJsonValue<uint16_t>(value_field, fname));
-            break;
-          case UINT32:
-            serializer->serialize(type_id, readJsonValue<uint32_t>(value_field, fname));
-            break;
-          case UINT64:
-            serializer->serialize(type_id, readJsonValue<uint64_t>(value_field, fname));
-            break;
-          case INT8:
-            serializer->serialize(type_id, readJsonValue<int8_t>(value_field, fname));
-            break;
-          case INT16:
-            serializer->serialize(type_id, readJsonValue<int16_t>(value_field, fname));
-            break;
-          case INT32:
-            serializer->serialize(type_id, readJsonValue<int32_t>(value_field, fname));
-            break;
-          case INT64:
-            serializer->serialize(type_id, readJsonValue<int64_t>(value_field, fname));
-            break;
-          case FLOAT32:
-            serializer->serialize(type_id, readJsonValue<float>(value_field, fname));
-            break;
-          case FLOAT64:
-            serializer->serialize(type_id, readJsonValue<double>(value_field, fname));
-            break;
-          case DURATION:
-          case TIME: {
-            int32_t secs = 0;
-            int32_t nsecs = 0;
-            if (value_field) {
-              if (!value_field->IsObject()) {
-                throw std::runtime_error(std::string("Expected time/duration object in field: ") + fname);
-              }
-              auto sec_it = value_field->FindMember("secs");
-              auto nsec_it = value_field->FindMember("nsecs");
-              if (sec_it == value_field->MemberEnd() || nsec_it == value_field->MemberEnd()) {
-                throw std::runtime_error(std::string("Missing secs/nsecs in field: ") + fname);
-              }
-              secs = readJsonValue<int32_t>(&sec_it->value, fname);
-              nsecs = readJsonValue<int32_t>(&nsec_it->value, fname);
-            }
-            serializer->serializeUInt32(static_cast<uint32_t>(secs));
-            serializer->serializeUInt32(static_cast<uint32_t>(nsecs));
-          } break;
-          case STRING: {
-            if (value_field) {
-              const char* str = value_field->GetString();
-              uint32_t len = value_field->GetStringLength();
-              serializer->serializeString(std::string(str, len));
-            } else {
-              serializer->serializeString("");
-            }
-          } break;
-          case OTHER: {
-            auto msg_node_child = field.getMessagePtr(_schema->msg_library);
-            if (!msg_node_child) {
-              throw std::runtime_error(std::string("Missing ROSType in library for field: ") + fname);
-            }
-            serializeImpl(msg_node_child.get(), value_field);
-          } break;
-        }
-      }
-    }
-  };
+//=============================================================================
+// JSON support
+//=============================================================================
 
-  auto root_msg = _schema->field_tree.croot()->value()->getMessagePtr(_schema->msg_library);
-  rapidjson::Value& json_root = json_document;
-  serializeImpl(root_msg.get(), &json_root);
+bool Parser::deserializeIntoJson(Span<const uint8_t> buffer, std::string* json_txt, Deserializer* deserializer,
+                                 int indent) const {
+  json_txt->clear();
+  JsonMessageWriter writer(json_txt, indent);
+  // The arrays are written entirely; only the large blobs are left out.
+  details::DecodeOptions options = decodeOptions();
+  options.max_array_size = std::numeric_limits<uint32_t>::max();
+  // the memoized layouts are those of decodeOptions()
+  details::ShapeCache no_shapes;
+  bool filtered_out = false;
+  bool entire_message_parsed;
+  if (auto* cdr_deserializer = dynamic_cast<NanoCDR_Deserializer*>(deserializer)) {
+    entire_message_parsed = walkSchemaWith(buffer, cdr_deserializer, &writer, &filtered_out, no_shapes, options);
+  } else {
+    entire_message_parsed = walkSchemaWith(buffer, deserializer, &writer, &filtered_out, no_shapes, options);
+  }
+  if (filtered_out) {
+    json_txt->clear();
+  }
+  return entire_message_parsed;
+}
 
+bool Parser::serializeFromJson(const std::string_view json_string, Serializer* serializer) const {
+  serializer->reset();
+  EncodeJson(*_json_encoder, json_string, serializer);
   return true;
 }
 
-#endif
-
 //=============================================================================
 // applyVisitorToBuffer (unchanged from original)
 //=============================================================================
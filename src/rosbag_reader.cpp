@@ -0,0 +1,360 @@
+#include "rosx_introspection/rosbag_reader.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#ifdef ROSX_HAS_LZ4
+#include <lz4frame.h>
+#endif
+
+#ifdef ROSX_HAS_BZ2
+#include <bzlib.h>
+#endif
+
+namespace RosMsgParser {
+
+namespace {
+
+constexpr std::string_view BAG_MAGIC = "#ROSBAG V2.0\n";
+
+// Value of the "op" field of a record header.
+enum RecordOp : uint8_t {
+  OP_MESSAGE_DATA = 0x02,
+  OP_BAG_HEADER = 0x03,
+  OP_INDEX_DATA = 0x04,
+  OP_CHUNK = 0x05,
+  OP_CHUNK_INFO = 0x06,
+  OP_CONNECTION = 0x07,
+};
+
+// The integers of a bag are little-endian.
+template <typename T>
+T loadField(Span<const uint8_t> value, const char* name) {
+  if (value.size() != sizeof(T)) {
+    throw std::runtime_error(std::string("RosbagReader: invalid size of the field ") + name);
+  }
+  T out;
+  memcpy(&out, value.data(), sizeof(T));
+  return out;
+}
+
+uint32_t loadLength(const uint8_t* ptr) {
+  uint32_t out;
+  memcpy(&out, ptr, sizeof(out));
+  return out;
+}
+
+std::string toString(Span<const uint8_t> value) {
+  return std::string(reinterpret_cast<const char*>(value.data()), value.size());
+}
+
+// A record header, or the header of a connection, is a list of "name=value" fields,
+// each prefixed by its length.
+template <class Function>
+void forEachField(Span<const uint8_t> header, Function&& function) {
+  const uint8_t* ptr = header.data();
+  const uint8_t* end = ptr + header.size();
+  while (ptr < end) {
+    if (end - ptr < 4) {
+      throw std::runtime_error("RosbagReader: truncated header field");
+    }
+    const uint32_t length = loadLength(ptr);
+    ptr += 4;
+    if (length > static_cast<size_t>(end - ptr)) {
+      throw std::runtime_error("RosbagReader: truncated header field");
+    }
+    const auto* equal = static_cast<const uint8_t*>(memchr(ptr, '=', length));
+    if (!equal) {
+      throw std::runtime_error("RosbagReader: header field without '='");
+    }
+    const std::string_view name(reinterpret_cast<const char*>(ptr), static_cast<size_t>(equal - ptr));
+    function(name, Span<const uint8_t>(equal + 1, ptr + length));
+    ptr += length;
+  }
+}
+
+uint8_t recordOp(Span<const uint8_t> header) {
+  uint8_t op = 0;
+  forEachField(header, [&](std::string_view name, Span<const uint8_t> value) {
+    if (name == "op") {
+      op = loadField<uint8_t>(value, "op");
+    }
+  });
+  return op;
+}
+
+}  // namespace
+
+struct RosbagReader::Record {
+  uint8_t op = 0;
+  Span<const uint8_t> header;
+  Span<const uint8_t> data;
+};
+
+#ifdef ROSX_HAS_LZ4
+struct RosbagReader::Lz4Context {
+  LZ4F_dctx* context = nullptr;
+
+  Lz4Context() {
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION))) {
+      throw std::runtime_error("RosbagReader: failed to create the lz4 context");
+    }
+  }
+
+  ~Lz4Context() {
+    LZ4F_freeDecompressionContext(context);
+  }
+};
+#else
+struct RosbagReader::Lz4Context {};
+#endif
+
+RosbagReader::RosbagReader(const std::string& filename) : _file(filename, std::ios::binary) {
+  if (!_file) {
+    throw std::runtime_error("RosbagReader: can not open " + filename);
+  }
+  char magic[BAG_MAGIC.size()];
+  if (!_file.read(magic, sizeof(magic)) || std::string_view(magic, sizeof(magic)) != BAG_MAGIC) {
+    throw std::runtime_error("RosbagReader: " + filename + " is not a ROS bag of version 2.0");
+  }
+}
+
+RosbagReader::~RosbagReader() = default;
+
+bool RosbagReader::supportsCompression(const std::string& compression) {
+  if (compression == "none") {
+    return true;
+  }
+#ifdef ROSX_HAS_LZ4
+  if (compression == "lz4") {
+    return true;
+  }
+#endif
+#ifdef ROSX_HAS_BZ2
+  if (compression == "bz2") {
+    return true;
+  }
+#endif
+  return false;
+}
+
+bool RosbagReader::readRecord(Record& record) {
+  uint32_t length = 0;
+  if (!_file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+    return false;
+  }
+  _header.resize(length);
+  if (!_file.read(reinterpret_cast<char*>(_header.data()), length) ||
+      !_file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+    throw std::runtime_error("RosbagReader: truncated record");
+  }
+  record.header = Span<const uint8_t>(_header.data(), _header.size());
+  record.op = recordOp(record.header);
+
+  // the indices are not needed to read the file sequentially
+  if (record.op != OP_CHUNK && record.op != OP_CONNECTION && record.op != OP_MESSAGE_DATA) {
+    record.data = {};
+    if (!_file.seekg(length, std::ios::cur)) {
+      throw std::runtime_error("RosbagReader: truncated record");
+    }
+    return true;
+  }
+  _data.resize(length);
+  if (!_file.read(reinterpret_cast<char*>(_data.data()), length)) {
+    throw std::runtime_error("RosbagReader: truncated record");
+  }
+  record.data = Span<const uint8_t>(_data.data(), _data.size());
+  return true;
+}
+
+void RosbagReader::readConnection(const Record& record) {
+  RosbagConnection connection;
+  bool has_id = false;
+  forEachField(record.header, [&](std::string_view name, Span<const uint8_t> value) {
+    if (name == "conn") {
+      connection.id = loadField<uint32_t>(value, "conn");
+      has_id = true;
+    } else if (name == "topic") {
+      connection.topic = toString(value);
+    }
+  });
+  if (!has_id) {
+    throw std::runtime_error("RosbagReader: connection without id");
+  }
+  if (_connections.count(connection.id) != 0) {
+    return;
+  }
+  forEachField(record.data, [&](std::string_view name, Span<const uint8_t> value) {
+    if (name == "type") {
+      connection.datatype = toString(value);
+    } else if (name == "md5sum") {
+      connection.md5sum = toString(value);
+    } else if (name == "message_definition") {
+      connection.definition = toString(value);
+    } else if (name == "callerid") {
+      connection.callerid = toString(value);
+    } else if (name == "latching") {
+      connection.latching = (toString(value) == "1");
+    }
+  });
+  _connections.emplace(connection.id, std::move(connection));
+}
+
+void RosbagReader::decompressChunk(const Record& record) {
+  std::string compression;
+  uint32_t size = 0;
+  forEachField(record.header, [&](std::string_view name, Span<const uint8_t> value) {
+    if (name == "compression") {
+      compression = toString(value);
+    } else if (name == "size") {
+      size = loadField<uint32_t>(value, "size");
+    }
+  });
+
+  if (compression == "none") {
+    // the records are read from the data of the chunk, without copying them
+    std::swap(_chunk, _data);
+    return;
+  }
+  _chunk.resize(size);
+
+#ifdef ROSX_HAS_LZ4
+  if (compression == "lz4") {
+    if (!_lz4) {
+      _lz4 = std::make_unique<Lz4Context>();
+    }
+    LZ4F_resetDecompressionContext(_lz4->context);
+    size_t dst_pos = 0;
+    size_t src_pos = 0;
+    while (src_pos < record.data.size()) {
+      size_t dst_size = _chunk.size() - dst_pos;
+      size_t src_size = record.data.size() - src_pos;
+      const size_t result = LZ4F_decompress(_lz4->context, _chunk.data() + dst_pos, &dst_size,
+                                            record.data.data() + src_pos, &src_size, nullptr);
+      if (LZ4F_isError(result)) {
+        throw std::runtime_error(std::string("RosbagReader: lz4 error: ") + LZ4F_getErrorName(result));
+      }
+      dst_pos += dst_size;
+      src_pos += src_size;
+      if (result == 0) {
+        break;
+      }
+      if (dst_size == 0 && src_size == 0) {
+        throw std::runtime_error("RosbagReader: truncated lz4 chunk");
+      }
+    }
+    if (dst_pos != size) {
+      throw std::runtime_error("RosbagReader: the lz4 chunk does not match its size");
+    }
+    return;
+  }
+#endif
+
+#ifdef ROSX_HAS_BZ2
+  if (compression == "bz2") {
+    unsigned int dst_size = size;
+    const int result =
+        BZ2_bzBuffToBuffDecompress(reinterpret_cast<char*>(_chunk.data()), &dst_size,
+                                   const_cast<char*>(reinterpret_cast<const char*>(record.data.data())),
+                                   static_cast<unsigned int>(record.data.size()), 0, 0);
+    if (result != BZ_OK || dst_size != size) {
+      throw std::runtime_error("RosbagReader: bz2 error " + std::to_string(result));
+    }
+    return;
+  }
+#endif
+
+  throw std::runtime_error("RosbagReader: unsupported compression \"" + compression + "\"");
+}
+
+void RosbagReader::readChunks(const ChunkCallback& callback) {
+  _file.clear();
+  _file.seekg(BAG_MAGIC.size());
+
+  auto makeMessage = [&](const Record& record) {
+    RosbagMessage message;
+    bool has_id = false;
+    uint32_t id = 0;
+    forEachField(record.header, [&](std::string_view name, Span<const uint8_t> value) {
+      if (name == "conn") {
+        id = loadField<uint32_t>(value, "conn");
+        has_id = true;
+      } else if (name == "time") {
+        const auto stamp = loadField<uint64_t>(value, "time");
+        message.stamp.sec = static_cast<uint32_t>(stamp);
+        message.stamp.nsec = static_cast<uint32_t>(stamp >> 32);
+      }
+    });
+    auto it = _connections.find(id);
+    if (!has_id || it == _connections.end()) {
+      throw std::runtime_error("RosbagReader: message of an unknown connection");
+    }
+    message.connection = &it->second;
+    message.data = record.data;
+    return message;
+  };
+
+  Record record;
+  while (readRecord(record)) {
+    switch (record.op) {
+      case OP_CONNECTION:
+        readConnection(record);
+        break;
+
+      case OP_MESSAGE_DATA: {
+        const RosbagMessage message = makeMessage(record);
+        if (!callback(Span<const RosbagMessage>(&message, 1))) {
+          return;
+        }
+      } break;
+
+      case OP_CHUNK: {
+        decompressChunk(record);
+        _messages.clear();
+        const uint8_t* ptr = _chunk.data();
+        const uint8_t* end = ptr + _chunk.size();
+        Record inner;
+        while (ptr < end) {
+          // header length, header, data length, data
+          if (end - ptr < 4 || loadLength(ptr) > static_cast<size_t>(end - ptr - 4)) {
+            throw std::runtime_error("RosbagReader: truncated record in chunk");
+          }
+          inner.header = Span<const uint8_t>(ptr + 4, loadLength(ptr));
+          ptr += 4 + inner.header.size();
+          if (end - ptr < 4 || loadLength(ptr) > static_cast<size_t>(end - ptr - 4)) {
+            throw std::runtime_error("RosbagReader: truncated record in chunk");
+          }
+          inner.data = Span<const uint8_t>(ptr + 4, loadLength(ptr));
+          ptr += 4 + inner.data.size();
+          inner.op = recordOp(inner.header);
+
+          if (inner.op == OP_CONNECTION) {
+            readConnection(inner);
+          } else if (inner.op == OP_MESSAGE_DATA) {
+            _messages.push_back(makeMessage(inner));
+          }
+        }
+        if (!_messages.empty() && !callback(Span<const RosbagMessage>(_messages.data(), _messages.size()))) {
+          return;
+        }
+      } break;
+
+      default:
+        break;
+    }
+  }
+}
+
+void RosbagReader::readMessages(const MessageCallback& callback) {
+  readChunks([&callback](Span<const RosbagMessage> messages) {
+    for (const auto& message : messages) {
+      if (!callback(message)) {
+        return false;
+      }
+    }
+    return true;
+  });
+}
+
+}  // namespace RosMsgParser
@@ -1,8 +1,77 @@
 #include "rosx_introspection/serializer.hpp"
 
+#include <cstring>
+
 #include "rosx_introspection/contrib/nanocdr.hpp"
 namespace RosMsgParser {
 
+namespace {
+// Invoke [func] with the value of [type] stored at [src].
+template <class Func>
+void visitValue(BuiltinType type, const void* src, Func&& func) {
+  auto load = [src](auto value) {
+    memcpy(&value, src, sizeof(value));
+    return value;
+  };
+  switch (type) {
+    case BOOL:
+      func(load(bool{}));
+      break;
+    case CHAR:
+      func(load(char{}));
+      break;
+    case BYTE:
+    case UINT8:
+      func(load(uint8_t{}));
+      break;
+    case INT8:
+      func(load(int8_t{}));
+      break;
+    case UINT16:
+      func(load(uint16_t{}));
+      break;
+    case INT16:
+      func(load(int16_t{}));
+      break;
+    case UINT32:
+      func(load(uint32_t{}));
+      break;
+    case INT32:
+      func(load(int32_t{}));
+      break;
+    case UINT64:
+      func(load(uint64_t{}));
+      break;
+    case INT64:
+      func(load(int64_t{}));
+      break;
+    case FLOAT32:
+      func(load(float{}));
+      break;
+    case FLOAT64:
+      func(load(double{}));
+      break;
+    case TIME:
+    case DURATION:
+      func(load(Time{}));
+      break;
+    default:
+      throw std::runtime_error("Unsupported type");
+  }
+}
+}  // namespace
+
+void Serializer::writeFrom(BuiltinType type, const void* src) {
+  visitValue(type, src, [this, type](auto value) {
+    if constexpr (std::is_same_v<decltype(value), Time>) {
+      serializeUInt32(value.sec);
+      serializeUInt32(value.nsec);
+    } else {
+      serialize(type, Variant(value));
+    }
+  });
+}
+
 NanoCDR_Serializer::NanoCDR_Serializer() {
   _storage.reserve(1024);
   _cdr_encoder = std::make_shared<nanocdr::Encoder>(nanocdr::CdrHeader(), _storage);
@@ -55,12 +124,28 @@ void NanoCDR_Serializer::serializeString(const std::string& str) {
   _cdr_encoder->encode(str);
 }
 
+void NanoCDR_Serializer::serializeStringView(std::string_view str) {
+  _cdr_encoder->encode(str);
+}
+
 void NanoCDR_Serializer::serializeUInt32(uint32_t value) {
   _cdr_encoder->encode(value);
 }
 
+void NanoCDR_Serializer::writeFrom(BuiltinType type, const void* src) {
+  visitValue(type, src, [this](auto value) {
+    if constexpr (std::is_same_v<decltype(value), Time>) {
+      _cdr_encoder->encode(value.sec);
+      _cdr_encoder->encode(value.nsec);
+    } else {
+      _cdr_encoder->encode(value);
+    }
+  });
+}
+
 void NanoCDR_Serializer::reset() {
-  _cdr_encoder = std::make_shared<nanocdr::Encoder>(nanocdr::CdrHeader(), _storage);
+  // reuse the encoder, and the memory of the storage
+  *_cdr_encoder = nanocdr::Encoder(nanocdr::CdrHeader(), _storage);
 }
 
 const char* NanoCDR_Serializer::getBufferData() const {
@@ -23,8 +23,22 @@
 
 #include "rosx_introspection/stringtree_leaf.hpp"
 
+#include <string_view>
+
 namespace RosMsgParser {
 
+size_t FieldLeafHash::operator()(const FieldLeaf& leaf) const {
+  size_t hash = std::hash<const void*>()(leaf.node);
+  auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2); };
+  for (const uint16_t index : leaf.index_array) {
+    combine(index);
+  }
+  for (const auto& key : leaf.key_suffixes) {
+    combine(std::hash<std::string_view>()(std::string_view(key.data, key.len)));
+  }
+  return hash;
+}
+
 // Helper: fill bracket placeholders in a cached path template using segment memcpy.
 // Each placeholder is filled with either a @key value (key_mask bit set, pulled
 // in order from key_suffixes) or a numeric array index (pulled in order from
@@ -0,0 +1,109 @@
+#include "rosx_introspection/timeseries_collector.hpp"
+
+namespace RosMsgParser {
+
+TimeSeriesColumn& TimeSeriesCollector::findColumn(const FieldLeaf& leaf, TimeSeriesColumn::Type type) {
+  TimeSeriesColumn* column = nullptr;
+  auto it = _column_index.find(leaf);
+  if (it != _column_index.end()) {
+    column = it->second;
+    if (column->type != type) {
+      throw std::runtime_error("TimeSeriesCollector: values of different types for the field " + column->name());
+    }
+  } else {
+    column = &_columns.emplace_back();
+    column->leaf = leaf;
+    column->type = type;
+    _column_index.emplace(leaf, column);
+  }
+
+  if (_position >= _column_at.size()) {
+    _column_at.resize(_position + 1);
+  }
+  _column_at[_position++] = column;
+  return *column;
+}
+
+uint32_t TimeSeriesCollector::stringId(TimeSeriesColumn& column, std::string_view value) {
+  // most of the string fields (frame_id, names) repeat the previous value
+  if (!column.string_ids.empty() && _strings[column.string_ids.back()] == value) {
+    return column.string_ids.back();
+  }
+  auto it = _string_ids.find(value);
+  if (it != _string_ids.end()) {
+    return it->second;
+  }
+  const auto id = static_cast<uint32_t>(_strings.size());
+  _strings.emplace_back(value);
+  _string_ids.emplace(_strings.back(), id);
+  return id;
+}
+
+void TimeSeriesCollector::writeValue(const FieldLeaf& leaf, const Variant& value) {
+  switch (value.getTypeID()) {
+    case FLOAT32:
+    case FLOAT64:
+    case TIME:
+    case DURATION:
+      appendFloat(leaf, value.convert<double>());
+      break;
+    case UINT64:
+      appendInt(leaf, value.extract<uint64_t>());
+      break;
+    case STRING:
+      writeString(leaf, value.extract<std::string_view>());
+      break;
+    default:
+      appendInt(leaf, value.convert<int64_t>());
+      break;
+  }
+}
+
+void TimeSeriesCollector::writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) {
+  // each element has its own column
+  _element = leaf;
+  ForEachTypedArrayValue(type, raw, count, [this](size_t index, auto value) {
+    using T = decltype(value);
+    _element.index_array.back() = static_cast<uint16_t>(index);
+    if constexpr (std::is_same_v<T, Time>) {
+      appendFloat(_element, value.toSec());
+    } else if constexpr (std::is_floating_point_v<T>) {
+      appendFloat(_element, value);
+    } else {
+      appendInt(_element, value);
+    }
+  });
+}
+
+void TimeSeriesCollector::rollback(size_t count) {
+  for (size_t i = 0; i < count && i < _column_at.size(); i++) {
+    auto& column = *_column_at[i];
+    column.time.pop_back();
+    switch (column.type) {
+      case TimeSeriesColumn::FLOAT64:
+        column.float_values.pop_back();
+        break;
+      case TimeSeriesColumn::INT64:
+        column.int_values.pop_back();
+        break;
+      case TimeSeriesColumn::STRING:
+        column.string_ids.pop_back();
+        break;
+    }
+  }
+}
+
+void TimeSeriesCollector::clear() {
+  for (auto& column : _columns) {
+    column.time.clear();
+    column.float_values.clear();
+    column.int_values.clear();
+    column.string_ids.clear();
+  }
+  _strings.clear();
+  _string_ids.clear();
+  _position = 0;
+  _message_size = 0;
+}
+
+}  // namespace RosMsgParser
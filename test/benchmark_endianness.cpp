@@ -0,0 +1,128 @@
+/// Standalone benchmark of the byte swapping of big-endian CDR messages.
+/// The same message is encoded in little- and big-endian and decoded N times:
+/// a writer that only receives the arrays measures the bulk decode, a FlatMessage
+/// the complete deserialization.
+/// Usage: ./endianness_benchmark [iterations]
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "rosx_introspection/details/byte_swap.hpp"
+#include "rosx_introspection/ros_parser.hpp"
+
+using namespace RosMsgParser;
+
+static const char* SCHEMA =
+    "std_msgs/Header header\n"
+    "float32[] ranges\n"
+    "float32[] intensities\n"
+    "float64[] positions\n"
+    "int16[] samples\n"
+    "uint64[] stamps\n"
+    "================================================================================\n"
+    "MSG: std_msgs/Header\n"
+    "time stamp\n"
+    "string frame_id\n";
+
+static constexpr uint32_t ARRAY_SIZE = 2000;
+
+static std::vector<uint8_t> encodeMessage(nanocdr::Endianness endianness) {
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{endianness, nanocdr::EncodingFlag::PLAIN_CDR});
+  encoder.encode(uint32_t(1700000000));
+  encoder.encode(uint32_t(500));
+  encoder.encode(std::string("laser"));
+  std::vector<float> floats(ARRAY_SIZE);
+  std::vector<double> doubles(ARRAY_SIZE);
+  std::vector<int16_t> shorts(ARRAY_SIZE);
+  std::vector<uint64_t> longs(ARRAY_SIZE);
+  for (uint32_t i = 0; i < ARRAY_SIZE; i++) {
+    floats[i] = float(i) * 0.01f;
+    doubles[i] = double(i) * 0.001;
+    shorts[i] = static_cast<int16_t>(i);
+    longs[i] = uint64_t(i) << 20;
+  }
+  encoder.encode(floats);
+  encoder.encode(floats);
+  encoder.encode(doubles);
+  encoder.encode(shorts);
+  encoder.encode(longs);
+  const auto encoded = encoder.encodedBuffer();
+  return std::vector<uint8_t>(encoded.data(), encoded.data() + encoded.size());
+}
+
+// Receives the arrays in bulk, without converting their values.
+class ArrayChecksumWriter final : public MessageWriter {
+ public:
+  void writeValue(const FieldLeaf&, const Variant&) override {}
+  void writeString(const FieldLeaf&, const std::string&) override {}
+  void writeEnum(const FieldLeaf&, int32_t, const std::string&) override {}
+  void writeArray(const FieldLeaf&, BuiltinType, Span<const uint8_t> raw, size_t) override {
+    checksum += raw.back();
+  }
+  uint64_t checksum = 0;
+};
+
+template <class Function>
+static double measureMBPerSec(size_t bytes, int iterations, Function&& function) {
+  function();  // warmup
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    function();
+  }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  double seconds = std::chrono::duration<double>(t1 - t0).count();
+  return (bytes * iterations) / seconds / (1024.0 * 1024.0);
+}
+
+int main(int argc, char* argv[]) {
+  const int iterations = (argc >= 2) ? std::atoi(argv[1]) : 20000;
+
+  Parser parser("scan", ROSType("sensor_msgs/Scan"), SCHEMA);
+  parser.setMaxArrayPolicy(Parser::KEEP_LARGE_ARRAYS, ARRAY_SIZE);
+
+  const auto little = encodeMessage(nanocdr::Endianness::CDR_LITTLE_ENDIAN);
+  const auto big = encodeMessage(nanocdr::Endianness::CDR_BIG_ENDIAN);
+
+  std::cout << "CDR message: " << little.size() << " bytes" << std::endl;
+  std::cout << "Iterations: " << iterations << std::endl;
+  std::cout << "Byte swap: " << details::swapBytesImplementation() << std::endl;
+  std::cout << std::endl;
+
+  for (const auto* message : {&little, &big}) {
+    const bool is_big = (message == &big);
+    Span<const uint8_t> buffer(*message);
+    NanoCDR_Deserializer deserializer;
+
+    ArrayChecksumWriter writer;
+    double bulk_mb = measureMBPerSec(message->size(), iterations, [&]() {
+      parser.walkSchema<NanoCDR_Deserializer, ArrayChecksumWriter>(buffer, &deserializer, &writer);
+    });
+
+    std::vector<double> positions(ARRAY_SIZE);
+    double read_array_mb = measureMBPerSec(ARRAY_SIZE * sizeof(double), iterations, [&]() {
+      deserializer.init(buffer);
+      deserializer.jump(4 + 4 + 4 + 6);
+      for (int array = 0; array < 2; array++) {
+        deserializer.jump(deserializer.deserializeUInt32() * sizeof(float));
+      }
+      const uint32_t size = deserializer.deserializeUInt32();
+      deserializer.readArrayInto(FLOAT64, positions.data(), size);
+    });
+
+    FlatMessage flat;
+    double flat_mb = measureMBPerSec(message->size(), iterations, [&]() {
+      parser.deserialize(buffer, &flat, &deserializer);
+    });
+
+    std::cout << "=== " << (is_big ? "Big-endian" : "Little-endian") << " ===" << std::endl;
+    std::cout << "Bulk arrays:        " << bulk_mb << " MB/s" << std::endl;
+    std::cout << "readArrayInto:      " << read_array_mb << " MB/s of float64 (last " << positions.back() << ")"
+              << std::endl;
+    std::cout << "FlatMessage:        " << flat_mb << " MB/s" << std::endl;
+    std::cout << "(checksum " << writer.checksum << ")" << std::endl;
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
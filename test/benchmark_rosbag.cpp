@@ -0,0 +1,164 @@
+/// Deserialization throughput on the messages of a ROS1 bag (format 2.0), read with RosbagReader.
+/// The equivalent of mcap_benchmark for the .bag files.
+/// Usage: ./rosbag_benchmark <bag_file> [--iterations N] [--writer flat|json|msgpack]
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "rosx_introspection/msgpack_utils.hpp"
+#include "rosx_introspection/ros_parser.hpp"
+#include "rosx_introspection/rosbag_reader.hpp"
+
+enum class WriterMode { FLAT, JSON, MSGPACK };
+
+struct TopicStats {
+  size_t message_count = 0;
+  size_t total_bytes = 0;
+  double total_ms = 0;
+};
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <bag_file> [--iterations N] [--writer flat|json|msgpack]" << std::endl;
+    return 1;
+  }
+
+  std::string bag_file = argv[1];
+  int iterations = 1;
+  WriterMode mode = WriterMode::FLAT;
+
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--iterations" && i + 1 < argc) {
+      iterations = std::stoi(argv[++i]);
+    } else if (arg == "--writer" && i + 1 < argc) {
+      std::string val = argv[++i];
+      if (val == "flat") {
+        mode = WriterMode::FLAT;
+      } else if (val == "json") {
+        mode = WriterMode::JSON;
+      } else if (val == "msgpack") {
+        mode = WriterMode::MSGPACK;
+      } else {
+        std::cerr << "Unknown writer: " << val << " (use flat, json, or msgpack)" << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  const char* mode_str = (mode == WriterMode::FLAT) ? "flat" : (mode == WriterMode::JSON) ? "json" : "msgpack";
+
+  std::cout << "Benchmark: " << bag_file << std::endl;
+  std::cout << "Iterations: " << iterations << std::endl;
+  std::cout << "Writer: " << mode_str << std::endl;
+  std::cout << "---" << std::endl;
+
+  for (int iter = 0; iter < iterations; iter++) {
+    auto total_start = std::chrono::high_resolution_clock::now();
+
+    std::unique_ptr<RosMsgParser::RosbagReader> reader;
+    try {
+      reader = std::make_unique<RosMsgParser::RosbagReader>(bag_file);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+
+    // parsers by connection id: the same topic may have several connections
+    std::unordered_map<uint32_t, std::unique_ptr<RosMsgParser::Parser>> parsers;
+    std::unordered_map<std::string, TopicStats> stats;
+    RosMsgParser::FlatMessage flat_msg;
+    RosMsgParser::ROS_Deserializer deserializer;
+    std::string json_output;
+    std::vector<uint8_t> msgpack_output;
+
+    try {
+      reader->readMessages([&](const RosMsgParser::RosbagMessage& msg) {
+        const auto& connection = *msg.connection;
+
+        auto it = parsers.find(connection.id);
+        if (it == parsers.end()) {
+          std::unique_ptr<RosMsgParser::Parser> parser;
+          try {
+            parser = std::make_unique<RosMsgParser::Parser>(
+                connection.topic, RosMsgParser::ROSType(connection.datatype), connection.definition);
+          } catch (const std::exception& e) {
+            std::cerr << "Warning: " << connection.topic << ": " << e.what() << std::endl;
+          }
+          it = parsers.emplace(connection.id, std::move(parser)).first;
+        }
+        if (!it->second) {
+          return true;
+        }
+
+        auto& parser = *it->second;
+        auto& topic_stats = stats[connection.topic];
+        topic_stats.total_bytes += msg.data.size();
+        topic_stats.message_count++;
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        try {
+          switch (mode) {
+            case WriterMode::FLAT: {
+              parser.deserialize(msg.data, &flat_msg, &deserializer);
+              std::string field_name;
+              for (const auto& pair : flat_msg.value) {
+                pair.first.toStr(field_name);
+              }
+              break;
+            }
+            case WriterMode::JSON:
+              parser.deserializeIntoJson(msg.data, &json_output, &deserializer);
+              break;
+            case WriterMode::MSGPACK:
+              RosMsgParser::deserializeToMsgpack(parser, msg.data, &deserializer, msgpack_output);
+              break;
+          }
+        } catch (const std::exception& e) {
+          return true;
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        topic_stats.total_ms += std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0;
+        return true;
+      });
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to read " << bag_file << ": " << e.what() << std::endl;
+      return 1;
+    }
+
+    auto total_end = std::chrono::high_resolution_clock::now();
+    double wall_ms = std::chrono::duration_cast<std::chrono::microseconds>(total_end - total_start).count() / 1000.0;
+
+    if (iterations > 1) {
+      std::cout << "\n=== Iteration " << (iter + 1) << " ===" << std::endl;
+    }
+
+    size_t total_messages = 0;
+    size_t total_bytes = 0;
+    double total_deser_ms = 0;
+
+    for (const auto& [topic, s] : stats) {
+      total_messages += s.message_count;
+      total_bytes += s.total_bytes;
+      total_deser_ms += s.total_ms;
+
+      double msgs_per_sec = s.message_count / (s.total_ms / 1000.0);
+      double mb_per_sec = (s.total_bytes / (1024.0 * 1024.0)) / (s.total_ms / 1000.0);
+
+      std::cout << topic << ":" << std::endl;
+      std::cout << "  messages: " << s.message_count << std::endl;
+      std::cout << "  bytes: " << s.total_bytes << std::endl;
+      std::cout << "  " << mode_str << ": " << s.total_ms << " ms"
+                << " (" << msgs_per_sec << " msg/s, " << mb_per_sec << " MB/s)" << std::endl;
+    }
+
+    std::cout << "\nTotal: " << total_messages << " messages, " << total_bytes << " bytes" << std::endl;
+    std::cout << "  " << mode_str << " only: " << total_deser_ms << " ms" << std::endl;
+    std::cout << "  wall clock (incl. bag I/O): " << wall_ms << " ms" << std::endl;
+  }
+
+  return 0;
+}
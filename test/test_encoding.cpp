@@ -1,28 +1,31 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include "rosx_introspection/arrow_batch_writer.hpp"
+#include "rosx_introspection/csv_message_writer.hpp"
 #include "rosx_introspection/deserializer.hpp"
+#include "rosx_introspection/details/byte_swap.hpp"
 #include "rosx_introspection/msgpack_utils.hpp"
 #include "rosx_introspection/ros_message.hpp"
 #include "rosx_introspection/ros_parser.hpp"
 #include "rosx_introspection/serializer.hpp"
+#include "rosx_introspection/timeseries_collector.hpp"
 
 using namespace RosMsgParser;
 
 namespace {
 
+// serializeFromJson() needs RapidJSON
 bool HasJsonSupport() {
   Parser parser("topic", ROSType("my_pkg/Test"), "uint32 value\n");
   NanoCDR_Serializer serializer;
-  serializer.reset();
-  serializer.serialize(UINT32, Variant(uint32_t(0)));
-
-  NanoCDR_Deserializer deserializer;
-  std::string json;
   try {
-    return parser.deserializeIntoJson(
-        Span<const uint8_t>(
-            reinterpret_cast<const uint8_t*>(serializer.getBufferData()), serializer.getBufferSize()),
-        &json, &deserializer);
+    return parser.serializeFromJson(R"({"value":0})", &serializer);
   } catch (const std::runtime_error& ex) {
     if (std::string(ex.what()).find("without JSON support") != std::string::npos) {
       return false;
@@ -31,6 +34,131 @@ bool HasJsonSupport() {
   }
 }
 
+// Decodes every value one by one, disabling the fixed layout of the structs.
+class FieldByFieldDeserializer : public Deserializer {
+ public:
+  void init(Span<const uint8_t> buffer) override {
+    _cdr.init(buffer);
+  }
+  bool isROS2() const override {
+    return true;
+  }
+  void jump(size_t bytes) override {
+    _cdr.jump(bytes);
+  }
+  Variant deserialize(BuiltinType type) override {
+    return _cdr.deserialize(type);
+  }
+  Span<const uint8_t> deserializeByteSequence() override {
+    return _cdr.deserializeByteSequence();
+  }
+  void deserializeString(std::string& out) override {
+    _cdr.deserializeString(out);
+  }
+  uint32_t deserializeUInt32() override {
+    return _cdr.deserializeUInt32();
+  }
+  const uint8_t* getCurrentPtr() const override {
+    return _cdr.getCurrentPtr();
+  }
+  size_t bytesLeft() const override {
+    return _cdr.bytesLeft();
+  }
+  void reset() override {
+    _cdr.reset();
+  }
+
+ private:
+  NanoCDR_Deserializer _cdr;
+};
+
+const char* fixed_layout_def =
+    "uint8 flag\n"
+    "Sample[2] samples\n"
+    "Unaligned unaligned\n"
+    "geometry_msgs/PoseWithCovariance pose\n"
+    "================================================================================\n"
+    "MSG: my_pkg/Sample\n"
+    "float32 x\n"
+    "int8 y\n"
+    "uint16[3] z\n"
+    "================================================================================\n"
+    "MSG: my_pkg/Unaligned\n"
+    "uint8 a\n"
+    "float64 b\n"
+    "================================================================================\n"
+    "MSG: geometry_msgs/PoseWithCovariance\n"
+    "geometry_msgs/Pose pose\n"
+    "float64[36] covariance\n"
+    "================================================================================\n"
+    "MSG: geometry_msgs/Pose\n"
+    "geometry_msgs/Point position\n"
+    "geometry_msgs/Quaternion orientation\n"
+    "================================================================================\n"
+    "MSG: geometry_msgs/Point\n"
+    "float64 x\n"
+    "float64 y\n"
+    "float64 z\n"
+    "================================================================================\n"
+    "MSG: geometry_msgs/Quaternion\n"
+    "float64 x\n"
+    "float64 y\n"
+    "float64 z\n"
+    "float64 w\n";
+
+// Invokes [encode] on each value of a message of type fixed_layout_def, in order.
+template <class Encode>
+void EncodeFixedLayoutMessage(Encode&& encode) {
+  encode(uint8_t(7));
+  for (int i = 0; i < 2; i++) {
+    encode(float(1.5f + i));
+    encode(int8_t(-3 - i));
+    for (int j = 0; j < 3; j++) {
+      encode(uint16_t(1000 * i + j));
+    }
+  }
+  encode(uint8_t(9));
+  encode(double(-2.25));
+  for (int i = 0; i < 7 + 36; i++) {
+    encode(double(0.5 * i));
+  }
+}
+
+void ExpectSameFlatMessages(const FlatMessage& a, const FlatMessage& b) {
+  ASSERT_EQ(a.value.size(), b.value.size());
+  for (size_t i = 0; i < a.value.size(); i++) {
+    EXPECT_EQ(a.value[i].first.toStdString(), b.value[i].first.toStdString());
+    EXPECT_EQ(a.value[i].second.getTypeID(), b.value[i].second.getTypeID());
+    if (a.value[i].second.getTypeID() == STRING) {
+      EXPECT_EQ(a.value[i].second.extract<std::string>(), b.value[i].second.extract<std::string>());
+    } else {
+      EXPECT_EQ(a.value[i].second.convert<double>(), b.value[i].second.convert<double>());
+    }
+  }
+  ASSERT_EQ(a.blob.size(), b.blob.size());
+  for (size_t i = 0; i < a.blob.size(); i++) {
+    EXPECT_EQ(a.blob[i].first.toStdString(), b.blob[i].first.toStdString());
+    EXPECT_TRUE(std::equal(a.blob[i].second.begin(), a.blob[i].second.end(), b.blob[i].second.begin(),
+                           b.blob[i].second.end()));
+  }
+}
+
+// Encodes values as ROS1 does: no padding, strings prefixed by their length.
+struct Ros1Encoder {
+  std::vector<uint8_t> buffer;
+
+  void encode(const std::string& str) {
+    encode(static_cast<uint32_t>(str.size()));
+    buffer.insert(buffer.end(), str.begin(), str.end());
+  }
+
+  template <typename T>
+  void encode(T value) {
+    const auto* ptr = reinterpret_cast<const uint8_t*>(&value);
+    buffer.insert(buffer.end(), ptr, ptr + sizeof(T));
+  }
+};
+
 }  // namespace
 
 TEST(NanoSerializer, RoundTrip) {
@@ -169,10 +297,6 @@ TEST(NanoDeserializer, EmptyByteSequence) {
 }
 
 TEST(ParserJson, LargeArrayShouldNotCorruptFollowingFields) {
-  if (!HasJsonSupport()) {
-    GTEST_SKIP() << "JSON support disabled in this build";
-  }
-
   Parser parser("topic", ROSType("my_pkg/Test"), "uint8[] data\nuint32 tail\n");
 
   NanoCDR_Serializer serializer;
@@ -192,6 +316,36 @@ TEST(ParserJson, LargeArrayShouldNotCorruptFollowingFields) {
   EXPECT_NE(json.find("\"tail\":42"), std::string::npos);
 }
 
+TEST(ParserJson, LargeArraysAreWrittenEntirely) {
+  // the MaxArrayPolicy of the FlatMessage does not apply to the JSON
+  Parser parser("topic", ROSType("my_pkg/Test"), "float32[] values\nuint8[] data\nuint32 tail\n");
+  parser.setMaxArrayPolicy(Parser::DISCARD_LARGE_ARRAYS, 2);
+
+  NanoCDR_Serializer serializer;
+  serializer.reset();
+  serializer.serializeUInt32(3);
+  for (int i = 0; i < 3; i++) {
+    serializer.serialize(FLOAT32, Variant(float(i)));
+  }
+  serializer.serializeUInt32(3);
+  for (int i = 0; i < 3; i++) {
+    serializer.serialize(UINT8, Variant(uint8_t(i)));
+  }
+  serializer.serialize(UINT32, Variant(uint32_t(42)));
+  const Span<const uint8_t> buffer(reinterpret_cast<const uint8_t*>(serializer.getBufferData()),
+                                   serializer.getBufferSize());
+
+  NanoCDR_Deserializer deserializer;
+  std::string json;
+  ASSERT_TRUE(parser.deserializeIntoJson(buffer, &json, &deserializer));
+  EXPECT_EQ(json, R"({"values":[0.0,1.0,2.0],"tail":42})");
+
+  FlatMessage flat;
+  EXPECT_FALSE(parser.deserialize(buffer, &flat, &deserializer));
+  ASSERT_EQ(flat.value.size(), 1u);
+  EXPECT_EQ(flat.value[0].second.convert<uint32_t>(), 42u);
+}
+
 TEST(ParserFlatMessage, LargeUint8ArrayShouldBeBlob) {
   Parser parser("topic", ROSType("my_pkg/Test"), "uint8[] data\n");
   parser.setMaxArrayPolicy(Parser::DISCARD_LARGE_ARRAYS, 100);
@@ -343,3 +497,1412 @@ TEST(ROSDeserializer, UnsupportedTypeShouldThrow) {
 
   EXPECT_THROW(deserializer.deserialize(OTHER), std::runtime_error);
 }
+
+// Records the typed events, and the values that reach writeValue().
+class TypedEventsWriter : public MessageWriter {
+ public:
+  std::vector<std::string> events;
+
+  void writeValue(const FieldLeaf& leaf, const Variant& value) override {
+    events.push_back(leaf.toStdString() + "=" + toStr(value.getTypeID()));
+  }
+  void writeBool(const FieldLeaf& leaf, bool value) override {
+    record(leaf, "bool", value);
+  }
+  void writeChar(const FieldLeaf& leaf, char value) override {
+    record(leaf, "char", value);
+  }
+  void writeInt8(const FieldLeaf& leaf, int8_t value) override {
+    record(leaf, "int8", value);
+  }
+  void writeInt16(const FieldLeaf& leaf, int16_t value) override {
+    record(leaf, "int16", value);
+  }
+  void writeInt32(const FieldLeaf& leaf, int32_t value) override {
+    record(leaf, "int32", value);
+  }
+  void writeInt64(const FieldLeaf& leaf, int64_t value) override {
+    record(leaf, "int64", value);
+  }
+  void writeUInt8(const FieldLeaf& leaf, uint8_t value) override {
+    record(leaf, "uint8", value);
+  }
+  void writeUInt16(const FieldLeaf& leaf, uint16_t value) override {
+    record(leaf, "uint16", value);
+  }
+  void writeUInt32(const FieldLeaf& leaf, uint32_t value) override {
+    record(leaf, "uint32", value);
+  }
+  void writeUInt64(const FieldLeaf& leaf, uint64_t value) override {
+    record(leaf, "uint64", value);
+  }
+  void writeFloat32(const FieldLeaf& leaf, float value) override {
+    record(leaf, "float32", value);
+  }
+  void writeFloat64(const FieldLeaf& leaf, double value) override {
+    record(leaf, "float64", value);
+  }
+  void writeString(const FieldLeaf& leaf, const std::string& value) override {
+    events.push_back(leaf.toStdString() + "=" + value);
+  }
+  void writeEnum(const FieldLeaf& leaf, int32_t value, const std::string& /*name*/) override {
+    record(leaf, "enum", value);
+  }
+
+ private:
+  template <typename T>
+  void record(const FieldLeaf& leaf, const char* type, T value) {
+    std::ostringstream ss;
+    ss << leaf.toStdString() << "=" << type << ":" << +value;
+    events.push_back(ss.str());
+  }
+};
+
+TEST(TypedDecode, ScalarsBypassVariant) {
+  const char* def =
+      "bool b\n"
+      "char c\n"
+      "byte y\n"
+      "int8 i8\n"
+      "int16 i16\n"
+      "int32 i32\n"
+      "int64 i64\n"
+      "uint8 u8\n"
+      "uint16 u16\n"
+      "uint32 u32\n"
+      "uint64 u64\n"
+      "float32 f32\n"
+      "float64 f64\n"
+      "time t\n"
+      "string s\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  encoder.encode(true);
+  encoder.encode(char('A'));
+  encoder.encode(uint8_t(200));
+  encoder.encode(int8_t(-8));
+  encoder.encode(int16_t(-16));
+  encoder.encode(int32_t(-32));
+  encoder.encode(int64_t(-64));
+  encoder.encode(uint8_t(8));
+  encoder.encode(uint16_t(16));
+  encoder.encode(uint32_t(32));
+  encoder.encode(uint64_t(1) << 63);
+  encoder.encode(float(0.5f));
+  encoder.encode(double(-0.25));
+  encoder.encode(uint32_t(10));
+  encoder.encode(uint32_t(20));
+  encoder.encode(std::string("end"));
+  const auto encoded = encoder.encodedBuffer();
+  const Span<const uint8_t> buffer(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+
+  const std::vector<std::string> expected = {
+      "topic/b=bool:1", "topic/c=char:65", "topic/y=uint8:200", "topic/i8=int8:-8", "topic/i16=int16:-16",
+      "topic/i32=int32:-32", "topic/i64=int64:-64", "topic/u8=uint8:8", "topic/u16=uint16:16", "topic/u32=uint32:32",
+      "topic/u64=uint64:9223372036854775808", "topic/f32=float32:0.5", "topic/f64=float64:-0.25", "topic/t=TIME",
+      "topic/s=end"};
+
+  // the concrete deserializer, the abstract one, and the value by value decoding
+  // that uses the default implementation of Deserializer::readInto()
+  NanoCDR_Deserializer deserializer;
+  FieldByFieldDeserializer field_by_field;
+  TypedEventsWriter writer;
+  parser.walkSchema(buffer, &deserializer, &writer);
+  EXPECT_EQ(writer.events, expected);
+  for (Deserializer* deser : std::initializer_list<Deserializer*>{&deserializer, &field_by_field}) {
+    TypedEventsWriter base_writer;
+    parser.walkSchema(buffer, deser, &base_writer);
+    EXPECT_EQ(base_writer.events, expected);
+  }
+
+  // the typed events of FlatMessageWriter store the same Variants as writeValue()
+  FlatMessage flat;
+  parser.deserialize(buffer, &flat, &deserializer);
+  ASSERT_EQ(flat.value.size(), expected.size());
+  EXPECT_EQ(flat.value[2].second.getTypeID(), UINT8);
+  EXPECT_EQ(flat.value[10].second.extract<uint64_t>(), uint64_t(1) << 63);
+  EXPECT_EQ(flat.value[13].second.extract<Time>().nsec, 20u);
+
+  // read() on the concrete and on the abstract deserializer
+  const std::vector<uint8_t> packed = {1, 2, 0, 0, 0, 0, 0, 0, 0xF0, 0x3F, 5};
+  ROS_Deserializer ros_deserializer;
+  ros_deserializer.init(Span<const uint8_t>(packed));
+  EXPECT_EQ(ros_deserializer.read<uint16_t>(), 0x0201);
+  Deserializer& base = ros_deserializer;
+  EXPECT_EQ(base.read<double>(), 1.0);
+  EXPECT_THROW((void)base.read<uint16_t>(), std::runtime_error);
+}
+
+TEST(StringPolicy, ReferencesTheBuffer) {
+  const char* def =
+      "string frame_id\n"
+      "string[] names\n"
+      "string empty\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  encoder.encode(std::string("base_link"));
+  encoder.encode(uint32_t(2));
+  encoder.encode(std::string("a_joint_with_a_name_longer_than_the_small_string_buffer"));
+  encoder.encode(std::string("b"));
+  encoder.encode(std::string());
+  const auto encoded = encoder.encodedBuffer();
+  const Span<const uint8_t> buffer(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+  auto inBuffer = [&](const Variant& value) {
+    const auto* chars = reinterpret_cast<const uint8_t*>(value.extract<std::string_view>().data());
+    return chars >= buffer.data() && chars < buffer.data() + buffer.size();
+  };
+
+  NanoCDR_Deserializer deserializer;
+  FlatMessage copied;
+  parser.deserialize(buffer, &copied, &deserializer);
+  ASSERT_EQ(copied.value.size(), 4u);
+  EXPECT_FALSE(copied.value[0].second.isStringReference());
+
+  parser.setStringPolicy(Parser::STORE_STRING_AS_REFERENCE);
+  parser.setShapeMemoization(1);
+  FieldByFieldDeserializer field_by_field;
+  // the second message has the same shape, and it is decoded by the shape cache
+  for (int i = 0; i < 2; i++) {
+    FlatMessage referenced;
+    parser.deserialize(buffer, &referenced, &deserializer);
+    ExpectSameFlatMessages(referenced, copied);
+    for (size_t j = 0; j < 3; j++) {
+      EXPECT_TRUE(referenced.value[j].second.isStringReference());
+      EXPECT_TRUE(inBuffer(referenced.value[j].second));
+    }
+    // a copy of a reference is a reference; a string assigned later is a copy
+    FlatMessage other = referenced;
+    EXPECT_TRUE(other.value[2].second.isStringReference());
+    EXPECT_EQ(other.value[2].second.extract<std::string>(), "b");
+    other.value[2].second = std::string("c");
+    EXPECT_FALSE(other.value[2].second.isStringReference());
+    EXPECT_EQ(referenced.value[2].second.extract<std::string>(), "b");
+  }
+  EXPECT_EQ(parser.shapeCacheHits(), 1u);
+
+  // the default Deserializer::deserializeStringView() doesn't return views of the buffer
+  FlatMessage from_default;
+  parser.deserialize(buffer, &from_default, &field_by_field);
+  ExpectSameFlatMessages(from_default, copied);
+  EXPECT_FALSE(from_default.value[0].second.isStringReference());
+
+  std::vector<uint8_t> ros_buffer = {3, 0, 0, 0, 'a', 'b', 'c', 9, 0, 0, 0};
+  ROS_Deserializer ros_deserializer;
+  ros_deserializer.init(Span<const uint8_t>(ros_buffer));
+  const std::string_view abc = ros_deserializer.deserializeStringView();
+  EXPECT_EQ(abc, "abc");
+  EXPECT_EQ(abc.data(), reinterpret_cast<const char*>(ros_buffer.data() + 4));
+  EXPECT_THROW((void)ros_deserializer.deserializeStringView(), std::runtime_error);
+}
+
+TEST(FixedLayout, SameValuesAsFieldByField) {
+  Parser parser("topic", ROSType("my_pkg/Test"), fixed_layout_def);
+
+  const std::vector<nanocdr::CdrHeader> headers = {
+      {nanocdr::Endianness::CDR_LITTLE_ENDIAN, nanocdr::EncodingFlag::PLAIN_CDR, nanocdr::CdrVersion::DDS_CDR},
+      {nanocdr::Endianness::CDR_BIG_ENDIAN, nanocdr::EncodingFlag::PLAIN_CDR, nanocdr::CdrVersion::DDS_CDR},
+  };
+  for (const auto& header : headers) {
+    nanocdr::Encoder encoder(header);
+    EncodeFixedLayoutMessage([&](auto value) { encoder.encode(value); });
+    const auto encoded = encoder.encodedBuffer();
+    Span<const uint8_t> buffer(encoded.data(), encoded.size());
+
+    FlatMessage fast;
+    NanoCDR_Deserializer fast_deserializer;
+    ASSERT_TRUE(parser.deserialize(buffer, &fast, &fast_deserializer));
+    EXPECT_EQ(fast_deserializer.bytesLeft(), 0u);
+
+    FlatMessage slow;
+    FieldByFieldDeserializer slow_deserializer;
+    ASSERT_TRUE(parser.deserialize(buffer, &slow, &slow_deserializer));
+
+    ExpectSameFlatMessages(fast, slow);
+    ASSERT_EQ(fast.value.size(), 1u + 2 * 5 + 2 + 7 + 36);
+    EXPECT_EQ(fast.value[3].first.toStdString(), "topic/samples[0]/z[0]");
+    EXPECT_EQ(fast.value[10].second.convert<uint16_t>(), 1002);
+    EXPECT_EQ(fast.value.back().first.toStdString(), "topic/pose/covariance[35]");
+    EXPECT_EQ(fast.value.back().second.convert<double>(), 0.5 * 42);
+
+    // a truncated buffer is rejected
+    Span<const uint8_t> truncated(encoded.data(), encoded.size() - 1);
+    EXPECT_THROW(parser.deserialize(truncated, &fast, &fast_deserializer), std::runtime_error);
+  }
+
+  // ROS1: no padding
+  std::vector<uint8_t> ros1_buffer;
+  EncodeFixedLayoutMessage([&](auto value) {
+    const auto* ptr = reinterpret_cast<const uint8_t*>(&value);
+    ros1_buffer.insert(ros1_buffer.end(), ptr, ptr + sizeof(value));
+  });
+  FlatMessage ros1_flat;
+  ROS_Deserializer ros1_deserializer;
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(ros1_buffer.data(), ros1_buffer.size()), &ros1_flat,
+                                 &ros1_deserializer));
+  EXPECT_EQ(ros1_deserializer.bytesLeft(), 0u);
+  ASSERT_EQ(ros1_flat.value.size(), 1u + 2 * 5 + 2 + 7 + 36);
+  EXPECT_EQ(ros1_flat.value[12].second.convert<double>(), -2.25);
+  EXPECT_EQ(ros1_flat.value.back().second.convert<double>(), 0.5 * 42);
+}
+
+TEST(FixedLayout, RunsOfFixedFieldsAfterAString) {
+  const char* def =
+      "string frame_id\n"
+      "float64 x\n"
+      "float64 y\n"
+      "uint8 flag\n"
+      "geometry_msgs/Point point\n"
+      "int32 count\n"
+      "string[] names\n"
+      "uint16 last\n"
+      "================================================================================\n"
+      "MSG: geometry_msgs/Point\n"
+      "float64 x\n"
+      "float64 y\n"
+      "float64 z\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  // x, y, flag, point and count are a single run
+  const DecodeProgram& program = *parser.getDecodeProgram();
+  const auto& root_ops = program.ops;
+  const DecodeOp& x_op = root_ops[program.root_entry + 1];
+  ASSERT_NE(x_op.run, DecodeOp::NO_TARGET);
+  EXPECT_EQ(program.fixed_structs[x_op.run].members.size(), 5u);
+  // strings and sequences are empty, the values are not padded
+  EXPECT_EQ(program.min_size, 4u + 8 + 8 + 1 + 24 + 4 + 4 + 2);
+
+  auto encode = [](auto& encoder) {
+    encoder.encode(std::string("odom"));
+    encoder.encode(double(1.5));
+    encoder.encode(double(-2.5));
+    encoder.encode(uint8_t(7));
+    encoder.encode(double(10));
+    encoder.encode(double(20));
+    encoder.encode(double(30));
+    encoder.encode(int32_t(-4));
+    encoder.encode(uint32_t(2));
+    encoder.encode(std::string("a"));
+    encoder.encode(std::string("bc"));
+    encoder.encode(uint16_t(99));
+  };
+
+  parser.setShapeMemoization(2);
+  for (auto endianness : {nanocdr::Endianness::CDR_LITTLE_ENDIAN, nanocdr::Endianness::CDR_BIG_ENDIAN}) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{endianness});
+    encode(encoder);
+    const auto encoded = encoder.encodedBuffer();
+    Span<const uint8_t> buffer(encoded.data(), encoded.size());
+
+    FlatMessage slow;
+    FieldByFieldDeserializer slow_deserializer;
+    ASSERT_TRUE(parser.deserialize(buffer, &slow, &slow_deserializer));
+    ASSERT_EQ(slow.value.size(), 11u);
+    EXPECT_EQ(slow.value[5].first.toStdString(), "topic/point/y");
+    EXPECT_EQ(slow.value[5].second.convert<double>(), 20.0);
+
+    // the second message is replayed from the shape cache
+    NanoCDR_Deserializer fast_deserializer;
+    for (int i = 0; i < 2; i++) {
+      FlatMessage fast;
+      ASSERT_TRUE(parser.deserialize(buffer, &fast, &fast_deserializer));
+      EXPECT_EQ(fast_deserializer.bytesLeft(), 0u);
+      ExpectSameFlatMessages(fast, slow);
+    }
+
+    // every truncation is rejected, by the minimum size or by the bounds checks
+    for (size_t size = 0; size < encoded.size(); size++) {
+      FlatMessage truncated;
+      EXPECT_THROW(parser.deserialize(Span<const uint8_t>(encoded.data(), size), &truncated, &fast_deserializer),
+                   std::runtime_error)
+          << "size " << size;
+    }
+  }
+
+  // ROS1: no padding
+  Ros1Encoder ros1_encoder;
+  encode(ros1_encoder);
+  const std::vector<uint8_t>& ros1_buffer = ros1_encoder.buffer;
+
+  FlatMessage ros1_flat;
+  ROS_Deserializer ros1_deserializer;
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(ros1_buffer), &ros1_flat, &ros1_deserializer));
+  EXPECT_EQ(ros1_deserializer.bytesLeft(), 0u);
+  ASSERT_EQ(ros1_flat.value.size(), 11u);
+  EXPECT_EQ(ros1_flat.value[3].second.convert<int>(), 7);
+  EXPECT_EQ(ros1_flat.value[7].second.convert<int>(), -4);
+  EXPECT_EQ(ros1_flat.value[10].second.convert<int>(), 99);
+  EXPECT_THROW(parser.deserialize(Span<const uint8_t>(ros1_buffer.data(), program.min_size - 1), &ros1_flat,
+                                  &ros1_deserializer),
+               std::runtime_error);
+}
+
+TEST(FixedLayout, LargeArraysFollowMaxArrayPolicy) {
+  Parser parser("topic", ROSType("my_pkg/Test"), fixed_layout_def);
+  parser.setMaxArrayPolicy(Parser::DISCARD_LARGE_ARRAYS, 10);
+
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  EncodeFixedLayoutMessage([&](auto value) { encoder.encode(value); });
+  const auto encoded = encoder.encodedBuffer();
+
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  EXPECT_FALSE(parser.deserialize(Span<const uint8_t>(encoded.data(), encoded.size()), &flat, &deserializer));
+  EXPECT_EQ(flat.value.size(), 1u + 2 * 5 + 2 + 7);
+}
+
+namespace {
+
+// Counts the events received from the walker
+class ArrayEventCounter final : public MessageWriter {
+ public:
+  void writeValue(const FieldLeaf&, const Variant&) override {
+    values++;
+  }
+  void writeString(const FieldLeaf&, const std::string&) override {}
+  void writeEnum(const FieldLeaf&, int32_t, const std::string&) override {}
+  void writeArray(const FieldLeaf& leaf, BuiltinType type, Span<const uint8_t> raw, size_t count) override {
+    arrays++;
+    MessageWriter::writeArray(leaf, type, raw, count);
+  }
+  size_t values = 0;
+  size_t arrays = 0;
+};
+
+}  // namespace
+
+TEST(BulkArray, SwappedAndTruncated) {
+  Parser parser("topic", ROSType("my_pkg/Test"), "float32[] ranges\nint16[4] fixed\ntime[] stamps\n");
+  parser.setMaxArrayPolicy(Parser::KEEP_LARGE_ARRAYS, 100);
+
+  for (auto endianness : {nanocdr::Endianness::CDR_LITTLE_ENDIAN, nanocdr::Endianness::CDR_BIG_ENDIAN}) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{endianness, nanocdr::EncodingFlag::PLAIN_CDR});
+    encoder.encode(uint32_t(150));
+    for (int i = 0; i < 150; i++) {
+      encoder.encode(float(i) * 0.5f);
+    }
+    for (int i = 0; i < 4; i++) {
+      encoder.encode(int16_t(-i));
+    }
+    encoder.encode(uint32_t(2));
+    for (uint32_t i = 0; i < 2; i++) {
+      encoder.encode(uint32_t(100 + i));
+      encoder.encode(uint32_t(200 + i));
+    }
+    const auto encoded = encoder.encodedBuffer();
+    Span<const uint8_t> buffer(encoded.data(), encoded.size());
+
+    FlatMessage flat;
+    NanoCDR_Deserializer deserializer;
+    EXPECT_FALSE(parser.deserialize(buffer, &flat, &deserializer));
+    EXPECT_EQ(deserializer.bytesLeft(), 0u);
+
+    // only the first max_array_size elements are stored
+    ASSERT_EQ(flat.value.size(), 100u + 4 + 2);
+    EXPECT_EQ(flat.value[99].first.toStdString(), "topic/ranges[99]");
+    EXPECT_EQ(flat.value[99].second.convert<float>(), 49.5f);
+    EXPECT_EQ(flat.value[103].first.toStdString(), "topic/fixed[3]");
+    EXPECT_EQ(flat.value[103].second.convert<int16_t>(), -3);
+    EXPECT_EQ(flat.value[105].first.toStdString(), "topic/stamps[1]");
+    EXPECT_EQ(flat.value[105].second.extract<Time>().sec, 101u);
+    EXPECT_EQ(flat.value[105].second.extract<Time>().nsec, 201u);
+
+    // one event per array, expanded by the default implementation
+    ArrayEventCounter counter;
+    NanoCDR_Deserializer deserializer2;
+    parser.walkSchema(buffer, &deserializer2, &counter);
+    EXPECT_EQ(counter.arrays, 3u);
+    EXPECT_EQ(counter.values, 106u);
+  }
+}
+
+TEST(BulkArray, SwapKernelsMatchScalarSwap) {
+  // every length of tail after the 16 and 32 bytes blocks, from unaligned buffers
+  std::vector<uint8_t> src(300);
+  for (size_t i = 0; i < src.size(); i++) {
+    src[i] = static_cast<uint8_t>(i * 7 + 3);
+  }
+  for (size_t size : {1, 2, 4, 8}) {
+    for (size_t offset = 0; offset < 3; offset++) {
+      for (size_t count = 0; count <= 33; count++) {
+        const uint8_t* in = src.data() + offset;
+        std::vector<uint8_t> expected(count * size);
+        for (size_t i = 0; i < count; i++) {
+          for (size_t b = 0; b < size; b++) {
+            expected[i * size + b] = in[i * size + size - 1 - b];
+          }
+        }
+        std::vector<uint8_t> out(count * size + 1);
+        details::swapBytesInBulk(out.data() + 1, in, count, size);
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), out.begin() + 1)) << size << " " << count;
+
+        // in place
+        std::vector<uint8_t> inplace(in, in + count * size);
+        details::swapBytesInBulk(inplace.data(), inplace.data(), count, size);
+        EXPECT_EQ(inplace, expected) << size << " " << count;
+      }
+    }
+  }
+  EXPECT_THROW(details::swapBytesInBulk(src.data(), src.data(), 1, 3), std::runtime_error);
+  const std::string implementation = details::swapBytesImplementation();
+  EXPECT_FALSE(implementation.empty());
+}
+
+TEST(BulkArray, ReadArrayInto) {
+  for (auto endianness : {nanocdr::Endianness::CDR_LITTLE_ENDIAN, nanocdr::Endianness::CDR_BIG_ENDIAN}) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{endianness, nanocdr::EncodingFlag::PLAIN_CDR});
+    encoder.encode(uint8_t(1));
+    std::vector<double> doubles;
+    for (int i = 0; i < 37; i++) {
+      doubles.push_back(i * 1.25 - 10);
+    }
+    encoder.encode(doubles);
+    encoder.encode(std::array<int16_t, 3>{-1, 2, -3});
+    encoder.encode(uint32_t(7));
+    encoder.encode(uint32_t(8));
+    const auto encoded = encoder.encodedBuffer();
+    Span<const uint8_t> buffer(encoded.data(), encoded.size());
+
+    NanoCDR_Deserializer deserializer;
+    deserializer.init(buffer);
+    EXPECT_EQ(deserializer.read<uint8_t>(), 1);
+    ASSERT_EQ(deserializer.read<uint32_t>(), doubles.size());
+    std::vector<double> decoded(doubles.size());
+    deserializer.readArrayInto(FLOAT64, decoded.data(), decoded.size());
+    EXPECT_EQ(decoded, doubles);
+    int16_t shorts[3];
+    deserializer.readArrayInto(INT16, shorts, 3);
+    EXPECT_EQ(shorts[2], -3);
+    Time stamp;
+    deserializer.readArrayInto(TIME, &stamp, 1);
+    EXPECT_EQ(stamp.sec, 7u);
+    EXPECT_EQ(stamp.nsec, 8u);
+    EXPECT_EQ(deserializer.bytesLeft(), 0u);
+    EXPECT_THROW(deserializer.readArrayInto(UINT8, shorts, 1), std::runtime_error);
+
+    // nanocdr decodes the sequences in bulk too
+    nanocdr::Decoder decoder(nanocdr::ConstBuffer(encoded.data(), encoded.size()));
+    uint8_t first = 0;
+    std::vector<double> sequence;
+    std::array<int16_t, 3> array{};
+    decoder.decode(first);
+    decoder.decode(sequence);
+    decoder.decode(array);
+    EXPECT_EQ(sequence, doubles);
+    EXPECT_EQ(array[0], -1);
+    EXPECT_EQ(array[1], 2);
+  }
+}
+
+TEST(SkipNotStored, LargeArraysOfStructs) {
+  const char* def =
+      "uint8 flag\n"
+      "Item[] items\n"
+      "geometry_msgs/Point[] points\n"
+      "uint32 tail\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Item\n"
+      "string name\n"
+      "geometry_msgs/Point p\n"
+      "int32[] values\n"
+      "================================================================================\n"
+      "MSG: geometry_msgs/Point\n"
+      "float64 x\n"
+      "float64 y\n"
+      "float64 z\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  encoder.encode(uint8_t(1));
+  encoder.encode(uint32_t(3));
+  for (int i = 0; i < 3; i++) {
+    encoder.encode(std::string("item_") + std::to_string(i));
+    for (int j = 0; j < 3; j++) {
+      encoder.encode(double(i + j));
+    }
+    encoder.encode(uint32_t(1));
+    encoder.encode(int32_t(-i));
+  }
+  encoder.encode(uint32_t(3));
+  for (int i = 0; i < 9; i++) {
+    encoder.encode(double(i));
+  }
+  encoder.encode(uint32_t(42));
+  const auto encoded = encoder.encodedBuffer();
+  Span<const uint8_t> buffer(encoded.data(), encoded.size());
+
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+
+  parser.setMaxArrayPolicy(Parser::DISCARD_LARGE_ARRAYS, 2);
+  EXPECT_FALSE(parser.deserialize(buffer, &flat, &deserializer));
+  EXPECT_EQ(deserializer.bytesLeft(), 0u);
+  ASSERT_EQ(flat.value.size(), 2u);
+  EXPECT_EQ(flat.value[1].first.toStdString(), "topic/tail");
+  EXPECT_EQ(flat.value[1].second.convert<uint32_t>(), 42u);
+
+  parser.setMaxArrayPolicy(Parser::KEEP_LARGE_ARRAYS, 2);
+  EXPECT_FALSE(parser.deserialize(buffer, &flat, &deserializer));
+  EXPECT_EQ(deserializer.bytesLeft(), 0u);
+  ASSERT_EQ(flat.value.size(), 1u + 2 * 5 + 2 * 3 + 1);
+  EXPECT_EQ(flat.value[10].first.toStdString(), "topic/items[1]/values[0]");
+  EXPECT_EQ(flat.value[10].second.convert<int32_t>(), -1);
+  EXPECT_EQ(flat.value[16].first.toStdString(), "topic/points[1]/z");
+  EXPECT_EQ(flat.value[16].second.convert<double>(), 5.0);
+  EXPECT_EQ(flat.value.back().second.convert<uint32_t>(), 42u);
+
+  // corrupted length of a string that is not stored
+  std::vector<uint8_t> corrupted(encoded.data(), encoded.data() + encoded.size());
+  corrupted[15] = 0x7f;  // most significant byte of the length of items[0].name
+  parser.setMaxArrayPolicy(Parser::DISCARD_LARGE_ARRAYS, 2);
+  EXPECT_THROW(parser.deserialize(Span<const uint8_t>(corrupted.data(), corrupted.size()), &flat, &deserializer),
+               std::runtime_error);
+}
+
+TEST(FieldFilter, StoresOnlySelectedFields) {
+  Parser parser("topic", ROSType("my_pkg/Test"), fixed_layout_def);
+
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  EncodeFixedLayoutMessage([&](auto value) { encoder.encode(value); });
+  const auto encoded = encoder.encodedBuffer();
+  Span<const uint8_t> buffer(encoded.data(), encoded.size());
+
+  FlatMessage all;
+  NanoCDR_Deserializer deserializer;
+  ASSERT_TRUE(parser.deserialize(buffer, &all, &deserializer));
+
+  parser.setFieldFilter({"flag", "samples/z", "pose/pose/*/x", "**/w"});
+
+  FlatMessage filtered;
+  ASSERT_TRUE(parser.deserialize(buffer, &filtered, &deserializer));
+  EXPECT_EQ(deserializer.bytesLeft(), 0u);
+
+  FlatMessage expected;
+  for (const auto& entry : all.value) {
+    const std::string path = entry.first.toStdString();
+    if (path == "topic/flag" || path.find("/z[") != std::string::npos ||
+        path == "topic/pose/pose/position/x" || path == "topic/pose/pose/orientation/x" ||
+        path == "topic/pose/pose/orientation/w") {
+      expected.value.push_back(entry);
+    }
+  }
+  ASSERT_EQ(expected.value.size(), 1u + 2 * 3 + 3);
+  ExpectSameFlatMessages(filtered, expected);
+
+  // the selected fields are found with or without the fixed layout
+  FlatMessage slow;
+  FieldByFieldDeserializer slow_deserializer;
+  ASSERT_TRUE(parser.deserialize(buffer, &slow, &slow_deserializer));
+  ExpectSameFlatMessages(slow, expected);
+
+  // a whole struct
+  parser.setFieldFilter({"/pose/pose/"});
+  ASSERT_TRUE(parser.deserialize(buffer, &filtered, &deserializer));
+  ASSERT_EQ(filtered.value.size(), 7u);
+  EXPECT_EQ(filtered.value[0].first.toStdString(), "topic/pose/pose/position/x");
+
+  std::ostringstream warnings;
+  parser.setWarningsStream(&warnings);
+  parser.setFieldFilter({"flag", "pose/not_a_field"});
+  EXPECT_NE(warnings.str().find("pose/not_a_field"), std::string::npos);
+  ASSERT_TRUE(parser.deserialize(buffer, &filtered, &deserializer));
+  ASSERT_EQ(filtered.value.size(), 1u);
+
+  EXPECT_THROW(parser.setFieldFilter({"samples[0]/x"}), std::runtime_error);
+
+  // no filter
+  parser.setFieldFilter({});
+  ASSERT_TRUE(parser.deserialize(buffer, &filtered, &deserializer));
+  ExpectSameFlatMessages(filtered, all);
+}
+
+TEST(FieldPredicates, RejectMessagesEarly) {
+  const char* def =
+      "my_pkg/Header header\n"
+      "uint8 status\n"
+      "float64[] data\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Header\n"
+      "uint32 seq\n"
+      "string frame_id\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+  parser.setMaxArrayPolicy(Parser::KEEP_LARGE_ARRAYS, 1000);
+
+  auto encode = [](const std::string& frame_id, uint8_t status) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(uint32_t(7));
+    encoder.encode(frame_id);
+    encoder.encode(status);
+    encoder.encode(uint32_t(200));
+    for (int i = 0; i < 200; i++) {
+      encoder.encode(double(i));
+    }
+    const auto encoded = encoder.encodedBuffer();
+    return std::vector<uint8_t>(encoded.data(), encoded.data() + encoded.size());
+  };
+  const auto accepted = encode("base_link", 2);
+  const auto wrong_frame = encode("map", 2);
+  const auto wrong_status = encode("base_link", 3);
+
+  parser.setFieldPredicates({"header/frame_id == \"base_link\"", "status < 3"});
+
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(accepted), &flat, &deserializer));
+  EXPECT_FALSE(flat.filtered_out);
+  EXPECT_EQ(flat.value.size(), 3u + 200);
+
+  EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(wrong_status), &flat, &deserializer));
+  EXPECT_TRUE(flat.filtered_out);
+  EXPECT_TRUE(flat.value.empty());
+
+  // the walk stops at the string, before the array
+  ArrayEventCounter counter;
+  bool filtered_out = false;
+  EXPECT_TRUE(parser.walkSchema(Span<const uint8_t>(wrong_frame), &deserializer, &counter, &filtered_out));
+  EXPECT_TRUE(filtered_out);
+  EXPECT_EQ(counter.values, 1u);
+  EXPECT_EQ(counter.arrays, 0u);
+  EXPECT_GT(deserializer.bytesLeft(), 200u * 8);
+
+  // the fields of the predicates don't need to be stored
+  parser.setFieldFilter({"data"});
+  EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(accepted), &flat, &deserializer));
+  EXPECT_FALSE(flat.filtered_out);
+  EXPECT_EQ(flat.value.size(), 200u);
+  EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(wrong_frame), &flat, &deserializer));
+  EXPECT_TRUE(flat.filtered_out);
+  parser.setFieldFilter({});
+
+  parser.setFieldPredicates({"status != 2"});
+  EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(accepted), &flat, &deserializer));
+  EXPECT_TRUE(flat.filtered_out);
+  EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(wrong_status), &flat, &deserializer));
+  EXPECT_FALSE(flat.filtered_out);
+
+  EXPECT_THROW(parser.setFieldPredicates({"data < 3"}), std::runtime_error);
+  EXPECT_THROW(parser.setFieldPredicates({"header == 1"}), std::runtime_error);
+  EXPECT_THROW(parser.setFieldPredicates({"status == \"ok\""}), std::runtime_error);
+  EXPECT_THROW(parser.setFieldPredicates({"header/frame_id == 3"}), std::runtime_error);
+  EXPECT_THROW(parser.setFieldPredicates({"not_a_field == 3"}), std::runtime_error);
+  EXPECT_THROW(parser.setFieldPredicates({"status 3"}), std::runtime_error);
+
+  parser.setFieldPredicates({});
+  EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(wrong_frame), &flat, &deserializer));
+  EXPECT_FALSE(flat.filtered_out);
+  EXPECT_EQ(flat.value.size(), 3u + 200);
+}
+
+TEST(ShapeMemoization, ReplaysRepeatedShapes) {
+  const char* def =
+      "string frame_id\n"
+      "geometry_msgs/Point[] points\n"
+      "string[] names\n"
+      "float32[] ranges\n"
+      "uint8[] image\n"
+      "uint32 tail\n"
+      "================================================================================\n"
+      "MSG: geometry_msgs/Point\n"
+      "float64 x\n"
+      "float64 y\n"
+      "float64 z\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+  Parser reference("topic", ROSType("my_pkg/Test"), def);
+  parser.setShapeMemoization(2);
+
+  auto encode = [](nanocdr::Endianness endianness, const std::string& frame_id, uint32_t num_points,
+                   const std::vector<std::string>& names, uint32_t image_size, int seed) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{endianness, nanocdr::EncodingFlag::PLAIN_CDR});
+    encoder.encode(frame_id);
+    encoder.encode(num_points);
+    for (uint32_t i = 0; i < num_points * 3; i++) {
+      encoder.encode(double(seed * 100 + i));
+    }
+    encoder.encode(uint32_t(names.size()));
+    for (const auto& name : names) {
+      encoder.encode(name);
+    }
+    encoder.encode(uint32_t(5));
+    for (int i = 0; i < 5; i++) {
+      encoder.encode(float(seed) + 0.25f * i);
+    }
+    encoder.encode(image_size);
+    for (uint32_t i = 0; i < image_size; i++) {
+      encoder.encode(uint8_t(seed + i));
+    }
+    encoder.encode(uint32_t(seed));
+    const auto encoded = encoder.encodedBuffer();
+    return std::vector<uint8_t>(encoded.data(), encoded.data() + encoded.size());
+  };
+  const auto little = nanocdr::Endianness::CDR_LITTLE_ENDIAN;
+  const auto big = nanocdr::Endianness::CDR_BIG_ENDIAN;
+
+  FlatMessage flat;
+  FlatMessage expected;
+  NanoCDR_Deserializer deserializer;
+  auto check = [&](const std::vector<uint8_t>& message, size_t hits, size_t misses) {
+    Span<const uint8_t> buffer(message);
+    const bool entire_message_parsed = reference.deserialize(buffer, &expected, &deserializer);
+    EXPECT_EQ(parser.deserialize(buffer, &flat, &deserializer), entire_message_parsed);
+    EXPECT_EQ(deserializer.bytesLeft(), 0u);
+    ExpectSameFlatMessages(flat, expected);
+    EXPECT_EQ(parser.shapeCacheHits(), hits);
+    EXPECT_EQ(parser.shapeCacheMisses(), misses);
+  };
+
+  check(encode(little, "base_link", 2, {"a", "bb"}, 300, 1), 0, 1);
+  // same lengths, different values
+  check(encode(little, "odometry1", 2, {"c", "dd"}, 300, 2), 1, 1);
+  check(encode(little, "map", 2, {"a", "bb"}, 300, 3), 1, 2);
+  check(encode(little, "base_link", 2, {"a", "bb"}, 300, 4), 2, 2);
+  check(encode(little, "base_link", 2, {"aa", "b"}, 300, 5), 2, 3);
+  check(encode(little, "base_link", 3, {}, 10, 6), 2, 4);
+  check(encode(big, "base_link", 3, {}, 10, 7), 2, 5);
+  check(encode(big, "base_link", 3, {}, 10, 8), 3, 5);
+  // the least recently used layout was dropped
+  check(encode(little, "map", 2, {"a", "bb"}, 300, 9), 3, 6);
+
+  // the other writers receive the same events
+  const auto message = encode(little, "map", 2, {"a", "bb"}, 300, 10);
+  ArrayEventCounter counter;
+  ArrayEventCounter expected_counter;
+  parser.walkSchema(Span<const uint8_t>(message), &deserializer, &counter);
+  reference.walkSchema(Span<const uint8_t>(message), &deserializer, &expected_counter);
+  EXPECT_EQ(parser.shapeCacheHits(), 4u);
+  EXPECT_EQ(counter.values, expected_counter.values);
+  EXPECT_EQ(counter.arrays, expected_counter.arrays);
+
+  // a different MaxArrayPolicy invalidates the layouts
+  parser.setMaxArrayPolicy(Parser::KEEP_LARGE_ARRAYS, 1000);
+  reference.setMaxArrayPolicy(Parser::KEEP_LARGE_ARRAYS, 1000);
+  check(encode(little, "map", 2, {"a", "bb"}, 300, 11), 4, 7);
+  check(encode(little, "map", 2, {"a", "bb"}, 300, 12), 5, 7);
+
+  // truncated message with a known shape
+  const auto truncated = encode(little, "map", 2, {"a", "bb"}, 300, 13);
+  EXPECT_THROW(parser.deserialize(Span<const uint8_t>(truncated.data(), truncated.size() - 1), &flat, &deserializer),
+               std::runtime_error);
+
+  // the path through a union depends on its discriminant
+  const char* idl = R"(
+    module my_pkg {
+      union Value switch (int32) { case 0: float number; case 1: string text; };
+      struct Test { Value value; };
+    };
+  )";
+  Parser union_parser("topic", ROSType("my_pkg/Test"), idl, DDS_IDL);
+  union_parser.setShapeMemoization(4);
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  encoder.encode(int32_t(0));
+  encoder.encode(float(1.5f));
+  const auto encoded = encoder.encodedBuffer();
+  EXPECT_TRUE(union_parser.deserialize(Span<const uint8_t>(encoded.data(), encoded.size()), &flat, &deserializer));
+  EXPECT_EQ(union_parser.shapeCacheMisses(), 0u);
+}
+
+TEST(DeserializeBatch, SameAsSequential) {
+  const char* def =
+      "string frame_id\n"
+      "float64[] values\n"
+      "uint8[] data\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  std::vector<std::vector<uint8_t>> messages;
+  for (int i = 0; i < 500; i++) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(std::string("frame_") + std::to_string(i % 7));
+    encoder.encode(uint32_t(i % 5));
+    for (int j = 0; j < i % 5; j++) {
+      encoder.encode(double(i * 10 + j));
+    }
+    encoder.encode(uint32_t(i % 3 == 0 ? 150 : 2));
+    for (int j = 0; j < (i % 3 == 0 ? 150 : 2); j++) {
+      encoder.encode(uint8_t(i + j));
+    }
+    const auto encoded = encoder.encodedBuffer();
+    messages.emplace_back(encoded.data(), encoded.data() + encoded.size());
+  }
+  std::vector<Span<const uint8_t>> buffers;
+  for (const auto& message : messages) {
+    buffers.emplace_back(message);
+  }
+
+  std::vector<FlatMessage> expected(messages.size());
+  NanoCDR_Deserializer deserializer;
+  for (size_t i = 0; i < messages.size(); i++) {
+    parser.deserialize(buffers[i], &expected[i], &deserializer);
+  }
+
+  ThreadPoolExecutor pool(4);
+  InlineExecutor inline_executor;
+  parser.setShapeMemoization(8);
+  for (Executor* executor : std::initializer_list<Executor*>{&pool, &inline_executor, &pool}) {
+    std::vector<FlatMessage> outputs(messages.size());
+    EXPECT_TRUE(
+        parser.deserializeBatch(Span<const Span<const uint8_t>>(buffers), Span<FlatMessage>(outputs), *executor));
+    for (size_t i = 0; i < messages.size(); i++) {
+      ExpectSameFlatMessages(outputs[i], expected[i]);
+    }
+  }
+  EXPECT_EQ(parser.shapeCacheHits() + parser.shapeCacheMisses(), 3 * messages.size());
+  EXPECT_GT(parser.shapeCacheHits(), 0u);
+
+  // errors are reported to the caller
+  std::vector<FlatMessage> outputs(messages.size());
+  std::vector<uint8_t> truncated(messages[10].begin(), messages[10].end() - 4);
+  buffers[10] = Span<const uint8_t>(truncated);
+  EXPECT_THROW(parser.deserializeBatch(Span<const Span<const uint8_t>>(buffers), Span<FlatMessage>(outputs), pool),
+               std::runtime_error);
+  EXPECT_THROW(parser.deserializeBatch(Span<const Span<const uint8_t>>(buffers), Span<FlatMessage>(outputs.data(), 3),
+                                       pool),
+               std::runtime_error);
+}
+
+TEST(TimeSeriesCollector, ColumnsByField) {
+  const char* def =
+      "my_pkg/Header header\n"
+      "uint8 status\n"
+      "float64[] data\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Header\n"
+      "uint32 seq\n"
+      "string frame_id\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  auto encode = [](uint32_t seq, const std::string& frame_id, uint8_t status, std::vector<double> data) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(seq);
+    encoder.encode(frame_id);
+    encoder.encode(status);
+    encoder.encode(static_cast<uint32_t>(data.size()));
+    for (double value : data) {
+      encoder.encode(value);
+    }
+    const auto encoded = encoder.encodedBuffer();
+    return std::vector<uint8_t>(encoded.data(), encoded.data() + encoded.size());
+  };
+
+  TimeSeriesCollector collector;
+  NanoCDR_Deserializer deserializer;
+  collector.collect(parser, Span<const uint8_t>(encode(1, "map", 0, {1.0, 2.0})), 0.1, &deserializer);
+  collector.collect(parser, Span<const uint8_t>(encode(2, "map", 1, {3.0, 4.0, 5.0})), 0.2, &deserializer);
+  collector.collect(parser, Span<const uint8_t>(encode(3, "odom", 2, {6.0, 7.0})), 0.3, &deserializer);
+
+  std::map<std::string, const TimeSeriesColumn*> columns;
+  for (const auto& column : collector.columns()) {
+    columns[column.name()] = &column;
+  }
+  ASSERT_EQ(columns.size(), 6u);
+
+  const auto& seq = *columns.at("topic/header/seq");
+  EXPECT_EQ(seq.type, TimeSeriesColumn::INT64);
+  EXPECT_EQ(seq.time, (std::vector<double>{0.1, 0.2, 0.3}));
+  EXPECT_EQ(seq.int_values, (std::vector<int64_t>{1, 2, 3}));
+  EXPECT_TRUE(seq.float_values.empty());
+
+  const auto& frame_id = *columns.at("topic/header/frame_id");
+  EXPECT_EQ(frame_id.type, TimeSeriesColumn::STRING);
+  ASSERT_EQ(frame_id.string_ids.size(), 3u);
+  EXPECT_EQ(frame_id.string_ids[0], frame_id.string_ids[1]);
+  EXPECT_EQ(collector.strings()[frame_id.string_ids[1]], "map");
+  EXPECT_EQ(collector.strings()[frame_id.string_ids[2]], "odom");
+
+  EXPECT_EQ(columns.at("topic/status")->int_values, (std::vector<int64_t>{0, 1, 2}));
+
+  const auto& data1 = *columns.at("topic/data[1]");
+  EXPECT_EQ(data1.type, TimeSeriesColumn::FLOAT64);
+  EXPECT_EQ(data1.float_values, (std::vector<double>{2.0, 4.0, 7.0}));
+  const auto& data2 = *columns.at("topic/data[2]");
+  EXPECT_EQ(data2.time, (std::vector<double>{0.2}));
+  EXPECT_EQ(data2.float_values, (std::vector<double>{5.0}));
+
+  // nothing is appended for the messages rejected by a predicate
+  parser.setFieldPredicates({"status < 3"});
+  collector.collect(parser, Span<const uint8_t>(encode(4, "map", 5, {8.0})), 0.4, &deserializer);
+  collector.collect(parser, Span<const uint8_t>(encode(5, "map", 0, {9.0})), 0.5, &deserializer);
+  EXPECT_EQ(seq.int_values, (std::vector<int64_t>{1, 2, 3, 5}));
+  EXPECT_EQ(frame_id.size(), 4u);
+  EXPECT_EQ(columns.at("topic/data[0]")->float_values, (std::vector<double>{1.0, 3.0, 6.0, 9.0}));
+  EXPECT_EQ(data1.size(), 3u);
+
+  collector.clear();
+  EXPECT_EQ(collector.columns().size(), 6u);
+  EXPECT_EQ(seq.size(), 0u);
+  EXPECT_TRUE(collector.strings().empty());
+}
+
+TEST(ArrowBatchWriter, ExportColumns) {
+  const char* def =
+      "my_pkg/Header header\n"
+      "float64[] data\n"
+      "uint8[] blob\n"
+      "my_pkg/Point[] points\n"
+      "bool flag\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Header\n"
+      "uint32 seq\n"
+      "string frame_id\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Point\n"
+      "float32 x\n"
+      "float32 y\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+  parser.setMaxArrayPolicy(Parser::KEEP_LARGE_ARRAYS, 16);
+  parser.setBlobPolicy(Parser::STORE_BLOB_AS_REFERENCE);
+
+  auto encode = [](uint32_t seq, const std::string& frame_id, std::vector<double> data, std::vector<uint8_t> blob,
+                   std::vector<std::pair<float, float>> points, bool flag) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(seq);
+    encoder.encode(frame_id);
+    encoder.encode(static_cast<uint32_t>(data.size()));
+    for (double value : data) {
+      encoder.encode(value);
+    }
+    encoder.encode(static_cast<uint32_t>(blob.size()));
+    for (uint8_t value : blob) {
+      encoder.encode(value);
+    }
+    encoder.encode(static_cast<uint32_t>(points.size()));
+    for (const auto& [x, y] : points) {
+      encoder.encode(x);
+      encoder.encode(y);
+    }
+    encoder.encode(flag);
+    const auto encoded = encoder.encodedBuffer();
+    return std::vector<uint8_t>(encoded.data(), encoded.data() + encoded.size());
+  };
+
+  const std::vector<uint8_t> large_blob(20, 7);
+  const std::vector<std::vector<uint8_t>> messages = {
+      encode(1, "map", {1.0, 2.0}, {1, 2, 3}, {{1.f, 2.f}}, true),
+      encode(2, "odom", {}, large_blob, {}, false),
+      encode(3, "map", {3.0, 4.0, 5.0}, {}, {{3.f, 4.f}, {5.f, 6.f}}, true),
+      encode(4, "rejected", {}, {}, {}, true),
+  };
+
+  ArrowBatchWriter writer(parser);
+  NanoCDR_Deserializer deserializer;
+  parser.setFieldPredicates({"header/seq < 4"});
+  for (const auto& message : messages) {
+    writer.append(Span<const uint8_t>(message), &deserializer);
+  }
+  EXPECT_EQ(writer.rows(), 3u);
+
+  ArrowSchema schema;
+  writer.exportSchema(&schema);
+  EXPECT_STREQ(schema.format, "+s");
+  EXPECT_STREQ(schema.name, "topic");
+  ASSERT_EQ(schema.n_children, 5);
+  EXPECT_STREQ(schema.children[0]->format, "+s");
+  EXPECT_STREQ(schema.children[0]->children[0]->format, "I");
+  EXPECT_STREQ(schema.children[0]->children[1]->format, "u");
+  EXPECT_STREQ(schema.children[1]->format, "+l");
+  EXPECT_STREQ(schema.children[1]->children[0]->format, "g");
+  EXPECT_STREQ(schema.children[2]->format, "vz");
+  EXPECT_STREQ(schema.children[3]->children[0]->format, "+s");
+  EXPECT_STREQ(schema.children[3]->children[0]->children[1]->name, "y");
+  EXPECT_STREQ(schema.children[4]->format, "b");
+  schema.release(&schema);
+  EXPECT_EQ(schema.release, nullptr);
+
+  ArrowArray batch;
+  writer.exportBatch(&batch);
+  EXPECT_EQ(writer.rows(), 0u);
+  ASSERT_EQ(batch.length, 3);
+  ASSERT_EQ(batch.n_children, 5);
+
+  auto buffer = [](const ArrowArray* array, int index) { return array->buffers[index]; };
+
+  const ArrowArray* header = batch.children[0];
+  const auto* seq = static_cast<const uint32_t*>(buffer(header->children[0], 1));
+  EXPECT_EQ(std::vector<uint32_t>(seq, seq + 3), (std::vector<uint32_t>{1, 2, 3}));
+  const auto* frame_offsets = static_cast<const int32_t*>(buffer(header->children[1], 1));
+  const auto* frame_chars = static_cast<const char*>(buffer(header->children[1], 2));
+  EXPECT_EQ(std::string(frame_chars + frame_offsets[1], frame_offsets[2] - frame_offsets[1]), "odom");
+  EXPECT_EQ(frame_offsets[3], 10);
+
+  const ArrowArray* data = batch.children[1];
+  const auto* data_offsets = static_cast<const int32_t*>(buffer(data, 1));
+  EXPECT_EQ(std::vector<int32_t>(data_offsets, data_offsets + 4), (std::vector<int32_t>{0, 2, 2, 5}));
+  ASSERT_EQ(data->children[0]->length, 5);
+  EXPECT_EQ(static_cast<const double*>(buffer(data->children[0], 1))[4], 5.0);
+
+  // the small values are inlined, the blob references the message
+  const ArrowArray* blob = batch.children[2];
+  ASSERT_EQ(blob->n_buffers, 5);
+  const auto* views = static_cast<const uint8_t*>(buffer(blob, 1));
+  int32_t view_length = 0;
+  memcpy(&view_length, views, 4);
+  EXPECT_EQ(view_length, 3);
+  EXPECT_EQ(views[6], 3);
+  memcpy(&view_length, views + 16, 4);
+  EXPECT_EQ(view_length, 20);
+  int32_t buffer_index = 0;
+  int32_t buffer_offset = 0;
+  memcpy(&buffer_index, views + 16 + 8, 4);
+  memcpy(&buffer_offset, views + 16 + 12, 4);
+  EXPECT_EQ(buffer_index, 1);
+  const auto* referenced = static_cast<const uint8_t*>(buffer(blob, 2 + buffer_index)) + buffer_offset;
+  EXPECT_GE(referenced, messages[1].data());
+  EXPECT_LT(referenced, messages[1].data() + messages[1].size());
+  EXPECT_EQ(std::vector<uint8_t>(referenced, referenced + 20), large_blob);
+  memcpy(&view_length, views + 32, 4);
+  EXPECT_EQ(view_length, 0);
+
+  const ArrowArray* points = batch.children[3];
+  const auto* points_offsets = static_cast<const int32_t*>(buffer(points, 1));
+  EXPECT_EQ(std::vector<int32_t>(points_offsets, points_offsets + 4), (std::vector<int32_t>{0, 1, 1, 3}));
+  const ArrowArray* point = points->children[0];
+  ASSERT_EQ(point->length, 3);
+  const auto* y = static_cast<const float*>(buffer(point->children[1], 1));
+  EXPECT_EQ(std::vector<float>(y, y + 3), (std::vector<float>{2.f, 4.f, 6.f}));
+
+  const auto flags = *static_cast<const uint8_t*>(buffer(batch.children[4], 1));
+  EXPECT_EQ(flags & 0x7, 0x5);
+  EXPECT_EQ(batch.children[4]->null_count, 0);
+
+  batch.release(&batch);
+  EXPECT_EQ(batch.release, nullptr);
+
+  // the writer can be reused; the fields that are not stored are null
+  parser.setFieldPredicates({});
+  parser.setFieldFilter({"header/frame_id"});
+  writer.append(Span<const uint8_t>(messages[0]), &deserializer);
+  writer.exportBatch(&batch);
+  ASSERT_EQ(batch.length, 1);
+  EXPECT_EQ(batch.children[0]->children[0]->null_count, 1);
+  EXPECT_EQ(batch.children[0]->children[1]->null_count, 0);
+  EXPECT_EQ(batch.children[4]->null_count, 1);
+  EXPECT_EQ(batch.children[1]->children[0]->length, 0);
+  batch.release(&batch);
+}
+
+TEST(CsvMessageWriter, RowsInFieldOrder) {
+  const char* def =
+      "string frame_id\n"
+      "uint8 status\n"
+      "time stamp\n"
+      "float64[] data\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  auto encode = [](const std::string& frame_id, uint8_t status, std::vector<double> data) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(frame_id);
+    encoder.encode(status);
+    encoder.encode(uint32_t(12));
+    encoder.encode(uint32_t(5000));
+    encoder.encode(static_cast<uint32_t>(data.size()));
+    for (double value : data) {
+      encoder.encode(value);
+    }
+    const auto encoded = encoder.encodedBuffer();
+    return std::vector<uint8_t>(encoded.data(), encoded.data() + encoded.size());
+  };
+
+  std::string csv;
+  CsvMessageWriter writer(&csv);
+  writer.setArrayColumns(2);
+  NanoCDR_Deserializer deserializer;
+  writer.append(parser, Span<const uint8_t>(encode("map", 0, {1.5, 0.1})), 0.5, &deserializer);
+  EXPECT_EQ(writer.columns(), 6u);
+  writer.append(parser, Span<const uint8_t>(encode("a,\"b\"", 1, {-2.0})), 1.0, &deserializer);
+  writer.append(parser, Span<const uint8_t>(encode("map", 2, {3.0, 4.0, 5.0})), 1.5, &deserializer);
+
+  EXPECT_EQ(csv,
+            "timestamp,topic/frame_id,topic/status,topic/stamp,topic/data[0],topic/data[1]\n"
+            "0.5,map,0,12.000005000,1.5,0.1\n"
+            "1,\"a,\"\"b\"\"\",1,12.000005000,-2,\n"
+            "1.5,map,2,12.000005000,3,4\n");
+  EXPECT_EQ(writer.droppedValues(), 1u);
+
+  // nothing is appended for the messages rejected by a predicate
+  parser.setFieldPredicates({"status < 3"});
+  csv.clear();
+  writer.append(parser, Span<const uint8_t>(encode("map", 5, {1.0})), 2.0, &deserializer);
+  EXPECT_TRUE(csv.empty());
+  writer.append(parser, Span<const uint8_t>(encode("odom", 0, {})), 2.5, &deserializer);
+  EXPECT_EQ(csv, "2.5,odom,0,12.000005000,,\n");
+
+  // the header is written before the first accepted message
+  std::string other;
+  CsvMessageWriter tab_writer(&other, '\t');
+  tab_writer.setArrayColumns(1);
+  tab_writer.append(parser, Span<const uint8_t>(encode("map", 5, {1.0})), 3.0, &deserializer);
+  EXPECT_TRUE(other.empty());
+  EXPECT_EQ(tab_writer.columns(), 0u);
+  tab_writer.append(parser, Span<const uint8_t>(encode("map", 1, {1.0})), 3.5, &deserializer);
+  EXPECT_EQ(other,
+            "timestamp\ttopic/frame_id\ttopic/status\ttopic/stamp\ttopic/data[0]\n"
+            "3.5\tmap\t1\t12.000005000\t1\n");
+
+  // the columns come from the FieldTree, not from the first message
+  parser.setFieldPredicates({});
+  std::string sized;
+  CsvMessageWriter sized_writer(&sized);
+  sized_writer.setArrayColumns(3);
+  sized_writer.append(parser, Span<const uint8_t>(encode("map", 0, {})), 4.0, &deserializer);
+  sized_writer.append(parser, Span<const uint8_t>(encode("map", 1, {1.0, 2.0})), 4.5, &deserializer);
+  EXPECT_EQ(sized,
+            "timestamp,topic/frame_id,topic/status,topic/stamp,topic/data[0],topic/data[1],topic/data[2]\n"
+            "4,map,0,12.000005000,,,\n"
+            "4.5,map,1,12.000005000,1,2,\n");
+  EXPECT_EQ(sized_writer.droppedValues(), 0u);
+}
+
+TEST(JsonMessageWriter, StreamsNestedValues) {
+  const char* def =
+      "my_pkg/Header header\n"
+      "float32[] data\n"
+      "int8[2] pair\n"
+      "my_pkg/Point[] points\n"
+      "string[] names\n"
+      "uint8[] empty\n"
+      "bool flag\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Header\n"
+      "uint32 seq\n"
+      "time stamp\n"
+      "string frame_id\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Point\n"
+      "float64 x\n"
+      "float64 y\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  encoder.encode(uint32_t(7));
+  encoder.encode(uint32_t(12));
+  encoder.encode(uint32_t(500));
+  encoder.encode(std::string("a\"b\n\x01"));
+  encoder.encode(uint32_t(2));
+  encoder.encode(1.5f);
+  encoder.encode(2.0f);
+  encoder.encode(int8_t(-1));
+  encoder.encode(int8_t(3));
+  encoder.encode(uint32_t(2));
+  for (double value : {1.0, 2.0, 3.25, 4.0}) {
+    encoder.encode(value);
+  }
+  encoder.encode(uint32_t(1));
+  encoder.encode(std::string("x"));
+  encoder.encode(uint32_t(0));
+  encoder.encode(uint8_t(1));
+  const auto encoded = encoder.encodedBuffer();
+  const std::vector<uint8_t> buffer(encoded.data(), encoded.data() + encoded.size());
+
+  const std::string expected =
+      R"({"header":{"seq":7,"stamp":{"secs":12,"nsecs":500},"frame_id":"a\"b\n\u0001"},)"
+      R"("data":[1.5,2.0],"pair":[-1,3],"points":[{"x":1.0,"y":2.0},{"x":3.25,"y":4.0}],)"
+      R"("names":["x"],"empty":[],"flag":true})";
+
+  NanoCDR_Deserializer deserializer;
+  std::string json;
+  // the second message has the same shape, and its events are replayed
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(parser.deserializeIntoJson(Span<const uint8_t>(buffer), &json, &deserializer));
+    EXPECT_EQ(json, expected);
+  }
+  // the elements of the arrays one by one
+  FieldByFieldDeserializer field_by_field;
+  ASSERT_TRUE(parser.deserializeIntoJson(Span<const uint8_t>(buffer), &json, &field_by_field));
+  EXPECT_EQ(json, expected);
+
+  // the fields excluded by the filter are omitted
+  parser.setFieldFilter({"header/seq", "points"});
+  ASSERT_TRUE(parser.deserializeIntoJson(Span<const uint8_t>(buffer), &json, &deserializer));
+  EXPECT_EQ(json, R"({"header":{"seq":7},"points":[{"x":1.0,"y":2.0},{"x":3.25,"y":4.0}]})");
+  parser.setFieldFilter({});
+
+  parser.deserializeIntoJson(Span<const uint8_t>(buffer), &json, &deserializer, 2);
+  const std::string pretty_header =
+      "{\n"
+      "  \"header\": {\n"
+      "    \"seq\": 7,\n"
+      "    \"stamp\": {\n"
+      "      \"secs\": 12,\n"
+      "      \"nsecs\": 500\n"
+      "    },\n";
+  EXPECT_EQ(json.compare(0, pretty_header.size(), pretty_header), 0);
+  EXPECT_NE(json.find("  \"empty\": [],\n  \"flag\": true\n}"), std::string::npos);
+  EXPECT_NE(json.find("  \"pair\": [\n    -1,\n    3\n  ],\n"), std::string::npos);
+}
+
+TEST(ParserJson, EncodesKeysInAnyOrder) {
+  if (!HasJsonSupport()) {
+    GTEST_SKIP() << "JSON support disabled in this build";
+  }
+
+  const char* def =
+      "my_pkg/Header header\n"
+      "int8[2] pair\n"
+      "my_pkg/Point[] points\n"
+      "string[] names\n"
+      "bool flag\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Header\n"
+      "uint32 seq\n"
+      "time stamp\n"
+      "string frame_id\n"
+      "================================================================================\n"
+      "MSG: my_pkg/Point\n"
+      "float64 x\n"
+      "float64 y\n";
+  Parser parser("topic", ROSType("my_pkg/Test"), def);
+  NanoCDR_Serializer serializer;
+  auto serialized = [&]() { return std::string(serializer.getBufferData(), serializer.getBufferSize()); };
+
+  nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+  encoder.encode(uint32_t(3));
+  encoder.encode(uint32_t(0));
+  encoder.encode(uint32_t(0));
+  encoder.encode(std::string("\xC3\xA9\n"));
+  encoder.encode(int8_t(0));
+  encoder.encode(int8_t(0));
+  encoder.encode(uint32_t(1));
+  encoder.encode(1.0);
+  encoder.encode(2.0);
+  encoder.encode(uint32_t(0));
+  encoder.encode(uint8_t(1));
+  const auto encoded = encoder.encodedBuffer();
+  const std::string expected(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+  // unordered and unknown keys, absent fields
+  ASSERT_TRUE(parser.serializeFromJson(R"( {"flag": true, "points": [{"y": 2, "x": 1.0}],
+                                            "unknown": {"a": [1, {"b": null}], "c": "}"},
+                                            "header": {"frame_id": "é\n", "seq": 3, "seq": 4}} )",
+                                       &serializer));
+  EXPECT_EQ(serialized(), expected);
+
+  // round trip of the output of deserializeIntoJson
+  NanoCDR_Deserializer deserializer;
+  std::string json;
+  ASSERT_TRUE(parser.deserializeIntoJson(Span<const uint8_t>(encoded.data(), encoded.size()), &json, &deserializer));
+  ASSERT_TRUE(parser.serializeFromJson(json, &serializer));
+  EXPECT_EQ(serialized(), expected);
+
+  EXPECT_THROW(parser.serializeFromJson(R"({"pair": [1]})", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson(R"({"pair": [1, 128]})", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson(R"({"header": {"seq": -1}})", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson(R"({"names": "x"})", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson(R"({"points": [{"x": 1}})", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson(R"({"flag": true} x)", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson("[]", &serializer), std::runtime_error);
+}
+
+TEST(ParserJson, FloatingPointValues) {
+  if (!HasJsonSupport()) {
+    GTEST_SKIP() << "JSON support disabled in this build";
+  }
+
+  Parser parser("topic", ROSType("my_pkg/Test"), "float32 single\nfloat64 double_value\n");
+  NanoCDR_Serializer serializer;
+  NanoCDR_Deserializer deserializer;
+  FlatMessage flat;
+  auto decode = [&](const std::string& json) {
+    parser.serializeFromJson(json, &serializer);
+    const auto* data = reinterpret_cast<const uint8_t*>(serializer.getBufferData());
+    EXPECT_TRUE(parser.deserialize(Span<const uint8_t>(data, serializer.getBufferSize()), &flat, &deserializer));
+    return std::make_pair(flat.value[0].second.extract<float>(), flat.value[1].second.extract<double>());
+  };
+
+  auto values = decode(R"({"single": NaN, "double_value": -Infinity})");
+  EXPECT_TRUE(std::isnan(values.first));
+  EXPECT_EQ(values.second, -std::numeric_limits<double>::infinity());
+
+  // out of the range of a float32: infinite, like a cast from float64
+  values = decode(R"({"single": -1e39, "double_value": 1e39})");
+  EXPECT_EQ(values.first, -std::numeric_limits<float>::infinity());
+  EXPECT_EQ(values.second, 1e39);
+  values = decode(R"({"single": 1e39, "double_value": Infinity})");
+  EXPECT_EQ(values.first, std::numeric_limits<float>::infinity());
+  EXPECT_EQ(values.second, std::numeric_limits<double>::infinity());
+
+  // only the spellings written by JsonMessageWriter
+  for (const char* token : {"inf", "-inf", "nan", "infinity", "-Infinityx", "+1", "-", ".5"}) {
+    EXPECT_THROW(parser.serializeFromJson(std::string(R"({"single": )") + token + "}", &serializer),
+                 std::runtime_error)
+        << token;
+  }
+  EXPECT_THROW(parser.serializeFromJson(R"({"double_value": 1e400})", &serializer), std::runtime_error);
+}
+
+TEST(ParserJson, EnumsAndUnionsByName) {
+  if (!HasJsonSupport()) {
+    GTEST_SKIP() << "JSON support disabled in this build";
+  }
+
+  const char* idl = R"(
+module TestModule {
+  enum Mode { IDLE, AUTO, MANUAL };
+  struct Velocity {
+    float64 linear;
+    float64 angular;
+  };
+  union Command switch(Mode) {
+    case AUTO: Velocity velocity;
+    case MANUAL: string text;
+  };
+  struct Request {
+    uint32 id;
+    Mode mode;
+    Command command;
+  };
+};
+)";
+  Parser parser("topic", ROSType("TestModule/Request"), idl, DDS_IDL);
+  NanoCDR_Serializer serializer;
+  auto serialized = [&]() { return std::string(serializer.getBufferData(), serializer.getBufferSize()); };
+  auto expected = [](uint32_t id, int32_t mode, int32_t discriminant, auto... values) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(id);
+    encoder.encode(mode);
+    encoder.encode(discriminant);
+    (encoder.encode(values), ...);
+    const auto encoded = encoder.encodedBuffer();
+    return std::string(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+  };
+
+  parser.serializeFromJson(R"({"command": {"velocity": {"angular": 0.5, "linear": 2}}, "mode": "AUTO", "id": 1})",
+                           &serializer);
+  EXPECT_EQ(serialized(), expected(1, 1, 1, 2.0, 0.5));
+
+  parser.serializeFromJson(R"({"id": 2, "mode": 2, "command": {"text": "hi"}})", &serializer);
+  EXPECT_EQ(serialized(), expected(2, 2, 2, std::string("hi")));
+
+  // the first case, with a default value
+  parser.serializeFromJson(R"({"id": 3, "command": null})", &serializer);
+  EXPECT_EQ(serialized(), expected(3, 0, 1, 0.0, 0.0));
+
+  // the union is decoded as the value of its active case
+  NanoCDR_Deserializer deserializer;
+  FlatMessage flat;
+  parser.serializeFromJson(R"({"mode": "MANUAL", "command": {"text": "stop"}})", &serializer);
+  const auto* data = reinterpret_cast<const uint8_t*>(serializer.getBufferData());
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(data, serializer.getBufferSize()), &flat, &deserializer));
+  ASSERT_EQ(flat.value.size(), 3u);
+  EXPECT_EQ(flat.value[1].second.convert<int32_t>(), 2);
+  EXPECT_EQ(flat.value[2].second.extract<std::string>(), "stop");
+
+  // round trip of the output of deserializeIntoJson, for both kinds of cases
+  auto roundTrip = [&](const char* input, const char* expected_json) {
+    parser.serializeFromJson(input, &serializer);
+    const std::string encoded = serialized();
+    std::string json;
+    ASSERT_TRUE(parser.deserializeIntoJson(
+        Span<const uint8_t>(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size()), &json, &deserializer));
+    EXPECT_EQ(json, expected_json);
+    parser.serializeFromJson(json, &serializer);
+    EXPECT_EQ(serialized(), encoded);
+  };
+  roundTrip(R"({"id": 4, "mode": "AUTO", "command": {"velocity": {"linear": 1.5, "angular": -1}}})",
+            R"({"id":4,"mode":1,"command":{"velocity":{"linear":1.5,"angular":-1.0}}})");
+  roundTrip(R"({"id": 5, "mode": "MANUAL", "command": {"text": "stop"}})",
+            R"({"id":5,"mode":2,"command":{"text":"stop"}})");
+
+  EXPECT_THROW(parser.serializeFromJson(R"({"mode": "FAST"})", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson(R"({"command": {"jump": 1}})", &serializer), std::runtime_error);
+  EXPECT_THROW(parser.serializeFromJson(R"({"command": {"text": "a", "velocity": {}}})", &serializer),
+               std::runtime_error);
+}
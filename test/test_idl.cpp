@@ -4,7 +4,10 @@
 #include <iomanip>
 #include <sstream>
 
+#include "rosx_introspection/arrow_batch_writer.hpp"
+#include "rosx_introspection/csv_message_writer.hpp"
 #include "rosx_introspection/idl_parser.hpp"
+#include "rosx_introspection/lazy_message_view.hpp"
 #include "rosx_introspection/ros_parser.hpp"
 
 using namespace RosMsgParser;
@@ -794,6 +797,52 @@ TEST(IDLDeserialize, WalkSchemaConsistency) {
   EXPECT_EQ(flat.value[3].first.toStdString(), "topic/qw");
 }
 
+// A user writer, used with both the virtual and the static walkSchema
+class PathRecorder final : public MessageWriter {
+ public:
+  void writeValue(const FieldLeaf& leaf, const Variant& value) override {
+    lines.push_back(leaf.toStdString() + "=" + std::to_string(value.convert<double>()));
+  }
+  void writeString(const FieldLeaf& leaf, const std::string& value) override {
+    lines.push_back(leaf.toStdString() + "=" + value);
+  }
+  void writeEnum(const FieldLeaf& leaf, int32_t, const std::string& name) override {
+    lines.push_back(leaf.toStdString() + "=" + name);
+  }
+  void beginStruct(const ROSField& field) override {
+    lines.push_back("begin " + field.name());
+  }
+  void endStruct() override {
+    lines.push_back("end");
+  }
+  std::vector<std::string> lines;
+};
+
+TEST(IDLDeserialize, WalkSchemaStaticTypes) {
+  Parser parser("topic", ROSType("TestModule/Pose"), DESER_SIMPLE_IDL, DDS_IDL);
+
+  NanoCDR_Serializer serializer;
+  serializer.reset();
+  for (int i = 0; i < 4; i++) {
+    serializer.serialize(FLOAT64, Variant(1.0 + i));
+  }
+  Span<const uint8_t> buffer(reinterpret_cast<const uint8_t*>(serializer.getBufferData()),
+                             serializer.getBufferSize());
+
+  NanoCDR_Deserializer deserializer;
+  PathRecorder static_writer;
+  ASSERT_TRUE((parser.walkSchema<NanoCDR_Deserializer, PathRecorder>(buffer, &deserializer, &static_writer)));
+
+  PathRecorder virtual_writer;
+  Deserializer* base_deserializer = &deserializer;
+  MessageWriter* base_writer = &virtual_writer;
+  ASSERT_TRUE(parser.walkSchema(buffer, base_deserializer, base_writer));
+
+  ASSERT_EQ(static_writer.lines.size(), 4u);
+  EXPECT_EQ(static_writer.lines[3], "topic/qw=4.000000");
+  EXPECT_EQ(static_writer.lines, virtual_writer.lines);
+}
+
 // Test struct inheritance deserialization
 static const char* DESER_INHERITANCE_IDL = R"(
 module TestModule {
@@ -1165,6 +1214,128 @@ TEST(IDLComparison, McapRoboticsInputs) {
       << "Deserialized more values than expected";
 }
 
+TEST(IDLDeserialize, LazyMessageView) {
+  const std::string base_path = "test/test_data/mcap/ims_msgs__RoboticsInputs";
+  std::string idl_text = readFile(base_path + ".idl");
+  auto cdr_data = readBinaryFile(base_path + ".cdr");
+  if (idl_text.empty() || cdr_data.empty()) {
+    GTEST_SKIP() << "Test data not found at " << base_path;
+  }
+
+  Parser parser("ims_msgs::RoboticsInputs", ROSType("ims_msgs/RoboticsInputs"), idl_text, DDS_IDL);
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  parser.deserialize(Span<const uint8_t>(cdr_data), &flat, &deserializer);
+  ASSERT_GT(flat.value.size(), 200u);
+
+  // Paths relative to the message, in the same order as the FlatMessage.
+  // The root is a keyed struct: they start with "[ArmID:0]/"
+  std::vector<std::string> paths;
+  for (const auto& [key, value] : flat.value) {
+    paths.push_back(key.toStdString().substr(std::string("ims_msgs::RoboticsInputs").size()));
+  }
+
+  // The first field doesn't require the rest of the message
+  LazyMessageView view(parser, Span<const uint8_t>(cdr_data), &deserializer);
+  ASSERT_TRUE(view.get<double>(paths[0]).has_value());
+  EXPECT_FALSE(view.finished());
+  EXPECT_LT(view.decodedCount(), flat.value.size());
+
+  // Fields read out of order: from the cache or resuming the decoding
+  const size_t middle = paths.size() / 2;
+  const auto middle_value = view.get<double>(paths[middle]);
+  ASSERT_TRUE(middle_value.has_value());
+  EXPECT_EQ(*middle_value, flat.value[middle].second.convert<double>()) << paths[middle];
+
+  // The deserializer can be used in between
+  parser.deserialize(Span<const uint8_t>(cdr_data), &flat, &deserializer);
+
+  for (size_t i = paths.size(); i-- > 0;) {
+    FieldLeaf leaf;
+    ASSERT_TRUE(view.resolve(paths[i], leaf)) << paths[i];
+    const auto value = view.get<double>(leaf);
+    ASSERT_TRUE(value.has_value()) << paths[i];
+    EXPECT_EQ(*value, flat.value[i].second.convert<double>()) << paths[i];
+  }
+  EXPECT_EQ(view.decodedCount(), flat.value.size());
+
+  EXPECT_FALSE(view.get<double>("not_a_field").has_value());
+
+  // A new message reuses the view
+  view.reset(Span<const uint8_t>(cdr_data));
+  EXPECT_EQ(view.decodedCount(), 0u);
+  EXPECT_EQ(view.get<double>(paths.back()), flat.value.back().second.convert<double>());
+}
+
+static const char* LAZY_VIEW_IDL = R"(
+module TestModule {
+  enum Mode { Idle, Running };
+  struct Item {
+    uint32 id;
+    string label;
+  };
+  struct LazyMsg {
+    Mode mode;
+    string name;
+    sequence<Item> items;
+    float64 last;
+  };
+};
+)";
+
+TEST(IDLDeserialize, LazyMessageViewStringsAndSequences) {
+  Parser parser("topic", ROSType("TestModule/LazyMsg"), LAZY_VIEW_IDL, DDS_IDL);
+
+  NanoCDR_Serializer serializer;
+  serializer.reset();
+  serializer.serialize(INT32, Variant(int32_t(1)));
+  serializer.serializeString("robot");
+  serializer.serializeUInt32(2);
+  serializer.serialize(UINT32, Variant(uint32_t(10)));
+  serializer.serializeString("first");
+  serializer.serialize(UINT32, Variant(uint32_t(20)));
+  serializer.serializeString("second");
+  serializer.serialize(FLOAT64, Variant(0.5));
+  std::vector<uint8_t> buffer(serializer.getBufferData(), serializer.getBufferData() + serializer.getBufferSize());
+
+  NanoCDR_Deserializer deserializer;
+  LazyMessageView view(parser, Span<const uint8_t>(buffer), &deserializer);
+
+  EXPECT_EQ(view.get<std::string>("name"), "robot");
+  EXPECT_EQ(view.get<int32_t>("mode"), 1);
+  EXPECT_EQ(view.get<std::string>("mode"), "Running");
+  EXPECT_EQ(view.get<uint32_t>("items[1]/id"), 20u);
+  EXPECT_FALSE(view.finished());
+  EXPECT_EQ(view.get<std::string_view>("items[0]/label"), "first");
+  EXPECT_EQ(view.get<double>("last"), 0.5);
+  EXPECT_FALSE(view.get<uint32_t>("items[2]/id").has_value());
+  EXPECT_FALSE(view.get<uint32_t>("items/id").has_value());
+  EXPECT_THROW(view.get<std::string>("last"), std::runtime_error);
+
+  // Only the requested fields are decoded: the other values are skipped
+  LazyMessageView last_only(parser, Span<const uint8_t>(buffer), &deserializer);
+  EXPECT_EQ(last_only.get<double>("last"), 0.5);
+  EXPECT_EQ(last_only.decodedCount(), 1u);
+
+  // the elements of the array that precede the requested one are met on the way
+  EXPECT_EQ(last_only.get<uint32_t>("items[1]/id"), 20u);
+  EXPECT_EQ(last_only.decodedCount(), 3u);
+  EXPECT_EQ(last_only.get<uint32_t>("items[0]/id"), 10u);
+  EXPECT_EQ(last_only.decodedCount(), 3u);
+  EXPECT_FALSE(last_only.get<uint32_t>("items[5]/id").has_value());
+  EXPECT_EQ(last_only.decodedCount(), 3u);
+
+  // a string_view stays valid while more strings are cached
+  LazyMessageView views(parser, Span<const uint8_t>(buffer), &deserializer);
+  const std::string_view first = views.get<std::string_view>("items[0]/label").value();
+  const std::string_view name = views.get<std::string_view>("name").value();
+  const std::string_view second = views.get<std::string_view>("items[1]/label").value();
+  EXPECT_EQ(views.get<std::string_view>("mode"), "Running");
+  EXPECT_EQ(first, "first");
+  EXPECT_EQ(name, "robot");
+  EXPECT_EQ(second, "second");
+}
+
 TEST(IDLParser, RealWorldDataTypes) {
   auto schema = ParseIDL("topic", ROSType("CommonTypes/ArmState"), REAL_WORLD_IDL);
 
@@ -1483,6 +1654,53 @@ TEST(IDLDeserialize, UnionWithDefaultCase) {
   EXPECT_EQ(flat.value[0].second.convert<uint32_t>(), 42u);
 }
 
+// Case labels far from each other, looked up without the dense table
+static const char* UNION_SPARSE_IDL = R"(
+module TestModule {
+  union SparseUnion switch(int64) {
+    case -5: int8 val_neg;
+    case 7: uint16 val_small;
+    case 1000000: float32 val_large;
+    default: int32 val_default;
+  };
+  struct SparseUnionMsg {
+    SparseUnion data;
+  };
+};
+)";
+
+TEST(IDLDeserialize, UnionWithSparseLabels) {
+  Parser parser("topic", ROSType("TestModule/SparseUnionMsg"), UNION_SPARSE_IDL, DDS_IDL);
+
+  const auto& program = *parser.getDecodeProgram();
+  ASSERT_EQ(program.unions.size(), 1u);
+  const DecodeUnion& compiled = program.unions[0];
+  ASSERT_EQ(compiled.cases.size(), 3u);
+  EXPECT_EQ(compiled.activeCase(-5).field->field_name, "val_neg");
+  EXPECT_EQ(compiled.activeCase(7).field->field_name, "val_small");
+  EXPECT_EQ(compiled.activeCase(1000000).field->field_name, "val_large");
+  EXPECT_EQ(compiled.activeCase(8).field->field_name, "val_default");
+  EXPECT_EQ(compiled.activeCase(-1000000).field->field_name, "val_default");
+
+  auto decode = [&](int64_t discriminant, BuiltinType type, Variant value) {
+    NanoCDR_Serializer serializer;
+    serializer.reset();
+    serializer.serialize(INT64, Variant(discriminant));
+    serializer.serialize(type, value);
+    std::vector<uint8_t> buffer(serializer.getBufferData(), serializer.getBufferData() + serializer.getBufferSize());
+    FlatMessage flat;
+    NanoCDR_Deserializer deserializer;
+    parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer);
+    EXPECT_EQ(flat.value.size(), 1u);
+    return flat.value.empty() ? 0.0 : flat.value[0].second.convert<double>();
+  };
+
+  EXPECT_EQ(decode(-5, INT8, Variant(int8_t(-3))), -3.0);
+  EXPECT_EQ(decode(7, UINT16, Variant(uint16_t(700))), 700.0);
+  EXPECT_EQ(decode(1000000, FLOAT32, Variant(2.5f)), 2.5);
+  EXPECT_EQ(decode(42, INT32, Variant(int32_t(-42))), -42.0);
+}
+
 // I1: @value() annotation on enum members (focused test)
 static const char* VALUE_ANNOTATION_ENUM_IDL = R"(
 module TestModule {
@@ -1608,8 +1826,8 @@ TEST(IDLDeserialize, EmptySequence) {
 }
 
 // Regression test for a SEGV when a DDS union's active case is a struct.
-// The field tree intentionally models a union as a single (childless) leaf
-// node, so walking the resolved case struct used to index a non-existent
+// The field tree used to model a union as a single (childless) leaf
+// node, so walking the resolved case struct indexed a non-existent
 // child node -> out-of-bounds read -> crash. Reproduces the real-world
 // "2025-10-01_17-13-01_Arm_DB2.3_DDS.mcap" RoboticsCommand/SynchronizedMove
 // crash in a minimal form. The deserialization must complete without crashing.
@@ -1665,6 +1883,77 @@ TEST(IDLDeserialize, UnionWithStructCase) {
   EXPECT_EQ(flat.value[0].second.convert<uint32_t>(), 7u);  // Command.id round-trips
 }
 
+static const char* DESER_UNION_CASE_NODES_IDL = R"(
+module TestModule {
+  struct MoveData {
+    int32 axis;
+  };
+  struct StopData {
+    float64 delay;
+  };
+  union Payload switch(int32) {
+    case 4:
+      StopData stop;
+    case 1:
+    case 2:
+      MoveData move;
+    case 3:
+      int32 code;
+    default:
+      MoveData other;
+  };
+  struct Command {
+    uint32 id;
+    Payload payload;
+  };
+};
+)";
+
+// The struct cases of a union are children of the union field, a node per case in the
+// order of declaration, also when a case has several labels.
+TEST(IDLDeserialize, UnionStructCaseNodes) {
+  Parser parser("cmd_topic", ROSType("TestModule/Command"), DESER_UNION_CASE_NODES_IDL, DDS_IDL);
+
+  const auto* payload = parser.getSchema()->field_tree.croot()->child(1);
+  ASSERT_EQ(payload->children().size(), 3u);
+  EXPECT_EQ(payload->child(0)->value()->name(), "stop");
+  EXPECT_EQ(payload->child(1)->value()->name(), "move");
+  EXPECT_EQ(payload->child(2)->value()->name(), "other");
+
+  auto encode = [](int32_t discriminant, int32_t axis) {
+    NanoCDR_Serializer serializer;
+    serializer.reset();
+    serializer.serialize(UINT32, Variant(uint32_t(7)));
+    serializer.serialize(INT32, Variant(discriminant));
+    serializer.serialize(INT32, Variant(axis));
+    return std::vector<uint8_t>(serializer.getBufferData(), serializer.getBufferData() + serializer.getBufferSize());
+  };
+
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  for (int32_t discriminant : {1, 2}) {
+    const auto buffer = encode(discriminant, 3);
+    ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer));
+    ASSERT_EQ(flat.value.size(), 2u);
+    EXPECT_EQ(flat.value[1].first.toStdString(), "cmd_topic/payload/move/axis");
+    EXPECT_EQ(flat.value[1].second.convert<int32_t>(), 3);
+  }
+
+  const auto buffer = encode(9, 5);
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer));
+  ASSERT_EQ(flat.value.size(), 2u);
+  EXPECT_EQ(flat.value[1].first.toStdString(), "cmd_topic/payload/other/axis");
+
+  std::string json;
+  ASSERT_TRUE(parser.deserializeIntoJson(Span<const uint8_t>(buffer), &json, &deserializer));
+  EXPECT_EQ(json, R"({"id":7,"payload":{"other":{"axis":5}}})");
+
+  // the members of a union case have no column
+  ArrowBatchWriter arrow(parser);
+  ASSERT_TRUE(arrow.append(Span<const uint8_t>(buffer), &deserializer));
+  EXPECT_EQ(arrow.rows(), 1u);
+}
+
 // DDS enum @value() compatibility: a @value(N) annotation sets the *display*
 // value to N while the value transmitted on the CDR wire stays the sequential
 // ordinal. ddsCompatValue() exposes the wire value used for matching.
@@ -1762,6 +2051,45 @@ TEST(IDLDeserialize, TwoConsecutiveUnsetOptionals) {
   EXPECT_EQ(flat.value[1].second.convert<uint32_t>(), 0xABCDu);
 }
 
+// A present XCDR1 optional member: its values are aligned relative to the beginning of
+// the member, not to the origin of the stream.
+static const char* DESER_PRESENT_OPTIONAL_IDL = R"(
+module M {
+  struct S {
+    uint32 a;
+    uint32 b;
+    @optional float64 value;
+    uint32 tail;
+  };
+};
+)";
+
+TEST(IDLDeserialize, PresentOptionalAlignedToMember) {
+  Parser parser("s", ROSType("M/S"), DESER_PRESENT_OPTIONAL_IDL, DDS_IDL);
+
+  std::vector<uint8_t> buffer = {
+      0x00, 0x01, 0x00, 0x00,  // encapsulation: PLAIN_CDR, little-endian
+      0x01, 0x00, 0x00, 0x00,  // a = 1
+      0x02, 0x00, 0x00, 0x00,  // b = 2
+      0x02, 0x00, 0x08, 0x00,  // value header: member_id=2, size=8
+  };
+  const double value = 2.5;
+  const auto* value_bytes = reinterpret_cast<const uint8_t*>(&value);
+  buffer.insert(buffer.end(), value_bytes, value_bytes + sizeof(value));  // origin + 12: not padded
+  buffer.insert(buffer.end(), {0x03, 0x00, 0x00, 0x00});                  // tail = 3
+
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer));
+  ASSERT_EQ(flat.value.size(), 4u);
+  EXPECT_DOUBLE_EQ(flat.value[2].second.convert<double>(), 2.5);
+  EXPECT_EQ(flat.value[3].second.convert<uint32_t>(), 3u);
+
+  // the next message starts again without member tracking
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer));
+  EXPECT_DOUBLE_EQ(flat.value[2].second.convert<double>(), 2.5);
+}
+
 // Multiple @key fields must all contribute to the path. Previously the single
 // key suffix overwrote, keeping only the last key (causing path collisions
 // between samples that differ only in an earlier key).
@@ -2054,3 +2382,359 @@ TEST(IDLKeyConvergence, NonKeyedSequenceUsesIndex) {
   EXPECT_EQ(paths[0], "p/items[0]/a");
   EXPECT_EQ(paths[1], "p/items[1]/a");
 }
+
+// XCDR2 extensibility: DHEADERs before the appendable and mutable types and before the arrays
+// of types that are not primitive, EMHEADERs before the members of the mutable types.
+static const char* DESER_XCDR2_IDL = R"(
+module X {
+  struct Point {
+    double x;
+    double y;
+  };
+  @final struct Stamp {
+    uint32 sec;
+    uint32 nanosec;
+  };
+  struct Sample {
+    Stamp stamp;
+    Point position;
+    sequence<Point> path;
+    sequence<string> names;
+    string label;
+  };
+  @mutable struct Config {
+    @id(10) uint32 rate;
+    string name;
+    @optional double gain;
+    Point origin;
+  };
+  @appendable struct Tag {
+    string text;
+  };
+  struct Tagged {
+    Tag tag;
+    sequence<string> names;
+    uint16 count;
+  };
+};
+)";
+
+// Little-endian XCDR2 stream. The DHEADERs are written as placeholders, patched once
+// the size of their value is known.
+class Xcdr2Stream {
+ public:
+  explicit Xcdr2Stream(uint8_t encapsulation) : bytes{0x00, encapsulation, 0x00, 0x00} {}
+
+  template <typename T>
+  void put(T value) {
+    align(std::min<size_t>(sizeof(T), 4));
+    const auto* ptr = reinterpret_cast<const uint8_t*>(&value);
+    bytes.insert(bytes.end(), ptr, ptr + sizeof(T));
+  }
+
+  void putString(const std::string& text) {
+    put(uint32_t(text.size() + 1));
+    bytes.insert(bytes.end(), text.begin(), text.end());
+    bytes.push_back(0);
+  }
+
+  // Write a DHEADER and return the offset to pass to close().
+  size_t open() {
+    put(uint32_t(0));
+    return bytes.size();
+  }
+
+  void close(size_t begin) {
+    const auto size = static_cast<uint32_t>(bytes.size() - begin);
+    memcpy(&bytes[begin - 4], &size, sizeof(size));
+  }
+
+  // EMHEADER with the size of the member in NEXTINT (length code 4).
+  size_t openMember(uint32_t id) {
+    put(uint32_t((4u << 28) | id));
+    return open();
+  }
+
+  void align(size_t size) {
+    while ((bytes.size() - 4) % size != 0) {
+      bytes.push_back(0);
+    }
+  }
+
+  std::vector<uint8_t> bytes;
+};
+
+static std::vector<std::string> flatLines(const FlatMessage& flat) {
+  std::vector<std::string> lines;
+  for (const auto& [leaf, value] : flat.value) {
+    if (value.getTypeID() == STRING) {
+      lines.push_back(leaf.toStdString() + "=" + value.extract<std::string>());
+    } else {
+      char number[32];
+      snprintf(number, sizeof(number), "%g", value.convert<double>());
+      lines.push_back(leaf.toStdString() + "=" + number);
+    }
+  }
+  return lines;
+}
+
+static std::vector<uint8_t> encodeDelimitedSample() {
+  Xcdr2Stream s(0x09);  // DELIMIT_CDR2, little-endian
+  const size_t root = s.open();
+  s.put(uint32_t(100));  // stamp is @final: no DHEADER
+  s.put(uint32_t(200));
+  const size_t position = s.open();
+  s.put(1.0);
+  s.put(2.0);
+  s.close(position);
+  const size_t path = s.open();
+  s.put(uint32_t(2));
+  size_t point = s.open();
+  s.put(3.0);
+  s.put(4.0);
+  s.close(point);
+  point = s.open();
+  s.put(5.0);
+  s.put(6.0);
+  s.put(uint32_t(77));  // member appended by a newer version of Point
+  s.close(point);
+  s.close(path);
+  const size_t names = s.open();
+  s.put(uint32_t(2));
+  s.putString("a");
+  s.putString("bc");
+  s.close(names);
+  s.putString("label");
+  s.put(uint32_t(99));  // member appended by a newer version of Sample
+  s.close(root);
+  return s.bytes;
+}
+
+TEST(IDLDeserialize, Xcdr2Delimited) {
+  Parser parser("s", ROSType("X/Sample"), DESER_XCDR2_IDL, DDS_IDL);
+  const std::vector<std::string> expected = {
+      "s/stamp/sec=100", "s/stamp/nanosec=200", "s/position/x=1", "s/position/y=2", "s/path[0]/x=3",
+      "s/path[0]/y=4",   "s/path[1]/x=5",       "s/path[1]/y=6",  "s/names[0]=a",   "s/names[1]=bc",
+      "s/label=label"};
+
+  const auto buffer = encodeDelimitedSample();
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer));
+  EXPECT_EQ(flatLines(flat), expected);
+  EXPECT_EQ(deserializer.bytesLeft(), 0u);
+
+  // the second message is replayed from the offsets of the first one
+  parser.setShapeMemoization(2);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer));
+    EXPECT_EQ(flatLines(flat), expected);
+  }
+  EXPECT_EQ(parser.shapeCacheHits(), 1u);
+
+  // the structs and the sequences that are not stored are skipped using their DHEADER
+  parser.setFieldFilter({"label"});
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(buffer), &flat, &deserializer));
+  EXPECT_EQ(flatLines(flat), std::vector<std::string>{"s/label=label"});
+
+  // a DHEADER larger than the message
+  auto truncated = buffer;
+  truncated.resize(truncated.size() - 8);
+  EXPECT_THROW(parser.deserialize(Span<const uint8_t>(truncated), &flat, &deserializer), std::runtime_error);
+}
+
+TEST(IDLDeserialize, Xcdr2Mutable) {
+  Parser parser("c", ROSType("X/Config"), DESER_XCDR2_IDL, DDS_IDL);
+
+  // The members are out of order, [gain] is absent and the member 99 is unknown.
+  Xcdr2Stream s(0x0b);  // PL_CDR2, little-endian
+  const size_t root = s.open();
+  s.put(uint32_t((5u << 28) | 11));  // name: NEXTINT is the length of the string
+  s.putString("cfg");
+  const size_t origin = s.openMember(13);
+  const size_t point = s.open();  // Point takes the extensibility of the encapsulation
+  s.put(uint32_t((3u << 28) | 1));
+  s.put(2.5);
+  s.put(uint32_t((3u << 28) | 0));
+  s.put(1.5);
+  s.close(point);
+  s.close(origin);
+  s.put(uint32_t((2u << 28) | 99));
+  s.put(uint32_t(7));
+  s.put(uint32_t((2u << 28) | 10));
+  s.put(uint32_t(30));
+  s.close(root);
+
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(s.bytes), &flat, &deserializer));
+  const std::vector<std::string> expected = {"c/rate=30", "c/name=cfg", "c/origin/x=1.5", "c/origin/y=2.5"};
+  EXPECT_EQ(flatLines(flat), expected);
+  EXPECT_EQ(deserializer.bytesLeft(), 0u);
+}
+
+TEST(IDLDeserialize, Xcdr2PlainWithAppendable) {
+  Parser parser("t", ROSType("X/Tagged"), DESER_XCDR2_IDL, DDS_IDL);
+
+  Xcdr2Stream s(0x07);  // PLAIN_CDR2, little-endian: the root is final
+  const size_t tag = s.open();
+  s.putString("hello");
+  s.close(tag);
+  const size_t names = s.open();
+  s.put(uint32_t(1));
+  s.putString("x");
+  s.close(names);
+  s.put(uint16_t(5));
+
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(s.bytes), &flat, &deserializer));
+  const std::vector<std::string> expected = {"t/tag/text=hello", "t/names[0]=x", "t/count=5"};
+  EXPECT_EQ(flatLines(flat), expected);
+}
+
+static const char* CSV_IDL = R"(
+module C {
+  enum Joint { J1, J2 };
+  struct Axis {
+    @key Joint joint;
+    double value;
+  };
+  struct Move {
+    int32 axis;
+  };
+  union Command switch (int32) {
+    case 0: float number;
+    case 1: Move move;
+  };
+  struct State {
+    @optional uint32 extra;
+    Command command;
+    sequence<Axis> axes;
+    uint16 status;
+  };
+};
+)";
+
+// The columns of the absent values are known before the first message; those under
+// a @key come from the first message.
+TEST(IDLDeserialize, CsvColumnsOfOptionalUnionAndKey) {
+  Parser parser("s", ROSType("C/State"), CSV_IDL, DDS_IDL);
+
+  Xcdr2Stream first(0x07);
+  first.put(uint8_t(0));  // no extra
+  first.put(int32_t(0));
+  first.put(1.5f);
+  const size_t axes = first.open();
+  first.put(uint32_t(2));
+  first.put(int32_t(0));
+  first.put(0.5);
+  first.put(int32_t(1));
+  first.put(0.25);
+  first.close(axes);
+  first.put(uint16_t(3));
+
+  Xcdr2Stream second(0x07);
+  second.put(uint8_t(1));
+  second.put(uint32_t(9));
+  second.put(int32_t(1));
+  second.put(int32_t(4));
+  const size_t one_axis = second.open();
+  second.put(uint32_t(1));
+  second.put(int32_t(1));
+  second.put(2.0);
+  second.close(one_axis);
+  second.put(uint16_t(5));
+
+  std::string csv;
+  CsvMessageWriter writer(&csv);
+  NanoCDR_Deserializer deserializer;
+  ASSERT_TRUE(writer.append(parser, Span<const uint8_t>(first.bytes), 1.0, &deserializer));
+  ASSERT_TRUE(writer.append(parser, Span<const uint8_t>(second.bytes), 2.0, &deserializer));
+  EXPECT_EQ(csv,
+            "timestamp,s/extra,s/command,s/command/move/axis,s/axes[J1]/value,s/axes[J2]/value,s/status\n"
+            "1,,1.5,,0.5,0.25,3\n"
+            "2,9,,4,,2,5\n");
+  EXPECT_EQ(writer.droppedValues(), 0u);
+}
+
+// Reading is sent by an older version of the type, that has only its first members.
+static const char* XCDR2_OLDER_VERSION_IDL = R"(
+module V {
+  @appendable struct Reading {
+    uint32 id;
+    double value;
+    uint16 flags;
+  };
+  struct Holder {
+    Reading reading;
+    string note;
+  };
+};
+)";
+
+TEST(IDLDeserialize, Xcdr2AppendableOlderVersion) {
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+
+  // at the root, the members that don't fit in the DHEADER are absent
+  Parser root_parser("r", ROSType("V/Reading"), XCDR2_OLDER_VERSION_IDL, DDS_IDL);
+  Xcdr2Stream root(0x09);  // DELIMIT_CDR2, little-endian
+  const size_t reading = root.open();
+  root.put(uint32_t(1));
+  root.put(2.5);
+  root.close(reading);
+  ASSERT_TRUE(root_parser.deserialize(Span<const uint8_t>(root.bytes), &flat, &deserializer));
+  EXPECT_EQ(flatLines(flat), (std::vector<std::string>{"r/id=1", "r/value=2.5"}));
+  EXPECT_EQ(deserializer.bytesLeft(), 0u);
+
+  // nested, the decoding continues after the DHEADER of the struct
+  Parser parser("h", ROSType("V/Holder"), XCDR2_OLDER_VERSION_IDL, DDS_IDL);
+  Xcdr2Stream s(0x09);
+  const size_t holder = s.open();
+  const size_t nested = s.open();
+  s.put(uint32_t(1));
+  s.close(nested);
+  s.putString("note");
+  s.close(holder);
+  const std::vector<std::string> expected = {"h/reading/id=1", "h/note=note"};
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(s.bytes), &flat, &deserializer));
+  EXPECT_EQ(flatLines(flat), expected);
+  EXPECT_EQ(deserializer.bytesLeft(), 0u);
+
+  // the same from a memoized layout
+  parser.setShapeMemoization(2);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(s.bytes), &flat, &deserializer));
+    EXPECT_EQ(flatLines(flat), expected);
+  }
+  EXPECT_EQ(parser.shapeCacheHits(), 1u);
+}
+
+TEST(IDLDeserialize, Xcdr2MinimumSize) {
+  // In XCDR2, the structs that are not final may be an older version, with only their DHEADER
+  Parser parser("r", ROSType("V/Reading"), XCDR2_OLDER_VERSION_IDL, DDS_IDL);
+  EXPECT_EQ(parser.getDecodeProgram()->min_size, 4u + 8 + 2);
+  EXPECT_EQ(parser.getDecodeProgram()->min_size_xcdr2, 4u);
+  Parser holder_parser("h", ROSType("V/Holder"), XCDR2_OLDER_VERSION_IDL, DDS_IDL);
+  EXPECT_EQ(holder_parser.getDecodeProgram()->min_size, 4u + 8 + 2 + 4);
+  EXPECT_EQ(holder_parser.getDecodeProgram()->min_size_xcdr2, 4u);
+
+  // shorter than the min_size of the current version of the type
+  Xcdr2Stream s(0x09);  // DELIMIT_CDR2, little-endian
+  const size_t reading = s.open();
+  s.put(uint32_t(1));
+  s.close(reading);
+  FlatMessage flat;
+  NanoCDR_Deserializer deserializer;
+  ASSERT_TRUE(parser.deserialize(Span<const uint8_t>(s.bytes), &flat, &deserializer));
+  EXPECT_EQ(flatLines(flat), std::vector<std::string>{"r/id=1"});
+
+  // without XCDR2, the same bytes are too short
+  std::vector<uint8_t> plain = s.bytes;
+  plain[1] = 0x01;  // CDR, little-endian
+  EXPECT_THROW(parser.deserialize(Span<const uint8_t>(plain), &flat, &deserializer), std::runtime_error);
+
+  // a DHEADER is always needed
+  EXPECT_THROW(parser.deserialize(Span<const uint8_t>(s.bytes.data(), 6), &flat, &deserializer), std::runtime_error);
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include "rosx_introspection/decode_program.hpp"
 #include "rosx_introspection/ros_message.hpp"
 #include "rosx_introspection/stringtree_leaf.hpp"
 
@@ -205,3 +206,56 @@ TEST(Parser, BoundedSequence) {
 
   EXPECT_FALSE(msg.field(3).isArray());
 }
+
+TEST(Parser, DecodeProgram) {
+  auto msg_parsed = ParseMessageDefinitions(pose_stamped_def, ROSType("geometry_msgs/PoseStamped"));
+  MessageSchema::Ptr schema = BuildMessageSchema("pose_stamped", msg_parsed);
+  auto program = CompileDecodeProgram(*schema);
+
+  // one sub-program for each message type
+  ASSERT_EQ(program->entries.size(), 5u);
+
+  const DecodeOp* root = &program->ops[program->root_entry];
+  EXPECT_EQ(root[0].code, DecodeOp::STRUCT);
+  EXPECT_EQ(root[0].child, 0);
+  EXPECT_EQ(root[1].code, DecodeOp::STRUCT);
+  EXPECT_EQ(root[1].child, 1);
+  EXPECT_EQ(root[2].code, DecodeOp::RETURN);
+
+  const DecodeOp* header = &program->ops[root[0].target];
+  EXPECT_EQ(header[0].code, DecodeOp::SCALAR);
+  EXPECT_EQ(header[0].type, UINT32);
+  EXPECT_EQ(header[1].code, DecodeOp::SCALAR);
+  EXPECT_EQ(header[1].type, TIME);
+  EXPECT_EQ(header[2].code, DecodeOp::STRING);
+  EXPECT_EQ(header[3].code, DecodeOp::RETURN);
+
+  // Quaternion and Point are shared by every path that uses them
+  const DecodeOp* pose = &program->ops[root[1].target];
+  EXPECT_EQ(program->ops[pose[0].target].type, FLOAT64);
+  EXPECT_EQ(program->ops[pose[1].target + 3].code, DecodeOp::SCALAR);
+
+  // the header contains a string, the pose is made only of float64
+  EXPECT_EQ(root[0].fixed, DecodeOp::NO_TARGET);
+  ASSERT_NE(root[1].fixed, DecodeOp::NO_TARGET);
+  const FixedStruct& fixed_pose = program->fixed_structs[root[1].fixed];
+  EXPECT_EQ(fixed_pose.blockSize(PrimitiveAlignment::PACKED), 56u);
+  EXPECT_EQ(fixed_pose.blockSize(PrimitiveAlignment::CDR), 56u);
+  EXPECT_EQ(fixed_pose.blockSize(PrimitiveAlignment::XCDR2), 56u);
+  EXPECT_EQ(fixed_pose.blockSize(PrimitiveAlignment::UNSPECIFIED), 0u);
+  EXPECT_EQ(fixed_pose.members[1].offset[static_cast<size_t>(PrimitiveAlignment::CDR)], 24u);
+
+  // arrays are lowered into BEGIN_SEQUENCE / element / END_SEQUENCE
+  auto array_msgs = ParseMessageDefinitions("int32[] data\nfloat64[3] fixed\n", ROSType("my_pkg/Arrays"));
+  auto array_program = CompileDecodeProgram(*BuildMessageSchema("arrays", array_msgs));
+  const DecodeOp* ops = &array_program->ops[array_program->root_entry];
+  EXPECT_EQ(ops[0].code, DecodeOp::BEGIN_SEQUENCE);
+  EXPECT_EQ(ops[0].array_size, -1);
+  EXPECT_EQ(ops[1].code, DecodeOp::SCALAR);
+  EXPECT_TRUE(ops[1].hasFlag(DecodeOp::IN_SEQUENCE));
+  EXPECT_EQ(ops[2].code, DecodeOp::END_SEQUENCE);
+  EXPECT_EQ(ops[3].code, DecodeOp::BEGIN_SEQUENCE);
+  EXPECT_EQ(ops[3].array_size, 3);
+  EXPECT_EQ(ops[3].child, 1);
+  EXPECT_EQ(ops[6].code, DecodeOp::RETURN);
+}
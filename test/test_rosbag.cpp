@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "rosx_introspection/ros_parser.hpp"
+#include "rosx_introspection/rosbag_reader.hpp"
+
+#ifdef ROSX_HAS_LZ4
+#include <lz4frame.h>
+#endif
+
+#ifdef ROSX_HAS_BZ2
+#include <bzlib.h>
+#endif
+
+using namespace RosMsgParser;
+
+namespace {
+
+const char* SIMPLE_DEFINITION =
+    "uint32 value\n"
+    "string name\n";
+
+// Records of a bag of version 2.0: header fields "name=value", each prefixed by its length.
+class BagBuilder {
+ public:
+  using Fields = std::vector<std::pair<std::string, std::string>>;
+
+  static std::string u32(uint32_t value) {
+    return std::string(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  static std::string u64(uint64_t value) {
+    return std::string(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  static std::string op(uint8_t value) {
+    return std::string(1, static_cast<char>(value));
+  }
+
+  static std::string fields(const Fields& fields) {
+    std::string out;
+    for (const auto& [name, value] : fields) {
+      out += u32(static_cast<uint32_t>(name.size() + 1 + value.size())) + name + "=" + value;
+    }
+    return out;
+  }
+
+  static std::string record(const Fields& header, const std::string& data) {
+    const std::string header_bytes = fields(header);
+    return u32(static_cast<uint32_t>(header_bytes.size())) + header_bytes + u32(static_cast<uint32_t>(data.size())) +
+           data;
+  }
+
+  static std::string connection(uint32_t id, const std::string& topic) {
+    return record({{"op", op(0x07)}, {"conn", u32(id)}, {"topic", topic}},
+                  fields({{"topic", topic},
+                          {"type", "test_msgs/Simple"},
+                          {"md5sum", "0123456789abcdef"},
+                          {"message_definition", SIMPLE_DEFINITION},
+                          {"latching", "1"}}));
+  }
+
+  static std::string message(uint32_t id, uint32_t sec, uint32_t nsec, uint32_t value, const std::string& name) {
+    const std::string data = u32(value) + u32(static_cast<uint32_t>(name.size())) + name;
+    return record({{"op", op(0x02)}, {"conn", u32(id)}, {"time", u64((uint64_t(nsec) << 32) | sec)}}, data);
+  }
+
+  static std::string chunk(const std::string& records, const std::string& compression = "none") {
+    return compressedChunk(records, compression, records);
+  }
+
+  // [data] is [records] compressed with [compression]
+  static std::string compressedChunk(const std::string& records, const std::string& compression,
+                                     const std::string& data) {
+    const std::string size = u32(static_cast<uint32_t>(records.size()));
+    return record({{"op", op(0x05)}, {"compression", compression}, {"size", size}}, data);
+  }
+};
+
+std::string writeBag(const std::string& name, const std::string& records) {
+  const auto path = (std::filesystem::temp_directory_path() / name).string();
+  std::ofstream file(path, std::ios::binary);
+  file << "#ROSBAG V2.0\n" << records;
+  return path;
+}
+
+// The chunks are compressed with [compress], if given.
+std::string simpleBag(const std::string& compression = "none",
+                      std::string (*compress)(const std::string&) = nullptr) {
+  using B = BagBuilder;
+  auto chunk = [&](const std::string& records) {
+    return compress ? B::compressedChunk(records, compression, compress(records)) : B::chunk(records);
+  };
+  std::string bag;
+  bag += B::record({{"op", B::op(0x03)}, {"conn_count", B::u32(2)}, {"chunk_count", B::u32(2)}}, std::string(64, ' '));
+  bag += chunk(B::connection(0, "/a") + B::message(0, 10, 1, 100, "first"));
+  bag += B::record({{"op", B::op(0x06)}, {"ver", B::u32(1)}}, B::u32(0) + B::u32(1));
+  bag += chunk(B::message(0, 11, 2, 200, "second") + B::connection(1, "/b") + B::message(1, 12, 3, 300, "third"));
+  bag += B::record({{"op", B::op(0x04)}, {"ver", B::u32(1)}, {"conn", B::u32(1)}}, B::u64(0));
+  // the connections are repeated at the end of the file
+  bag += B::connection(0, "/a") + B::connection(1, "/b");
+  return bag;
+}
+
+// "topic sec.nsec value name" for each message of the bag
+std::vector<std::string> readLines(RosbagReader& bag) {
+  std::unordered_map<uint32_t, Parser> parsers;
+  ROS_Deserializer deserializer;
+  FlatMessage flat;
+  std::vector<std::string> lines;
+
+  bag.readMessages([&](const RosbagMessage& msg) {
+    const auto& conn = *msg.connection;
+    auto it = parsers.find(conn.id);
+    if (it == parsers.end()) {
+      it = parsers.emplace(conn.id, Parser(conn.topic, ROSType(conn.datatype), conn.definition)).first;
+    }
+    it->second.deserialize(msg.data, &flat, &deserializer);
+    lines.push_back(conn.topic + " " + std::to_string(msg.stamp.sec) + "." + std::to_string(msg.stamp.nsec) + " " +
+                    std::to_string(flat.value[0].second.convert<uint32_t>()) + " " +
+                    flat.value[1].second.extract<std::string>());
+    return true;
+  });
+  return lines;
+}
+
+const std::vector<std::string> SIMPLE_BAG_LINES = {"/a 10.1 100 first", "/a 11.2 200 second", "/b 12.3 300 third"};
+
+#ifdef ROSX_HAS_LZ4
+std::string compressLz4(const std::string& records) {
+  std::string out(LZ4F_compressFrameBound(records.size(), nullptr), '\0');
+  const size_t size = LZ4F_compressFrame(out.data(), out.size(), records.data(), records.size(), nullptr);
+  if (LZ4F_isError(size)) {
+    throw std::runtime_error("LZ4F_compressFrame failed");
+  }
+  out.resize(size);
+  return out;
+}
+#endif
+
+#ifdef ROSX_HAS_BZ2
+std::string compressBz2(const std::string& records) {
+  // bzip2 may expand the input by 1%, plus 600 bytes
+  std::string out(records.size() + records.size() / 100 + 600, '\0');
+  auto size = static_cast<unsigned int>(out.size());
+  if (BZ2_bzBuffToBuffCompress(out.data(), &size, const_cast<char*>(records.data()),
+                               static_cast<unsigned int>(records.size()), 9, 0, 0) != BZ_OK) {
+    throw std::runtime_error("BZ2_bzBuffToBuffCompress failed");
+  }
+  out.resize(size);
+  return out;
+}
+#endif
+
+}  // namespace
+
+TEST(RosbagReader, ReadMessages) {
+  const auto path = writeBag("rosx_simple.bag", simpleBag());
+  RosbagReader bag(path);
+
+  EXPECT_EQ(readLines(bag), SIMPLE_BAG_LINES);
+
+  ASSERT_EQ(bag.connections().size(), 2u);
+  const auto& connection = bag.connections().at(1);
+  EXPECT_EQ(connection.topic, "/b");
+  EXPECT_EQ(connection.datatype, "test_msgs/Simple");
+  EXPECT_EQ(connection.md5sum, "0123456789abcdef");
+  EXPECT_EQ(connection.definition, SIMPLE_DEFINITION);
+  EXPECT_TRUE(connection.latching);
+
+  // the messages of a chunk are all valid at the same time
+  std::vector<size_t> chunk_sizes;
+  bag.readChunks([&](Span<const RosbagMessage> messages) {
+    chunk_sizes.push_back(messages.size());
+    EXPECT_EQ(messages.front().data.size(), 4u + 4u + (chunk_sizes.size() == 1 ? 5u : 6u));
+    return true;
+  });
+  EXPECT_EQ(chunk_sizes, (std::vector<size_t>{1, 2}));
+
+  // stop after the first message
+  size_t count = 0;
+  bag.readMessages([&](const RosbagMessage&) {
+    count++;
+    return false;
+  });
+  EXPECT_EQ(count, 1u);
+
+  std::filesystem::remove(path);
+}
+
+TEST(RosbagReader, InvalidFiles) {
+  EXPECT_THROW(RosbagReader("/this/file/does/not/exist.bag"), std::runtime_error);
+
+  const auto not_a_bag = (std::filesystem::temp_directory_path() / "rosx_not_a_bag.bag").string();
+  std::ofstream(not_a_bag) << "#ROSBAG V1.2\n";
+  EXPECT_THROW(RosbagReader{not_a_bag}, std::runtime_error);
+  std::filesystem::remove(not_a_bag);
+
+  EXPECT_TRUE(RosbagReader::supportsCompression("none"));
+  EXPECT_FALSE(RosbagReader::supportsCompression("zstd"));
+
+  using B = BagBuilder;
+  const auto path = writeBag("rosx_zstd.bag", B::chunk(B::connection(0, "/a"), "zstd"));
+  RosbagReader bag(path);
+  EXPECT_THROW(bag.readMessages([](const RosbagMessage&) { return true; }), std::runtime_error);
+
+  // a record truncated in the middle
+  const auto truncated = simpleBag();
+  const auto truncated_path = writeBag("rosx_truncated.bag", truncated.substr(0, truncated.size() / 2));
+  RosbagReader truncated_bag(truncated_path);
+  EXPECT_THROW(truncated_bag.readMessages([](const RosbagMessage&) { return true; }), std::runtime_error);
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(truncated_path);
+}
+
+TEST(RosbagReader, Lz4Chunks) {
+#ifdef ROSX_HAS_LZ4
+  if (!RosbagReader::supportsCompression("lz4")) {
+    GTEST_SKIP() << "RosbagReader was built without lz4";
+  }
+  const auto path = writeBag("rosx_lz4.bag", simpleBag("lz4", compressLz4));
+  RosbagReader bag(path);
+  EXPECT_EQ(readLines(bag), SIMPLE_BAG_LINES);
+  std::filesystem::remove(path);
+#else
+  GTEST_SKIP() << "lz4 not found at build time";
+#endif
+}
+
+TEST(RosbagReader, Bz2Chunks) {
+#ifdef ROSX_HAS_BZ2
+  if (!RosbagReader::supportsCompression("bz2")) {
+    GTEST_SKIP() << "RosbagReader was built without bz2";
+  }
+  const auto path = writeBag("rosx_bz2.bag", simpleBag("bz2", compressBz2));
+  RosbagReader bag(path);
+  EXPECT_EQ(readLines(bag), SIMPLE_BAG_LINES);
+
+  // a chunk whose data is not bz2
+  using B = BagBuilder;
+  const auto corrupted_path = writeBag("rosx_bad_bz2.bag", B::chunk(B::connection(0, "/a"), "bz2"));
+  RosbagReader corrupted(corrupted_path);
+  EXPECT_THROW(corrupted.readMessages([](const RosbagMessage&) { return true; }), std::runtime_error);
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(corrupted_path);
+#else
+  GTEST_SKIP() << "bz2 not found at build time";
+#endif
+}
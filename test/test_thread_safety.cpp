@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "rosx_introspection/lazy_message_view.hpp"
+#include "rosx_introspection/ros_parser.hpp"
+
+// Several threads decode with the same Parser. Build with -DROSX_SANITIZE_THREAD=ON
+// to let ThreadSanitizer check that they don't race.
+
+using namespace RosMsgParser;
+
+namespace {
+
+constexpr int NUM_THREADS = 8;
+constexpr int NUM_ITERATIONS = 200;
+
+std::vector<std::string> ToStrings(const FlatMessage& flat) {
+  std::vector<std::string> out;
+  for (const auto& [leaf, value] : flat.value) {
+    std::string text = leaf.toStdString() + "=";
+    if (value.getTypeID() == STRING) {
+      text += value.extract<std::string>();
+    } else if (value.getTypeID() != TIME && value.getTypeID() != DURATION) {
+      text += std::to_string(value.convert<double>());
+    }
+    out.push_back(std::move(text));
+  }
+  return out;
+}
+
+// Decode each message in NUM_THREADS threads at the same time, and compare the
+// results with the ones of a Parser used by a single thread.
+void DecodeConcurrently(Parser& shared, const Parser& reference, const std::vector<std::vector<uint8_t>>& messages) {
+  std::vector<std::vector<std::string>> expected;
+  NanoCDR_Deserializer deserializer;
+  for (const auto& message : messages) {
+    FlatMessage flat;
+    reference.deserialize(Span<const uint8_t>(message), &flat, &deserializer);
+    expected.push_back(ToStrings(flat));
+  }
+
+  std::atomic<int> mismatches = 0;
+  std::atomic<bool> start = false;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < NUM_THREADS; t++) {
+    threads.emplace_back([&, t]() {
+      NanoCDR_Deserializer thread_deserializer;
+      FlatMessage flat;
+      while (!start) {
+        std::this_thread::yield();
+      }
+      for (int i = 0; i < NUM_ITERATIONS; i++) {
+        const size_t index = static_cast<size_t>(t + i) % messages.size();
+        shared.deserialize(Span<const uint8_t>(messages[index]), &flat, &thread_deserializer);
+        if (ToStrings(flat) != expected[index]) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  start = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(mismatches, 0);
+}
+
+}  // namespace
+
+TEST(ThreadSafety, SharedParserWithShapeMemoization) {
+  const char* def =
+      "std_msgs/Header header\n"
+      "string[] name\n"
+      "float64[] position\n"
+      "geometry_msgs/Point[] points\n"
+      "================================================================================\n"
+      "MSG: std_msgs/Header\n"
+      "uint32 seq\n"
+      "time stamp\n"
+      "string frame_id\n"
+      "================================================================================\n"
+      "MSG: geometry_msgs/Point\n"
+      "float64 x\n"
+      "float64 y\n"
+      "float64 z\n";
+  Parser shared("joints", ROSType("sensor_msgs/JointState"), def);
+  Parser reference("joints", ROSType("sensor_msgs/JointState"), def);
+  shared.setShapeMemoization(2);
+
+  // a few shapes, more than the capacity of the cache
+  std::vector<std::vector<uint8_t>> messages;
+  for (int i = 0; i < 12; i++) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(uint32_t(i));
+    encoder.encode(uint32_t(100 + i));
+    encoder.encode(uint32_t(0));
+    encoder.encode(std::string(i % 2 ? "base_link" : "map"));
+    const uint32_t joints = 2 + i % 3;
+    encoder.encode(joints);
+    for (uint32_t j = 0; j < joints; j++) {
+      encoder.encode(std::string("joint_") + std::to_string(j));
+    }
+    encoder.encode(joints);
+    for (uint32_t j = 0; j < joints; j++) {
+      encoder.encode(double(i + j));
+    }
+    encoder.encode(uint32_t(i % 4));
+    for (int j = 0; j < 3 * (i % 4); j++) {
+      encoder.encode(double(-j));
+    }
+    const auto encoded = encoder.encodedBuffer();
+    messages.emplace_back(encoded.data(), encoded.data() + encoded.size());
+  }
+
+  DecodeConcurrently(shared, reference, messages);
+  EXPECT_EQ(shared.shapeCacheHits() + shared.shapeCacheMisses(), size_t(NUM_THREADS * NUM_ITERATIONS));
+}
+
+TEST(ThreadSafety, SharedParserWithKeysAndUnions) {
+  const char* idl = R"(
+    module my_pkg {
+      enum Mode { IDLE, RUNNING };
+      union Command switch (int32) { case 0: float64 speed; case 1: string text; };
+      struct Joint { @key string name; float64 position; Mode mode; };
+      struct Robot { sequence<Joint> joints; Command command; };
+    };
+  )";
+  Parser shared("robot", ROSType("my_pkg/Robot"), idl, DDS_IDL);
+  Parser reference("robot", ROSType("my_pkg/Robot"), idl, DDS_IDL);
+
+  std::vector<std::vector<uint8_t>> messages;
+  for (int i = 0; i < 6; i++) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(uint32_t(i % 3 + 1));
+    for (int j = 0; j < i % 3 + 1; j++) {
+      encoder.encode(std::string("J") + std::to_string(j));
+      encoder.encode(double(i * 10 + j));
+      encoder.encode(int32_t(j % 2));
+    }
+    encoder.encode(int32_t(i % 2));
+    if (i % 2) {
+      encoder.encode(std::string("stop"));
+    } else {
+      encoder.encode(double(i));
+    }
+    const auto encoded = encoder.encodedBuffer();
+    messages.emplace_back(encoded.data(), encoded.data() + encoded.size());
+  }
+
+  DecodeConcurrently(shared, reference, messages);
+
+  // lazy views on the same Parser
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches = 0;
+  for (int t = 0; t < NUM_THREADS; t++) {
+    threads.emplace_back([&]() {
+      NanoCDR_Deserializer deserializer;
+      LazyMessageView view(shared, &deserializer);
+      for (int i = 0; i < NUM_ITERATIONS; i++) {
+        view.reset(Span<const uint8_t>(messages[2]));
+        if (view.get<double>("joints[J2]/position") != 22.0) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(mismatches, 0);
+}
+
+TEST(ThreadSafety, ConcurrentParsersCollection) {
+  constexpr uint32_t NUM_TOPICS = 100;
+  std::vector<std::vector<uint8_t>> messages;
+  for (uint32_t i = 0; i < NUM_TOPICS; i++) {
+    nanocdr::Encoder encoder(nanocdr::CdrHeader{});
+    encoder.encode(i);
+    encoder.encode(std::string("topic_") + std::to_string(i));
+    const auto encoded = encoder.encodedBuffer();
+    messages.emplace_back(encoded.data(), encoded.data() + encoded.size());
+  }
+
+  using Collection = ConcurrentParsersCollection<NanoCDR_Deserializer>;
+  Collection collection;
+  EXPECT_EQ(collection.deserialize(0, Span<const uint8_t>(messages[0])), nullptr);
+
+  // topics are registered while the other threads decode the ones already available
+  std::atomic<bool> done = false;
+  std::atomic<int> mismatches = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < NUM_THREADS / 2; t++) {
+    threads.emplace_back([&]() {
+      std::vector<const FlatMessage*> previous(NUM_TOPICS, nullptr);
+      while (!done || previous.back() == nullptr) {
+        const auto available = static_cast<Collection::TopicHandle>(collection.size());
+        for (Collection::TopicHandle handle = 0; handle < available; handle++) {
+          const FlatMessage* msg = collection.deserialize(handle, Span<const uint8_t>(messages[handle]));
+          // each thread has its own output for each topic
+          const bool same_output = !previous[handle] || previous[handle] == msg;
+          previous[handle] = msg;
+          if (!msg || !same_output || msg->value.size() != 2 || msg->value[0].second.convert<uint32_t>() != handle ||
+              msg->value[1].second.extract<std::string>() != "topic_" + std::to_string(handle)) {
+            mismatches++;
+          }
+        }
+      }
+    });
+  }
+  for (uint32_t i = 0; i < NUM_TOPICS; i++) {
+    const std::string topic = "topic_" + std::to_string(i);
+    EXPECT_EQ(collection.registerParser(topic, ROSType("my_pkg/Test"), "uint32 id\nstring name\n"), i);
+  }
+  done = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(mismatches, 0);
+
+  EXPECT_EQ(collection.size(), NUM_TOPICS);
+  EXPECT_EQ(collection.registerParser("topic_7", ROSType("my_pkg/Other"), "uint8 x\n"), 7u);
+  EXPECT_EQ(collection.findTopic("topic_42"), 42u);
+  EXPECT_EQ(collection.findTopic("unknown"), Collection::INVALID_HANDLE);
+  EXPECT_EQ(collection.getParser(NUM_TOPICS), nullptr);
+  EXPECT_EQ(collection.deserialize(Collection::INVALID_HANDLE, Span<const uint8_t>(messages[0])), nullptr);
+
+  // a Parser configured before its registration
+  Parser parser("filtered", ROSType("my_pkg/Test"), "uint32 id\nstring name\n");
+  parser.setFieldFilter({"name"});
+  const auto handle = collection.registerParser("filtered", std::move(parser));
+  EXPECT_EQ(handle, NUM_TOPICS);
+  const FlatMessage* msg = collection.deserialize(handle, Span<const uint8_t>(messages[3]));
+  ASSERT_EQ(msg->value.size(), 1u);
+  EXPECT_EQ(msg->value[0].second.extract<std::string>(), "topic_3");
+}